@@ -16,6 +16,9 @@
 #include <google/protobuf/empty.pb.h>
 
 #include <mutex>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
 #include <condition_variable>
 #include <iostream>
 #include <memory>
@@ -27,6 +30,8 @@
 #include "ClassesSource/BICDeviceGRPCService.h"
 #include "ClassesSource/BICBridgeGRPCService.h"
 #include "ClassesSource/BICInfoGRPCService.h"
+#include "ClassesSource/SharedExecutor.h"
+#include "ClassesSource/ThreadRoleRegistry.h"
 
 
 // BIC Usings
@@ -132,8 +137,69 @@ void RunServer() {
     theImplantFactory->~IImplantFactory();
 }
 
-// Main Stub, just runs the server
+// Parses a positive decimal command line value, rejecting signs, trailing characters, 0 and values beyond maxValue
+bool parsePositiveOption(const char* optionName, const char* text, unsigned long maxValue, unsigned long* value)
+{
+  char* parseEnd = nullptr;
+  errno = 0;
+  *value = std::isdigit((unsigned char)text[0]) ? std::strtoul(text, &parseEnd, 10) : 0;
+  if (parseEnd == nullptr || *parseEnd != '\0' || errno == ERANGE || *value == 0 || *value > maxValue)
+  {
+    std::cout << "ERROR: " << optionName << " needs a whole number from 1 to " << maxValue << ", got \"" << text << "\"" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+// Main Stub, applies command line options and runs the server
+// Usage: BICgRPCmicroserver [--thread-config <file>] [--telemetry-max-age-ms <milliseconds>] [--executor-threads <count>] [--plugin-dir <directory>]
+// Controller plugins can only be loaded when --plugin-dir is given, and only from that directory
 int main(int argc, char** argv) {
+  // Thread roles must be configured before any server thread starts
+  for (int i = 1; i < argc; i++)
+  {
+    if (std::string(argv[i]) == "--thread-config" && i + 1 < argc)
+    {
+      ThreadRoleRegistry::instance().loadConfig(argv[++i]);
+    }
+    else if (std::string(argv[i]) == "--telemetry-max-age-ms" && i + 1 < argc)
+    {
+      unsigned long maxAgeMs;
+      if (!parsePositiveOption(argv[i], argv[i + 1], 3600000, &maxAgeMs))
+      {
+        return 1;
+      }
+      i++;
+      deviceService.telemetryMaxAge = std::chrono::milliseconds(maxAgeMs);
+      std::cout << "TELEMETRY INFO: Temperature and humidity reads answered from values up to " << deviceService.telemetryMaxAge.count() << " ms old" << std::endl;
+    }
+    else if (std::string(argv[i]) == "--executor-threads" && i + 1 < argc)
+    {
+      unsigned long executorThreads;
+      if (!parsePositiveOption(argv[i], argv[i + 1], 1024, &executorThreads))
+      {
+        return 1;
+      }
+      i++;
+      if (executorThreads < MIN_EXECUTOR_WORKERS)
+      {
+        std::cout << "ERROR: --executor-threads needs at least " << MIN_EXECUTOR_WORKERS << " workers so blocking stream writes cannot take the whole pool" << std::endl;
+        return 1;
+      }
+      SharedExecutor::instance().configure((uint32_t)executorThreads);
+    }
+    else if (std::string(argv[i]) == "--plugin-dir" && i + 1 < argc)
+    {
+      deviceService.controllerPluginDirectory = argv[++i];
+      std::cout << "PLUGIN INFO: Controller plugins loaded from " << deviceService.controllerPluginDirectory << std::endl;
+    }
+    else
+    {
+      std::cout << "WARNING: Unknown command line option " << argv[i] << std::endl;
+    }
+  }
+  ThreadRoleRegistry::instance().reportStartup();
+
   RunServer();
 
   return 0;
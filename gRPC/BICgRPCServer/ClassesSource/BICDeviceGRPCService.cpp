@@ -40,6 +40,9 @@ using BICgRPC::bicGetHumidityReply;
 
 namespace BICGRPCHelperNamespace
 {
+    // Time before a sequence trial deadline at which waiting switches from sleeping to spinning
+    static const std::chrono::microseconds SEQUENCE_SPIN_MARGIN(1500);
+
     // ************************* Non-GRPC Helper Service Function Declarations *************************
     void BICDeviceGRPCService::passFactory(cortec::implantapi::IImplantFactory* serverFactory)
     {
@@ -57,11 +60,27 @@ namespace BICGRPCHelperNamespace
             it->second->connectionStreamNotify.notify_all();
             it->second->errorStreamNotify.notify_all();
             it->second->powerStreamNotify.notify_all();
+            {
+                std::lock_guard<std::mutex> StreamLockInst(it->second->shadowStreamLock);
+                it->second->isShadowStreamStopRequested = true;
+                it->second->shadowStreamNotify.notify_all();
+            }
+            it->second->stimStateStreamStopGeneration++;
+            it->second->isSequenceStopRequested = true;
+            it->second->sequenceNotify.notify_all();
+            it->second->listener->stimStateNotifier.wakeAll();
+            it->second->listener->stopTelemetryStream();
+
+            // The shared open-loop scheduler must not call into the listener once it is gone
+            it->second->listener->enableOpenLoopStim(false, 0, 0);
 
             // Dispose the things!
             it->second->theImplant->setImplantPower(false);
             it->second->theImplant->~IImplant();
         }
+
+        // Report how the shared executor kept up over the session
+        SharedExecutor::instance().reportStats();
     }
 
     // ************************* Construction, Initialization, and Destruction Function Declarations *************************
@@ -203,6 +222,19 @@ namespace BICGRPCHelperNamespace
         deviceDirectory[request->deviceaddress()]->connectionStreamNotify.notify_all();
         deviceDirectory[request->deviceaddress()]->errorStreamNotify.notify_all();
         deviceDirectory[request->deviceaddress()]->powerStreamNotify.notify_all();
+        {
+            std::lock_guard<std::mutex> StreamLockInst(deviceDirectory[request->deviceaddress()]->shadowStreamLock);
+            deviceDirectory[request->deviceaddress()]->isShadowStreamStopRequested = true;
+            deviceDirectory[request->deviceaddress()]->shadowStreamNotify.notify_all();
+        }
+        deviceDirectory[request->deviceaddress()]->stimStateStreamStopGeneration++;
+        deviceDirectory[request->deviceaddress()]->isSequenceStopRequested = true;
+        deviceDirectory[request->deviceaddress()]->sequenceNotify.notify_all();
+        deviceDirectory[request->deviceaddress()]->listener->stimStateNotifier.wakeAll();
+        deviceDirectory[request->deviceaddress()]->listener->stopTelemetryStream();
+
+        // The shared open-loop scheduler must not call into the listener once it is gone
+        deviceDirectory[request->deviceaddress()]->listener->enableOpenLoopStim(false, 0, 0);
 
         // Dispose the things!
         deviceDirectory[request->deviceaddress()]->theImplant->setImplantPower(false);
@@ -278,11 +310,24 @@ namespace BICGRPCHelperNamespace
             return grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, "Not Initialized");
         }
 
+        // Answer from a recent measurement if the client allows it
+        BICDeviceInfoStruct* theDevice = deviceDirectory[request->deviceaddress()];
+        ImpedanceMeasurement cachedMeasurement;
+        if (theDevice->impedanceCache.lookup(request->channel(), std::chrono::milliseconds(request->maxcacheagems()), &cachedMeasurement))
+        {
+            reply->set_channelimpedance(cachedMeasurement.impedance);
+            reply->set_units("ohms");
+            reply->set_success("success");
+            return grpc::Status::OK;
+        }
+
         // Perform the operation
         double impedanceValue;
         try
         {
-            impedanceValue = deviceDirectory[request->deviceaddress()]->theImplant->getImpedance(request->channel());
+            std::chrono::steady_clock::time_point measurementStart = std::chrono::steady_clock::now();
+            impedanceValue = theDevice->theImplant->getImpedance(request->channel());
+            theDevice->impedanceCache.store(request->channel(), impedanceValue, measurementStart);
         }
         catch (const std::exception& theError)
         {
@@ -302,6 +347,84 @@ namespace BICGRPCHelperNamespace
         return grpc::Status::OK;
     }
 
+    grpc::Status BICDeviceGRPCService::bicImpedanceSweep(grpc::ServerContext* context, const BICgRPC::bicImpedanceSweepRequest* request, grpc::ServerWriter<BICgRPC::ImpedanceSweepUpdate>* writer)  {
+        // Check if already initialized
+        if (deviceDirectory.find(request->deviceaddress()) == deviceDirectory.end())
+        {
+            return grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, "Not Initialized");
+        }
+        BICDeviceInfoStruct* theDevice = deviceDirectory[request->deviceaddress()];
+
+        // Sweep the requested channels, or all of them
+        std::vector<uint32_t> channels(request->channels().begin(), request->channels().end());
+        if (channels.empty())
+        {
+            for (uint32_t channel = 0; channel < (uint32_t)theDevice->theImplantInfo->getChannelCount(); channel++)
+            {
+                channels.push_back(channel);
+            }
+        }
+
+        // Measure back to back, streaming each result before starting the next measurement
+        std::chrono::milliseconds maxCacheAge(request->maxcacheagems());
+        uint32_t measuredChannels = 0;
+        uint32_t cachedChannels = 0;
+        uint32_t failedChannels = 0;
+        BICgRPC::ImpedanceSweepUpdate anUpdate;
+        for (uint32_t channel : channels)
+        {
+            if (context->IsCancelled())
+            {
+                break;
+            }
+            anUpdate.Clear();
+            anUpdate.set_channel(channel);
+
+            ImpedanceMeasurement measurement;
+            if (theDevice->impedanceCache.lookup(channel, maxCacheAge, &measurement))
+            {
+                anUpdate.set_iscached(true);
+                cachedChannels++;
+            }
+            else
+            {
+                try
+                {
+                    std::chrono::steady_clock::time_point measurementStart = std::chrono::steady_clock::now();
+                    double impedanceValue = theDevice->theImplant->getImpedance(channel);
+                    measurement = theDevice->impedanceCache.store(channel, impedanceValue, measurementStart);
+                    measuredChannels++;
+                }
+                catch (const std::exception& theError)
+                {
+                    std::string returnMessage = "error: exception - ";
+                    returnMessage += theError.what();
+                    anUpdate.set_success(returnMessage);
+                    failedChannels++;
+                    if (!writer->Write(anUpdate))
+                    {
+                        break;
+                    }
+                    continue;
+                }
+            }
+
+            anUpdate.set_channelimpedance(measurement.impedance);
+            anUpdate.set_units("ohms");
+            anUpdate.set_success("success");
+            anUpdate.set_timestamp(measurement.timeStamp);
+            anUpdate.set_measurementns(measurement.measurementNs);
+            if (!writer->Write(anUpdate))
+            {
+                break;
+            }
+        }
+
+        // One summary line per sweep instead of one per channel
+        std::cout << "IMPEDANCE INFO: Sweep of " << channels.size() << " channels, " << measuredChannels << " measured, " << cachedChannels << " from cache, " << failedChannels << " failed" << std::endl;
+        return grpc::Status::OK;
+    }
+
     grpc::Status BICDeviceGRPCService::bicGetTemperature(grpc::ServerContext* context, const BICgRPC::RequestDeviceAddress* request, BICgRPC::bicGetTemperatureReply* reply)  {
         // Check if already initialized
         if (deviceDirectory.find(request->deviceaddress()) == deviceDirectory.end())
@@ -311,11 +434,12 @@ namespace BICGRPCHelperNamespace
             return grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, "Not Initialized");
         }
 
-        // Perform the operation
-        double temperatureValue;
+        // Perform the operation, concurrent reads share one device call
+        BICDeviceInfoStruct* theDevice = deviceDirectory[request->deviceaddress()];
+        TelemetryReading temperatureReading;
         try
         {
-            temperatureValue = deviceDirectory[request->deviceaddress()]->theImplant->getTemperature();
+            temperatureReading = theDevice->listener->telemetryCache.read(TELEMETRY_TEMPERATURE, telemetryMaxAge, [theDevice]() { return theDevice->theImplant->getTemperature(); });
         }
         catch (const std::exception& theError)
         {
@@ -326,8 +450,10 @@ namespace BICGRPCHelperNamespace
         }
 
         // Respond to client
-        reply->set_temperature(temperatureValue);
+        reply->set_temperature(temperatureReading.value);
         reply->set_units("celsius");
+        reply->set_timestamp(temperatureReading.timeStamp);
+        reply->set_iscached(temperatureReading.isCached);
         reply->set_success("success");
         return grpc::Status::OK;
     }
@@ -341,11 +467,12 @@ namespace BICGRPCHelperNamespace
             return grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, "Not Initialized");
         }
 
-        // Perform the operation
-        double humidityValue;
+        // Perform the operation, concurrent reads share one device call
+        BICDeviceInfoStruct* theDevice = deviceDirectory[request->deviceaddress()];
+        TelemetryReading humidityReading;
         try
         {
-            humidityValue = deviceDirectory[request->deviceaddress()]->theImplant->getHumidity();
+            humidityReading = theDevice->listener->telemetryCache.read(TELEMETRY_HUMIDITY, telemetryMaxAge, [theDevice]() { return theDevice->theImplant->getHumidity(); });
         }
         catch (const std::exception& theError)
         {
@@ -356,8 +483,10 @@ namespace BICGRPCHelperNamespace
         }
 
         // Respond to client
-        reply->set_humidity(humidityValue);
+        reply->set_humidity(humidityReading.value);
         reply->set_units("celsius");
+        reply->set_timestamp(humidityReading.timeStamp);
+        reply->set_iscached(humidityReading.isCached);
         reply->set_success("success");
         return grpc::Status::OK;
     }
@@ -373,6 +502,10 @@ namespace BICGRPCHelperNamespace
         try
         {
             deviceDirectory[request->deviceaddress()]->theImplant->setImplantPower(request->powerenabled());
+
+            // A power cycle may lose persistent commands, so the next enqueue always transfers its command
+            deviceDirectory[request->deviceaddress()]->lastEnqueuedCommandKey = 0;
+            deviceDirectory[request->deviceaddress()]->lastEnqueuedDefinition.clear();
         }
         catch (const std::exception&)
         {
@@ -415,6 +548,103 @@ namespace BICGRPCHelperNamespace
 
         return grpc::Status::OK;
     }
+
+    /// <summary>
+    /// Copies a cached telemetry value into a snapshot
+    /// </summary>
+    /// <param name="theReading">Cached value</param>
+    /// <param name="units">Units of the value</param>
+    /// <param name="aValue">Snapshot value to fill</param>
+    static void fillSnapshotValue(const TelemetryReading& theReading, const char* units, BICgRPC::bicGetDeviceSnapshotReply::SnapshotValue* aValue)
+    {
+        aValue->set_isvalid(theReading.isValid);
+        aValue->set_value(theReading.value);
+        aValue->set_units(units);
+        aValue->set_timestamp(theReading.timeStamp);
+    }
+
+    /// <summary>
+    /// Adds a connection state to a snapshot
+    /// </summary>
+    /// <param name="connectionType">Connection name, as used in ConnectionUpdate</param>
+    /// <param name="theConnection">Latest reported state</param>
+    /// <param name="reply">Snapshot to add to</param>
+    static void addSnapshotConnection(const char* connectionType, const ConnectionStatus& theConnection, BICgRPC::bicGetDeviceSnapshotReply* reply)
+    {
+        BICgRPC::bicGetDeviceSnapshotReply::SnapshotConnection* aConnection = reply->add_connections();
+        aConnection->set_connectiontype(connectionType);
+        aConnection->set_isknown(theConnection.isKnown);
+        aConnection->set_isconnected(theConnection.isConnected);
+        aConnection->set_timestamp(theConnection.timeStamp);
+    }
+
+    grpc::Status BICDeviceGRPCService::bicGetDeviceSnapshot(grpc::ServerContext* context, const BICgRPC::RequestDeviceAddress* request, BICgRPC::bicGetDeviceSnapshotReply* reply) {
+        // Check if already initialized
+        if (deviceDirectory.find(request->deviceaddress()) == deviceDirectory.end())
+        {
+            // Not found!
+            reply->set_success("error: not initialized");
+            return grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, "Not Initialized");
+        }
+
+        // Gather the state already held by the server, the device is not called
+        static const char* STREAM_NAMES[STATUS_STREAM_COUNT] = { "Neural", "Temperature", "Humidity", "Connection", "Error", "Power", "StimTimeLog" };
+        BICDeviceInfoStruct* theDevice = deviceDirectory[request->deviceaddress()];
+        ListenerStatus theStatus = theDevice->listener->getStatus();
+        InterpolationStatistics gapStats = theDevice->listener->getInterpolationStatistics();
+        TelemetryReadCache& theTelemetry = theDevice->listener->telemetryCache;
+
+        // Stimulation and triggering state
+        reply->set_timestamp(std::chrono::system_clock::now().time_since_epoch().count());
+        reply->set_isstimulating(theStatus.isStimulating);
+        reply->set_istriggeringstim(theStatus.isOpenLoopEnabled || theStatus.isClosedLoopEnabled);
+        reply->set_isopenloopenabled(theStatus.isOpenLoopEnabled);
+        reply->set_isclosedloopenabled(theStatus.isClosedLoopEnabled);
+        reply->set_issequencerunning(theDevice->isSequenceRunning);
+        reply->set_ismeasuring(theStatus.isMeasuring);
+
+        // Latest values pushed by the device, in the units of the corresponding streams
+        fillSnapshotValue(theTelemetry.latest(TELEMETRY_TEMPERATURE), "celsius", reply->mutable_temperature());
+        fillSnapshotValue(theTelemetry.latest(TELEMETRY_HUMIDITY), "rh", reply->mutable_humidity());
+        fillSnapshotValue(theTelemetry.latest(TELEMETRY_IMPLANT_VOLTAGE), "microvolts", reply->mutable_implantvoltage());
+        fillSnapshotValue(theTelemetry.latest(TELEMETRY_COIL_CURRENT), "milliamperes", reply->mutable_coilcurrent());
+        fillSnapshotValue(theTelemetry.latest(TELEMETRY_CONTROL_VALUE), "%", reply->mutable_controlvalue());
+
+        // Connection and RF link
+        addSnapshotConnection("USB", theStatus.usbConnection, reply);
+        addSnapshotConnection("Inductive", theStatus.inductiveConnection, reply);
+        addSnapshotConnection("Overall", theStatus.overallConnection, reply);
+        BICgRPC::bicGetDeviceSnapshotReply::SnapshotRfQuality* rfQuality = reply->mutable_rfquality();
+        rfQuality->set_isknown(theStatus.rfQuality.isKnown);
+        rfQuality->set_antennaqualitydbm(theStatus.rfQuality.antennaQualitydBm);
+        rfQuality->set_validframesreceived(theStatus.rfQuality.validFramesReceived);
+        rfQuality->set_invalidhandshake(theStatus.rfQuality.invalidHandshake);
+        rfQuality->set_radiocrcerrors(theStatus.rfQuality.radioCrcErrors);
+        rfQuality->set_otherrxerrors(theStatus.rfQuality.otherRxErrors);
+        rfQuality->set_rxqueueoverflows(theStatus.rfQuality.rxQueueOverflows);
+        rfQuality->set_txqueueoverflows(theStatus.rfQuality.txQueueOverflows);
+        rfQuality->set_rfchannel(theStatus.rfQuality.rfChannel);
+        rfQuality->set_timestamp(theStatus.rfQuality.timeStamp);
+
+        // Streams, their queues and drop counters
+        for (int streamIndex = 0; streamIndex < STATUS_STREAM_COUNT; streamIndex++)
+        {
+            BICgRPC::bicGetDeviceSnapshotReply::SnapshotStream* aStream = reply->add_streams();
+            aStream->set_name(STREAM_NAMES[streamIndex]);
+            aStream->set_isenabled(theStatus.streams[streamIndex].isEnabled);
+            aStream->set_queued(theStatus.streams[streamIndex].queued);
+            aStream->set_dropped(theStatus.streams[streamIndex].dropped);
+        }
+        BICgRPC::bicGetDeviceSnapshotReply::SnapshotStream* shadowStream = reply->add_streams();
+        shadowStream->set_name("ShadowEvaluation");
+        shadowStream->set_isenabled(theStatus.isShadowStreaming);
+        reply->set_neuralgapsdropped(gapStats.gapsDropped);
+        reply->set_neuraldroppedsamples(gapStats.droppedSamples);
+
+        // Respond to client
+        reply->set_success("success");
+        return grpc::Status::OK;
+    }
     
 
     // ************************* Streaming Control Function Declarations *************************
@@ -534,6 +764,51 @@ namespace BICGRPCHelperNamespace
         return grpc::Status::OK;
     }
 
+    grpc::Status BICDeviceGRPCService::bicTelemetryStream(grpc::ServerContext* context, const BICgRPC::bicTelemetryStreamRequest* request, grpc::ServerWriter<BICgRPC::TelemetryUpdate>* writer)  {
+        // Check if already initialized
+        if (deviceDirectory.find(request->deviceaddress()) == deviceDirectory.end())
+        {
+            return grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, "Not Initialized");
+        }
+        BICDeviceInfoStruct* theDevice = deviceDirectory[request->deviceaddress()];
+
+        if (!request->enable())
+        {
+            // disable streaming
+            theDevice->listener->stopTelemetryStream();
+            return grpc::Status::OK;
+        }
+
+        // Only one telemetry stream per device, like the per-type streams
+        TelemetryMultiplexer theMultiplexer(request->subscriptions());
+        if (!theDevice->listener->attachTelemetryMultiplexer(&theMultiplexer))
+        {
+            // Already streaming, do nothing
+            return grpc::Status::OK;
+        }
+
+        // This thread is the stream's only writer. Wake up periodically to notice a client that went away.
+        while (!theMultiplexer.isStopped() && !context->IsCancelled())
+        {
+            BICgRPC::TelemetryUpdate* anUpdate = theMultiplexer.next(std::chrono::milliseconds(500));
+            if (anUpdate != NULL)
+            {
+                bool isWritten = writer->Write(*anUpdate);
+                delete anUpdate;
+                if (!isWritten)
+                {
+                    break;
+                }
+            }
+        }
+        theDevice->listener->detachTelemetryMultiplexer(&theMultiplexer);
+
+        TelemetryMultiplexerStats streamStats = theMultiplexer.getStats();
+        std::cout << "TELEMETRY INFO: Telemetry stream closed, " << streamStats.sent << " of " << streamStats.published << " updates sent, "
+            << streamStats.conflated << " conflated by rate limits, " << streamStats.dropped << " dropped." << std::endl;
+        return grpc::Status::OK;
+    }
+
     grpc::Status BICDeviceGRPCService::bicPowerStream(grpc::ServerContext* context, const BICgRPC::bicSetStreamEnable* request, grpc::ServerWriter<BICgRPC::PowerUpdate>* writer)  {
         // Check requested stream state and current streaming state (don't want to destroy a previously requested stream without it being stopped first)
         if (!deviceDirectory[request->deviceaddress()]->listener->powerStreamingState && request->enable())
@@ -563,7 +838,164 @@ namespace BICGRPCHelperNamespace
         return grpc::Status::OK;
     }
 
+    grpc::Status BICDeviceGRPCService::bicShadowEvaluationStream(grpc::ServerContext* context, const BICgRPC::bicShadowEvaluationRequest* request, grpc::ServerWriter<BICgRPC::ShadowEvaluationUpdate>* writer)  {
+        // Check if already initialized
+        if (deviceDirectory.find(request->deviceaddress()) == deviceDirectory.end())
+        {
+            return grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, "Not Initialized");
+        }
+        BICDeviceInfoStruct* theDevice = deviceDirectory[request->deviceaddress()];
+
+        if (!request->enable())
+        {
+            // disable streaming
+            std::lock_guard<std::mutex> StreamLockInst(theDevice->shadowStreamLock);
+            theDevice->isShadowStreamStopRequested = true;
+            theDevice->shadowStreamNotify.notify_one();
+            return grpc::Status::OK;
+        }
+
+        // Check if parameters are valid
+        if (request->candidates_size() == 0 || request->candidates_size() > 32)
+        {
+            return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "Between 1 and 32 candidates required");
+        }
+        double samplingRate = (double)theDevice->theImplantInfo->getSamplingRate();
+        std::vector<ClosedLoopControllerConfig> candidateConfigs;
+        for (const BICgRPC::distributedStimEnableRequest& aCandidate : request->candidates())
+        {
+            grpc::Status validationStatus = validateDistributedStimRequest(&aCandidate);
+            if (!validationStatus.ok())
+            {
+                return validationStatus;
+            }
+            candidateConfigs.push_back(buildControllerConfig(&aCandidate, samplingRate));
+        }
+
+        // Start evaluating
+        ShadowEvaluator* theEvaluator = new ShadowEvaluator(candidateConfigs, request->workerthreads(), samplingRate);
+        std::chrono::milliseconds reportInterval(request->reportintervalms() > 0 ? request->reportintervalms() : 1000);
+        {
+            // Attaching and clearing the stop request happen together, so neither a second stream nor a stop request can slip in between
+            std::lock_guard<std::mutex> StreamLockInst(theDevice->shadowStreamLock);
+            if (!theDevice->listener->attachShadowEvaluator(theEvaluator))
+            {
+                delete theEvaluator;
+                return grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, "Shadow evaluation already streaming");
+            }
+            theDevice->isShadowStreamStopRequested = false;
+        }
+
+        // Report periodically until stopped or the client goes away
+        std::vector<ShadowTrigger> triggers;
+        std::vector<ShadowCandidateStats> candidateStats;
+        BICgRPC::ShadowEvaluationUpdate anUpdate;
+        bool isStopping = false;
+        while (!isStopping)
+        {
+            {
+                std::unique_lock<std::mutex> StreamLockInst(theDevice->shadowStreamLock);
+                theDevice->shadowStreamNotify.wait_for(StreamLockInst, reportInterval, [theDevice] { return theDevice->isShadowStreamStopRequested; });
+                isStopping = theDevice->isShadowStreamStopRequested || context->IsCancelled();
+            }
+            if (isStopping)
+            {
+                // Stop feeding blocks before the final report so it includes everything evaluated
+                theDevice->listener->detachShadowEvaluator(theEvaluator);
+            }
+
+            theEvaluator->collectResults(&triggers, &candidateStats);
+            anUpdate.Clear();
+            for (const ShadowTrigger& aTrigger : triggers)
+            {
+                BICgRPC::ShadowTrigger* anEntry = anUpdate.add_triggers();
+                anEntry->set_candidateid(aTrigger.candidateId);
+                anEntry->set_samplecounter(aTrigger.sampleCounter);
+                anEntry->set_timestamp(aTrigger.timeStamp);
+                anEntry->set_phase(aTrigger.phase);
+                anEntry->set_triggerphase(aTrigger.triggerPhase);
+            }
+            for (uint32_t candidateId = 0; candidateId < candidateStats.size(); candidateId++)
+            {
+                BICgRPC::ShadowCandidateSummary* aSummary = anUpdate.add_candidates();
+                aSummary->set_candidateid(candidateId);
+                aSummary->set_triggercount(candidateStats[candidateId].triggers);
+                aSummary->set_evaluatedsamples(candidateStats[candidateId].samples);
+                aSummary->set_triggerrate(candidateStats[candidateId].samples > 0 ? candidateStats[candidateId].triggers * samplingRate / candidateStats[candidateId].samples : 0);
+            }
+            anUpdate.set_droppedblocks(theEvaluator->getDroppedBlocks());
+            if (!writer->Write(anUpdate))
+            {
+                isStopping = true;
+                theDevice->listener->detachShadowEvaluator(theEvaluator);
+            }
+        }
+
+        std::cout << "STIM INFO: Shadow evaluation of " << theEvaluator->getCandidateCount() << " candidates ended, " << theEvaluator->getDroppedBlocks() << " blocks dropped." << std::endl;
+        delete theEvaluator;
+        return grpc::Status::OK;
+    }
+
+    grpc::Status BICDeviceGRPCService::WatchStimulationState(grpc::ServerContext* context, const BICgRPC::bicSetStreamEnable* request, grpc::ServerWriter<BICgRPC::StimulationStateUpdate>* writer)  {
+        // Check if already initialized
+        if (deviceDirectory.find(request->deviceaddress()) == deviceDirectory.end())
+        {
+            return grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, "Not Initialized");
+        }
+        BICDeviceInfoStruct* theDevice = deviceDirectory[request->deviceaddress()];
+        StimulationStateNotifier& theNotifier = theDevice->listener->stimStateNotifier;
+
+        if (!request->enable())
+        {
+            // Stop every watcher of this device
+            theDevice->stimStateStreamStopGeneration++;
+            theNotifier.wakeAll();
+            return grpc::Status::OK;
+        }
+
+        // Only a stop issued after this point ends this stream, another client enabling its own watcher does not revive stopped ones
+        uint64_t stopGeneration = theDevice->stimStateStreamStopGeneration;
+
+        // Send the current state, then each change as it is published. The timeout only bounds how late a cancelled client is noticed.
+        StimulationStateEvent latestEvent = theNotifier.current();
+        uint64_t sentSequence = latestEvent.sequence;
+        BICgRPC::StimulationStateUpdate anUpdate;
+        bool isChanged = true;
+        while (theDevice->stimStateStreamStopGeneration == stopGeneration && !context->IsCancelled())
+        {
+            if (isChanged)
+            {
+                anUpdate.set_isstimulating(latestEvent.isStimulating);
+                anUpdate.set_sequence(latestEvent.sequence);
+                anUpdate.set_timestamp(latestEvent.timeStamp);
+                anUpdate.set_missedchanges(latestEvent.sequence > sentSequence + 1 ? latestEvent.sequence - sentSequence - 1 : 0);
+                if (!writer->Write(anUpdate))
+                {
+                    break;
+                }
+                sentSequence = latestEvent.sequence;
+            }
+            isChanged = theNotifier.waitForChange(sentSequence, std::chrono::milliseconds(500), &latestEvent);
+        }
+        return grpc::Status::OK;
+    }
+
     grpc::Status BICDeviceGRPCService::bicNeuralStream(grpc::ServerContext* context, const BICgRPC::bicNeuralSetStreamingEnable* request, grpc::ServerWriter<BICgRPC::NeuralUpdate>* writer)  {
+        return runNeuralStream(request, writer, NULL);
+    }
+
+    grpc::Status BICDeviceGRPCService::bicNeuralBlockStream(grpc::ServerContext* context, const BICgRPC::bicNeuralSetStreamingEnable* request, grpc::ServerWriter<BICgRPC::NeuralBlockUpdate>* writer)  {
+        return runNeuralStream(request, NULL, writer);
+    }
+
+    /// <summary>
+    /// Shared implementation of the per-sample and block neural streams. Exactly one of the writers is expected to be non-null when enabling.
+    /// </summary>
+    /// <param name="request">Neural stream request from the client</param>
+    /// <param name="writer">Writer for the per-sample NeuralUpdate stream, or NULL</param>
+    /// <param name="blockWriter">Writer for the NeuralBlockUpdate stream, or NULL</param>
+    /// <returns>gRPC status of the stream</returns>
+    grpc::Status BICDeviceGRPCService::runNeuralStream(const BICgRPC::bicNeuralSetStreamingEnable* request, grpc::ServerWriter<BICgRPC::NeuralUpdate>* writer, grpc::ServerWriter<BICgRPC::NeuralBlockUpdate>* blockWriter)  {
         // Check requested stream state and current streaming state (don't want to destroy a previously requested stream without it being stopped first)
         if (!deviceDirectory[request->deviceaddress()]->listener->neuralStreamingState && request->enable())
         { 
@@ -575,8 +1007,22 @@ namespace BICGRPCHelperNamespace
                 referenceElectrodes.insert(referenceElectrodes.begin(), request->refchannels()[i]);
             }
 
+            // Determine which closed-loop processing outputs to stream, all of them if the client did not select any
+            uint32_t dspOutputs = DSP_OUTPUT_ALL;
+            if (request->has_dspoutputs())
+            {
+                const BICgRPC::DspOutputSelection& selection = request->dspoutputs();
+                dspOutputs = (selection.filtsample() ? (uint32_t)DSP_OUTPUT_FILT_SAMPLE : 0u)
+                    | (selection.phase() ? (uint32_t)DSP_OUTPUT_PHASE : 0u)
+                    | (selection.triggerphase() ? (uint32_t)DSP_OUTPUT_TRIGGER_PHASE : 0u)
+                    | (selection.prefiltsample() ? (uint32_t)DSP_OUTPUT_PRE_FILT_SAMPLE : 0u)
+                    | (selection.hampelfiltsample() ? (uint32_t)DSP_OUTPUT_HAMPEL_FILT_SAMPLE : 0u)
+                    | (selection.isvalidtarget() ? (uint32_t)DSP_OUTPUT_VALID_TARGET : 0u);
+            }
+
             // Configure buffers and state variables for streaming start
-            deviceDirectory[request->deviceaddress()]->listener->enableNeuralStreaming(true, request->buffersize(), request->maxinterpolationpoints(), writer);
+            deviceDirectory[request->deviceaddress()]->listener->enableNeuralStreaming(true, request->buffersize(), request->maxinterpolationpoints(), (InterpolationMethod)request->interpolationmethod(), (GapHandlingMode)request->gaphandling(), dspOutputs,
+                (double)deviceDirectory[request->deviceaddress()]->theImplantInfo->getSamplingRate(), writer, blockWriter);
 
             // Create the waiting objects for notification for end of stream
             std::unique_lock<std::mutex> StreamLockInst(deviceDirectory[request->deviceaddress()]->neuralStreamLock);
@@ -587,7 +1033,7 @@ namespace BICGRPCHelperNamespace
             deviceDirectory[request->deviceaddress()]->theImplant->stopMeasurement();
 
             // Clean up the writers and busy flags
-            deviceDirectory[request->deviceaddress()]->listener->enableNeuralStreaming(false, 0, 0, NULL);
+            deviceDirectory[request->deviceaddress()]->listener->enableNeuralStreaming(false, 0, 0, INTERPOLATION_LINEAR, GAP_HANDLING_SEND_INTERPOLATED, DSP_OUTPUT_NONE, 0, NULL, NULL);
         }
         else if (deviceDirectory[request->deviceaddress()]->listener->neuralStreamingState && request->enable())
         {
@@ -612,6 +1058,12 @@ namespace BICGRPCHelperNamespace
             return grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, "Not Initialized");
         }
 
+        // A running stimulation sequence owns the device's stimulation
+        if (deviceDirectory[request->deviceaddress()]->isSequenceRunning)
+        {
+            return grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, "Stimulation sequence running");
+        }
+
         // Perform the operation
         try
         {
@@ -635,6 +1087,233 @@ namespace BICGRPCHelperNamespace
         return grpc::Status::OK;
     }
 
+    /// <summary>
+    /// Waits for the deadline of a sequence trial: sleeps until shortly before it, then spins
+    /// </summary>
+    /// <param name="theDevice">Device running the sequence</param>
+    /// <param name="deadline">Trial deadline</param>
+    /// <returns>True if the sequence was asked to stop while waiting</returns>
+    static bool waitForSequenceDeadline(BICDeviceInfoStruct* theDevice, std::chrono::steady_clock::time_point deadline)
+    {
+        {
+            std::unique_lock<std::mutex> sequenceLockInst(theDevice->sequenceLock);
+            theDevice->sequenceNotify.wait_until(sequenceLockInst, deadline - SEQUENCE_SPIN_MARGIN, [theDevice] { return (bool)theDevice->isSequenceStopRequested; });
+        }
+        while (std::chrono::steady_clock::now() < deadline && !theDevice->isSequenceStopRequested)
+        {
+            std::this_thread::yield();
+        }
+        return theDevice->isSequenceStopRequested;
+    }
+
+    grpc::Status BICDeviceGRPCService::ExecuteStimulationSequence(grpc::ServerContext* context, const BICgRPC::stimulationSequenceRequest* request, grpc::ServerWriter<BICgRPC::StimulationTrialUpdate>* writer)  {
+        // Check if already initialized
+        if (deviceDirectory.find(request->deviceaddress()) == deviceDirectory.end())
+        {
+            return grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, "Not Initialized");
+        }
+        BICDeviceInfoStruct* theDevice = deviceDirectory[request->deviceaddress()];
+        StimulationStateNotifier& theNotifier = theDevice->listener->stimStateNotifier;
+
+        if (!request->enable())
+        {
+            // Stop the running sequence
+            std::lock_guard<std::mutex> sequenceLockInst(theDevice->sequenceLock);
+            theDevice->isSequenceStopRequested = true;
+            theDevice->sequenceNotify.notify_all();
+            theNotifier.wakeAll();
+            return grpc::Status::OK;
+        }
+
+        // Check if parameters are valid
+        if (request->waveformsets_size() == 0 || request->repetitions() == 0)
+        {
+            return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "At least one waveform set and one repetition required");
+        }
+        if ((uint64_t)request->waveformsets_size() * request->repetitions() > MAX_SEQUENCE_TRIALS)
+        {
+            return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "Sequence exceeds " + std::to_string(MAX_SEQUENCE_TRIALS) + " trials");
+        }
+        if (theDevice->listener->isTriggeringStimulation())
+        {
+            return grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, "Open-loop or closed-loop stimulation active");
+        }
+        {
+            // Claim the device and clear any earlier stop request together, so a stop sent once the sequence is claimed is never lost
+            std::lock_guard<std::mutex> sequenceLockInst(theDevice->sequenceLock);
+            if (theDevice->isSequenceRunning)
+            {
+                return grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, "Stimulation sequence already running");
+            }
+            theDevice->isSequenceRunning = true;
+            theDevice->isSequenceStopRequested = false;
+        }
+
+        // Assemble every waveform up front so no trial waits for it
+        std::vector<std::shared_ptr<IStimulationCommand>> commands;
+        std::vector<uint64_t> commandKeys;
+        std::vector<std::string> commandDefinitions;
+        try
+        {
+            for (const BICgRPC::StimulationWaveformSet& aSet : request->waveformsets())
+            {
+                commandKeys.push_back(0);
+                commandDefinitions.emplace_back();
+                commands.push_back(getCachedStimulationCommand(theDevice, aSet.functions(), aSet.waveformrepetitions(), &commandKeys.back(), &commandDefinitions.back()));
+            }
+        }
+        catch (const std::exception& theException)
+        {
+            theDevice->isSequenceRunning = false;
+            return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, theException.what());
+        }
+
+        // Plan the trials
+        StimulationSequenceConfig config;
+        config.waveformSetCount = (uint32_t)commands.size();
+        config.repetitions = request->repetitions();
+        config.randomizeOrder = request->randomizeorder();
+        config.interTrialIntervalUs = request->intertrialintervalus();
+        config.interTrialJitterUs = request->intertrialjitterus();
+        config.randomSeed = request->randomseed();
+        StimulationSequence theSequence(config);
+        const std::vector<StimulationSequenceTrial>& trials = theSequence.getTrials();
+        std::cout << "STIM INFO: Stimulation sequence of " << trials.size() << " trials started, seed " << theSequence.getRandomSeed() << std::endl;
+
+        std::chrono::steady_clock::time_point sequenceStart;
+        int64_t loadedSetIndex = -1;
+        uint32_t startedTrials = 0;
+        bool isStopping = false;
+        BICgRPC::StimulationTrialUpdate anUpdate;
+        for (uint32_t trialIndex = 0; trialIndex < trials.size() && !isStopping; trialIndex++)
+        {
+            const StimulationSequenceTrial& theTrial = trials[trialIndex];
+            anUpdate.Clear();
+            anUpdate.set_trialindex(trialIndex);
+            anUpdate.set_trialcount((uint32_t)trials.size());
+            anUpdate.set_waveformsetindex(theTrial.waveformSetIndex);
+            anUpdate.set_randomseed(theSequence.getRandomSeed());
+
+            try
+            {
+                // Load the trial's waveform unless the previous trial left it on the device
+                if ((int64_t)theTrial.waveformSetIndex != loadedSetIndex)
+                {
+                    theDevice->theImplant->enqueueStimulationCommand(commands[theTrial.waveformSetIndex].get(), (StimulationMode)BICgRPC::VOLATILE_WAVEFORM);
+                    theDevice->lastEnqueueType = (StimulationMode)BICgRPC::VOLATILE_WAVEFORM;
+                    theDevice->lastEnqueuedCommandKey = commandKeys[theTrial.waveformSetIndex];
+                    theDevice->lastEnqueuedDefinition = commandDefinitions[theTrial.waveformSetIndex];
+                    loadedSetIndex = theTrial.waveformSetIndex;
+                }
+
+                // Deadlines count from the first trial once its waveform is loaded
+                if (trialIndex == 0)
+                {
+                    sequenceStart = std::chrono::steady_clock::now();
+                }
+                std::chrono::steady_clock::time_point deadline = sequenceStart + std::chrono::microseconds(theTrial.startOffsetUs);
+                if (waitForSequenceDeadline(theDevice, deadline) || context->IsCancelled())
+                {
+                    isStopping = true;
+                    break;
+                }
+
+                // Start the trial
+                StimulationStateEvent startEvent = theNotifier.current();
+                std::chrono::system_clock::time_point before = std::chrono::system_clock::now();
+                std::chrono::steady_clock::time_point issueTime = std::chrono::steady_clock::now();
+                anUpdate.set_beforestimtimestamp(before.time_since_epoch().count());
+                anUpdate.set_scheduledtimestamp((before - std::chrono::duration_cast<std::chrono::system_clock::duration>(issueTime - deadline)).time_since_epoch().count());
+                anUpdate.set_schedulingerrorns(std::chrono::duration_cast<std::chrono::nanoseconds>(issueTime - deadline).count());
+                try
+                {
+                    theDevice->theImplant->startStimulation();
+                }
+                catch (const std::exception& theException)
+                {
+                    std::cout << "ERROR: Stimulation sequence trial " << trialIndex << " failed. Reason: " << theException.what() << std::endl;
+                    anUpdate.set_exception(theException.what());
+                }
+                anUpdate.set_afterstimtimestamp(std::chrono::system_clock::now().time_since_epoch().count());
+                startedTrials++;
+                if (!writer->Write(anUpdate))
+                {
+                    isStopping = true;
+                    break;
+                }
+
+                // Wait for the reported end of the stimulation before the next waveform is loaded. Without a report, move on once
+                // the next deadline has passed and the device is idle.
+                if (trialIndex + 1 < trials.size())
+                {
+                    std::chrono::steady_clock::time_point nextDeadline = sequenceStart + std::chrono::microseconds(trials[trialIndex + 1].startOffsetUs);
+                    StimulationStateEvent latestEvent = startEvent;
+                    while (!theDevice->isSequenceStopRequested && !context->IsCancelled())
+                    {
+                        bool isReportedEnded = latestEvent.sequence > startEvent.sequence && !latestEvent.isStimulating;
+                        if (isReportedEnded || (!latestEvent.isStimulating && std::chrono::steady_clock::now() >= nextDeadline - SEQUENCE_SPIN_MARGIN))
+                        {
+                            break;
+                        }
+                        std::chrono::steady_clock::duration untilDeadline = nextDeadline - SEQUENCE_SPIN_MARGIN - std::chrono::steady_clock::now();
+                        std::chrono::steady_clock::duration waitTime = std::chrono::milliseconds(100);
+                        if (untilDeadline > std::chrono::steady_clock::duration::zero() && untilDeadline < waitTime)
+                        {
+                            waitTime = untilDeadline;
+                        }
+                        theNotifier.waitForChange(latestEvent.sequence, waitTime, &latestEvent);
+                    }
+                }
+            }
+            catch (const std::exception& theException)
+            {
+                // Loading the waveform failed, the sequence cannot continue
+                std::cout << "ERROR: Stimulation sequence stopped at trial " << trialIndex << ". Reason: " << theException.what() << std::endl;
+                anUpdate.set_exception(theException.what());
+                writer->Write(anUpdate);
+                isStopping = true;
+                break;
+            }
+        }
+
+        // Do not leave a trial running after an early stop
+        if (isStopping && theDevice->listener->isStimulating())
+        {
+            try
+            {
+                theDevice->theImplant->stopStimulation();
+            }
+            catch (const std::exception&)
+            {
+            }
+        }
+        std::cout << "STIM INFO: Stimulation sequence ended after " << startedTrials << " of " << trials.size() << " trials" << std::endl;
+        theDevice->isSequenceRunning = false;
+        return grpc::Status::OK;
+    }
+
+    grpc::Status BICDeviceGRPCService::bicGetStimulationCommandCache(grpc::ServerContext* context, const BICgRPC::RequestDeviceAddress* request, BICgRPC::stimulationCommandCacheReply* reply)
+    {
+        // Check if already initialized
+        if (deviceDirectory.find(request->deviceaddress()) == deviceDirectory.end())
+        {
+            return grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, "Not Initialized");
+        }
+
+        // Respond to client
+        StimulationCommandCacheStats stats = deviceDirectory[request->deviceaddress()]->commandCache.getStats();
+        reply->set_hits(stats.hits);
+        reply->set_misses(stats.misses);
+        reply->set_evictions(stats.evictions);
+        reply->set_skippedenqueues(stats.skippedEnqueues);
+        reply->set_entries(stats.entries);
+        reply->set_totalbuildns(stats.totalBuildNs);
+        reply->set_meanbuildns(stats.misses > 0 ? stats.totalBuildNs / stats.misses : 0);
+        reply->set_maxbuildns(stats.maxBuildNs);
+        reply->set_lastcommandkey(stats.lastKey);
+        return grpc::Status::OK;
+    }
+
     grpc::Status BICDeviceGRPCService::bicStopStimulation(grpc::ServerContext* context, const BICgRPC::RequestDeviceAddress* request, BICgRPC::bicSuccessReply* reply)  {
         // Check if already initialized
         if (deviceDirectory.find(request->deviceaddress()) == deviceDirectory.end())
@@ -668,87 +1347,47 @@ namespace BICGRPCHelperNamespace
             return grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, "Not Initialized");
         }
 
-        // Create objects required for 
-        std::unique_ptr<IStimulationCommandFactory> theFactory(createStimulationCommandFactory());
-        IStimulationCommand* theStimulationCommand = theFactory->createStimulationCommand();
-        theStimulationCommand->setRepetitions(request->waveformrepititions());
+        BICDeviceInfoStruct* theDevice = deviceDirectory[request->deviceaddress()];
+
+        // A running stimulation sequence owns the device's stimulation
+        if (theDevice->isSequenceRunning)
+        {
+            return grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, "Stimulation sequence running");
+        }
 
-        // Iterate through provided functions and add them to the command 
+        // Take the command from the cache, building it from the provided functions if it is new
         try
         {
-            for (int i = 0; i < request->functions_size(); i++)
+            std::shared_ptr<IStimulationCommand> theStimulationCommand;
+            uint64_t commandKey = request->cachedcommandkey();
+            std::string commandDefinition;
+            if (commandKey != 0 && request->functions_size() == 0)
             {
-                // Set general function parameters
-                IStimulationFunction* theFunction = theFactory->createStimulationFunction();
-                theFunction->setName(request->functions().at(i).functionname());
-
-                // Check which requested type of function requested
-                if (request->functions().at(i).has_stimpulse())
+                theStimulationCommand = theDevice->commandCache.find(commandKey, &commandDefinition);
+                if (!theStimulationCommand)
                 {
-                    // Set repetition field
-                    theFunction->setRepetitions(request->functions().at(i).stimpulse().pulserepetitions(), request->functions().at(i).stimpulse().burstrepetitions());
-
-                    // Pull out the electrodes and set the electrode fields
-                    std::set<uint32_t> sources;
-                    std::set<uint32_t> sinks;
-                    for (int j = 0; j < request->functions().at(i).stimpulse().sourceelectrodes().size(); j++)
-                    {
-                        sources.insert(request->functions().at(i).stimpulse().sourceelectrodes()[j]);
-                    }
-                    for (int j = 0; j < request->functions().at(i).stimpulse().sinkelectrodes().size(); j++)
-                    {
-                        sinks.insert(request->functions().at(i).stimpulse().sinkelectrodes()[j]);
-                    }
-                    theFunction->setVirtualStimulationElectrodes(sources, sinks, request->functions().at(i).stimpulse().useground());
-
-                    // Generate the stimulation pulse by assembling atoms and appending them to the function
-                    // Generate Atoms -- positive  pulse
-                    theFunction->append(theFactory->createRect4AmplitudeStimulationAtom(
-                        request->functions().at(i).stimpulse().amplitude()[0],
-                        request->functions().at(i).stimpulse().amplitude()[1],
-                        request->functions().at(i).stimpulse().amplitude()[2],
-                        request->functions().at(i).stimpulse().amplitude()[3],
-                        request->functions().at(i).stimpulse().pulsewidth()));
-
-                    // Generate atoms -- DZ0
-                    theFunction->append(theFactory->createRect4AmplitudeStimulationAtom(0, 0, 0, 0, request->functions().at(i).stimpulse().dz0duration()));
-
-                    // Genmerate atoms -- charge balance ( based on charge balance ratio - does this have to be 4?)
-                    theFunction->append(theFactory->createRect4AmplitudeStimulationAtom(
-                        request->functions().at(i).stimpulse().amplitude()[0] / -4,
-                        request->functions().at(i).stimpulse().amplitude()[1] / -4,
-                        request->functions().at(i).stimpulse().amplitude()[2] / -4,
-                        request->functions().at(i).stimpulse().amplitude()[3] / -4,
-                        request->functions().at(i).stimpulse().pulsewidth() * 4));
-
-                    // Generate atoms -- DZ0
-                    // TODO - SHOULD THIS BE HERE?
-                    theFunction->append(theFactory->createRect4AmplitudeStimulationAtom(0, 0, 0, 0, request->functions().at(i).stimpulse().dz0duration()));
-
-                    // Generate atoms -- DZ1
-                    theFunction->append(theFactory->createRect4AmplitudeStimulationAtom(0, 0, 0, 0, request->functions().at(i).stimpulse().dz1duration()));
-
-                    // Add the function to the command
-                    theStimulationCommand->append(theFunction);
+                    return grpc::Status(grpc::StatusCode::NOT_FOUND, "Stimulation command not cached");
                 }
-                else if (request->functions().at(i).has_pause())
-                {
-                    // Create the pulse function
-                    theFunction->append(theFactory->createStimulationPauseAtom(request->functions().at(i).pause().duration()));
+            }
+            else
+            {
+                theStimulationCommand = getCachedStimulationCommand(theDevice, request->functions(), request->waveformrepititions(), &commandKey, &commandDefinition);
+            }
 
-                    // Add the function to the command
-                    theStimulationCommand->append(theFunction);
-                }
-                else
-                {
-                    // No atoms?
-                }
+            // Persistent commands stay on the device, so the one it already holds in the same mode is not transferred again
+            StimulationMode theMode = (StimulationMode)request->mode();
+            if (request->mode() != BICgRPC::VOLATILE_WAVEFORM && commandKey == theDevice->lastEnqueuedCommandKey && theMode == theDevice->lastEnqueueType
+                && commandDefinition == theDevice->lastEnqueuedDefinition)
+            {
+                theDevice->commandCache.countSkippedEnqueue();
+                return grpc::Status::OK;
             }
 
-            // Stimulation Command created, now enqueue
-            deviceDirectory[request->deviceaddress()]->theImplant->enqueueStimulationCommand(theStimulationCommand, (StimulationMode)request->mode());
-            deviceDirectory[request->deviceaddress()]->lastEnqueueType = (StimulationMode)request->mode();
-            delete theStimulationCommand;
+            // Stimulation Command ready, now enqueue
+            theDevice->theImplant->enqueueStimulationCommand(theStimulationCommand.get(), theMode);
+            theDevice->lastEnqueueType = theMode;
+            theDevice->lastEnqueuedCommandKey = commandKey;
+            theDevice->lastEnqueuedDefinition = commandDefinition;
         }
         catch (const std::exception theExeption)
         {
@@ -760,24 +1399,131 @@ namespace BICGRPCHelperNamespace
         return grpc::Status::OK;
     }
 
-    grpc::Status BICDeviceGRPCService::enableDistributedStimulation(grpc::ServerContext* context, const BICgRPC::distributedStimEnableRequest* request, BICgRPC::bicSuccessReply* reply)
+    /// <summary>
+    /// Looks up the command for a set of function definitions in the device's command cache, building it on a miss. The key is the
+    /// FNV-1a hash of the definitions serialized as a StimulationWaveformSet; these messages hold no maps, so the serialization is canonical.
+    /// The serialization itself is kept with the command and compared on every hit.
+    /// </summary>
+    /// <param name="theDevice">Device whose cache is used</param>
+    /// <param name="functions">Function definitions in stimulation order</param>
+    /// <param name="repetitions">Repetitions of the whole command</param>
+    /// <param name="commandKey">Filled with the cache key of the command</param>
+    /// <param name="canonicalDefinition">Filled with the serialized definitions</param>
+    /// <returns>The cached command</returns>
+    std::shared_ptr<IStimulationCommand> BICDeviceGRPCService::getCachedStimulationCommand(BICDeviceInfoStruct* theDevice, const google::protobuf::RepeatedPtrField<BICgRPC::StimulationFunctionDefinition>& functions, uint32_t repetitions, uint64_t* commandKey, std::string* canonicalDefinition)
     {
-        // Check if already initialized
-        if (deviceDirectory.find(request->deviceaddress()) == deviceDirectory.end())
+        BICgRPC::StimulationWaveformSet canonicalSet;
+        *canonicalSet.mutable_functions() = functions;
+        canonicalSet.set_waveformrepetitions(repetitions);
+        *canonicalDefinition = canonicalSet.SerializeAsString();
+        *commandKey = StimulationCommandCache::hashDefinition(*canonicalDefinition);
+
+        return theDevice->commandCache.findOrBuild(*commandKey, *canonicalDefinition, [this, &functions, repetitions](IStimulationCommandFactory* theFactory) {
+            return buildStimulationCommand(theFactory, functions, repetitions);
+        });
+    }
+
+    /// <summary>
+    /// Assembles a stimulation command from gRPC function definitions, as enqueued by bicEnqueueStimulation
+    /// </summary>
+    /// <param name="theFactory">Factory creating the command, functions and atoms</param>
+    /// <param name="functions">Function definitions in stimulation order</param>
+    /// <param name="repetitions">Repetitions of the whole command</param>
+    /// <returns>The command, owned by the caller</returns>
+    IStimulationCommand* BICDeviceGRPCService::buildStimulationCommand(IStimulationCommandFactory* theFactory, const google::protobuf::RepeatedPtrField<BICgRPC::StimulationFunctionDefinition>& functions, uint32_t repetitions)
+    {
+        IStimulationCommand* theStimulationCommand = theFactory->createStimulationCommand();
+        theStimulationCommand->setRepetitions(repetitions);
+
+        for (int i = 0; i < functions.size(); i++)
         {
-            return grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, "Not Initialized");
+            // Set general function parameters
+            IStimulationFunction* theFunction = theFactory->createStimulationFunction();
+            theFunction->setName(functions.at(i).functionname());
+
+            // Check which requested type of function requested
+            if (functions.at(i).has_stimpulse())
+            {
+                // Set repetition field
+                theFunction->setRepetitions(functions.at(i).stimpulse().pulserepetitions(), functions.at(i).stimpulse().burstrepetitions());
+
+                // Pull out the electrodes and set the electrode fields
+                std::set<uint32_t> sources;
+                std::set<uint32_t> sinks;
+                for (int j = 0; j < functions.at(i).stimpulse().sourceelectrodes().size(); j++)
+                {
+                    sources.insert(functions.at(i).stimpulse().sourceelectrodes()[j]);
+                }
+                for (int j = 0; j < functions.at(i).stimpulse().sinkelectrodes().size(); j++)
+                {
+                    sinks.insert(functions.at(i).stimpulse().sinkelectrodes()[j]);
+                }
+                theFunction->setVirtualStimulationElectrodes(sources, sinks, functions.at(i).stimpulse().useground());
+
+                // Generate the stimulation pulse by assembling atoms and appending them to the function
+                // Generate Atoms -- positive  pulse
+                theFunction->append(theFactory->createRect4AmplitudeStimulationAtom(
+                    functions.at(i).stimpulse().amplitude()[0],
+                    functions.at(i).stimpulse().amplitude()[1],
+                    functions.at(i).stimpulse().amplitude()[2],
+                    functions.at(i).stimpulse().amplitude()[3],
+                    functions.at(i).stimpulse().pulsewidth()));
+
+                // Generate atoms -- DZ0
+                theFunction->append(theFactory->createRect4AmplitudeStimulationAtom(0, 0, 0, 0, functions.at(i).stimpulse().dz0duration()));
+
+                // Genmerate atoms -- charge balance ( based on charge balance ratio - does this have to be 4?)
+                theFunction->append(theFactory->createRect4AmplitudeStimulationAtom(
+                    functions.at(i).stimpulse().amplitude()[0] / -4,
+                    functions.at(i).stimpulse().amplitude()[1] / -4,
+                    functions.at(i).stimpulse().amplitude()[2] / -4,
+                    functions.at(i).stimpulse().amplitude()[3] / -4,
+                    functions.at(i).stimpulse().pulsewidth() * 4));
+
+                // Generate atoms -- DZ0
+                // TODO - SHOULD THIS BE HERE?
+                theFunction->append(theFactory->createRect4AmplitudeStimulationAtom(0, 0, 0, 0, functions.at(i).stimpulse().dz0duration()));
+
+                // Generate atoms -- DZ1
+                theFunction->append(theFactory->createRect4AmplitudeStimulationAtom(0, 0, 0, 0, functions.at(i).stimpulse().dz1duration()));
+
+                // Add the function to the command
+                theStimulationCommand->append(theFunction);
+            }
+            else if (functions.at(i).has_pause())
+            {
+                // Create the pulse function
+                theFunction->append(theFactory->createStimulationPauseAtom(functions.at(i).pause().duration()));
+
+                // Add the function to the command
+                theStimulationCommand->append(theFunction);
+            }
+            else
+            {
+                // No atoms?
+            }
         }
 
+        return theStimulationCommand;
+    }
+
+    /// <summary>
+    /// Checks the closed-loop parameters of a distributed stimulation request
+    /// </summary>
+    /// <param name="request">Request from the client</param>
+    /// <returns>OK if the parameters are valid, INVALID_ARGUMENT otherwise</returns>
+    grpc::Status BICDeviceGRPCService::validateDistributedStimRequest(const BICgRPC::distributedStimEnableRequest* request)
+    {
         // Check if parameters are valid
         if (request->sensingchannel() < 0 || request->sensingchannel() > 31)
         {
             return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "Arguments out of range");
         }
 
-        // Check that there are at least three coefficients for filtering
-        if (request->filtercoefficients_b_size() < 3 || request->filtercoefficients_a_size() < 3)
+        // Check that the coefficients match the controller's band-pass filter
+        if (request->filtercoefficients_b_size() != IIR_FILTER_COEFFICIENTS || request->filtercoefficients_a_size() != IIR_FILTER_COEFFICIENTS)
         {
-            return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "Need at least 3 values for filter coefficients");
+            return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "Need exactly 5 values for each set of filter coefficients");
         }
 
         // Check that starting trigger phase is valid
@@ -792,20 +1538,395 @@ namespace BICGRPCHelperNamespace
             return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "Arguments out of range");
         }
 
-        // Grab all coefficient values and store in a vector
-        std::vector<double> coefficients_B;
-        std::vector<double> coefficients_A;
-        for (int i = 0; i < request->filtercoefficients_b_size(); i++)
+        return grpc::Status::OK;
+    }
+
+    /// <summary>
+    /// Converts the closed-loop parameters of a distributed stimulation request into a controller configuration
+    /// </summary>
+    /// <param name="request">Validated request from the client</param>
+    /// <param name="samplingRate">Device sampling rate in Hz</param>
+    /// <returns>Controller configuration</returns>
+    ClosedLoopControllerConfig BICDeviceGRPCService::buildControllerConfig(const BICgRPC::distributedStimEnableRequest* request, double samplingRate)
+    {
+        ClosedLoopControllerConfig config;
+        config.sensingChannel = request->sensingchannel();
+        config.filtCoeff_B.assign(request->filtercoefficients_b().begin(), request->filtercoefficients_b().end());
+        config.filtCoeff_A.assign(request->filtercoefficients_a().begin(), request->filtercoefficients_a().end());
+        config.stimThreshold = request->triggerstimthreshold();
+        config.triggerPhase = request->inittriggerstimphase();
+        config.targetPhase = request->targetphase();
+        config.phaseEstimatorType = (PhaseEstimatorType)request->phaseestimator();
+        config.phaseEstimatorWindow = request->phaseestimatorwindow();
+        config.predictionHorizon = request->phasepredictionhorizon();
+        config.samplingRate = samplingRate;
+        return config;
+    }
+
+    /// <summary>
+    /// Converts a gRPC pipeline description into a pipeline configuration. Stages without a type are passed on unchanged so compilation rejects them.
+    /// </summary>
+    /// <param name="pipeline">Pipeline description from the client</param>
+    /// <returns>Pipeline configuration</returns>
+    DspPipelineConfig BICDeviceGRPCService::buildPipelineConfig(const BICgRPC::DspPipeline& pipeline)
+    {
+        DspPipelineConfig config;
+        config.sensingChannel = pipeline.sensingchannel();
+        config.refractorySamples = pipeline.refractorysamples();
+        for (const BICgRPC::DspStage& aStage : pipeline.stages())
+        {
+            DspStageConfig stageConfig;
+            stageConfig.type = (DspStageType)aStage.stage_case();
+            stageConfig.input = aStage.input();
+            switch (aStage.stage_case())
+            {
+            case BICgRPC::DspStage::kDcBlock:
+                stageConfig.pole = aStage.dcblock().pole();
+                stageConfig.blankDuringStim = aStage.dcblock().blankduringstim();
+                break;
+            case BICgRPC::DspStage::kNotch:
+                stageConfig.frequency = aStage.notch().frequency();
+                stageConfig.qualityFactor = aStage.notch().qualityfactor();
+                break;
+            case BICgRPC::DspStage::kHampel:
+                stageConfig.window = aStage.hampel().window();
+                stageConfig.deviations = aStage.hampel().deviations();
+                break;
+            case BICgRPC::DspStage::kSosFilter:
+                stageConfig.sections.assign(aStage.sosfilter().sections().begin(), aStage.sosfilter().sections().end());
+                break;
+            case BICgRPC::DspStage::kEnvelope:
+                stageConfig.timeConstantMs = aStage.envelope().timeconstantms();
+                break;
+            case BICgRPC::DspStage::kPhase:
+                stageConfig.phaseEstimatorType = (PhaseEstimatorType)aStage.phase().phaseestimator();
+                stageConfig.window = aStage.phase().phaseestimatorwindow();
+                stageConfig.predictionHorizon = aStage.phase().phasepredictionhorizon();
+                stageConfig.filtCoeff_B.assign(aStage.phase().filtercoefficients_b().begin(), aStage.phase().filtercoefficients_b().end());
+                stageConfig.filtCoeff_A.assign(aStage.phase().filtercoefficients_a().begin(), aStage.phase().filtercoefficients_a().end());
+                break;
+            case BICgRPC::DspStage::kThreshold:
+                stageConfig.level = aStage.threshold().level();
+                stageConfig.isRisingCrossing = aStage.threshold().risingcrossing();
+                stageConfig.isAbsolute = aStage.threshold().absolute();
+                break;
+            default:
+                break;
+            }
+            config.stages.push_back(stageConfig);
+        }
+        return config;
+    }
+
+    grpc::Status BICDeviceGRPCService::enableDistributedStimulation(grpc::ServerContext* context, const BICgRPC::distributedStimEnableRequest* request, BICgRPC::bicSuccessReply* reply)
+    {
+        // Check if already initialized
+        if (deviceDirectory.find(request->deviceaddress()) == deviceDirectory.end())
+        {
+            return grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, "Not Initialized");
+        }
+
+        // Check if parameters are valid
+        grpc::Status validationStatus = validateDistributedStimRequest(request);
+        if (!validationStatus.ok())
+        {
+            return validationStatus;
+        }
+
+        // A running stimulation sequence owns the device's stimulation
+        if (request->enable() && deviceDirectory[request->deviceaddress()]->isSequenceRunning)
+        {
+            return grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, "Stimulation sequence running");
+        }
+
+        // Perform the operation
+        ClosedLoopControllerConfig config = buildControllerConfig(request, (double)deviceDirectory[request->deviceaddress()]->theImplantInfo->getSamplingRate());
+        bool isApplied = deviceDirectory[request->deviceaddress()]->listener->enableDistributedStim(request->enable(), config.sensingChannel, config.filtCoeff_B, config.filtCoeff_A, request->triggeredfunctionindex(), config.stimThreshold, config.triggerPhase, config.targetPhase,
+            config.phaseEstimatorType, config.phaseEstimatorWindow, config.predictionHorizon, request->predictivescheduling(),
+            (TriggerWaitMode)request->triggerwaitmode(), request->triggerspinmicroseconds(), config.samplingRate);
+        if (!isApplied)
+        {
+            return grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, "Controller already enabled or other stimulation running");
+        }
+
+        // Respond to client
+        return grpc::Status::OK;
+    }
+
+    grpc::Status BICDeviceGRPCService::enableClosedLoopController(grpc::ServerContext* context, const BICgRPC::closedLoopControllerEnableRequest* request, BICgRPC::bicSuccessReply* reply)
+    {
+        const BICgRPC::distributedStimEnableRequest& settings = request->settings();
+
+        // Check if already initialized
+        if (deviceDirectory.find(settings.deviceaddress()) == deviceDirectory.end())
+        {
+            return grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, "Not Initialized");
+        }
+
+        // Check if parameters are valid
+        if (request->controllerid() >= MAX_CLOSED_LOOP_CONTROLLERS)
+        {
+            return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "Controller ID out of range");
+        }
+        grpc::Status validationStatus = validateDistributedStimRequest(&settings);
+        if (!validationStatus.ok())
+        {
+            return validationStatus;
+        }
+
+        // A running stimulation sequence owns the device's stimulation
+        if (settings.enable() && deviceDirectory[settings.deviceaddress()]->isSequenceRunning)
+        {
+            return grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, "Stimulation sequence running");
+        }
+
+        // With preloaded stimulation functions each controller starts its own function, otherwise the current stimulation command
+        BICDeviceInfoStruct* theDevice = deviceDirectory[settings.deviceaddress()];
+        int64_t stimFunctionIndex = NO_STIM_FUNCTION_INDEX;
+        if (theDevice->lastEnqueueType == StimulationMode::STIM_MODE_PERSISTENT_FUNC_PRELOADING)
+        {
+            stimFunctionIndex = settings.triggeredfunctionindex();
+        }
+
+        // Perform the operation
+        if (!theDevice->listener->enableClosedLoopController(request->controllerid(), settings.enable(), buildControllerConfig(&settings, (double)theDevice->theImplantInfo->getSamplingRate()),
+            settings.predictivescheduling(), stimFunctionIndex, (TriggerWaitMode)settings.triggerwaitmode(), settings.triggerspinmicroseconds()))
+        {
+            return grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, "Controller already enabled, held by a block controller, or other stimulation running");
+        }
+
+        // Respond to client
+        return grpc::Status::OK;
+    }
+
+    grpc::Status BICDeviceGRPCService::UpdateDistributedStimParameters(grpc::ServerContext* context, const BICgRPC::distributedStimParameterUpdate* request, BICgRPC::bicSuccessReply* reply)
+    {
+        // Check if already initialized
+        if (deviceDirectory.find(request->deviceaddress()) == deviceDirectory.end())
+        {
+            return grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, "Not Initialized");
+        }
+
+        // Check if parameters are valid
+        if (request->controllerid() >= MAX_CLOSED_LOOP_CONTROLLERS)
+        {
+            return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "Controller ID out of range");
+        }
+        if (request->filtercoefficients_b_size() != request->filtercoefficients_a_size()
+            || (request->filtercoefficients_b_size() != 0 && request->filtercoefficients_b_size() != IIR_FILTER_COEFFICIENTS))
+        {
+            return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "Filter coefficients must be empty or exactly 5 values each");
+        }
+        if ((request->has_inittriggerstimphase() && (request->inittriggerstimphase() < 0 || request->inittriggerstimphase() > 360))
+            || (request->has_targetphase() && (request->targetphase() < 0 || request->targetphase() > 360)))
+        {
+            return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "Arguments out of range");
+        }
+
+        // Perform the operation, fields left unset keep their current values
+        ClosedLoopParameters parameters;
+        parameters.filtCoeff_B.assign(request->filtercoefficients_b().begin(), request->filtercoefficients_b().end());
+        parameters.filtCoeff_A.assign(request->filtercoefficients_a().begin(), request->filtercoefficients_a().end());
+        parameters.isStimThresholdSet = request->has_triggerstimthreshold();
+        parameters.stimThreshold = request->triggerstimthreshold();
+        parameters.isTriggerPhaseSet = request->has_inittriggerstimphase();
+        parameters.triggerPhase = request->inittriggerstimphase();
+        parameters.isTargetPhaseSet = request->has_targetphase();
+        parameters.targetPhase = request->targetphase();
+        if (!deviceDirectory[request->deviceaddress()]->listener->updateClosedLoopController(request->controllerid(), parameters))
+        {
+            return grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, "Closed-loop controller not enabled");
+        }
+
+        // Respond to client
+        return grpc::Status::OK;
+    }
+
+    grpc::Status BICDeviceGRPCService::bicLoadControllerPlugin(grpc::ServerContext* context, const BICgRPC::bicLoadControllerPluginRequest* request, BICgRPC::bicLoadControllerPluginReply* reply)
+    {
+        // Check if already initialized
+        if (deviceDirectory.find(request->deviceaddress()) == deviceDirectory.end())
+        {
+            return grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, "Not Initialized");
+        }
+
+        // Check if parameters are valid, controller 0 always holds the default phase controller
+        if (request->controllerid() == 0 || request->controllerid() >= MAX_CLOSED_LOOP_CONTROLLERS)
+        {
+            return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "Controller ID out of range");
+        }
+        BICDeviceInfoStruct* theDevice = deviceDirectory[request->deviceaddress()];
+
+        // Unload request
+        if (!request->enable())
+        {
+            if (!theDevice->listener->detachBlockController(request->controllerid(), BLOCK_CONTROLLER_PLUGIN))
+            {
+                return grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, "No plugin loaded for this controller");
+            }
+            return grpc::Status::OK;
+        }
+
+        // A running stimulation sequence owns the device's stimulation
+        if (theDevice->isSequenceRunning)
+        {
+            return grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, "Stimulation sequence running");
+        }
+
+        // Plugins run arbitrary code in the server, so they are only loaded from the directory the operator named on the command line
+        if (controllerPluginDirectory.empty())
+        {
+            return grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, "Controller plugins disabled, start the server with --plugin-dir");
+        }
+        std::string libraryPath;
+        std::string errorMessage;
+        if (!PluginBlockController::resolveLibraryPath(controllerPluginDirectory, request->librarypath(), &libraryPath, &errorMessage))
+        {
+            return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, errorMessage);
+        }
+
+        // Load the library and create the controller before touching the listener
+        PluginBlockController* thePlugin = PluginBlockController::load(libraryPath, request->config(), (double)theDevice->theImplantInfo->getSamplingRate(), &errorMessage);
+        if (thePlugin == NULL)
+        {
+            std::cout << "ERROR: Could not load controller plugin " << libraryPath << ": " << errorMessage << std::endl;
+            return grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, errorMessage);
+        }
+        reply->set_pluginname(thePlugin->getName());
+        reply->set_abiversion(thePlugin->getAbiVersion());
+        for (const std::string& telemetryName : thePlugin->getTelemetryNames())
+        {
+            reply->add_telemetrynames(telemetryName);
+        }
+
+        // With preloaded stimulation functions the plugin starts its own function by default, otherwise the current stimulation command
+        int64_t stimFunctionIndex = NO_STIM_FUNCTION_INDEX;
+        if (theDevice->lastEnqueueType == StimulationMode::STIM_MODE_PERSISTENT_FUNC_PRELOADING)
+        {
+            stimFunctionIndex = request->triggeredfunctionindex();
+        }
+
+        // Perform the operation
+        if (!theDevice->listener->attachBlockController(request->controllerid(), thePlugin, stimFunctionIndex, (TriggerWaitMode)request->triggerwaitmode(), request->triggerspinmicroseconds()))
+        {
+            delete thePlugin;
+            return grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, "Controller ID in use or stimulation busy");
+        }
+
+        // Respond to client
+        return grpc::Status::OK;
+    }
+
+    grpc::Status BICDeviceGRPCService::bicSetDspPipeline(grpc::ServerContext* context, const BICgRPC::bicSetDspPipelineRequest* request, BICgRPC::bicSetDspPipelineReply* reply)
+    {
+        // Check if already initialized
+        if (deviceDirectory.find(request->deviceaddress()) == deviceDirectory.end())
+        {
+            return grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, "Not Initialized");
+        }
+
+        // Check if parameters are valid, controller 0 always holds the default phase controller
+        if (request->controllerid() == 0 || request->controllerid() >= MAX_CLOSED_LOOP_CONTROLLERS)
+        {
+            return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "Controller ID out of range");
+        }
+        BICDeviceInfoStruct* theDevice = deviceDirectory[request->deviceaddress()];
+
+        // Removal request
+        if (!request->enable())
+        {
+            if (!theDevice->listener->detachBlockController(request->controllerid(), BLOCK_CONTROLLER_DSP_PIPELINE))
+            {
+                return grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, "No pipeline running on this controller");
+            }
+            return grpc::Status::OK;
+        }
+
+        // A running stimulation sequence owns the device's stimulation
+        if (theDevice->isSequenceRunning)
+        {
+            return grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, "Stimulation sequence running");
+        }
+
+        // Compile the pipeline once, before touching the listener
+        if (request->pipeline().sensingchannel() > 31)
+        {
+            return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "Arguments out of range");
+        }
+        std::string errorMessage;
+        DspPipeline* thePipeline = DspPipeline::compile(buildPipelineConfig(request->pipeline()), (double)theDevice->theImplantInfo->getSamplingRate(), &errorMessage);
+        if (thePipeline == NULL)
+        {
+            return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, errorMessage);
+        }
+        for (const std::string& telemetryName : thePipeline->getTelemetryNames())
+        {
+            reply->add_telemetrynames(telemetryName);
+        }
+
+        // With preloaded stimulation functions the pipeline starts its own function, otherwise the current stimulation command
+        int64_t stimFunctionIndex = NO_STIM_FUNCTION_INDEX;
+        if (theDevice->lastEnqueueType == StimulationMode::STIM_MODE_PERSISTENT_FUNC_PRELOADING)
+        {
+            stimFunctionIndex = request->triggeredfunctionindex();
+        }
+
+        // Perform the operation
+        if (!theDevice->listener->attachBlockController(request->controllerid(), thePipeline, stimFunctionIndex, (TriggerWaitMode)request->triggerwaitmode(), request->triggerspinmicroseconds()))
+        {
+            delete thePipeline;
+            return grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, "Controller ID in use or stimulation busy");
+        }
+
+        // Respond to client
+        return grpc::Status::OK;
+    }
+
+    grpc::Status BICDeviceGRPCService::bicEnableTriggerInputController(grpc::ServerContext* context, const BICgRPC::triggerInputControllerEnableRequest* request, BICgRPC::bicSuccessReply* reply)
+    {
+        // Check if already initialized
+        if (deviceDirectory.find(request->deviceaddress()) == deviceDirectory.end())
+        {
+            return grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, "Not Initialized");
+        }
+
+        // Check if parameters are valid, controller 0 always holds the default phase controller
+        if (request->controllerid() == 0 || request->controllerid() >= MAX_CLOSED_LOOP_CONTROLLERS)
+        {
+            return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "Controller ID out of range");
+        }
+        BICDeviceInfoStruct* theDevice = deviceDirectory[request->deviceaddress()];
+
+        // Removal request
+        if (!request->enable())
+        {
+            if (!theDevice->listener->detachBlockController(request->controllerid(), BLOCK_CONTROLLER_TRIGGER_INPUT))
+            {
+                return grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, "No trigger input controller running on this controller");
+            }
+            return grpc::Status::OK;
+        }
+
+        // A running stimulation sequence owns the device's stimulation
+        if (theDevice->isSequenceRunning)
         {
-            coefficients_B.push_back(request->filtercoefficients_b()[i]);
+            return grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, "Stimulation sequence running");
         }
-        for (int i = 0; i < request->filtercoefficients_a_size(); i++)
+
+        // With preloaded stimulation functions the controller starts its own function, otherwise the current stimulation command
+        int64_t stimFunctionIndex = NO_STIM_FUNCTION_INDEX;
+        if (theDevice->lastEnqueueType == StimulationMode::STIM_MODE_PERSISTENT_FUNC_PRELOADING)
         {
-            coefficients_A.push_back(request->filtercoefficients_a()[i]);
+            stimFunctionIndex = request->triggeredfunctionindex();
         }
 
         // Perform the operation
-        deviceDirectory[request->deviceaddress()]->listener->enableDistributedStim(request->enable(), request->sensingchannel(), coefficients_B, coefficients_A, request->triggeredfunctionindex(), request->triggerstimthreshold(), request->inittriggerstimphase(), request->targetphase());
+        TriggerInputController* theController = new TriggerInputController((TriggerInputEdge)request->edge(), request->delaymicroseconds(), request->holdoffsamples());
+        if (!theDevice->listener->attachBlockController(request->controllerid(), theController, stimFunctionIndex, (TriggerWaitMode)request->triggerwaitmode(), request->triggerspinmicroseconds()))
+        {
+            delete theController;
+            return grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, "Controller ID in use or stimulation busy");
+        }
 
         // Respond to client
         return grpc::Status::OK;
@@ -818,10 +1939,42 @@ namespace BICGRPCHelperNamespace
             return grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, "Not Initialized");
         }
 
+        // A running stimulation sequence owns the device's stimulation
+        if (request->enable() && deviceDirectory[request->deviceaddress()]->isSequenceRunning)
+        {
+            return grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, "Stimulation sequence running");
+        }
+
+        // Perform the operation
+        deviceDirectory[request->deviceaddress()]->listener->enableOpenLoopStim(request->enable(), request->watchdoginterval(), request->targetratehz());
+
+        // Respond to client
+        return grpc::Status::OK;
+    }
+
+    grpc::Status BICDeviceGRPCService::bicGetOpenLoopJitter(grpc::ServerContext* context, const BICgRPC::RequestDeviceAddress* request, BICgRPC::openLoopJitterReply* reply)
+    {
+        // Check if already initialized
+        if (deviceDirectory.find(request->deviceaddress()) == deviceDirectory.end())
+        {
+            return grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, "Not Initialized");
+        }
+
         // Perform the operation
-        deviceDirectory[request->deviceaddress()]->listener->enableOpenLoopStim(request->enable(), request->watchdoginterval());
+        OpenLoopJitterStats stats;
+        if (!deviceDirectory[request->deviceaddress()]->listener->getOpenLoopJitterStats(&stats))
+        {
+            return grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, "Open loop stimulation not running");
+        }
 
         // Respond to client
+        reply->set_periodns(stats.periodNs);
+        reply->set_issuedperiods(stats.issuedPeriods);
+        reply->set_missedperiods(stats.missedPeriods);
+        reply->set_busyretries(stats.busyRetries);
+        reply->set_meanerrorns(stats.meanErrorNs);
+        reply->set_stddeverrorns(stats.stdDevErrorNs);
+        reply->set_maxerrorns(stats.maxErrorNs);
         return grpc::Status::OK;
     }
 }
\ No newline at end of file
@@ -9,6 +9,9 @@
 
 #include "BICgRPC.grpc.pb.h"
 #include "BICDeviceInfoStruct.h"
+#include "DspPipeline.h"
+#include "StimulationSequence.h"
+#include "TriggerInputController.h"
 
 namespace BICGRPCHelperNamespace
 {
@@ -20,12 +23,26 @@ namespace BICGRPCHelperNamespace
         std::vector<std::unique_ptr<BICDeviceInfoStruct>> theImplants;
         std::unordered_map<std::string, BICDeviceInfoStruct*> deviceDirectory;
         std::mutex rpcServiceLock;
+        std::chrono::milliseconds telemetryMaxAge{ 0 };    // Temperature and humidity reads are answered from values no older than this, 0 to always read the device
+        std::string controllerPluginDirectory;             // Directory controller plugins are loaded from, empty to refuse plugin loading
 
         // ************************* Non-GRPC Helper Service Function Declarations *************************
         void passFactory(cortec::implantapi::IImplantFactory* serverFactory);
 
         void controlDispose();
 
+        grpc::Status validateDistributedStimRequest(const BICgRPC::distributedStimEnableRequest* request);
+
+        ClosedLoopControllerConfig buildControllerConfig(const BICgRPC::distributedStimEnableRequest* request, double samplingRate);
+
+        DspPipelineConfig buildPipelineConfig(const BICgRPC::DspPipeline& pipeline);
+
+        std::shared_ptr<cortec::implantapi::IStimulationCommand> getCachedStimulationCommand(BICDeviceInfoStruct* theDevice, const google::protobuf::RepeatedPtrField<BICgRPC::StimulationFunctionDefinition>& functions, uint32_t repetitions, uint64_t* commandKey, std::string* canonicalDefinition);
+
+        cortec::implantapi::IStimulationCommand* buildStimulationCommand(cortec::implantapi::IStimulationCommandFactory* theFactory, const google::protobuf::RepeatedPtrField<BICgRPC::StimulationFunctionDefinition>& functions, uint32_t repetitions);
+
+        grpc::Status runNeuralStream(const BICgRPC::bicNeuralSetStreamingEnable* request, grpc::ServerWriter<BICgRPC::NeuralUpdate>* writer, grpc::ServerWriter<BICgRPC::NeuralBlockUpdate>* blockWriter);
+
         // ************************* Construction, Initialization, and Destruction Function Declarations *************************
         grpc::Status ScanDevices(grpc::ServerContext* context, const BICgRPC::ScanDevicesRequest* request, BICgRPC::ScanDevicesReply* reply) override;
 
@@ -45,6 +62,7 @@ namespace BICGRPCHelperNamespace
         grpc::Status bicSetImplantPower(grpc::ServerContext* context, const BICgRPC::bicSetImplantPowerRequest* request, BICgRPC::bicSuccessReply* reply) override;
 
         grpc::Status bicGetIsStimulating(grpc::ServerContext* context, const BICgRPC::bicGetIsStimulatingRequest* request, BICgRPC::bicGetIsStimulatingReply* reply) override;
+        grpc::Status bicGetDeviceSnapshot(grpc::ServerContext* context, const BICgRPC::RequestDeviceAddress* request, BICgRPC::bicGetDeviceSnapshotReply* reply) override;
 
         // ************************* Streaming Control Function Declarations *************************
         grpc::Status bicTemperatureStream(grpc::ServerContext* context, const BICgRPC::bicSetStreamEnable* request, grpc::ServerWriter<BICgRPC::TemperatureUpdate>* writer) override;
@@ -54,11 +72,19 @@ namespace BICGRPCHelperNamespace
         grpc::Status bicConnectionStream(grpc::ServerContext* context, const BICgRPC::bicSetStreamEnable* request, grpc::ServerWriter<BICgRPC::ConnectionUpdate>* writer) override;
 
         grpc::Status bicErrorStream(grpc::ServerContext* context, const BICgRPC::bicSetStreamEnable* request, grpc::ServerWriter<BICgRPC::ErrorUpdate>* writer) override;
+        grpc::Status bicTelemetryStream(grpc::ServerContext* context, const BICgRPC::bicTelemetryStreamRequest* request, grpc::ServerWriter<BICgRPC::TelemetryUpdate>* writer) override;
 
         grpc::Status bicPowerStream(grpc::ServerContext* context, const BICgRPC::bicSetStreamEnable* request, grpc::ServerWriter<BICgRPC::PowerUpdate>* writer) override;
 
+        grpc::Status bicShadowEvaluationStream(grpc::ServerContext* context, const BICgRPC::bicShadowEvaluationRequest* request, grpc::ServerWriter<BICgRPC::ShadowEvaluationUpdate>* writer) override;
+        grpc::Status ExecuteStimulationSequence(grpc::ServerContext* context, const BICgRPC::stimulationSequenceRequest* request, grpc::ServerWriter<BICgRPC::StimulationTrialUpdate>* writer) override;
+        grpc::Status bicImpedanceSweep(grpc::ServerContext* context, const BICgRPC::bicImpedanceSweepRequest* request, grpc::ServerWriter<BICgRPC::ImpedanceSweepUpdate>* writer) override;
+        grpc::Status WatchStimulationState(grpc::ServerContext* context, const BICgRPC::bicSetStreamEnable* request, grpc::ServerWriter<BICgRPC::StimulationStateUpdate>* writer) override;
+
         grpc::Status bicNeuralStream(grpc::ServerContext* context, const BICgRPC::bicNeuralSetStreamingEnable* request, grpc::ServerWriter<BICgRPC::NeuralUpdate>* writer) override;
 
+        grpc::Status bicNeuralBlockStream(grpc::ServerContext* context, const BICgRPC::bicNeuralSetStreamingEnable* request, grpc::ServerWriter<BICgRPC::NeuralBlockUpdate>* writer) override;
+
           // ************************* Stimulation Control Function Declarations *************************
         grpc::Status bicStartStimulation(grpc::ServerContext* context, const BICgRPC::bicStartStimulationRequest* request, BICgRPC::bicSuccessReply* reply) override;
 
@@ -68,6 +94,20 @@ namespace BICGRPCHelperNamespace
 
         grpc::Status enableDistributedStimulation(grpc::ServerContext* context, const BICgRPC::distributedStimEnableRequest* request, BICgRPC::bicSuccessReply* reply) override;
 
+        grpc::Status enableClosedLoopController(grpc::ServerContext* context, const BICgRPC::closedLoopControllerEnableRequest* request, BICgRPC::bicSuccessReply* reply) override;
+
+        grpc::Status UpdateDistributedStimParameters(grpc::ServerContext* context, const BICgRPC::distributedStimParameterUpdate* request, BICgRPC::bicSuccessReply* reply) override;
+
+        grpc::Status bicLoadControllerPlugin(grpc::ServerContext* context, const BICgRPC::bicLoadControllerPluginRequest* request, BICgRPC::bicLoadControllerPluginReply* reply) override;
+
+        grpc::Status bicSetDspPipeline(grpc::ServerContext* context, const BICgRPC::bicSetDspPipelineRequest* request, BICgRPC::bicSetDspPipelineReply* reply) override;
+
+        grpc::Status bicEnableTriggerInputController(grpc::ServerContext* context, const BICgRPC::triggerInputControllerEnableRequest* request, BICgRPC::bicSuccessReply* reply) override;
+
         grpc::Status enableOpenLoopStimulation(grpc::ServerContext* context, const BICgRPC::openLoopStimEnableRequest* request, BICgRPC::bicSuccessReply* reply) override;
+
+        grpc::Status bicGetStimulationCommandCache(grpc::ServerContext* context, const BICgRPC::RequestDeviceAddress* request, BICgRPC::stimulationCommandCacheReply* reply) override;
+
+        grpc::Status bicGetOpenLoopJitter(grpc::ServerContext* context, const BICgRPC::RequestDeviceAddress* request, BICgRPC::openLoopJitterReply* reply) override;
     };
 }
@@ -4,6 +4,8 @@
 #include <cppapi/IImplant.h>
 #include <string>
 #include "BICListener.h"
+#include "ImpedanceCache.h"
+#include "StimulationCommandCache.h"
 
 namespace BICGRPCHelperNamespace {
     struct BICDeviceInfoStruct
@@ -15,6 +17,12 @@ namespace BICGRPCHelperNamespace {
         
         // Stimulation-related objects
         cortec::implantapi::StimulationMode lastEnqueueType;
+        uint64_t lastEnqueuedCommandKey = 0;                // Command cache key of the last enqueued command, 0 if unknown
+        std::string lastEnqueuedDefinition;                 // Canonical definition of the last enqueued command, compared with the key before skipping an enqueue
+        StimulationCommandCache commandCache;               // Built stimulation commands of this device
+
+        // Sensing-related objects
+        ImpedanceCache impedanceCache;                      // Latest impedance of each channel
         std::uint32_t openLoopWatchdogInterval;
 
         // BIC Device-specific Objects
@@ -29,6 +37,8 @@ namespace BICGRPCHelperNamespace {
         std::mutex connectionStreamLock;
         std::mutex errorStreamLock;
         std::mutex powerStreamLock;
+        std::mutex shadowStreamLock;
+        std::mutex sequenceLock;
 
         // Stream notify variables
         std::condition_variable tempStreamNotify;
@@ -37,5 +47,11 @@ namespace BICGRPCHelperNamespace {
         std::condition_variable connectionStreamNotify;
         std::condition_variable errorStreamNotify;
         std::condition_variable powerStreamNotify;
+        std::condition_variable shadowStreamNotify;
+        std::condition_variable sequenceNotify;
+        bool isShadowStreamStopRequested = false;      // Written under shadowStreamLock and set with shadowStreamNotify, the shadow stream also wakes periodically to report
+        std::atomic<uint64_t> stimStateStreamStopGeneration{ 0 };  // Advanced before waking the listener's stimulation state notifier, stops the watchers started before it
+        std::atomic<bool> isSequenceRunning{ false };               // A stimulation sequence owns the device's stimulation
+        std::atomic<bool> isSequenceStopRequested{ false };         // Set with sequenceNotify and a wake of the stimulation state notifier
     };
 }
\ No newline at end of file
@@ -1,9 +1,12 @@
 #include "BICListener.h"
+#include "ThreadRoleRegistry.h"
 #include <thread>
 #include <iostream>
 #include <chrono>
 #include <ctime>
 #include <fstream>
+#include <cmath>
+#include <functional>
 
 // #define to enable onData console events
 //#define DEBUG_CONSOLE_ENABLE;
@@ -18,10 +21,14 @@ using BICgRPC::NeuralUpdate;
 using BICgRPC::PowerUpdate;
 using BICgRPC::ConnectionUpdate;
 using BICgRPC::ErrorUpdate;
+using BICgRPC::TelemetryUpdate;
 using BICgRPC::NeuralSample;
 
 namespace BICGRPCHelperNamespace
 {
+    // Time a queued stimulation waits for others to be written to the stim time log with it
+    static const std::chrono::milliseconds STIM_TIME_LOG_BATCH_DELAY(100);
+
     //*************************************************** Device State Event Handlers ***************************************************
     /// <summary>
     /// Event Handler for Brain Interchange stimulation state change events
@@ -32,11 +39,18 @@ namespace BICGRPCHelperNamespace
         // Write Event Information to Console
         std::cout << "\tSTATE CHANGE: Stimulation state changed: " << isStimulating << std::endl;
 
-        // Grab a local-scoped lock before updating multi-threaded accessable state variables
-        std::lock_guard<std::mutex> lock(m_mutex);
+        // Update the value under a local-scoped lock before any waiter is woken
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_isStimulating = isStimulating;
+        }
 
-        // Update the value, local-scoped locked is released at end of function
-        m_isStimulating = isStimulating;
+        // Wake threads and streams waiting for the change, and let open-loop stimulation restart as soon as the previous one ends
+        stimStateNotifier.publish(isStimulating);
+        if (!isStimulating && isOLStimEn)
+        {
+            OpenLoopScheduler::instance().wake(openLoopScheduleId);
+        }
     }
 
     /// <summary>
@@ -106,6 +120,20 @@ namespace BICGRPCHelperNamespace
         const uint16_t radioCrcErrors, const uint16_t otherRxErrors,
         const uint32_t rxQueueOverflows, const uint32_t txQueueOverflows)
     {
+        // Keep the report for status snapshots
+        {
+            std::lock_guard<std::mutex> lock(m_statusLock);
+            rfQuality.isKnown = true;
+            rfQuality.antennaQualitydBm = antennaQualitydBm;
+            rfQuality.validFramesReceived = validFramesReceived;
+            rfQuality.invalidHandshake = invalidHandshake;
+            rfQuality.radioCrcErrors = radioCrcErrors;
+            rfQuality.otherRxErrors = otherRxErrors;
+            rfQuality.rxQueueOverflows = rxQueueOverflows;
+            rfQuality.txQueueOverflows = txQueueOverflows;
+            rfQuality.timeStamp = std::chrono::system_clock::now().time_since_epoch().count();
+        }
+
         // Write Event Information to Console
         std::cout << "\tSTATE CHANGE: Rf Quality Update: " << antennaQualitydBm << "dBm" << std::endl;
     }
@@ -116,6 +144,12 @@ namespace BICGRPCHelperNamespace
     /// <param name="rfChannel"></param>
     void BICListener::onChannelUpdate(const uint8_t rfChannel)
     {
+        // Keep the channel for status snapshots
+        {
+            std::lock_guard<std::mutex> lock(m_statusLock);
+            rfQuality.rfChannel = rfChannel;
+        }
+
         // Write Event Information to Console
         std::cout << "\tSTATE CHANGE: Rf Channel Update: " << rfChannel << std::endl;
     }
@@ -140,7 +174,7 @@ namespace BICGRPCHelperNamespace
     /// <summary>
     /// Enable or disable connection streaming to a gRPC client. 
     /// Function instructs BIC to start streaming, resulting in data being received by various connection event handler functions.  
-    /// Events puts data in a queue for independent transmission to client by thread utilizing "grpcConnectionStreamThread" function.
+    /// Events puts data in a queue for independent transmission to client by the "drainConnectionQueue" task on the shared executor.
     /// </summary>
     /// <param name="enableSensing">True if streaming is being requested to be enabled, false otherwise</param>
     /// <param name="aWriter">gRPC client writing inteface.</param>
@@ -155,62 +189,41 @@ namespace BICGRPCHelperNamespace
             // Prepare to stream connection data
             connectionStreamingState = true;
             connectionWriter = aWriter;
-            connectionDataNotify = new std::condition_variable();
-            connectionProcessingThread = new std::thread(&BICListener::grpcConnectionStreamThread, this);
+            connectionDrain.open();
         }
         else if (!enableSensing && connectionStreamingState == true)
         {
-            // Shut down streaming. First notify and wait for streaming handling thread to stop.
+            // Shut down streaming. Wait for a drain in progress so the writer is not used after the stream ends.
             connectionStreamingState = false;
-            connectionDataNotify->notify_all();
-            connectionProcessingThread->join();
-
-            // Delete generated resources to free memory
-            connectionProcessingThread->~thread();
-            delete connectionProcessingThread;
-            connectionProcessingThread = NULL;
-
-            connectionDataNotify->~condition_variable();
-            delete connectionDataNotify;
-            connectionDataNotify = NULL;
+            connectionDrain.close();
         }
     }
 
     /// <summary>
-    /// Private function that reads connection data from queue and sends to gRPC client. Intended to be run as a thread by enableConnectionSensing.
+    /// Private function that writes queued connection data to the gRPC client. Run on the shared executor whenever data is queued.
     /// </summary>
-    void BICListener::grpcConnectionStreamThread()
+    void BICListener::drainConnectionQueue()
     {
-        // Prepare the waiting for data variables
-        std::mutex connectionDataLock;
-        std::unique_lock<std::mutex> connectionDataWait(connectionDataLock);
-
-        // Loop while streaming is active
-        while (connectionStreamingState)
+        while (connectionStreamingState && !connectionSampleQueue.empty())
         {
-            if (connectionSampleQueue.empty())
+            // Attempt to write the packet to the gRPC stream writer
+            try {
+                // WARNING - THIS WILL BLOCK IF WRITER BUFFER IS FULL DUE TO SLOW READING BY CLIENT
+                connectionWriter->Write(*connectionSampleQueue.front());
+            }
+            catch (std::exception& anyException)
             {
-                connectionDataNotify->wait(connectionDataWait);
+                std::cout << "GRPC Write Failed. Reason: " << anyException.what() << std::endl;
             }
-            else
+            catch (...)
             {
-                // Attempt to write the packet to the gRPC stream writer
-                try {
-                    // WARNING - THIS WILL BLOCK IF WRITER BUFFER IS FULL DUE TO SLOW READING BY CLIENT
-                    connectionWriter->Write(*connectionSampleQueue.front());
-
-                    // Clean up the current sample from the list
-                    connectionSampleQueue.pop();
-                }
-                catch (std::exception& anyException)
-                {
-                    std::cout << "GRPC Write Failed. Reason: " << anyException.what() << std::endl;
-                }
-                catch (...)
-                {
-                    std::cout << "GRPC Write Buffer Failed. No reason." << std::endl;
-                }
+                std::cout << "GRPC Write Buffer Failed. No reason." << std::endl;
             }
+
+            // Clean up the current sample from the list, a failed write is not retried
+            delete connectionSampleQueue.front();
+            connectionSampleQueue.pop();
+            streamQueued[STATUS_STREAM_CONNECTION]--;
         }
     }
 
@@ -225,6 +238,14 @@ namespace BICGRPCHelperNamespace
         {
             // Event refers to PC/External USB connection
             const bool isConnected = info.at(ConnectionType::PC_TO_EXT) == ConnectionState::CONNECTED;
+            recordConnection(&usbConnection, isConnected);
+            if (telemetryStreamingState)
+            {
+                TelemetryUpdate* telemetryMessage = new TelemetryUpdate();
+                telemetryMessage->mutable_connection()->set_connectiontype("USB");
+                telemetryMessage->mutable_connection()->set_isconnected(isConnected);
+                publishTelemetry(TELEMETRY_SOURCE_USB_CONNECTION, telemetryMessage);
+            }
 
             // Write out new state to the console
             std::cout << "*** Connection state from PC to external unit changed: "
@@ -238,14 +259,16 @@ namespace BICGRPCHelperNamespace
                 connectionMessage->set_isconnected(isConnected);
 
                 // Add it to the buffer if there is room
-                if (connectionSampleQueue.size() < 100)
+                if (streamQueued[STATUS_STREAM_CONNECTION] < 100)
                 {
+                    streamQueued[STATUS_STREAM_CONNECTION]++;
                     connectionSampleQueue.push(connectionMessage);
-                    connectionDataNotify->notify_all();
+                    connectionDrain.signal();
                 }
                 else
                 {
                     delete connectionMessage;
+                    streamDrops[STATUS_STREAM_CONNECTION]++;
                     std::cout << "GRPC Connection Queue Size Overflow, streaming data skipped" << std::endl;
                 }
             }
@@ -254,6 +277,14 @@ namespace BICGRPCHelperNamespace
         {
             // Event refers to External/INS inductive connection
             const bool isConnected = info.at(ConnectionType::EXT_TO_IMPLANT) == ConnectionState::CONNECTED;
+            recordConnection(&inductiveConnection, isConnected);
+            if (telemetryStreamingState)
+            {
+                TelemetryUpdate* telemetryMessage = new TelemetryUpdate();
+                telemetryMessage->mutable_connection()->set_connectiontype("Inductive");
+                telemetryMessage->mutable_connection()->set_isconnected(isConnected);
+                publishTelemetry(TELEMETRY_SOURCE_INDUCTIVE_CONNECTION, telemetryMessage);
+            }
 
             // Write out new state to the console
             std::cout << "*** Connection state from external unit to implant changed: "
@@ -267,14 +298,16 @@ namespace BICGRPCHelperNamespace
                 connectionMessage->set_isconnected(isConnected);
 
                 // Add it to the buffer if there is room
-                if (connectionSampleQueue.size() < 100)
+                if (streamQueued[STATUS_STREAM_CONNECTION] < 100)
                 {
+                    streamQueued[STATUS_STREAM_CONNECTION]++;
                     connectionSampleQueue.push(connectionMessage);
-                    connectionDataNotify->notify_all();
+                    connectionDrain.signal();
                 }
                 else
                 {
                     delete connectionMessage;
+                    streamDrops[STATUS_STREAM_CONNECTION]++;
                     std::cout << "GRPC Connection Queue Size Overflow, streaming data skipped" << std::endl;
                 }
             }
@@ -287,6 +320,15 @@ namespace BICGRPCHelperNamespace
     /// <param name="isConnected">Boolean indicating if it is connected or not</param>
     void BICListener::onConnectionStateChanged(const bool isConnected)
     {
+        recordConnection(&overallConnection, isConnected);
+        if (telemetryStreamingState)
+        {
+            TelemetryUpdate* telemetryMessage = new TelemetryUpdate();
+            telemetryMessage->mutable_connection()->set_connectiontype("Overall");
+            telemetryMessage->mutable_connection()->set_isconnected(isConnected);
+            publishTelemetry(TELEMETRY_SOURCE_OVERALL_CONNECTION, telemetryMessage);
+        }
+
         // If gRPC connection streaming is enabled, write out the update
         if (connectionStreamingState)
         {
@@ -295,14 +337,16 @@ namespace BICGRPCHelperNamespace
             connectionMessage->set_isconnected(isConnected);
 
             // Add it to the buffer if there is room
-            if (connectionSampleQueue.size() < 100)
+            if (streamQueued[STATUS_STREAM_CONNECTION] < 100)
             {
+                streamQueued[STATUS_STREAM_CONNECTION]++;
                 connectionSampleQueue.push(connectionMessage);
-                connectionDataNotify->notify_all();
+                connectionDrain.signal();
             }
             else
             {
                 delete connectionMessage;
+                streamDrops[STATUS_STREAM_CONNECTION]++;
                 std::cout << "GRPC Connection Queue Size Overflow, streaming data skipped" << std::endl;
             }
         }
@@ -317,8 +361,13 @@ namespace BICGRPCHelperNamespace
     /// <param name="enableSensing">True if streaming is being requested to be enabled, false otherwise</param>
     /// <param name="dataBufferSize">Size of buffered data packets to be returned to gRPC client</param>
     /// <param name="interplationThreshold">The maximum number of data points to interpolate between lost data points</param>
-    /// <param name="aWriter">gRPC client writing inteface.</param>
-    void BICListener::enableNeuralStreaming(bool enableSensing, uint32_t dataBufferSize, uint32_t interplationThreshold, grpc::ServerWriter<BICgRPC::NeuralUpdate>* aWriter)
+    /// <param name="interpolationMethod">Method used to synthesize lost data points</param>
+    /// <param name="gapHandling">Whether lost data points are streamed as interpolated samples or as gap markers</param>
+    /// <param name="dspOutputs">DspOutputs bitmask of closed-loop processing outputs to include in each streamed sample</param>
+    /// <param name="samplingRate">Device sampling rate, reported in NeuralBlockUpdate headers</param>
+    /// <param name="aWriter">gRPC client writing inteface for per-sample NeuralUpdate messages, or NULL.</param>
+    /// <param name="aBlockWriter">gRPC client writing inteface for columnar NeuralBlockUpdate messages, or NULL. Used instead of aWriter when set.</param>
+    void BICListener::enableNeuralStreaming(bool enableSensing, uint32_t dataBufferSize, uint32_t interplationThreshold, InterpolationMethod interpolationMethod, GapHandlingMode gapHandling, uint32_t dspOutputs, double samplingRate, grpc::ServerWriter<BICgRPC::NeuralUpdate>* aWriter, grpc::ServerWriter<BICgRPC::NeuralBlockUpdate>* aBlockWriter)
     {
         // Accessing streaming state objects, grab the mutex for protection against multi-threaded race conditions
         std::lock_guard<std::mutex> lock(m_mutex);
@@ -329,8 +378,18 @@ namespace BICGRPCHelperNamespace
             // Prepare to stream neural data
             neuralStreamingState = true;
             neuroDataBufferThreshold = dataBufferSize;
-            neuroInterplationThreshold = interplationThreshold;
+            {
+                std::lock_guard<std::mutex> interpolatorLock(m_interpolatorLock);
+                neuralInterpolator.configure(interpolationMethod, interplationThreshold);
+                neuralInterpolator.resetSession(0);
+            }
+            neuralGapHandling = gapHandling;
+            neuralDspOutputs = dspOutputs;
+            neuralSamplingRate = samplingRate;
+            neuralBlockHasHistory = false;
+            neuralBlockPendingFilledGap = false;
             neuralWriter = aWriter;
+            neuralBlockWriter = aBlockWriter;
             neuralDataNotify = new std::condition_variable();
             neuralProcessingThread = new std::thread (&BICListener::grpcNeuralStreamThread, this);
         }
@@ -341,6 +400,11 @@ namespace BICGRPCHelperNamespace
             neuralDataNotify->notify_all();
             neuralProcessingThread->join();
 
+            // No subscriber remains for the closed-loop processing outputs
+            neuralDspOutputs = DSP_OUTPUT_NONE;
+            neuralWriter = NULL;
+            neuralBlockWriter = NULL;
+
             // Delete generated resources to free memory
             neuralProcessingThread->~thread();
             delete neuralProcessingThread;
@@ -349,16 +413,64 @@ namespace BICGRPCHelperNamespace
             neuralDataNotify->~condition_variable();
             delete neuralDataNotify;
             neuralDataNotify = NULL;
+
+            // Drop any blocks that were not transmitted before the stream closed
+            this->m_neuroBufferLock.lock();
+            while (!neuralSampleQueue.empty())
+            {
+                delete neuralSampleQueue.front();
+                neuralSampleQueue.pop();
+                streamQueued[STATUS_STREAM_NEURAL]--;
+            }
+            neuralQueuedSampleCount = 0;
+            this->m_neuroBufferLock.unlock();
+
+            // Report the session's gap statistics
+            InterpolationStatistics gapStats = getInterpolationStatistics();
+            std::cout << "STREAM INFO: Neural session interpolated " << gapStats.interpolatedSamples << " samples over " << gapStats.gapsFilled << " gaps, "
+                << gapStats.gapsDropped << " gaps (" << gapStats.droppedSamples << " samples) exceeded the interpolation limit, longest gap " << gapStats.longestGap << " samples." << std::endl;
+            std::cout << "STREAM INFO: Gap length histogram (1, 2, 3-4, 5-8, 9-16, 17-32, 33-64, 65+):";
+            for (size_t binIndex = 0; binIndex < gapStats.gapLengthHistogram.size(); binIndex++)
+            {
+                std::cout << " " << gapStats.gapLengthHistogram[binIndex];
+            }
+            std::cout << std::endl;
         }
     }
 
+    /// <summary>
+    /// Accessor for the per-sample cost of controller 0's phase estimator
+    /// </summary>
+    /// <returns>Copy of the estimator cost, empty if no estimator has run yet</returns>
+    PhaseEstimatorCost BICListener::getPhaseEstimatorCost()
+    {
+        std::lock_guard<std::mutex> lock(m_controllerLock);
+        IPhaseEstimator* theEstimator = controllers[0] != NULL ? controllers[0]->getPhaseEstimator() : NULL;
+        return theEstimator != NULL ? theEstimator->getCost() : PhaseEstimatorCost();
+    }
+
+    /// <summary>
+    /// Accessor for the gap statistics of the current (or last) neural streaming session
+    /// </summary>
+    /// <returns>Copy of the interpolation statistics</returns>
+    InterpolationStatistics BICListener::getInterpolationStatistics()
+    {
+        std::lock_guard<std::mutex> interpolatorLock(m_interpolatorLock);
+        return neuralInterpolator.getStatistics();
+    }
+
     /// <summary>
     /// Private function that reads neural data from queue and sends to gRPC client. Intended to be run as a thread by enableNeuralSensing.
+    /// Sample blocks are converted to protobuf messages here, at the gRPC boundary.
     /// </summary>
     void BICListener::grpcNeuralStreamThread()
     {
+        // Apply the configured scheduling for this thread
+        ThreadRoleRegistry::instance().applyRole(THREAD_ROLE_STREAM_WRITER);
+
         // Create buffer objects for gRPC straming and interpolation
         BICgRPC::NeuralUpdate* bufferedNeuroUpdate = new BICgRPC::NeuralUpdate();
+        BICgRPC::NeuralBlockUpdate* bufferedBlockUpdate = new BICgRPC::NeuralBlockUpdate();
         std::mutex neuralDataLock;
         std::unique_lock<std::mutex> neuroDataWait(neuralDataLock);
 
@@ -371,15 +483,16 @@ namespace BICGRPCHelperNamespace
             }
             else
             {
+                SampleBlock* nextBlock = NULL;
                 try {
                     // Lock the neurobuffer
                     this->m_neuroBufferLock.lock();
 
-                    // Add the front item to the queue for the current packet
-                    bufferedNeuroUpdate->mutable_samples()->AddAllocated(neuralSampleQueue.front());
-
-                    // Clean up the current sample from the list
+                    // Take ownership of the front block of the queue
+                    nextBlock = neuralSampleQueue.front();
                     neuralSampleQueue.pop();
+                    streamQueued[STATUS_STREAM_NEURAL]--;
+                    neuralQueuedSampleCount -= nextBlock->size();
 
                     // Unlock the neurobuffer
                     this->m_neuroBufferLock.unlock();
@@ -393,32 +506,295 @@ namespace BICGRPCHelperNamespace
                     std::cout << "GRPC Read Buffer Failed. No reason." << std::endl;
                 }
 
-                // If enough data has been queued, send data
-                if (bufferedNeuroUpdate->samples().size() >= neuroDataBufferThreshold)
+                if (nextBlock == NULL)
+                {
+                    continue;
+                }
+
+                if (neuralBlockWriter != NULL)
                 {
-                    // Attempt to write the packet to the gRPC stream writer
-                    try {
-                        // WARNING - THIS WILL BLOCK IF NEURALWRITER BUFFER IS FULL DUE TO SLOW READING BY CLIENT
-                        neuralWriter->Write(*bufferedNeuroUpdate);
+                    // Columnar stream: a change of channel count cannot share a header, so send what has been buffered first
+                    if (bufferedBlockUpdate->header().numberofsamples() > 0 && bufferedBlockUpdate->header().numberofmeasurements() != nextBlock->channelCount())
+                    {
+                        writeNeuralBlockUpdate(bufferedBlockUpdate);
                     }
-                    catch (std::exception& anyException)
+
+                    // Serialize the whole block, send once enough samples have been buffered
+                    serializeNeuralBlock(*nextBlock, bufferedBlockUpdate);
+                    if (bufferedBlockUpdate->header().numberofsamples() >= (uint32_t)neuroDataBufferThreshold)
                     {
-                        std::cout << "GRPC Write Failed. Reason: " << anyException.what() << std::endl;
+                        writeNeuralBlockUpdate(bufferedBlockUpdate);
                     }
-                    catch (...)
+
+                    delete nextBlock;
+                    continue;
+                }
+
+                size_t nextGap = 0;
+                for (uint32_t sampleIndex = 0; sampleIndex < nextBlock->size(); sampleIndex++)
+                {
+                    // In gap marker mode, gaps are sent as markers and interpolated samples stay on the server
+                    if (neuralGapHandling == GAP_HANDLING_SEND_MARKERS)
                     {
-                        std::cout << "GRPC Write Buffer Failed. No reason." << std::endl;
+                        while (nextGap < nextBlock->gaps.size() && nextBlock->gaps[nextGap].sampleIndex <= sampleIndex)
+                        {
+                            BICgRPC::NeuralGap* aGap = bufferedNeuroUpdate->add_gaps();
+                            aGap->set_startsamplecounter(nextBlock->gaps[nextGap].startCounter);
+                            aGap->set_length(nextBlock->gaps[nextGap].length);
+                            aGap->set_isinterpolatedonserver(nextBlock->gaps[nextGap].isFilled);
+                            nextGap++;
+                        }
+                        if (nextBlock->hasFlag(sampleIndex, SAMPLE_FLAG_INTERPOLATED))
+                        {
+                            continue;
+                        }
                     }
 
-                    // Delete all elements in the buffer after transmission, freeing up memory.
-                    delete bufferedNeuroUpdate;
-                    bufferedNeuroUpdate = new BICgRPC::NeuralUpdate();
+                    // Serialize the sample into the current packet
+                    serializeNeuralSample(*nextBlock, sampleIndex, bufferedNeuroUpdate->add_samples());
+
+                    // If enough data has been queued, send data
+                    if (bufferedNeuroUpdate->samples().size() >= neuroDataBufferThreshold)
+                    {
+                        writeNeuralUpdate(bufferedNeuroUpdate);
+                    }
                 }
+
+                delete nextBlock;
             }
         }
 
-        // Clean up the buffer
+        // Clean up the buffers
         delete bufferedNeuroUpdate;
+        delete bufferedBlockUpdate;
+    }
+
+    /// <summary>
+    /// Private function that sends a buffered NeuralUpdate to the gRPC client and clears it for reuse
+    /// </summary>
+    /// <param name="anUpdate">Update to send</param>
+    void BICListener::writeNeuralUpdate(BICgRPC::NeuralUpdate* anUpdate)
+    {
+        // Attempt to write the packet to the gRPC stream writer
+        try {
+            // WARNING - THIS WILL BLOCK IF NEURALWRITER BUFFER IS FULL DUE TO SLOW READING BY CLIENT
+            neuralWriter->Write(*anUpdate);
+        }
+        catch (std::exception& anyException)
+        {
+            std::cout << "GRPC Write Failed. Reason: " << anyException.what() << std::endl;
+        }
+        catch (...)
+        {
+            std::cout << "GRPC Write Buffer Failed. No reason." << std::endl;
+        }
+
+        // Clear all elements in the buffer after transmission, keeping the allocated messages for reuse.
+        anUpdate->Clear();
+    }
+
+    /// <summary>
+    /// Private function that sends a buffered NeuralBlockUpdate to the gRPC client and clears it for reuse
+    /// </summary>
+    /// <param name="anUpdate">Update to send</param>
+    void BICListener::writeNeuralBlockUpdate(BICgRPC::NeuralBlockUpdate* anUpdate)
+    {
+        // Attempt to write the packet to the gRPC stream writer
+        try {
+            // WARNING - THIS WILL BLOCK IF NEURALWRITER BUFFER IS FULL DUE TO SLOW READING BY CLIENT
+            neuralBlockWriter->Write(*anUpdate);
+        }
+        catch (std::exception& anyException)
+        {
+            std::cout << "GRPC Write Failed. Reason: " << anyException.what() << std::endl;
+        }
+        catch (...)
+        {
+            std::cout << "GRPC Write Buffer Failed. No reason." << std::endl;
+        }
+
+        // Clear all elements in the buffer after transmission, keeping the allocated storage for reuse.
+        anUpdate->Clear();
+    }
+
+    /// <summary>
+    /// Private function that appends every sample of a sample block to a columnar NeuralBlockUpdate.
+    /// Counter discontinuities become gap entries, and slow-moving fields are only recorded when they change.
+    /// </summary>
+    /// <param name="theBlock">Block holding the samples</param>
+    /// <param name="anUpdate">Update to append to, may already hold samples from earlier blocks</param>
+    void BICListener::serializeNeuralBlock(const SampleBlock& theBlock, BICgRPC::NeuralBlockUpdate* anUpdate)
+    {
+        BICgRPC::NeuralBlockHeader* header = anUpdate->mutable_header();
+        uint32_t dspOutputs = neuralDspOutputs;
+        uint32_t numChannels = theBlock.channelCount();
+
+        for (uint32_t row = 0; row < theBlock.size(); row++)
+        {
+            // In gap marker mode, interpolated samples stay on the server and only show up as a gap entry
+            if (neuralGapHandling == GAP_HANDLING_SEND_MARKERS && theBlock.hasFlag(row, SAMPLE_FLAG_INTERPOLATED))
+            {
+                neuralBlockPendingFilledGap = true;
+                continue;
+            }
+
+            uint32_t updateIndex = header->numberofsamples();
+            uint32_t sampleCounter = theBlock.sampleCounter[row];
+
+            // Record any discontinuity in the sample counter since the last serialized sample
+            if (neuralBlockHasHistory && sampleCounter != neuralBlockNextCounter)
+            {
+                BICgRPC::NeuralGap* aGap = anUpdate->add_gaps();
+                aGap->set_startsamplecounter(neuralBlockNextCounter);
+                aGap->set_length(sampleCounter - neuralBlockNextCounter);
+                aGap->set_isinterpolatedonserver(neuralBlockPendingFilledGap);
+                aGap->set_sampleindex(updateIndex);
+            }
+            neuralBlockNextCounter = sampleCounter + 1;
+            neuralBlockHasHistory = true;
+            neuralBlockPendingFilledGap = false;
+
+            // The first sample of an update fills in the batch header
+            if (updateIndex == 0)
+            {
+                header->set_firstsamplecounter(sampleCounter);
+                header->set_numberofmeasurements(numChannels);
+                header->set_samplingrate(neuralSamplingRate);
+                if (dspOutputs != DSP_OUTPUT_NONE)
+                {
+                    header->set_filtchannel(theBlock.filtChannel);
+                }
+            }
+
+            // Measurements, gathered sample-major from the channel planes
+            for (uint32_t channelIndex = 0; channelIndex < numChannels; channelIndex++)
+            {
+                anUpdate->add_measurements(theBlock.measurement(channelIndex, row));
+            }
+
+            // Boolean states are sent as the packed flag column
+            uint32_t sampleFlags = theBlock.flags[row];
+            if (!(dspOutputs & DSP_OUTPUT_VALID_TARGET))
+            {
+                sampleFlags &= ~SAMPLE_FLAG_VALID_TARGET;
+            }
+            anUpdate->add_flags(sampleFlags);
+
+            // Slow-moving fields, recorded at the start of each update and whenever they change
+            if (updateIndex == 0 || anUpdate->timestamps(anUpdate->timestamps_size() - 1).value() != theBlock.timeStamp[row])
+            {
+                BICgRPC::NeuralIntegerChange* aChange = anUpdate->add_timestamps();
+                aChange->set_sampleindex(updateIndex);
+                aChange->set_value(theBlock.timeStamp[row]);
+            }
+            if (updateIndex == 0 || anUpdate->supplyvoltages(anUpdate->supplyvoltages_size() - 1).value() != theBlock.supplyVoltage[row])
+            {
+                BICgRPC::NeuralIntegerChange* aChange = anUpdate->add_supplyvoltages();
+                aChange->set_sampleindex(updateIndex);
+                aChange->set_value(theBlock.supplyVoltage[row]);
+            }
+            if (updateIndex == 0 || anUpdate->stimulationnumbers(anUpdate->stimulationnumbers_size() - 1).value() != theBlock.stimulationNumber[row])
+            {
+                BICgRPC::NeuralIntegerChange* aChange = anUpdate->add_stimulationnumbers();
+                aChange->set_sampleindex(updateIndex);
+                aChange->set_value(theBlock.stimulationNumber[row]);
+            }
+            if ((dspOutputs & DSP_OUTPUT_TRIGGER_PHASE) && (updateIndex == 0 || anUpdate->triggerphases(anUpdate->triggerphases_size() - 1).value() != theBlock.triggerPhase[row]))
+            {
+                BICgRPC::NeuralValueChange* aChange = anUpdate->add_triggerphases();
+                aChange->set_sampleindex(updateIndex);
+                aChange->set_value(theBlock.triggerPhase[row]);
+            }
+
+            // Optional closed-loop processing columns
+            if (dspOutputs & DSP_OUTPUT_FILT_SAMPLE)
+            {
+                anUpdate->add_filtsamples(theBlock.filtSample[row]);
+            }
+            if (dspOutputs & DSP_OUTPUT_PHASE)
+            {
+                anUpdate->add_phases(theBlock.phase[row]);
+            }
+            if (dspOutputs & DSP_OUTPUT_PRE_FILT_SAMPLE)
+            {
+                anUpdate->add_prefiltsamples(theBlock.preFiltSample[row]);
+            }
+            if (dspOutputs & DSP_OUTPUT_HAMPEL_FILT_SAMPLE)
+            {
+                anUpdate->add_hampelfiltsamples(theBlock.hampelFiltSample[row]);
+            }
+
+            header->set_numberofsamples(updateIndex + 1);
+        }
+
+        // Block controller telemetry applies to the last sample of the block
+        for (const ControllerTelemetry& theTelemetry : theBlock.controllerTelemetry)
+        {
+            BICgRPC::ControllerTelemetry* anEntry = anUpdate->add_controllertelemetry();
+            anEntry->set_controllerid(theTelemetry.controllerId);
+            anEntry->set_sampleindex(header->numberofsamples() > 0 ? header->numberofsamples() - 1 : 0);
+            for (double aValue : theTelemetry.values)
+            {
+                anEntry->add_values(aValue);
+            }
+        }
+    }
+
+    /// <summary>
+    /// Private function that copies one sample of a sample block into a gRPC NeuralSample message
+    /// </summary>
+    /// <param name="theBlock">Block holding the sample</param>
+    /// <param name="sampleIndex">Index of the sample within the block</param>
+    /// <param name="aSample">Message to populate</param>
+    void BICListener::serializeNeuralSample(const SampleBlock& theBlock, uint32_t sampleIndex, NeuralSample* aSample)
+    {
+        aSample->set_numberofmeasurements(theBlock.channelCount());
+        aSample->set_supplyvoltage(theBlock.supplyVoltage[sampleIndex]);
+        aSample->set_isconnected(theBlock.hasFlag(sampleIndex, SAMPLE_FLAG_CONNECTED));
+        aSample->set_stimulationnumber(theBlock.stimulationNumber[sampleIndex]);
+        aSample->set_stimulationactive(theBlock.hasFlag(sampleIndex, SAMPLE_FLAG_STIM_ACTIVE));
+        aSample->set_samplecounter(theBlock.sampleCounter[sampleIndex]);
+        aSample->set_isinterpolated(theBlock.hasFlag(sampleIndex, SAMPLE_FLAG_INTERPOLATED));
+        aSample->set_timestamp(theBlock.timeStamp[sampleIndex]);
+        aSample->set_isinputtrighigh(theBlock.hasFlag(sampleIndex, SAMPLE_FLAG_INPUT_TRIG_HIGH));
+
+        // Closed-loop processing outputs, only the ones requested by the subscriber are serialized
+        uint32_t dspOutputs = neuralDspOutputs;
+        if (dspOutputs != DSP_OUTPUT_NONE)
+        {
+            aSample->set_filtchannel(theBlock.filtChannel);
+        }
+        if (dspOutputs & DSP_OUTPUT_FILT_SAMPLE)
+        {
+            aSample->set_filtsample(theBlock.filtSample[sampleIndex]);
+        }
+        if (dspOutputs & DSP_OUTPUT_PHASE)
+        {
+            aSample->set_phase(theBlock.phase[sampleIndex]);
+        }
+        if (dspOutputs & DSP_OUTPUT_TRIGGER_PHASE)
+        {
+            aSample->set_triggerphase(theBlock.triggerPhase[sampleIndex]);
+        }
+        if (dspOutputs & DSP_OUTPUT_PRE_FILT_SAMPLE)
+        {
+            aSample->set_prefiltsample(theBlock.preFiltSample[sampleIndex]);
+        }
+        if (dspOutputs & DSP_OUTPUT_HAMPEL_FILT_SAMPLE)
+        {
+            aSample->set_hampelfiltsample(theBlock.hampelFiltSample[sampleIndex]);
+        }
+        if (dspOutputs & DSP_OUTPUT_VALID_TARGET)
+        {
+            aSample->set_isvalidtarget(theBlock.hasFlag(sampleIndex, SAMPLE_FLAG_VALID_TARGET));
+        }
+
+        // Gather the channel planes into the sample's measurement list
+        aSample->mutable_measurements()->Reserve(theBlock.channelCount());
+        for (uint32_t channelIndex = 0; channelIndex < theBlock.channelCount(); channelIndex++)
+        {
+            aSample->add_measurements(theBlock.measurement(channelIndex, sampleIndex));
+        }
     }
 
     /// <summary>
@@ -428,31 +804,32 @@ namespace BICGRPCHelperNamespace
     /// <param name="samples">BIC sensed LFP samples</param>
     void BICListener::onData(const std::vector<CSample>* samples)
     {
+        // The callback thread belongs to the implant API, apply the configured scheduling the first time it delivers data
+        static thread_local bool isThreadRoleApplied = false;
+        if (!isThreadRoleApplied)
+        {
+            ThreadRoleRegistry::instance().applyRole(THREAD_ROLE_DATA_CALLBACK);
+            isThreadRoleApplied = true;
+        }
+
         std::chrono::system_clock::time_point packetReceived = std::chrono::system_clock::now();
         // Ensure samples is not empty before working with it.
         if (!samples->empty())
         {
+            // Create the sample block for this packet, interpolated samples are appended as they are generated
+            uint32_t numChannels = samples->at(0).getNumberOfMeasurements();
+            uint64_t sampleTime = packetReceived.time_since_epoch().count();
+            SampleBlock* newBlock = new SampleBlock(numChannels, (uint32_t)samples->size());
+            newBlock->filtChannel = distributedInputChannel;
+
+            // Hold the interpolator for the whole packet, streaming may be reconfiguring it or reading its statistics
+            std::unique_lock<std::mutex> interpolatorLock(m_interpolatorLock);
+
             // Loop through retrieved samples
             for (int i = 0; i < samples->size(); i++)
             {
-                // Create a new sample data buffer
-                int32_t sampleCounter = samples->at(i).getMeasurementCounter();
-                int16_t sampleNum = samples->at(i).getNumberOfMeasurements();
+                uint32_t sampleCounter = samples->at(i).getMeasurementCounter();
                 double* theData = samples->at(i).getMeasurements();
-                uint64_t sampleTime = packetReceived.time_since_epoch().count();
-                NeuralSample* newSample = new NeuralSample();
-                newSample->set_numberofmeasurements(sampleNum);
-                newSample->set_supplyvoltage(samples->at(i).getSupplyVoltage());
-                newSample->set_isconnected(samples->at(i).isConnected());
-                newSample->set_stimulationnumber(samples->at(i).getStimulationId());
-                newSample->set_stimulationactive(samples->at(i).isStimulationActive());
-                newSample->set_samplecounter(sampleCounter);
-                newSample->set_isinterpolated(false);
-                newSample->set_filtchannel(distributedInputChannel);
-                newSample->set_timestamp(sampleTime);
-                newSample->set_triggerphase(stimTriggerPhase);
-                newSample->set_isinputtrighigh(samples->at(i).isMeasurementTriggerHigh());
-
 
                 // Check if we've lost packets, if so interpolate
                 if (lastNeuroCount + 1 != sampleCounter)
@@ -465,13 +842,8 @@ namespace BICGRPCHelperNamespace
                     }
                     else
                     {
-                        // Missed packet!
+                        // Missed packet! Unsigned subtraction also covers the wrap around case
                         uint32_t diff = sampleCounter - (lastNeuroCount + 1);
-                        if (diff < 0)
-                        {
-                            // Wrap around case
-                            diff = (uint32_t)sampleCounter + (UINT32_MAX - lastNeuroCount + 1);
-                        }
 
 #ifdef DEBUG_CONSOLE_ENABLE
                         // Write error message to server console
@@ -479,897 +851,902 @@ namespace BICGRPCHelperNamespace
 #endif
 
                         // Ensure interpolation is a reasonable amount
-                        if (diff <= neuroInterplationThreshold)
+                        if (neuralInterpolator.canFill(diff))
                         {
                             // Continue the error
 #ifdef DEBUG_CONSOLE_ENABLE
                             std::cout << "DEBUG: Interpolating " << diff << " points..." << std::endl;
 #endif
 
-                            // Determine the interpolation slopes
-                            double interpolationSlopes[32] = { 0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0 };
-                            for (int index = 0; index < 32; index++)
-                            {
-                                interpolationSlopes[index] = (theData[index] - latestData[index]) / (diff + 1);
-                            }
-
-                            // Interpolate and mark data as interpolated in NeuralSample message
-                            for (uint32_t interpolatedPointNum = 1; interpolatedPointNum <= diff; interpolatedPointNum++)
+                            // Fill the whole gap at once, then mark status fields from the latest BIC packet
+                            newBlock->reserve(newBlock->size() + diff + (uint32_t)(samples->size() - i));
+                            uint32_t firstRow = neuralInterpolator.fillGap(newBlock, lastNeuroCount + 1, diff, theData);
+                            newBlock->gaps.push_back({ lastNeuroCount + 1, diff, firstRow, true });
+                            for (uint32_t row = firstRow; row < newBlock->size(); row++)
                             {
-                                // Create a new sample data buffer
-                                NeuralSample* newInterpolatedSample = new NeuralSample();
-
-                                // Add in the fields from the latest BIC packet
-                                newInterpolatedSample->set_numberofmeasurements(sampleNum);
-                                newInterpolatedSample->set_supplyvoltage(newSample->supplyvoltage());
-                                newInterpolatedSample->set_isconnected(newSample->isconnected());
-                                newInterpolatedSample->set_stimulationnumber(newSample->stimulationnumber());
-                                newInterpolatedSample->set_stimulationactive(newSample->stimulationactive());
-                                newInterpolatedSample->set_samplecounter(lastNeuroCount + interpolatedPointNum);
-                                newInterpolatedSample->set_isinterpolated(true);
-                                newInterpolatedSample->set_filtchannel(distributedInputChannel);
-                                newInterpolatedSample->set_timestamp(latestTimeStamp);
-                                newInterpolatedSample->set_triggerphase(stimTriggerPhase);
-                                newInterpolatedSample->set_isinputtrighigh(newSample->isinputtrighigh());
-                                
-                                // Copy in the time domain data in
-                                for (int interChannelPoint = 0; interChannelPoint < sampleNum; interChannelPoint++)
-                                {
-                                    double interpolatedSample = latestData[interChannelPoint] + (interpolationSlopes[interChannelPoint] * interpolatedPointNum);
-                                    newInterpolatedSample->add_measurements(interpolatedSample);
-                                    if (interChannelPoint == distributedInputChannel)
-                                    {
-
-                                        // Call calcPhase to estimate current sample's phase
-                                        newInterpolatedSample->set_phase(calcPhase(bpFiltData, lastNeuroCount + interpolatedPointNum, &sigFreqData, &phaseData));
-
-                                        // Call Processing Helper, take output and send to client
-                                        newInterpolatedSample->set_filtsample(processingHelper(interpolatedSample, lastNeuroCount + interpolatedPointNum, stimSampStamp, &rawPrevData, &stimOnset, &hampelPrevData, &dcFiltPrevData, sampGain));
-                                        newInterpolatedSample->set_prefiltsample(dcFiltPrevData[0]);
-                                        newInterpolatedSample->set_hampelfiltsample(hampelPrevData[0]);
-                                        newInterpolatedSample->set_isvalidtarget(isValidTarget);
-
-                                        // Update stimulation history window
-                                        if (newInterpolatedSample->stimulationactive() == true && prevStimActive == false)
-                                        {
-                                            stimOnset.insert(stimOnset.begin(), 1);
-                                            updateTriggerPhase(newInterpolatedSample->phase(), &triggerPhaseData);
-                                            prevStimActive = true;
-                                            stimSampStamp.insert(stimSampStamp.begin(), lastNeuroCount + interpolatedPointNum);
-                                            stimSampStamp.pop_back();
-                                        }
-                                        else
-                                        {
-                                            stimOnset.insert(stimOnset.begin(), 0);
-                                        }
-
-                                        // Mitigate self-triggering
-                                        if (isSelfTrig == false)
-                                        {
-                                            detectSelfTriggering(stimSampStamp, 1.25 * 1 / (sigFreqData[0]) * 1000);
-                                        }
-                                        else
-                                        {
-                                            if (lastNeuroCount + interpolatedPointNum - stimSampStamp[0] > 150) 
-                                            {
-                                                isSelfTrig = false;
-                                            }
-                                        }
-                                        if (newInterpolatedSample->stimulationactive() == false && prevStimActive == true)
-                                        {
-                                            // update state variable on stimActive state
-                                            prevStimActive = false;
-                                        }
-                                        stimOnset.pop_back();
-                                    }
-                                }
-                                // Add it to the buffer if there is room
-                                if (neuralSampleQueue.size() < 1000)
-                                {
-                                    // Lock the neurobuffer, add data, unlock
-                                    this->m_neuroBufferLock.lock();
-                                    neuralSampleQueue.push(newInterpolatedSample);
-                                    this->m_neuroBufferLock.unlock();
-                                }
-                                else
-                                {
-                                    delete newInterpolatedSample;
-                                    std::cout << "WARNING: GRPC Neural Queue Size Overflow, streaming data skipped" << std::endl;
-                                }
+                                newBlock->timeStamp[row] = latestTimeStamp;
+                                newBlock->supplyVoltage[row] = samples->at(i).getSupplyVoltage();
+                                newBlock->stimulationNumber[row] = samples->at(i).getStimulationId();
+                                newBlock->setFlag(row, SAMPLE_FLAG_CONNECTED, samples->at(i).isConnected());
+                                newBlock->setFlag(row, SAMPLE_FLAG_STIM_ACTIVE, samples->at(i).isStimulationActive());
+                                newBlock->setFlag(row, SAMPLE_FLAG_INPUT_TRIG_HIGH, samples->at(i).isMeasurementTriggerHigh());
                             }
                         }
                         else
                         {
                             // Continue the error
+                            neuralInterpolator.recordDroppedGap(diff);
+                            newBlock->gaps.push_back({ lastNeuroCount + 1, diff, newBlock->size(), false });
                             std::cout << "WARNING: Exceeded Interpolation limit. Data loss indicated by dropout in sample count" << std::endl;
                         }
                     }
                 }
 
+                // Copy the received sample into the block
+                uint32_t row = newBlock->appendSample();
+                newBlock->sampleCounter[row] = sampleCounter;
+                newBlock->timeStamp[row] = sampleTime;
+                newBlock->supplyVoltage[row] = samples->at(i).getSupplyVoltage();
+                newBlock->stimulationNumber[row] = samples->at(i).getStimulationId();
+                newBlock->setFlag(row, SAMPLE_FLAG_CONNECTED, samples->at(i).isConnected());
+                newBlock->setFlag(row, SAMPLE_FLAG_STIM_ACTIVE, samples->at(i).isStimulationActive());
+                newBlock->setFlag(row, SAMPLE_FLAG_INPUT_TRIG_HIGH, samples->at(i).isMeasurementTriggerHigh());
+                for (uint32_t channelIndex = 0; channelIndex < numChannels; channelIndex++)
+                {
+                    newBlock->measurement(channelIndex, row) = theData[channelIndex];
+                }
+                neuralInterpolator.updateHistory(theData, numChannels);
+
                 // Update Interpolation Info for future use
                 lastNeuroCount = sampleCounter;
 
                 // Update time value for interpolated sample
                 latestTimeStamp = sampleTime;
 
-                // Copy in the data to both the newSample and the latest data buffer (for future interpolation). Delete it when done
-                for (int j = 0; j < sampleNum; j++)
-                {
-                    newSample->add_measurements(theData[j]);
-                    latestData[j] = theData[j];
-                    if (j == distributedInputChannel)
-                    {
-                        // Estimate current sample's phase
-                        newSample->set_phase(calcPhase(bpFiltData, sampleCounter, &sigFreqData, &phaseData));
-
-                        // Call Processing Helper, take output and send to client
-                        newSample->set_filtsample(processingHelper(theData[j], sampleCounter, stimSampStamp, &rawPrevData, &stimOnset, &hampelPrevData, &dcFiltPrevData, sampGain));
-                        newSample->set_prefiltsample(dcFiltPrevData[0]);
-                        newSample->set_hampelfiltsample(hampelPrevData[0]);
-                        newSample->set_isvalidtarget(isValidTarget);
-
-                        // Update stimulation history window
-                        if (newSample->stimulationactive() == true && prevStimActive == false)
-                        {
-                            stimOnset.insert(stimOnset.begin(), 1);
-                            updateTriggerPhase(newSample->phase(), &triggerPhaseData);
-                            prevStimActive = true;
-                            stimSampStamp.insert(stimSampStamp.begin(), sampleCounter);
-                            stimSampStamp.pop_back();
-                        }
-                        else
-                        {
-                            stimOnset.insert(stimOnset.begin(), 0);
-                        }
-
-                        // Mitigate self-triggering
-                        if (isSelfTrig == false)
-                        {
-                            detectSelfTriggering(stimSampStamp, 1.25 * 1 / (sigFreqData[0]) * 1000);
-                        }
-                        else
-                        {
-                            if (sampleCounter - stimSampStamp[0] > 150) 
-                            {
-                                isSelfTrig = false;
-                            }
-
-                        }
-
-                        if (newSample->stimulationactive() == false && prevStimActive == true)
-                        {
-                            prevStimActive = false;
-                        }
-                        stimOnset.pop_back();
-                    }
-                }
-
                 delete theData;
+            }
+            interpolatorLock.unlock();
 
-                // Add latest received data packet to the buffer if there is room
-                if (neuralSampleQueue.size() < 1000)
-                {
-                    // Lock the neurobuffer, add data, unlock
-                    this->m_neuroBufferLock.lock();
-                    neuralSampleQueue.push(newSample);
-                    this->m_neuroBufferLock.unlock();
+            // Run the closed-loop signal processing over the whole block
+            processSampleBlock(newBlock);
 
-                    // Notify the streaming function that new data exists
-                    neuralDataNotify->notify_all();
-                }
-                else
-                {
-                    delete newSample;
-                    std::cout << "WARNING: GRPC Neural Queue Size Overflow, streaming data skipped" << std::endl;
-                }
+            // Add the block to the buffer if there is room
+            this->m_neuroBufferLock.lock();
+            if (neuralQueuedSampleCount < 1000)
+            {
+                // Add data while holding the neurobuffer lock
+                neuralQueuedSampleCount += newBlock->size();
+                neuralSampleQueue.push(newBlock);
+                streamQueued[STATUS_STREAM_NEURAL]++;
+                this->m_neuroBufferLock.unlock();
+
+                // Notify the streaming function that new data exists
+                neuralDataNotify->notify_all();
+            }
+            else
+            {
+                this->m_neuroBufferLock.unlock();
+                delete newBlock;
+                streamDrops[STATUS_STREAM_NEURAL]++;
+                std::cout << "WARNING: GRPC Neural Queue Size Overflow, streaming data skipped" << std::endl;
             }
         }
         // No matter what, delete samples
         delete samples;
     }
 
-    //*************************************************** Microservice Triggered Stimulation Functions ***************************************************
-    
     /// <summary>
-    /// Function that enables phase-locked stimulation functionality on an output channel based on an input channel's sensed neural activity
+    /// Runs every closed-loop controller over every sample of a block, in sample order. The outputs of controller 0 are stored in the block's DSP columns.
     /// </summary>
-    /// <param name="enableDistributed">A boolean indicating if phasic stim should be enabled or disabled</param>
-    /// <param name="sensingChannel">The channel to sense neural activity on</param>
-    /// <param name="filtCoeff_B">B-array with constants for IIR filter</param>
-    /// <param name="filtCoeff_A">A-array with constants for IIR filter</param>
-    /// <param name="triggeredFunctionIndex"></param>
-    /// <param name="stimThreshold">Amplitude threshold condition to send stimulation</param>
-    /// <param name="triggerPhase">Triggering phase condition to send stimulation</param>
-    /// <param name="nStimHistory">Size of window to sample-and-hold stimulation artifact</param>
-    /// <param name="nSelfTrigLimit">Upper limit of consecutive stimulation pulses to trigger a lockout period</param>
-    void BICListener::enableDistributedStim(bool enableDistributed, int sensingChannel, std::vector<double> filtCoeff_B, std::vector<double> filtCoeff_A, uint32_t triggeredFunctionIndex, double stimThreshold, double triggerPhase, double targetPhase)
+    /// <param name="theBlock">Sample block to process, received and interpolated samples in counter order</param>
+    void BICListener::processSampleBlock(SampleBlock* theBlock)
     {
-        distributedInputChannel = sensingChannel;
-        betaBandPassIIR_B = filtCoeff_B;
-        betaBandPassIIR_A = filtCoeff_A;
-        distributedStimThreshold = stimThreshold;
-        stimTriggerPhase = triggerPhase;
-        stimTargetPhase = targetPhase;
-
-        // assign upper and lower bounds for determining trigger phase depending on target phase
-        if ((stimTargetPhase > 0) && (stimTargetPhase < 90)) // ascending hyperpolarizing
-        {
-            lowerBound = 225;
-            upperBound = 360;
-            phasicStimTarget = 0;
-        }
-        else if ((stimTargetPhase > 90) && (stimTargetPhase < 180)) // descending hyperpolarizing
+        // Skip the processing chain entirely when neither closed-loop stimulation nor the neural stream subscriber uses its outputs
+        if (!isCLStimEn && neuralDspOutputs == DSP_OUTPUT_NONE && shadowEvaluator == NULL)
         {
-            lowerBound = -45;
-            upperBound = 90;
-            phasicStimTarget = 1;
+            return;
         }
-        else if ((stimTargetPhase > 180) && (stimTargetPhase < 270)) // descending depolarizing
+
+        // Hold the controllers for the whole block, creating the default controller 0 on first use so its outputs can be streamed
+        std::lock_guard<std::mutex> controllerLock(m_controllerLock);
+        if (controllers[0] == NULL)
         {
-            lowerBound = 0;
-            upperBound = 135;
-            phasicStimTarget = 2;
+            controllers[0] = new ClosedLoopController(ClosedLoopControllerConfig());
         }
-        else if ((stimTargetPhase > 270) && (stimTargetPhase < 360)) // ascending depolarizing
+        for (uint32_t controllerId = 0; controllerId < MAX_CLOSED_LOOP_CONTROLLERS; controllerId++)
         {
-            lowerBound = 90;
-            upperBound = 225;
-            phasicStimTarget = 3;
+            if (controllers[controllerId] != NULL)
+            {
+                controllers[controllerId]->ensurePhaseEstimator(neuralSamplingRate);
+            }
         }
 
-        if (enableDistributed && !isTriggeringStimulation() && !isStimulating())
+        // Block controllers go first, their triggers do not depend on the phase controllers' outputs
+        runBlockControllers(theBlock);
+
+        for (uint32_t row = 0; row < theBlock->size(); row++)
         {
-            // Enable Closed Loop since it is not enabled and request is to enable
-            // Instantiate the conditional variable for thread notification
-            stimTrigger = new std::condition_variable();
+            uint64_t currSamp = theBlock->sampleCounter[row];
+            bool isStimActive = theBlock->hasFlag(row, SAMPLE_FLAG_STIM_ACTIVE);
 
-            // Update state tracking variable
-            isCLStimEn = true;
+            // Attribute a stimulation onset to the controllers that triggered it, unattributed onsets (e.g. manual stimulation) go to every controller
+            uint32_t firedControllers = 0;
+            if (isStimActive && !prevBlockStimActive)
+            {
+                firedControllers = stimFiredControllers.exchange(0);
+            }
+            prevBlockStimActive = isStimActive;
 
-            // Start thread up
-            distributedStimThread = new std::thread(&BICListener::triggeredSendStimThread, this);
-        }
-        else if (!enableDistributed && isCLStimEn)
-        {
-            // Update state tracking variable
-            isCLStimEn = false;
-            stimTrigger->notify_all();
+            for (uint32_t controllerId = 0; controllerId < MAX_CLOSED_LOOP_CONTROLLERS; controllerId++)
+            {
+                ClosedLoopController* theController = controllers[controllerId];
+                if (theController == NULL || theController->getSensingChannel() >= theBlock->channelCount())
+                {
+                    continue;
+                }
 
-            // Disable Closed Loop since it is enabled and request is to disable
-            distributedStimThread->join();
-            distributedStimThread->~thread();
-            delete distributedStimThread;
-            distributedStimThread = NULL;
+                // Run the controller's chain on its sensing channel
+                ClosedLoopOutputs outputs;
+                bool isOwnStimOnset = firedControllers == 0 || (firedControllers & (1u << controllerId)) != 0;
+                theController->processSample(theBlock->channel(theController->getSensingChannel())[row], currSamp, isStimActive, controllerEnabled[controllerId], isOwnStimOnset, &outputs);
 
-            // Ensure stimulation is stopped
-            theImplantedDevice->stopStimulation();
+                // Controller 0 feeds the streamed DSP columns
+                if (controllerId == 0)
+                {
+                    theBlock->triggerPhase[row] = outputs.triggerPhase;
+                    theBlock->phase[row] = outputs.phase;
+                    theBlock->filtSample[row] = outputs.filtSample;
+                    theBlock->preFiltSample[row] = outputs.preFiltSample;
+                    theBlock->hampelFiltSample[row] = outputs.hampelFiltSample;
+                    theBlock->setFlag(row, SAMPLE_FLAG_VALID_TARGET, outputs.isValidTarget);
+                }
+
+                // Send stimulation if a valid target has been identified
+                if (outputs.isValidTarget)
+                {
+                    controllerTriggerPhase[controllerId] = outputs.triggerPhase;
+                    controllerEventTimeStamp[controllerId] = theBlock->timeStamp[row];
+                    if (theController->stimScheduler != NULL)
+                    {
+                        schedulePredictiveStim(controllerId, outputs.phase, theBlock->timeStamp[row]);
+                    }
+                    else
+                    {
+                        postControllerTrigger(controllerId);
+                    }
+                }
+            }
+        }
+
+        // Shadow controllers evaluate the block on their own threads
+        if (shadowEvaluator != NULL)
+        {
+            shadowEvaluator->submitBlock(*theBlock);
+        }
+    }
 
-            // Clean up the conditional variable
-            stimTrigger->~condition_variable();
-            delete stimTrigger;
-            stimTrigger = NULL;
-        }
-    }
-    
     /// <summary>
-    /// Thread to be started up when phase-triggered stimulation functionality is enabled.
-    /// Delivers a specific stimulation pattern whe
+    /// Runs every block controller over a block and acts on their trigger decisions. Called with m_controllerLock held.
     /// </summary>
-    void BICListener::triggeredSendStimThread()
+    /// <param name="theBlock">Sample block to process, block controller telemetry is appended to it</param>
+    void BICListener::runBlockControllers(SampleBlock* theBlock)
     {
-        // Create a mutex to make the conditional 'wait' functionality
-        std::mutex stimLock;
-        std::unique_lock<std::mutex> stimTriggerWait(stimLock);
-
-        // create instance of stimTimes to keep track of before and after stim timestamps
-        StimTimes startStimulationTimes;
-        // enable stim time logging
-        enableStimTimeLogging(true);
-
-        // initialize before and after timestamps
-        std::chrono::system_clock::time_point before;
-        std::chrono::system_clock::time_point after;
-
-        // Wait for a zero crossing
-        stimTrigger->wait(stimTriggerWait);
-
-        // Loop while streaming is active
-        while (isCLStimEn)
+        for (uint32_t controllerId = 0; controllerId < MAX_CLOSED_LOOP_CONTROLLERS; controllerId++)
         {
-            // Get time before start stimulation command (UTC)
-            before = std::chrono::system_clock::now();
-            startStimulationTimes.beforeStimTimeStamp = before.time_since_epoch().count();
-
-            try
+            IBlockController* theController = blockControllers[controllerId];
+            if (theController == NULL)
             {
-                // Execute the stimulation command
-                theImplantedDevice->startStimulation();
-
-                // Get time after start stimulation command (UTC)
-                after = std::chrono::system_clock::now();
-                startStimulationTimes.afterStimTimeStamp = after.time_since_epoch().count();
-
-                // If no exception encountered, mark it 0
-                startStimulationTimes.recordedException = "0";
-#ifdef DEBUG_CONSOLE_ENABLE
-                std::cout << "DEBUG: finished stim in " << elapsed_sec.count() << "s\n";
-#endif
-
-                // Add latest received data packet to the buffer if there is room
-                if (stimTimeSampleQueue.size() < 1000)
-                {
-                    // Lock the stim time buffer, add data, unlock
-                    this->m_stimTimeBufferLock.lock();
-                    stimTimeSampleQueue.push(startStimulationTimes); // add struct with timestamps and exception to queue
-                    this->m_stimTimeBufferLock.unlock();
+                continue;
+            }
 
-                    // Notify the streaming function that new data exists
-                    stimTimeDataNotify->notify_all();
-                }
-                else
-                {
-                    std::cout << "WARNING: Before Stim Time Log Queue Size Overflow, streaming data skipped" << std::endl;
-                }
+            ControllerDecision decision;
+            if (!theController->processBlock(*theBlock, &decision))
+            {
+                continue;
             }
-            catch (std::exception& anyException)
+            if (decision.triggerStimulation && controllerEnabled[controllerId] && theBlock->size() > 0)
             {
-                std::cout << "ERROR: Stimulation exception encountered: " << anyException.what() << std::endl;
-                
-                // If exception occurred, after is the timestamp when the exception occurred
-                after = std::chrono::system_clock::now();
-                startStimulationTimes.afterStimTimeStamp = after.time_since_epoch().count();
-                // Also keep track of exception encountered
-                startStimulationTimes.recordedException = anyException.what();
-
-                if (stimTimeSampleQueue.size() < 1000)
-                {
-                    // Lock the stim time buffer, add data, unlock
-                    this->m_stimTimeBufferLock.lock();
-                    stimTimeSampleQueue.push(startStimulationTimes); // add struct with timestamps and exception to queue
-                    this->m_stimTimeBufferLock.unlock();
-
-                    // Notify the streaming function that new data exists
-                    stimTimeDataNotify->notify_all();
-                }
-                else
-                {
-                    std::cout << "WARNING: Before Stim Time Log Queue Size Overflow, streaming data skipped" << std::endl;
-                }
+                issueBlockControllerTrigger(controllerId, theBlock, decision);
             }
-            catch (...)
+            if (!theController->getTelemetry().empty())
             {
-                std::cout << "ERROR: Stimulation exception encountered. No reason" << std::endl;
+                theBlock->controllerTelemetry.push_back({ controllerId, theController->getTelemetry() });
             }
+        }
+    }
+
+    /// <summary>
+    /// Hands a block controller's trigger to the stimulation thread, or to its scheduler when the trigger is delayed. A scheduler holds
+    /// one delayed stimulation at a time, so a trigger arriving while one is pending is rejected and reported back to the controller
+    /// without touching the pending stimulation's log details. Called with m_controllerLock held.
+    /// </summary>
+    /// <param name="controllerId">Controller that triggered</param>
+    /// <param name="theBlock">Block the decision was made on</param>
+    /// <param name="decision">The controller's trigger decision</param>
+    void BICListener::issueBlockControllerTrigger(uint32_t controllerId, SampleBlock* theBlock, const ControllerDecision& decision)
+    {
+        StimulationScheduler* theScheduler = decision.triggerDelayMicroseconds > 0 ? blockControllerSchedulers[controllerId] : NULL;
+        if (theScheduler != NULL && theScheduler->isPending())
+        {
+            blockControllers[controllerId]->onTriggerRejected();
+            return;
+        }
 
-            // Wait for a zero crossing
-            stimTrigger->wait(stimTriggerWait);
+        uint64_t eventTimeStamp = theBlock->timeStamp[std::min(decision.triggerSampleIndex, theBlock->size() - 1)];
+        controllerTriggerPhase[controllerId] = 0;
+        controllerEventTimeStamp[controllerId] = eventTimeStamp;
+        controllerTriggerStimFunction[controllerId] = decision.stimFunctionIndex < 0 ? NO_STIM_FUNCTION_INDEX : decision.stimFunctionIndex;
+        if (theScheduler == NULL)
+        {
+            postControllerTrigger(controllerId);
+            return;
+        }
+
+        // The delay runs from when the triggering sample was received
+        std::chrono::system_clock::duration sinceSample = std::chrono::system_clock::now().time_since_epoch() - std::chrono::system_clock::duration(eventTimeStamp);
+        std::chrono::steady_clock::duration untilStim = std::chrono::microseconds(decision.triggerDelayMicroseconds) - std::chrono::duration_cast<std::chrono::steady_clock::duration>(sinceSample);
+        if (!theScheduler->schedule(std::chrono::steady_clock::now() + untilStim))
+        {
+            // The scheduler is stopping
+            controllerEventTimeStamp[controllerId] = 0;
+            controllerTriggerStimFunction[controllerId] = NO_STIM_FUNCTION_INDEX;
+            blockControllers[controllerId]->onTriggerRejected();
         }
     }
 
+    //*************************************************** Microservice Triggered Stimulation Functions ***************************************************
+    
     /// <summary>
-    /// Adds a pointer to the implanted device interface to the BICListener, required for phase-locked stim functionality
+    /// Function that enables phase-locked stimulation functionality on an output channel based on an input channel's sensed neural activity.
+    /// Configures closed-loop controller 0, which issues the current stimulation command.
     /// </summary>
-    /// <param name="anImplantedDevice">the active impalnted device</param>
-    void BICListener::addImplantPointer(cortec::implantapi::IImplant* anImplantedDevice)
+    /// <param name="enableDistributed">A boolean indicating if phasic stim should be enabled or disabled</param>
+    /// <param name="sensingChannel">The channel to sense neural activity on</param>
+    /// <param name="filtCoeff_B">B-array with constants for IIR filter</param>
+    /// <param name="filtCoeff_A">A-array with constants for IIR filter</param>
+    /// <param name="triggeredFunctionIndex"></param>
+    /// <param name="stimThreshold">Amplitude threshold condition to send stimulation</param>
+    /// <param name="triggerPhase">Triggering phase condition to send stimulation</param>
+    /// <param name="targetPhase">Ideal phase to deliver stimulation</param>
+    /// <param name="phaseEstimatorType">Method used to estimate the phase of the sensed oscillation</param>
+    /// <param name="phaseEstimatorWindow">FIR Hilbert taps, ECHT window or AR fit window length in samples, 0 for the estimator's default</param>
+    /// <param name="predictionHorizon">Samples ahead at which forecasting estimators report phase, covering the stimulation pipeline delay</param>
+    /// <param name="predictiveScheduling">True to issue stimulation at the predicted time of the target phase instead of as soon as the trigger phase passes</param>
+    /// <param name="triggerWaitMode">Whether the stimulation thread sleeps or polls while waiting for a trigger</param>
+    /// <param name="triggerSpinMicroseconds">Polling time before falling back to sleeping in spin mode, 0 to poll until a trigger arrives</param>
+    /// <param name="samplingRate">Device sampling rate in Hz</param>
+    /// <returns>True if the controller is in the requested state, false if the request was refused</returns>
+    bool BICListener::enableDistributedStim(bool enableDistributed, int sensingChannel, std::vector<double> filtCoeff_B, std::vector<double> filtCoeff_A, uint32_t triggeredFunctionIndex, double stimThreshold, double triggerPhase, double targetPhase, PhaseEstimatorType phaseEstimatorType, uint32_t phaseEstimatorWindow, uint32_t predictionHorizon, bool predictiveScheduling, TriggerWaitMode triggerWaitMode, uint32_t triggerSpinMicroseconds, double samplingRate)
     {
-        theImplantedDevice = anImplantedDevice;
+        ClosedLoopControllerConfig config;
+        config.sensingChannel = sensingChannel;
+        config.filtCoeff_B = filtCoeff_B;
+        config.filtCoeff_A = filtCoeff_A;
+        config.stimThreshold = stimThreshold;
+        config.triggerPhase = triggerPhase;
+        config.targetPhase = targetPhase;
+        config.phaseEstimatorType = phaseEstimatorType;
+        config.phaseEstimatorWindow = phaseEstimatorWindow;
+        config.predictionHorizon = predictionHorizon;
+        config.samplingRate = samplingRate;
+
+        return enableClosedLoopController(0, enableDistributed, config, predictiveScheduling, NO_STIM_FUNCTION_INDEX, triggerWaitMode, triggerSpinMicroseconds);
     }
 
     /// <summary>
-    /// Handles the time-domain processing to be performed on each new datapoint
+    /// Enables or disables one closed-loop controller. Controllers run concurrently over the same sample blocks and share the stimulation thread,
+    /// which is started with the first enabled controller and stopped with the last.
     /// </summary>
-    /// <param name="newData">Latest datapoint to be processed for potential triggering of stimulation</param>
-    /// <param name="dataHistory">History of raw datapoints</param>
-    /// <param name="stimHistory">History of stimulation onsets</param>
-    /// <param name="hampelDataHistory">History of samples after going through Hampel filter</param>
-    /// <param name="dcFiltHistory">History of samples after going through DC Block filter</param>
-    /// <param name="filterGain">Gain of the IIR bandpass filter</param>
-    /// <returns></returns>
-    double BICListener::processingHelper(double newData, uint64_t currSamp, std::vector<int> stimSampHistory, std::vector<double>* dataHistory, std::vector<double>* stimHistory, std::vector<double>* hampelDataHistory, std::vector<double>* dcFiltHistory, double filterGain)
+    /// <param name="controllerId">Controller to change, 0 to MAX_CLOSED_LOOP_CONTROLLERS - 1</param>
+    /// <param name="enable">True to configure and enable a disabled controller, false to disable it. Enabled controllers are changed with updateClosedLoopController.</param>
+    /// <param name="config">Controller parameters, ignored when disabling</param>
+    /// <param name="predictiveScheduling">True to issue stimulation at the predicted time of the target phase instead of as soon as the trigger phase passes</param>
+    /// <param name="stimFunctionIndex">Preloaded stimulation function the controller starts, NO_STIM_FUNCTION_INDEX to start the current stimulation command</param>
+    /// <param name="triggerWaitMode">Wait mode of the stimulation thread, used if this call starts it</param>
+    /// <param name="triggerSpinMicroseconds">Spin budget of the stimulation thread, used if this call starts it</param>
+    /// <returns>True if the controller is in the requested state. False if it is out of range, already enabled, held by a block controller,
+    /// or if open-loop or other stimulation is running.</returns>
+    bool BICListener::enableClosedLoopController(uint32_t controllerId, bool enable, const ClosedLoopControllerConfig& config, bool predictiveScheduling, int64_t stimFunctionIndex, TriggerWaitMode triggerWaitMode, uint32_t triggerSpinMicroseconds)
     {
-        double stimCount = 0;
-        double dcFiltSamp;
-        double hampelSamp;
-        double MAD;
-        double medianVal;
+        if (controllerId >= MAX_CLOSED_LOOP_CONTROLLERS)
+        {
+            std::cout << "WARNING: Closed-loop controller " << controllerId << " out of range, request ignored" << std::endl;
+            return false;
+        }
 
-        std::vector<double> modifier(dataHistory->size());
-        std::vector<double> sorted(dataHistory->size());
+        // Enabling and disabling controllers is serialized with starting and stopping the stimulation thread they share
+        std::lock_guard<std::mutex> lifecycleLock(m_stimLifecycleLock);
+        if (enable)
+        {
+            if (controllerEnabled[controllerId] || isOLStimEn || (!isCLStimEn && isStimulating()))
+            {
+                return false;
+            }
 
-        // store most recent raw sample
-        dataHistory->insert(dataHistory->begin(), newData);
-        dataHistory->pop_back();
+            // Build the controller before taking the lock so that estimator set-up does not stall block processing
+            ClosedLoopController* newController = new ClosedLoopController(config);
+            if (predictiveScheduling)
+            {
+                newController->stimScheduler = new StimulationScheduler(std::bind(&BICListener::firePredictiveStim, this, controllerId, std::placeholders::_1));
+            }
+            controllerStimFunction[controllerId] = stimFunctionIndex;
+            controllerTriggerStimFunction[controllerId] = NO_STIM_FUNCTION_INDEX;
+
+            // Start the shared stimulation thread before the controller can post to its mailbox
+            startTriggeredStim(triggerWaitMode, triggerSpinMicroseconds);
+
+            // Swap in the controller
+            m_controllerLock.lock();
+            delete controllers[controllerId];
+            controllers[controllerId] = newController;
+            controllerEnabled[controllerId] = true;
+            if (controllerId == 0)
+            {
+                distributedInputChannel = config.sensingChannel;
+            }
+            m_controllerLock.unlock();
+            return true;
+        }
 
-        // Artifact rejection
-        for (int i = 0; i < stimHistory->size(); i++)
+        // Disabling a disabled controller leaves it as requested, block controllers are detached by their own calls
+        if (!controllerEnabled[controllerId])
+        {
+            return true;
+        }
+        if (blockControllers[controllerId] != NULL)
         {
-            stimCount += stimHistory->at(i);
+            return false;
         }
 
-        // Blank artifact or send data through DC block filter
-        if (stimCount > 0)
+        // Stop triggering from this controller. Controller 0 is kept so its outputs can still be streamed.
+        m_controllerLock.lock();
+        controllerEnabled[controllerId] = false;
+        ClosedLoopController* theController = controllers[controllerId];
+        IPhaseEstimator* theEstimator = theController->getPhaseEstimator();
+        if (theEstimator != NULL)
         {
-            dcFiltSamp = hampelDataHistory->at(0);
+            // Report the per-sample cost of the phase estimator used in this session
+            PhaseEstimatorCost estimatorCost = theEstimator->getCost();
+            double meanCost = estimatorCost.samples > 0 ? estimatorCost.totalMicroseconds / estimatorCost.samples : 0;
+            std::cout << "STIM INFO: Controller " << controllerId << " " << theEstimator->getName() << " phase estimator averaged " << meanCost << " us per sample (max "
+                << estimatorCost.maxMicroseconds << " us) over " << estimatorCost.samples << " samples." << std::endl;
+        }
+        if (controllerId == 0)
+        {
+            // Drop any pending predicted stimulation
+            delete theController->stimScheduler;
+            theController->stimScheduler = NULL;
         }
         else
         {
-            dcFiltSamp = 0.945 * dcFiltHistory->at(0) + dataHistory->at(0) - dataHistory->at(1);
+            delete theController;
+            controllers[controllerId] = NULL;
         }
-        dcFiltHistory->insert(dcFiltHistory->begin(), dcFiltSamp);
-        dcFiltHistory->pop_back();
-
-        // Hampel filter for outlier detection
-        // Identify median of a given window
-        sorted = *dcFiltHistory;
-        sort(sorted.begin(), sorted.end());
-        medianVal = sorted[((sorted.size() - 1) / 2) + 1];
-
-        // Calculate median absolute deviation (MAD)
-        for (int i = 0; i < dcFiltHistory->size(); i++)
+        bool isAnyEnabled = false;
+        for (uint32_t otherId = 0; otherId < MAX_CLOSED_LOOP_CONTROLLERS; otherId++)
         {
-            modifier[i] = abs(dcFiltHistory->at(i) - medianVal);
+            isAnyEnabled = isAnyEnabled || controllerEnabled[otherId];
         }
+        m_controllerLock.unlock();
 
-        sort(modifier.begin(), modifier.end());
-        MAD = 1.4826 * modifier[((modifier.size() - 1) / 2) + 1];
+        // Stop the stimulation thread with the last controller
+        stopTriggeredStimIfIdle(isAnyEnabled);
+        return true;
+    }
 
-        // Determine if a sample is an outlier and needs to be replaced by calculated median value
-        if (abs(dcFiltSamp - medianVal) <= 3 * MAD)
+    /// <summary>
+    /// Changes the parameters of an enabled closed-loop controller without stopping it. The controller swaps them in at its next sample,
+    /// keeping its filter and phase history, so stimulation continues uninterrupted.
+    /// </summary>
+    /// <param name="controllerId">Controller to update</param>
+    /// <param name="parameters">New parameters, empty filter coefficients and unset values keep the current ones</param>
+    /// <returns>True if the update was posted, false if the controller is not an enabled phase controller</returns>
+    bool BICListener::updateClosedLoopController(uint32_t controllerId, const ClosedLoopParameters& parameters)
+    {
+        if (controllerId >= MAX_CLOSED_LOOP_CONTROLLERS)
         {
-            hampelSamp = dcFiltSamp;
+            return false;
         }
-        else
+
+        // Copy the controller's configuration, the processing thread only changes it with m_controllerLock held
+        m_controllerLock.lock();
+        ClosedLoopController* theController = controllers[controllerId];
+        if (theController == NULL || !controllerEnabled[controllerId])
         {
-            hampelSamp = medianVal;
+            m_controllerLock.unlock();
+            return false;
         }
+        ClosedLoopControllerConfig currentConfig = theController->getConfig();
+        m_controllerLock.unlock();
 
-        // Band pass filter for beta activity
-        double filtSamp = filterIIR(hampelSamp, &bpFiltData, hampelDataHistory, &betaBandPassIIR_B, &betaBandPassIIR_A, 1);
+        // Build the update, including any replacement phase estimator, without holding up sample processing
+        ClosedLoopParameterUpdate* theUpdate = ClosedLoopController::buildParameterUpdate(currentConfig, parameters);
 
-        // Determine if we have a valid target to initiate stimulation 
-        if (phasicStimTarget == 1)
+        // Post it unless the controller was disabled or replaced in the meantime
+        m_controllerLock.lock();
+        bool isPosted = controllers[controllerId] == theController && controllerEnabled[controllerId];
+        if (isPosted)
         {
-            if (!isSelfTrig && isCLStimEn && detectTriggerPhase(phaseData, stimTriggerPhase) && abs(findMedian(&bpFiltData)) > distributedStimThreshold)
-            {
-                // If conditions have been met, then it's a valid target
-                isValidTarget = true;
-            }
-            else
-            {
-                isValidTarget = false;
-            }
+            theController->postParameterUpdate(theUpdate);
         }
-        else 
+        m_controllerLock.unlock();
+
+        if (!isPosted)
         {
-            if (!isSelfTrig && isCLStimEn && detectTriggerPhase(phaseData, stimTriggerPhase) && abs(bpFiltData[0]) > distributedStimThreshold)
-            {
-                // If conditions have been met, then it's a valid target
-                isValidTarget = true;
-            }
-            else
-            {
-                isValidTarget = false;
-            }
+            delete theUpdate->replacementEstimator;
+            delete theUpdate;
         }
+        return isPosted;
+    }
 
-        // send stimulation if a valid target has been identified
-        if (isValidTarget)
+    /// <summary>
+    /// Starts handing processed sample blocks to a shadow evaluator
+    /// </summary>
+    /// <param name="theEvaluator">Evaluator to feed, the caller keeps ownership</param>
+    /// <returns>True if attached, false if another evaluator is already attached</returns>
+    bool BICListener::attachShadowEvaluator(ShadowEvaluator* theEvaluator)
+    {
+        std::lock_guard<std::mutex> controllerLock(m_controllerLock);
+        if (shadowEvaluator != NULL)
         {
-            stimTrigger->notify_all();
+            return false;
         }
-
-        // Return the filtered sample for visualization purposes
-        return filtSamp;
+        shadowEvaluator = theEvaluator;
+        shadowStreamingState = true;
+        return true;
     }
 
     /// <summary>
-    /// Private function that applies an IIR filter to incoming neural data
+    /// Stops handing processed sample blocks to a shadow evaluator
     /// </summary>
-    /// <param name="currSamp">Latest neural sample</param>
-    /// <param name="prevFiltOut">History of filtered data samples</param>
-    /// <param name="prevInput">History of raw data samples</param>
-    /// <param name="b">B-array for IIR constants</param>
-    /// <param name="a">A-array for IIR constants</param>
-    /// <param name="gainVal">Gain for IIR bandpass filter</param>
-    /// <returns>Current filtered output sample</returns>
-    double BICListener::filterIIR(double currSamp, std::vector<double>* prevFiltOut, std::vector<double>* prevInput, std::vector<double>* b, std::vector<double>* a, double gainVal)
+    /// <param name="theEvaluator">Evaluator to stop feeding, an evaluator attached by another stream is left attached. The caller may delete it once this returns.</param>
+    void BICListener::detachShadowEvaluator(ShadowEvaluator* theEvaluator)
     {
-       double filtTemp;
-
-       // 2nd order IIR filter
-       filtTemp = b->at(0) * currSamp + b->at(1) * prevInput->at(0) + b->at(2) * prevInput->at(1) + b->at(3) * prevInput->at(2) + b->at(4) * prevInput->at(3)
-            - a->at(1) * prevFiltOut->at(0) - a->at(2) * prevFiltOut->at(1) - a->at(3) * prevFiltOut->at(2) - a->at(4) * prevFiltOut->at(3);
-
-        // remove the last sample and insert the most recent sample to the front of the vector
-        prevFiltOut->insert(prevFiltOut->begin(), filtTemp);
-        prevFiltOut->pop_back();
-
-        // Store most recent sample at the beginning of history window
-        prevInput->insert(prevInput->begin(), currSamp);
-        prevInput->pop_back();
-
-        return filtTemp;
+        std::lock_guard<std::mutex> controllerLock(m_controllerLock);
+        if (shadowEvaluator == theEvaluator)
+        {
+            shadowEvaluator = NULL;
+            shadowStreamingState = false;
+        }
     }
 
     /// <summary>
-    /// Helper function for identifying if the latest point is a positive zero crossing
+    /// Attaches and enables a block controller. Block controllers run before the phase controllers on every sample block and share their stimulation thread.
     /// </summary>
-    /// <param name="dataArray">Vector of sensing data to assess for zero crossing</param>
-    /// <returns>Boolean indicating if the latest point is a positive zero crossing</returns>
-    bool BICListener::isPosZeroCrossing(std::vector<double> dataArray)
+    /// <param name="controllerId">Controller ID to attach to, 1 to MAX_CLOSED_LOOP_CONTROLLERS - 1 and not in use by a phase controller</param>
+    /// <param name="theController">Controller to attach, owned by the listener until detached</param>
+    /// <param name="stimFunctionIndex">Preloaded stimulation function started when the controller does not request one, NO_STIM_FUNCTION_INDEX for the current stimulation command</param>
+    /// <param name="triggerWaitMode">Wait mode of the stimulation thread, used if this call starts it</param>
+    /// <param name="triggerSpinMicroseconds">Spin budget of the stimulation thread, used if this call starts it</param>
+    /// <returns>True if the controller was attached, false if the ID is unavailable or stimulation cannot be triggered</returns>
+    bool BICListener::attachBlockController(uint32_t controllerId, IBlockController* theController, int64_t stimFunctionIndex, TriggerWaitMode triggerWaitMode, uint32_t triggerSpinMicroseconds)
     {
-        bool isPosZeroCrossing = false;
+        // Controller 0 always holds the default phase controller that feeds the streamed DSP columns
+        if (controllerId == 0 || controllerId >= MAX_CLOSED_LOOP_CONTROLLERS)
+        {
+            return false;
+        }
 
-        // Check neighboring samples to determine for a zero-crossing
-        if (dataArray[0] > 0)
+        // Enabling and disabling controllers is serialized with starting and stopping the stimulation thread they share
+        std::lock_guard<std::mutex> lifecycleLock(m_stimLifecycleLock);
+        if (isOLStimEn || (!isCLStimEn && isStimulating()))
         {
-            if (dataArray[1] < 0)
-            {
-                isPosZeroCrossing = true;
-            }
+            return false;
         }
-        return isPosZeroCrossing;
+
+        // Only other lifecycle calls change the slot, so it stays free once checked
+        m_controllerLock.lock();
+        bool isSlotFree = controllers[controllerId] == NULL && blockControllers[controllerId] == NULL;
+        m_controllerLock.unlock();
+        if (!isSlotFree)
+        {
+            return false;
+        }
+
+        // Start the shared stimulation thread before the controller can post to its mailbox
+        startTriggeredStim(triggerWaitMode, triggerSpinMicroseconds);
+
+        m_controllerLock.lock();
+        controllerStimFunction[controllerId] = stimFunctionIndex;
+        controllerTriggerStimFunction[controllerId] = NO_STIM_FUNCTION_INDEX;
+        if (theController->hasDelayedTriggers())
+        {
+            blockControllerSchedulers[controllerId] = new StimulationScheduler(std::bind(&BICListener::firePredictiveStim, this, controllerId, std::placeholders::_1));
+        }
+        blockControllers[controllerId] = theController;
+        controllerEnabled[controllerId] = true;
+        m_controllerLock.unlock();
+
+        std::cout << "STIM INFO: Controller " << controllerId << " running block controller " << theController->getName() << std::endl;
+        return true;
     }
 
     /// <summary>
-    /// Helper function for identifying if the latest point is a negative zero crossing
+    /// Detaches, disables and deletes a block controller
     /// </summary>
-    /// <param name="dataArray">Vector of sensing data to assess for zero crossing</param>
-    /// <returns>Boolean indicating if the latest point is a negative zero crossing</returns>
-    bool BICListener::isNegZeroCrossing(std::vector<double> dataArray)
+    /// <param name="controllerId">Controller ID the block controller is attached to</param>
+    /// <param name="kind">Kind of block controller the caller manages, a controller of another kind is left attached</param>
+    /// <returns>True if a block controller of the given kind was detached</returns>
+    bool BICListener::detachBlockController(uint32_t controllerId, BlockControllerKind kind)
     {
-        bool isNegZeroCrossing = false;
+        if (controllerId >= MAX_CLOSED_LOOP_CONTROLLERS)
+        {
+            return false;
+        }
 
-        // Check neighboring samples to determine for a zero-crossing
-        if (dataArray[0] < 0)
+        std::lock_guard<std::mutex> lifecycleLock(m_stimLifecycleLock);
+        m_controllerLock.lock();
+        IBlockController* theController = blockControllers[controllerId];
+        if (theController == NULL || theController->getKind() != kind)
         {
-            if (dataArray[1] > 0)
-            {
-                isNegZeroCrossing = true;
-            }
+            m_controllerLock.unlock();
+            return false;
+        }
+        StimulationScheduler* theScheduler = blockControllerSchedulers[controllerId];
+        blockControllers[controllerId] = NULL;
+        blockControllerSchedulers[controllerId] = NULL;
+        controllerEnabled[controllerId] = false;
+        bool isAnyEnabled = false;
+        for (uint32_t otherId = 0; otherId < MAX_CLOSED_LOOP_CONTROLLERS; otherId++)
+        {
+            isAnyEnabled = isAnyEnabled || controllerEnabled[otherId];
         }
-        return isNegZeroCrossing;
+        m_controllerLock.unlock();
+
+        // Drop any delayed trigger and stop the stimulation thread first so no stimulation of this controller is issued after it is gone
+        delete theScheduler;
+        stopTriggeredStimIfIdle(isAnyEnabled);
+        std::cout << "STIM INFO: Controller " << controllerId << " block controller " << theController->getName() << " detached" << std::endl;
+        delete theController;
+        return true;
     }
 
     /// <summary>
-    /// Helper function for identifying if the previous sample was a maximum
+    /// Starts the stimulation thread shared by all closed-loop controllers if it is not already running. Called with m_stimLifecycleLock held.
     /// </summary>
-    /// <param name="dataArray">Vector of sensing data to assess for zero crossing</param>
-    /// <returns>Boolean indicating if the latest point is a negative zero crossing</returns>
-    bool BICListener::isMax(std::vector<double> dataArray)
+    /// <param name="triggerWaitMode">Whether the stimulation thread sleeps or polls while waiting for a trigger</param>
+    /// <param name="triggerSpinMicroseconds">Polling time before falling back to sleeping in spin mode, 0 to poll until a trigger arrives</param>
+    void BICListener::startTriggeredStim(TriggerWaitMode triggerWaitMode, uint32_t triggerSpinMicroseconds)
     {
-        bool isMax = false;
-
-        // Check if neighboring samples are smaller
-        if (dataArray[0] < dataArray[1] && dataArray[1] > dataArray[2])
+        if (isCLStimEn)
         {
-            isMax = true;
+            return;
         }
-        return isMax;
+
+        // Instantiate the trigger mailbox for thread notification
+        stimMailbox = new TriggerMailbox(triggerWaitMode, triggerSpinMicroseconds);
+
+        // Update state tracking variable
+        isCLStimEn = true;
+
+        // Start thread up
+        distributedStimThread = new std::thread(&BICListener::triggeredSendStimThread, this);
     }
 
     /// <summary>
-    /// Helper function for identifying if the previous sample was a minimum
+    /// Stops the shared stimulation thread once no closed-loop controller is enabled. Called with m_stimLifecycleLock held, after the
+    /// disabled controller's schedulers are gone, so nothing posts to the mailbox while it is deleted.
     /// </summary>
-    /// <param name="dataArray">Vector of sensing data to assess for zero crossing</param>
-    /// <returns>Boolean indicating if the latest point is a negative zero crossing</returns>
-    bool BICListener::isMin(std::vector<double> dataArray)
+    /// <param name="isAnyEnabled">True if any controller is still enabled, read under m_controllerLock by the caller</param>
+    void BICListener::stopTriggeredStimIfIdle(bool isAnyEnabled)
     {
-        bool isMin = false;
+        if (isAnyEnabled || !isCLStimEn)
+        {
+            return;
+        }
+
+        // Update state tracking variable
+        isCLStimEn = false;
+        stimMailbox->close();
 
-        // Check if neighboring samples are smaller
-        if (dataArray[0] > dataArray[1] && dataArray[1] < dataArray[2])
+        // Disable Closed Loop since it is enabled and request is to disable
+        distributedStimThread->join();
+        distributedStimThread->~thread();
+        delete distributedStimThread;
+        distributedStimThread = NULL;
+
+        // Ensure stimulation is stopped
+        theImplantedDevice->stopStimulation();
+
+        // Report trigger delivery and clean up the mailbox
+        TriggerMailboxStats mailboxStats = stimMailbox->getStats();
+        std::cout << "STIM INFO: " << mailboxStats.posted << " stimulation triggers posted, " << mailboxStats.delivered << " delivered ("
+            << mailboxStats.spinDeliveries << " while polling), " << mailboxStats.posted - mailboxStats.delivered << " coalesced with a pending trigger or dropped at shutdown." << std::endl;
+        if (skippedScheduledStims > 0)
         {
-            isMin = true;
+            std::cout << "STIM INFO: " << skippedScheduledStims << " predictive stimulations skipped while a stimulation was active." << std::endl;
         }
-        return isMin;
+        delete stimMailbox;
+        stimMailbox = NULL;
+        stimPendingControllers = 0;
+        stimFiredControllers = 0;
+        stimScheduledControllers = 0;
+        skippedScheduledStims = 0;
     }
     
     /// <summary>
-    /// Helper function to identify if a certain phase has passed
+    /// Thread to be started up when phase-triggered stimulation functionality is enabled.
+    /// Delivers the stimulation of every controller that triggered since the last wakeup.
     /// </summary>
-    /// <param name="prevPhase">Vector of previous phase data</param>
-    /// <param name="triggerPhase">Current triggering phase value</param>
-    /// <returns>Boolean indicating if the phase for triggering stim has passed</returns>
-    bool BICListener::detectTriggerPhase(std::vector<double> prevPhase, double triggerPhase)
+    void BICListener::triggeredSendStimThread()
     {
-        bool wasTriggerPhase = false;
-        double currTrigPhase = triggerPhase;
-        double latestPhase = prevPhase[0];
-        double oldestPhase = prevPhase[3];
+        // Apply the configured scheduling for this thread
+        ThreadRoleRegistry::instance().applyRole(THREAD_ROLE_STIM_TRIGGER);
+
+        // enable stim time logging
+        enableStimTimeLogging(true);
 
-        // for the ascending hyperpolarizing case, may need to convert phase estimations
-        if (phasicStimTarget == 1)
+        // Wait for a zero crossing, triggers posted while a stimulation is in progress stay pending in the mailbox
+        TriggerDelivery trigger;
+
+        // Loop while streaming is active
+        while (stimMailbox->wait(&trigger) && isCLStimEn)
         {
-            // convert the appropriate phases to enable proper comparison
-            if (triggerPhase > 270)
-            {
-                double currTrigPhase = triggerPhase - 360;
-            }
-            if (oldestPhase > 270)
+            uint32_t pendingControllers = stimPendingControllers.exchange(0);
+            for (uint32_t controllerId = 0; controllerId < MAX_CLOSED_LOOP_CONTROLLERS; controllerId++)
             {
-                double oldestPhase = prevPhase[3] - 360;
+                if ((pendingControllers & (1u << controllerId)) != 0)
+                {
+                    issueControllerStimulation(controllerId, NULL);
+                }
             }
-            if (latestPhase > 270)
+
+            // Predictive deadlines reached since the last wakeup, issued here so they never overlap another stimulation command
+            uint32_t scheduledControllers = stimScheduledControllers.exchange(0);
+            for (uint32_t controllerId = 0; controllerId < MAX_CLOSED_LOOP_CONTROLLERS; controllerId++)
             {
-                double latestPhase = prevPhase[0] - 360;
+                if ((scheduledControllers & (1u << controllerId)) != 0)
+                {
+                    issueScheduledStimulation(controllerId);
+                }
             }
         }
+    }
 
-        if (latestPhase > currTrigPhase && oldestPhase < currTrigPhase)
+    /// <summary>
+    /// Marks a controller's stimulation as pending and wakes the stimulation thread. Called with m_controllerLock held.
+    /// </summary>
+    /// <param name="controllerId">Controller that found a valid target</param>
+    void BICListener::postControllerTrigger(uint32_t controllerId)
+    {
+        if (stimMailbox == NULL)
         {
-            wasTriggerPhase = true;
+            return;
         }
-        return wasTriggerPhase;
+        stimPendingControllers.fetch_or(1u << controllerId);
+        stimMailbox->post();
     }
 
     /// <summary>
-    /// Function for calculating the phase of a sample
+    /// Issues the stimulation of one controller and logs its timing
     /// </summary>
-    /// <param name="dataArray">Vector of filtered sensing data</param>
-    /// <param name="currTimeStamp">Timestamp of the current sample</param>
-    /// <param name="prevSigFreq">Vector of previously calculated frequencies</param>
-    /// <param name="prevPhase">Vector of previously calculated phases</param>
-    /// <returns>Calculated phase of the current sample</returns>
-    double BICListener::calcPhase(std::vector<double> dataArray, uint64_t currSamp, std::vector<double>* prevSigFreq, std::vector<double>* prevPhase)
+    /// <param name="controllerId">Controller the stimulation belongs to</param>
+    /// <param name="scheduledStimulation">Deadline and issue time of a predictive stimulation, NULL when issued on trigger</param>
+    void BICListener::issueControllerStimulation(uint32_t controllerId, const ScheduledStimulation* scheduledStimulation)
     {
-        double avgSigFreq = 0;
-        double sigFreq = 0;
-        double currPhase = 0;
-        uint64_t sampDiff = 0;
-
-        // Identify sample difference 
-        sampDiff = currSamp - refSamp;
+        // create instance of stimTimes to keep track of before and after stim timestamps
+        StimTimes startStimulationTimes;
+        startStimulationTimes.controllerId = (int32_t)controllerId;
+        startStimulationTimes.triggerPhase = controllerTriggerPhase[controllerId];
+        startStimulationTimes.eventTimeStamp = controllerEventTimeStamp[controllerId].exchange(0);
 
-        // Estimate oscillation frequency
-        if (isPosZeroCrossing(dataArray) || isNegZeroCrossing(dataArray) || isMax(dataArray) || isMin(dataArray))
+        // Get time before start stimulation command (UTC)
+        std::chrono::system_clock::time_point before = std::chrono::system_clock::now();
+        startStimulationTimes.beforeStimTimeStamp = before.time_since_epoch().count();
+        if (scheduledStimulation != NULL)
         {
-            // If so, calculate the frequency
-            sigFreq = 1 / (4 * sampDiff * 0.001);
-
-            // Check that the calculated frequency is within reasonable bounds
-            if (sigFreq > 10 && sigFreq < 30) 
-            {
-                prevSigFreq->insert(prevSigFreq->begin(), sigFreq);
-                prevSigFreq->pop_back();
-            }
+            startStimulationTimes.scheduledStimTimeStamp = (before - std::chrono::duration_cast<std::chrono::system_clock::duration>(scheduledStimulation->issueTime - scheduledStimulation->deadline)).time_since_epoch().count();
+            startStimulationTimes.schedulingErrorNs = scheduledStimulation->schedulingErrorNs;
+        }
 
-            // Depending on its type, identify the current phase and reassign reference point for estimating phase
-            if (isPosZeroCrossing(dataArray))
+        try
+        {
+            // Execute the stimulation command, attributing the coming stimulation onset to this controller
+            stimFiredControllers.fetch_or(1u << controllerId);
+            int64_t stimFunctionIndex = controllerTriggerStimFunction[controllerId].exchange(NO_STIM_FUNCTION_INDEX);
+            if (stimFunctionIndex == NO_STIM_FUNCTION_INDEX)
             {
-                currPhase = 0;
-                refSamp = currSamp;
-                refPoint = 0;
+                stimFunctionIndex = controllerStimFunction[controllerId];
             }
-            else if (isNegZeroCrossing(dataArray))
+            if (stimFunctionIndex == NO_STIM_FUNCTION_INDEX)
             {
-                currPhase = 180;
-                refSamp = currSamp;
-                refPoint = 180;
-            } 
-
-            else if (isMax(dataArray))
-            {
-                currPhase = 90;
-                refSamp = currSamp;
-                refPoint = 90;
+                theImplantedDevice->startStimulation();
             }
-            else if (isMin(dataArray))
+            else
             {
-                currPhase = 270;
-                refSamp = currSamp;
-                refPoint = 270;
+                theImplantedDevice->startStimulation((uint32_t)stimFunctionIndex);
             }
-        }
 
-        // Calculate the phase value using previously recorded signal frequencies
-        else
+            // If no exception encountered, mark it 0
+            startStimulationTimes.recordedException = "0";
+        }
+        catch (std::exception& anyException)
         {
-            for (int i = 0; i < prevSigFreq->size(); i++)
-            {
-                avgSigFreq += prevSigFreq->at(i);
-            }
-            avgSigFreq /= prevSigFreq->size();
+            std::cout << "ERROR: Stimulation exception encountered: " << anyException.what() << std::endl;
 
-            currPhase = refPoint + (0.001 * sampDiff * avgSigFreq * 360);
+            // Also keep track of exception encountered
+            startStimulationTimes.recordedException = anyException.what();
+        }
+        catch (...)
+        {
+            std::cout << "ERROR: Stimulation exception encountered. No reason" << std::endl;
+            startStimulationTimes.recordedException = "Unknown";
         }
 
-        // Save the calculated phase
-        prevPhase->insert(prevPhase->begin(), currPhase);
-        prevPhase->pop_back();
+        // Get time after start stimulation command (UTC), or the time the exception occurred
+        startStimulationTimes.afterStimTimeStamp = std::chrono::system_clock::now().time_since_epoch().count();
 
-        return currPhase;
+        // Add the timestamps and exception to the stim time log
+        queueStimTime(startStimulationTimes);
     }
 
     /// <summary>
-    /// Function for updating the triggering phase value
+    /// Schedules a controller's stimulation at the predicted time the sensed oscillation reaches its target phase.
+    /// Falls back to immediate triggering when no usable frequency estimate is available. Called with m_controllerLock held.
     /// </summary>
-    /// <param name="prevStimPhase">phase of current sample that just triggered stimulation</param>
-    void BICListener::updateTriggerPhase(double prevStimPhase, std::vector<double>* prevTrigPhase)
+    /// <param name="controllerId">Controller that found a valid target</param>
+    /// <param name="currentPhase">Estimated phase of the sample that produced the valid target</param>
+    /// <param name="sampleTimeStamp">Receive time of that sample (system_clock ticks)</param>
+    void BICListener::schedulePredictiveStim(uint32_t controllerId, double currentPhase, uint64_t sampleTimeStamp)
     {
-        double phaseDiff = 0;
-        double actPhaseDiff = 0;
-        bool isValidTrigPhase = false;
-
-        // find phase difference and use that to update stimTriggerPhase alongside arbitrary gain
-        phaseDiff = prevStimPhase - stimTargetPhase; 
-
-        if (phaseDiff > 180)
-        {
-            actPhaseDiff = phaseDiff - 360;
-        }
-        else if (phaseDiff < -180)
-        {
-            actPhaseDiff = phaseDiff + 360;
-        }
-        else
+        ClosedLoopController* theController = controllers[controllerId];
+        if (theController->stimScheduler->isPending())
         {
-            actPhaseDiff = phaseDiff;
+            return;
         }
-        stimTriggerPhase -= (0.1) * actPhaseDiff;
 
-        // make "conversions" in order to minimize issues when updating trigger phase
-        if (stimTriggerPhase < 0)
+        // Phase still to travel, as a fraction of a cycle
+        double phaseToTarget = std::fmod(theController->getTargetPhase() - currentPhase, 360.0);
+        if (phaseToTarget < 0)
         {
-            stimTriggerPhase += 360; 
-        }
-        else if (stimTriggerPhase > 360)
-        {
-            stimTriggerPhase -= 360; 
+            phaseToTarget += 360;
         }
 
-        // Do appropriate conversions in order to enable trigger phase comparison for the ascending hyperpolarizing case
-        if (phasicStimTarget == 1)
-        {
-            // In the case where stimTriggerPhase is 270 - 360
-            if ((stimTriggerPhase >= 270) && (stimTriggerPhase <= 360))
-            {
-                // "convert" the phase to enable appropriate comparison
-                if (((stimTriggerPhase - 360) > lowerBound) && ((stimTriggerPhase - 360) < upperBound))
-                {
-                    isValidTrigPhase = true;
-                }
-            }
-            else
-            {
-                // otherwise, just go ahead and make the comparison to determine if stimTriggerPhase is out of bounds
-                if ((stimTriggerPhase > lowerBound) && (stimTriggerPhase < upperBound))
-                {
-                    isValidTrigPhase = true;
-                }
-            }
-            
-        }
-        // for all other phase targets
-        else 
-        {
-            // Check to reset stimTriggerPhase if out of bounds
-            if ((stimTriggerPhase > lowerBound) && (stimTriggerPhase < upperBound))
-            {
-                isValidTrigPhase = true;
-            }
-        }
-        
-        if (isValidTrigPhase)
+        double frequency = theController->getPhaseEstimator()->getFrequency();
+        if (!(frequency > 0) || std::isinf(frequency))
         {
-            // if newly calculated trigger phase is within bounds, add to the history 
-            prevTrigPhase->insert(prevTrigPhase->begin(), stimTriggerPhase);
-            prevTrigPhase->pop_back();
+            postControllerTrigger(controllerId);
+            return;
         }
-        else
+
+        // Time to the target phase, measured from when the sample was received
+        std::chrono::system_clock::duration sinceSample = std::chrono::system_clock::now().time_since_epoch() - std::chrono::system_clock::duration(sampleTimeStamp);
+        std::chrono::duration<double> untilTarget = std::chrono::duration<double>(phaseToTarget / (360 * frequency)) - sinceSample;
+        theController->stimScheduler->schedule(std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(untilTarget));
+    }
+
+    /// <summary>
+    /// Called from a controller's scheduler thread at a predicted stimulation deadline. Hands the stimulation to the stimulation thread,
+    /// so scheduled and triggered stimulation commands are issued one at a time.
+    /// </summary>
+    /// <param name="controllerId">Controller the scheduler belongs to</param>
+    /// <param name="firedStimulation">Deadline and issue time of the stimulation</param>
+    void BICListener::firePredictiveStim(uint32_t controllerId, const ScheduledStimulation& firedStimulation)
+    {
+        m_scheduledStimLock.lock();
+        controllerFiredStimulation[controllerId] = firedStimulation;
+        m_scheduledStimLock.unlock();
+
+        if (stimMailbox == NULL)
         {
-            // otherwise, update the trigger phase to be the median of previous trigger phases
-            stimTriggerPhase = findMedian(prevTrigPhase);
-            if (stimTriggerPhase == 0) // in the case that there hasn't been enough stimulation to establish a steady history of trigger phases, the median will yield 0
-            {
-                stimTriggerPhase = (lowerBound + upperBound) * 0.5;
-            }
+            return;
         }
+        stimScheduledControllers.fetch_or(1u << controllerId);
+        stimMailbox->post();
     }
 
     /// <summary>
-    /// Function for detecting if too many stimulation pulses have been sent out consecutively
+    /// Issues a controller's predictive stimulation on the stimulation thread. The stimulation is skipped if one is already active,
+    /// as open-loop stimulation does.
     /// </summary>
-    /// <param name="stimSampArray">Container of sample numbers indicating the onset of stimulation</param>
-    /// <param name="selfTrigThresh">Value dictating the maximum amount of time between two stimulation onsets to be considered self triggering </param>
-    void BICListener::detectSelfTriggering(std::vector<int> stimSampArray, double selfTrigThresh)
+    /// <param name="controllerId">Controller whose predictive deadline was reached</param>
+    void BICListener::issueScheduledStimulation(uint32_t controllerId)
     {
-        int counter = 0;
+        m_scheduledStimLock.lock();
+        ScheduledStimulation firedStimulation = controllerFiredStimulation[controllerId];
+        m_scheduledStimLock.unlock();
 
-        // Identify consecutive stimulation pulses
-        for (int i = 0; i < stimSampArray.size() - 1; i++)
+        if (isStimulating())
         {
-            if ((stimSampArray[i] - stimSampArray[i + 1]) <= selfTrigThresh)
-            {
-                // For every instance they are back to back, increase the counter
-                counter++;
-            }
+            // Clear the trigger's details so they are not attributed to the controller's next stimulation
+            controllerEventTimeStamp[controllerId] = 0;
+            controllerTriggerStimFunction[controllerId] = NO_STIM_FUNCTION_INDEX;
+            skippedScheduledStims++;
+            return;
         }
 
-        // Check if the number of self-triggering pulses exceeds the threshold limit and return boolean state
-        if (counter < stimSampArray.size() - 1)
+        // The scheduling error includes the hand-off to this thread
+        firedStimulation.issueTime = std::chrono::steady_clock::now();
+        firedStimulation.schedulingErrorNs = std::chrono::duration_cast<std::chrono::nanoseconds>(firedStimulation.issueTime - firedStimulation.deadline).count();
+        issueControllerStimulation(controllerId, &firedStimulation);
+    }
+
+    /// <summary>
+    /// Adds a stimulation's timestamps to the stim time log queue if there is room
+    /// </summary>
+    /// <param name="stimulationTimes">Timestamps and exception of the stimulation</param>
+    void BICListener::queueStimTime(const StimTimes& stimulationTimes)
+    {
+        if (streamQueued[STATUS_STREAM_STIM_TIME_LOG] < 1000)
         {
-            isSelfTrig = false;
+            // Lock the stim time buffer, add data, unlock
+            this->m_stimTimeBufferLock.lock();
+            stimTimeSampleQueue.push(stimulationTimes); // add struct with timestamps and exception to queue
+            streamQueued[STATUS_STREAM_STIM_TIME_LOG]++;
+            this->m_stimTimeBufferLock.unlock();
+
+            // Write it out with any others queued within the batching delay
+            stimTimeLogDrain.signalAt(std::chrono::steady_clock::now() + STIM_TIME_LOG_BATCH_DELAY);
         }
         else
         {
-            isSelfTrig = true;
+            streamDrops[STATUS_STREAM_STIM_TIME_LOG]++;
+            std::cout << "WARNING: Before Stim Time Log Queue Size Overflow, streaming data skipped" << std::endl;
         }
     }
 
-    double BICListener::findMedian(std::vector<double>* inputArray)
+    /// <summary>
+    /// Adds a pointer to the implanted device interface to the BICListener, required for phase-locked stim functionality
+    /// </summary>
+    /// <param name="anImplantedDevice">the active impalnted device</param>
+    void BICListener::addImplantPointer(cortec::implantapi::IImplant* anImplantedDevice)
     {
-        // Copy the input and sort its contents
-        std::vector<double>sorted(inputArray->size());
-        sorted= *inputArray;
-        sort(sorted.begin(), sorted.end());
-
-        // Determine the median value for the input and return it
-        double medianVal = sorted[((sorted.size() - 1) / 2) + 1];
-
-        return medianVal;
+        theImplantedDevice = anImplantedDevice;
     }
 
     /// <summary>
-    /// Private function that reads stimulation time data from queue and record to a file
+    /// Time from receiving the sample that caused a stimulation to issuing the stimulation command
     /// </summary>
-    void BICListener::logStimTimeThread()
+    /// <param name="stimulationTimes">Logged stimulation</param>
+    /// <returns>Latency in nanoseconds, 0 if the triggering sample is not known</returns>
+    static int64_t eventToCommandNs(const StimTimes& stimulationTimes)
     {
-        std::mutex stimTimeDataLock;
-        std::unique_lock<std::mutex> stimTimeDataWait(stimTimeDataLock);
-
-        // Open File
-        std::ofstream myFile;
-
-        // Get current date and time
-        time_t currTime;
-        char timeStampBuffer[100];
-        struct tm* curr_tm;
-        time(&currTime);
-        curr_tm = localtime(&currTime);
-
-        // Format date and time
-        strftime(timeStampBuffer, 100, "%m%d%Y_%I%M%S", curr_tm);
-        std::string timeStamp(timeStampBuffer);
-
-        // Append to the name of the stim logging file 
-        std::string fileName = "stimTimeLog_" + timeStamp + ".csv";
-        myFile.open(fileName, std::ios_base::app);
-        myFile << "BeforeStim, AfterStim, Exception, triggerPhase" << "\n";
-        myFile.close();
+        if (stimulationTimes.eventTimeStamp == 0)
+        {
+            return 0;
+        }
+        std::chrono::system_clock::duration latency((int64_t)(stimulationTimes.beforeStimTimeStamp - stimulationTimes.eventTimeStamp));
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(latency).count();
+    }
 
-        // Loop while streaming is active
-        while (stimTimeLoggingState)
+    /// <summary>
+    /// Private function that appends queued stimulation times to the log file. Run on the shared executor once the batching delay
+    /// after a queued stimulation has passed, so the file is opened once per batch rather than once per stimulation.
+    /// </summary>
+    void BICListener::drainStimTimeLog()
+    {
+        // Take the whole batch so stimulations queued meanwhile do not wait for the file
+        std::queue<StimTimes> stimTimeBatch;
+        this->m_stimTimeBufferLock.lock();
+        stimTimeBatch.swap(stimTimeSampleQueue);
+        streamQueued[STATUS_STREAM_STIM_TIME_LOG] = 0;
+        this->m_stimTimeBufferLock.unlock();
+        if (stimTimeBatch.empty())
         {
-            // if either are empty, wait
-            if (stimTimeSampleQueue.empty())
-            {
-                stimTimeDataNotify->wait(stimTimeDataWait);
-            }
-            else
+            return;
+        }
+
+        try {
+            std::ofstream myFile;
+            myFile.open(stimTimeLogFileName, std::ios_base::app);
+            while (!stimTimeBatch.empty())
             {
-                try {
-                    // Lock the buffer
-                    this->m_stimTimeBufferLock.lock();
-                    // Write out new line to file
-                    myFile.open(fileName, std::ios_base::app);
-                    // log timestamp before and after stim command and exception
-                    myFile << stimTimeSampleQueue.front().beforeStimTimeStamp << ", " << stimTimeSampleQueue.front().afterStimTimeStamp << ", " << stimTimeSampleQueue.front().recordedException << ", " << stimTriggerPhase << "\n";
-                    myFile.close();
-                    // Clean up the current sample from the list
-                    stimTimeSampleQueue.pop(); // take out first item of queue
-                    // Unlock the neurobuffer
-                    this->m_stimTimeBufferLock.unlock();
-                }
-                catch (std::exception& anyException)
-                {
-                    std::cout << "ERROR: Stim Time Logging Failed: " << anyException.what() << std::endl;
-                }
-                catch (...)
-                {
-                    std::cout << "ERROR: Stim Time Logging Failed. No reason." << std::endl;
-                }
+                // log timestamp before and after stim command and exception
+                const StimTimes& stimulationTimes = stimTimeBatch.front();
+                myFile << stimulationTimes.beforeStimTimeStamp << ", " << stimulationTimes.afterStimTimeStamp << ", " << stimulationTimes.recordedException << ", " << stimulationTimes.triggerPhase << ", "
+                    << stimulationTimes.scheduledStimTimeStamp << ", " << stimulationTimes.schedulingErrorNs << ", " << stimulationTimes.controllerId << ", "
+                    << eventToCommandNs(stimulationTimes) << "\n";
+                stimTimeBatch.pop();
             }
+            myFile.close();
+        }
+        catch (std::exception& anyException)
+        {
+            std::cout << "ERROR: Stim Time Logging Failed: " << anyException.what() << std::endl;
+        }
+        catch (...)
+        {
+            std::cout << "ERROR: Stim Time Logging Failed. No reason." << std::endl;
         }
     }
 
@@ -1382,151 +1759,137 @@ namespace BICGRPCHelperNamespace
         // Determine action to be taken. Only take action if requested action matches potential actions based on current state.
         if (enableSensing && stimTimeLoggingState == false)
         {
-            // Update state tracking variable
+            // Get current date and time
+            time_t currTime;
+            char timeStampBuffer[100];
+            struct tm* curr_tm;
+            time(&currTime);
+            curr_tm = localtime(&currTime);
+
+            // Format date and time
+            strftime(timeStampBuffer, 100, "%m%d%Y_%I%M%S", curr_tm);
+            std::string timeStamp(timeStampBuffer);
+
+            // Append to the name of the stim logging file and write the header
+            stimTimeLogFileName = "stimTimeLog_" + timeStamp + ".csv";
+            std::ofstream myFile;
+            myFile.open(stimTimeLogFileName, std::ios_base::app);
+            myFile << "BeforeStim, AfterStim, Exception, triggerPhase, ScheduledStim, SchedulingErrorNs, Controller, EventToCommandNs" << "\n";
+            myFile.close();
+
+            // Update state tracking variable and accept batches
             stimTimeLoggingState = true;
-            // Conditional variable for thread notification
-            stimTimeDataNotify = new std::condition_variable();
-            // Start thread
-            stimTimeLoggingThread = new std::thread(&BICListener::logStimTimeThread, this);
+            stimTimeLogDrain.open();
         }
         else if (!enableSensing && stimTimeLoggingState == true)
         {
-            // Shut down streaming. First notify and wait for streaming handling thread to stop.
+            // Shut down logging. Once no batch is pending or being written, write out what is left from this thread.
             stimTimeLoggingState = false;
-            stimTimeDataNotify->notify_all();
-            stimTimeLoggingThread->join();
-
-            // Delete generated resources to free memory
-            stimTimeLoggingThread->~thread();
-            delete stimTimeLoggingThread;
-            stimTimeLoggingThread = NULL;
-
-            stimTimeDataNotify->~condition_variable();
-            delete stimTimeDataNotify;
-            stimTimeDataNotify = NULL;
+            stimTimeLogDrain.close();
+            drainStimTimeLog();
         }
     }
 
     /// <summary>
-    /// Function that enables the delivery of open-loop stimulation by continually re-triggering stimulation at a defined interval
+    /// Function that enables the delivery of open-loop stimulation by re-triggering stimulation at fixed deadlines from the shared open-loop scheduler
     /// </summary>
     /// <param name="enableOpenLoop">Boolean indicating if open-loop stimulation should be enabled or disabled</param>
     /// <param name="watchdogInterval">Interval that the stimulation should be stopped and restarted in milliseconds</param>
-    void BICListener::enableOpenLoopStim(bool enableOpenLoop, uint32_t watchdogInterval)
+    /// <param name="targetRateHz">Stimulation rate in Hz, overrides watchdogInterval when greater than 0</param>
+    void BICListener::enableOpenLoopStim(bool enableOpenLoop, uint32_t watchdogInterval, double targetRateHz)
     {
         if (enableOpenLoop && !isTriggeringStimulation() && !isStimulating())
         {
             // Update state tracking variable
             isOLStimEn = true;
-            if (watchdogInterval > 10)
-            {
-                openLoopSleepTimeDuration = watchdogInterval;
-            }
-            else
+
+            // Periods stay no shorter than the 10 ms floor of the previous polling loop
+            double periodNs = targetRateHz > 0 ? 1e9 / targetRateHz : (double)watchdogInterval * 1e6;
+            if (periodNs < 10e6)
             {
-                openLoopSleepTimeDuration = 10;
+                periodNs = 10e6;
             }
 
-            // Start thread up
-            openLoopStimThread = new std::thread(&BICListener::openLoopStimLoopThread, this);
+            // Enable stim time logging and register with the scheduler, the first stimulation is issued right away
+            enableStimTimeLogging(true);
+            openLoopScheduleId = OpenLoopScheduler::instance().add(periodNs, std::bind(&BICListener::fireOpenLoopStim, this, std::placeholders::_1));
+            std::cout << "STIM INFO: Open loop stimulation enabled with a period of " << periodNs / 1e6 << " ms" << std::endl;
         }
         else if (!enableOpenLoop && isOLStimEn)
         {
             // Update state tracking variable
             isOLStimEn = false;
-            
+
+            // Remove the schedule first so no stimulation is issued after the stop below
+            OpenLoopJitterStats finalStats;
+            OpenLoopScheduler::instance().remove(openLoopScheduleId, &finalStats);
+            openLoopScheduleId = 0;
+
             // Ensure stimulation is stopped
             theImplantedDevice->stopStimulation();
 
-            // Disable Closed Loop since it is enabled and request is to disable
-            openLoopStimThread->join();
-            openLoopStimThread->~thread();
-            delete openLoopStimThread;
-            openLoopStimThread = NULL;
+            std::cout << "STIM INFO: Open loop stimulation disabled. Issued " << finalStats.issuedPeriods << " periods, missed " << finalStats.missedPeriods
+                << ", scheduling error mean " << finalStats.meanErrorNs << " ns, std dev " << finalStats.stdDevErrorNs << " ns, max " << finalStats.maxErrorNs << " ns" << std::endl;
         }
     }
 
-    void BICListener::openLoopStimLoopThread(void)
+    /// <summary>
+    /// Accessor for the timing statistics of the running open-loop stimulation
+    /// </summary>
+    /// <param name="stats">Filled with the statistics</param>
+    /// <returns>True if open-loop stimulation is running</returns>
+    bool BICListener::getOpenLoopJitterStats(OpenLoopJitterStats* stats)
     {
-        // Create instance of stimTimes to keep track of before and after stim timestamps
-        StimTimes startStimulationTimes;
-        // Enable stim time logging
-        enableStimTimeLogging(true);
-
-        // initialize before and after timestamps
-        std::chrono::system_clock::time_point before;
-        std::chrono::system_clock::time_point after;
+        return isOLStimEn && OpenLoopScheduler::instance().getStats(openLoopScheduleId, stats);
+    }
 
-        while (isOLStimEn)
+    /// <summary>
+    /// Open-loop scheduler callback: restarts stimulation unless the previous stimulation is still running
+    /// </summary>
+    /// <param name="firedStimulation">Deadline and issue time of this period</param>
+    /// <returns>False if stimulation is still active and the scheduler should retry, true otherwise</returns>
+    bool BICListener::fireOpenLoopStim(const ScheduledStimulation& firedStimulation)
+    {
+        if (isStimulating())
         {
-            // Get time before start stimulation command (UTC)
-            before = std::chrono::system_clock::now();
-            startStimulationTimes.beforeStimTimeStamp = before.time_since_epoch().count();
-
-            try {
-                // Check if stimulation is already occuring- once stimulation is no longer active, retrigger
-                while (isStimulating())
-                {
-                    std::this_thread::sleep_for(std::chrono::milliseconds(10)); // sleep for 10 ms before checking again
-                }
-
-                // Re-trigger stimulation
-                theImplantedDevice->startStimulation();
-
-                //Get time after start stimulation command (UTC)
-                after = std::chrono::system_clock::now();
-                startStimulationTimes.afterStimTimeStamp = after.time_since_epoch().count();
+            return false;
+        }
 
-                // No exception encountered, so label as "0"
-                startStimulationTimes.recordedException = "0";
+        // Create instance of stimTimes to keep track of before and after stim timestamps
+        StimTimes startStimulationTimes;
 
-                // Add latest received data packet to the buffer if there is room
-                if (stimTimeSampleQueue.size() < 1000)
-                {
-                    // Lock the stim time buffer, add data, unlock
-                    this->m_stimTimeBufferLock.lock();
-                    stimTimeSampleQueue.push(startStimulationTimes); // add struct with timestamps and exception to queue
-                    this->m_stimTimeBufferLock.unlock();
+        // Get time before start stimulation command (UTC), the deadline is expressed on the same clock for the log
+        std::chrono::system_clock::time_point before = std::chrono::system_clock::now();
+        startStimulationTimes.beforeStimTimeStamp = before.time_since_epoch().count();
+        startStimulationTimes.scheduledStimTimeStamp = (before - std::chrono::duration_cast<std::chrono::system_clock::duration>(firedStimulation.issueTime - firedStimulation.deadline)).time_since_epoch().count();
+        startStimulationTimes.schedulingErrorNs = firedStimulation.schedulingErrorNs;
 
-                    // Notify the streaming function that new data exists
-                    stimTimeDataNotify->notify_all();
-                }
-                else
-                {
-                    std::cout << "WARNING: Before Stim Time Log Queue Size Overflow, streaming data skipped" << std::endl;
-                }
+        try {
+            // Re-trigger stimulation
+            theImplantedDevice->startStimulation();
 
-                // Sleep for the triggering duration
-                std::this_thread::sleep_for(std::chrono::milliseconds(openLoopSleepTimeDuration));
-            }
-            catch (std::exception& anyException)
-            {
-                std::cout << "ERROR: Open Loop Management Exception Encountered. Reason: " << anyException.what() << std::endl;
+            // No exception encountered, so label as "0"
+            startStimulationTimes.recordedException = "0";
+        }
+        catch (std::exception& anyException)
+        {
+            std::cout << "ERROR: Open Loop Management Exception Encountered. Reason: " << anyException.what() << std::endl;
 
-                // If exception occurred, after is the time the exception occurred
-                after = std::chrono::system_clock::now();
-                startStimulationTimes.afterStimTimeStamp = after.time_since_epoch().count();
+            // Also keep track of exception encountered
+            startStimulationTimes.recordedException = anyException.what();
+        }
+        catch (...)
+        {
+            std::cout << "ERROR: Open Loop Management Exception Encountered. No reason." << std::endl;
+            startStimulationTimes.recordedException = "unknown";
+        }
 
-                // Also keep track of exception encountered
-                startStimulationTimes.recordedException = anyException.what();
+        // Get time after start stimulation command, or the time the exception occurred (UTC)
+        startStimulationTimes.afterStimTimeStamp = std::chrono::system_clock::now().time_since_epoch().count();
 
-                if (stimTimeSampleQueue.size() < 1000)
-                {
-                    // Lock the stim time buffer, add data, unlock
-                    this->m_stimTimeBufferLock.lock();
-                    stimTimeSampleQueue.push(startStimulationTimes); // add struct with timestamps and exception to queue
-                    this->m_stimTimeBufferLock.unlock();
-                }
-                else
-                {
-                    std::cout << "WARNING: Before Stim Time Log Queue Size Overflow, streaming data skipped" << std::endl;
-                }
-            }
-            catch (...)
-            {
-                std::cout << "ERROR: Open Loop Management Exception Encountered. No reason." << std::endl;
-            }
-        }
+        // Add the timestamps and exception to the stim time log
+        queueStimTime(startStimulationTimes);
+        return true;
     }
 
     /// <summary>
@@ -1538,11 +1901,60 @@ namespace BICGRPCHelperNamespace
         return isCLStimEn || isOLStimEn;
     }
 
+    /// <summary>
+    /// Gathers the state the listener holds for the device, for status snapshots. Does not call the device.
+    /// </summary>
+    /// <returns>Copy of the listener state</returns>
+    ListenerStatus BICListener::getStatus()
+    {
+        ListenerStatus theStatus;
+        theStatus.isStimulating = isStimulating();
+        theStatus.isMeasuring = isMeasuring();
+        theStatus.isOpenLoopEnabled = isOLStimEn;
+        theStatus.isClosedLoopEnabled = isCLStimEn;
+        theStatus.isShadowStreaming = shadowStreamingState;
+        {
+            std::lock_guard<std::mutex> lock(m_statusLock);
+            theStatus.usbConnection = usbConnection;
+            theStatus.inductiveConnection = inductiveConnection;
+            theStatus.overallConnection = overallConnection;
+            theStatus.rfQuality = rfQuality;
+        }
+
+        // Queue depths come from counters kept alongside each queue's pushes and pops, the queues themselves belong to their drains
+        theStatus.streams[STATUS_STREAM_NEURAL].isEnabled = neuralStreamingState;
+        theStatus.streams[STATUS_STREAM_TEMPERATURE].isEnabled = temperatureStreamingState;
+        theStatus.streams[STATUS_STREAM_HUMIDITY].isEnabled = humidityStreamingState;
+        theStatus.streams[STATUS_STREAM_CONNECTION].isEnabled = connectionStreamingState;
+        theStatus.streams[STATUS_STREAM_ERROR].isEnabled = errorStreamingState;
+        theStatus.streams[STATUS_STREAM_POWER].isEnabled = powerStreamingState;
+        theStatus.streams[STATUS_STREAM_STIM_TIME_LOG].isEnabled = stimTimeLoggingState;
+        for (int streamIndex = 0; streamIndex < STATUS_STREAM_COUNT; streamIndex++)
+        {
+            theStatus.streams[streamIndex].queued = streamQueued[streamIndex];
+            theStatus.streams[streamIndex].dropped = streamDrops[streamIndex];
+        }
+        return theStatus;
+    }
+
+    /// <summary>
+    /// Records a reported connection state for status snapshots
+    /// </summary>
+    /// <param name="theConnection">Connection reported</param>
+    /// <param name="isConnected">Reported state</param>
+    void BICListener::recordConnection(ConnectionStatus* theConnection, bool isConnected)
+    {
+        std::lock_guard<std::mutex> lock(m_statusLock);
+        theConnection->isKnown = true;
+        theConnection->isConnected = isConnected;
+        theConnection->timeStamp = std::chrono::system_clock::now().time_since_epoch().count();
+    }
+
     //*************************************************** Power Data Streaming Functions ***************************************************
     /// <summary>
     /// Enable or disable power streaming to a gRPC client. 
     /// Function instructs BIC to start streaming, resulting in data being received by various power event handler functions.  
-    /// Events puts data in a queue for independent transmission to client by thread utilizing "grpcPowerStreamThread" function.
+    /// Events puts data in a queue for independent transmission to client by the "drainPowerQueue" task on the shared executor.
     /// </summary>
     /// <param name="enableSensing">True if streaming is being requested to be enabled, false otherwise</param>
     /// <param name="aWriter">gRPC client writing interface.</param>
@@ -1557,62 +1969,41 @@ namespace BICGRPCHelperNamespace
             // Prepare to stream power data
             powerStreamingState = true;
             powerWriter = aWriter;
-            powerDataNotify = new std::condition_variable();
-            powerProcessingThread = new std::thread(&BICListener::grpcPowerStreamThread, this);
+            powerDrain.open();
         }
         else if (!enableSensing && powerStreamingState == true)
         {
-            // Shut down streaming. First notify and wait for streaming handling thread to stop.
+            // Shut down streaming. Wait for a drain in progress so the writer is not used after the stream ends.
             powerStreamingState = false;
-            powerDataNotify->notify_all();
-            powerProcessingThread->join();
-
-            // Delete generated resources to free memory
-            powerProcessingThread->~thread();
-            delete powerProcessingThread;
-            powerProcessingThread = NULL;
-
-            powerDataNotify->~condition_variable();
-            delete powerDataNotify;
-            powerDataNotify = NULL;
+            powerDrain.close();
         }
     }
 
     /// <summary>
-    /// Private function that reads power data from queue and sends to gRPC client. Intended to be run as a thread by enablePowerSensing.
+    /// Private function that writes queued power data to the gRPC client. Run on the shared executor whenever data is queued.
     /// </summary>
-    void BICListener::grpcPowerStreamThread()
+    void BICListener::drainPowerQueue()
     {
-        // Prepare the waiting for data variables
-        std::mutex powerDataLock;
-        std::unique_lock<std::mutex> powerDataWait(powerDataLock);
-
-        // Loop while streaming is active
-        while (powerStreamingState)
+        while (powerStreamingState && !powerSampleQueue.empty())
         {
-            if (powerSampleQueue.empty())
+            // Attempt to write the packet to the gRPC stream writer
+            try {
+                // WARNING - THIS WILL BLOCK IF WRITER BUFFER IS FULL DUE TO SLOW READING BY CLIENT
+                powerWriter->Write(*powerSampleQueue.front());
+            }
+            catch (std::exception& anyException)
             {
-                powerDataNotify->wait(powerDataWait);
+                std::cout << "ERROR: GRPC Write Failed: " << anyException.what() << std::endl;
             }
-            else
+            catch (...)
             {
-                // Attempt to write the packet to the gRPC stream writer
-                try {
-                    // WARNING - THIS WILL BLOCK IF WRITER BUFFER IS FULL DUE TO SLOW READING BY CLIENT
-                    powerWriter->Write(*powerSampleQueue.front());
-
-                    // Clean up the current sample from the list
-                    powerSampleQueue.pop();
-                }
-                catch (std::exception& anyException)
-                {
-                    std::cout << "ERROR: GRPC Write Failed: " << anyException.what() << std::endl;
-                }
-                catch (...)
-                {
-                    std::cout << "ERROR: GRPC Write Buffer Failed. No reason." << std::endl;
-                }
+                std::cout << "ERROR: GRPC Write Buffer Failed. No reason." << std::endl;
             }
+
+            // Clean up the current sample from the list, a failed write is not retried
+            delete powerSampleQueue.front();
+            powerSampleQueue.pop();
+            streamQueued[STATUS_STREAM_POWER]--;
         }
     }
 
@@ -1622,6 +2013,19 @@ namespace BICGRPCHelperNamespace
     /// <param name="voltageMicroV">New implant voltage level</param>
     void BICListener::onImplantVoltageChanged(const double voltageMicroV)
     {
+        // Keep the latest value for reads that do not need to reach the device
+        telemetryCache.update(TELEMETRY_IMPLANT_VOLTAGE, voltageMicroV);
+
+        // Add it to the unified telemetry stream if one is open
+        if (telemetryStreamingState)
+        {
+            TelemetryUpdate* telemetryMessage = new TelemetryUpdate();
+            telemetryMessage->mutable_power()->set_parameter("Voltage");
+            telemetryMessage->mutable_power()->set_value(voltageMicroV);
+            telemetryMessage->mutable_power()->set_units("microvolts");
+            publishTelemetry(TELEMETRY_SOURCE_VOLTAGE, telemetryMessage);
+        }
+
         // If gRPC power streaming is enabled, write out the update
         if (powerStreamingState)
         {
@@ -1631,14 +2035,16 @@ namespace BICGRPCHelperNamespace
             powerMessage->set_units("microvolts");
 
             // Add it to the buffer if there is room
-            if (powerSampleQueue.size() < 100)
+            if (streamQueued[STATUS_STREAM_POWER] < 100)
             {
+                streamQueued[STATUS_STREAM_POWER]++;
                 powerSampleQueue.push(powerMessage);
-                powerDataNotify->notify_all();
+                powerDrain.signal();
             }
             else
             {
                 delete powerMessage;
+                streamDrops[STATUS_STREAM_POWER]++;
                 std::cout << "WARNING: GRPC Power Queue Size Overflow, streaming data skipped" << std::endl;
             }
         }
@@ -1650,6 +2056,19 @@ namespace BICGRPCHelperNamespace
     /// <param name="currentMilliA">New coil current in milliamps</param>
     void BICListener::onPrimaryCoilCurrentChanged(const double currentMilliA)
     {
+        // Keep the latest value for reads that do not need to reach the device
+        telemetryCache.update(TELEMETRY_COIL_CURRENT, currentMilliA);
+
+        // Add it to the unified telemetry stream if one is open
+        if (telemetryStreamingState)
+        {
+            TelemetryUpdate* telemetryMessage = new TelemetryUpdate();
+            telemetryMessage->mutable_power()->set_parameter("CoilCurrent");
+            telemetryMessage->mutable_power()->set_value(currentMilliA);
+            telemetryMessage->mutable_power()->set_units("milliamperes");
+            publishTelemetry(TELEMETRY_SOURCE_COIL_CURRENT, telemetryMessage);
+        }
+
         // If gRPC power streaming is enabled, write out the update
         if (powerStreamingState)
         {
@@ -1659,14 +2078,16 @@ namespace BICGRPCHelperNamespace
             powerMessage->set_units("milliamperes");
 
             // Add it to the buffer if there is room
-            if (powerSampleQueue.size() < 100)
+            if (streamQueued[STATUS_STREAM_POWER] < 100)
             {
+                streamQueued[STATUS_STREAM_POWER]++;
                 powerSampleQueue.push(powerMessage);
-                powerDataNotify->notify_all();
+                powerDrain.signal();
             }
             else
             {
                 delete powerMessage;
+                streamDrops[STATUS_STREAM_POWER]++;
                 std::cout << "WARNING: GRPC Power Queue Size Overflow, streaming data skipped" << std::endl;
             }
         }
@@ -1678,6 +2099,19 @@ namespace BICGRPCHelperNamespace
     /// <param name="controlValue">New power system control percentage</param>
     void BICListener::onImplantControlValueChanged(const double controlValue)
     {
+        // Keep the latest value for reads that do not need to reach the device
+        telemetryCache.update(TELEMETRY_CONTROL_VALUE, controlValue);
+
+        // Add it to the unified telemetry stream if one is open
+        if (telemetryStreamingState)
+        {
+            TelemetryUpdate* telemetryMessage = new TelemetryUpdate();
+            telemetryMessage->mutable_power()->set_parameter("Control");
+            telemetryMessage->mutable_power()->set_value(controlValue);
+            telemetryMessage->mutable_power()->set_units("%");
+            publishTelemetry(TELEMETRY_SOURCE_CONTROL_VALUE, telemetryMessage);
+        }
+
         // If gRPC power streaming is enabled, write out the update
         if (powerStreamingState)
         {
@@ -1687,14 +2121,16 @@ namespace BICGRPCHelperNamespace
             powerMessage->set_units("%");
 
             // Add it to the buffer if there is room
-            if (powerSampleQueue.size() < 100)
+            if (streamQueued[STATUS_STREAM_POWER] < 100)
             {
+                streamQueued[STATUS_STREAM_POWER]++;
                 powerSampleQueue.push(powerMessage);
-                powerDataNotify->notify_all();
+                powerDrain.signal();
             }
             else
             {
                 delete powerMessage;
+                streamDrops[STATUS_STREAM_POWER]++;
                 std::cout << "WARNING: GRPC Power Queue Size Overflow, streaming data skipped" << std::endl;
             }
         }
@@ -1704,7 +2140,7 @@ namespace BICGRPCHelperNamespace
     /// <summary>
     /// Enable or disable temperature streaming to a gRPC client. 
     /// Function instructs BIC to start streaming, resulting in data being received by "onTemperatureChanged" event handler function.  
-    /// onTemperatureChanged puts data in a queue for independent transmission to client by thread utilizing "grpcTemperatureStreamThread" function.
+    /// onTemperatureChanged puts data in a queue for independent transmission to client by the "drainTemperatureQueue" task on the shared executor.
     /// </summary>
     /// <param name="enableSensing">True if streaming is being requested to be enabled, false otherwise</param>
     /// <param name="aWriter">gRPC client writing inteface.</param>
@@ -1719,62 +2155,41 @@ namespace BICGRPCHelperNamespace
             // Prepare to stream neural data
             temperatureStreamingState = true;
             temperatureWriter = aWriter;
-            temperatureDataNotify = new std::condition_variable();
-            temperatureProcessingThread = new std::thread(&BICListener::grpcTemperatureStreamThread, this);
+            temperatureDrain.open();
         }
         else if (!enableSensing && temperatureStreamingState == true)
         {
-            // Shut down streaming. First notify and wait for streaming handling thread to stop.
+            // Shut down streaming. Wait for a drain in progress so the writer is not used after the stream ends.
             temperatureStreamingState = false;
-            temperatureDataNotify->notify_all();
-            temperatureProcessingThread->join();
-
-            // Delete generated resources to free memory
-            temperatureProcessingThread->~thread();
-            delete temperatureProcessingThread;
-            temperatureProcessingThread = NULL;
-
-            temperatureDataNotify->~condition_variable();
-            delete temperatureDataNotify;
-            temperatureDataNotify = NULL;
+            temperatureDrain.close();
         }
     }
 
     /// <summary>
-    /// Private function that reads temperature data from queue and sends to gRPC client. Intended to be run as a thread by enableTemperatureSensing.
+    /// Private function that writes queued temperature data to the gRPC client. Run on the shared executor whenever data is queued.
     /// </summary>
-    void BICListener::grpcTemperatureStreamThread()
+    void BICListener::drainTemperatureQueue()
     {
-        // Prepare the waiting for data variables
-        std::mutex temperatureDataLock;
-        std::unique_lock<std::mutex> temperatureDataWait(temperatureDataLock);
-
-        // Loop while streaming is active
-        while (temperatureStreamingState)
+        while (temperatureStreamingState && !temperatureSampleQueue.empty())
         {
-            if (temperatureSampleQueue.empty())
+            // Attempt to write the packet to the gRPC stream writer
+            try {
+                // WARNING - THIS WILL BLOCK IF WRITER BUFFER IS FULL DUE TO SLOW READING BY CLIENT
+                temperatureWriter->Write(*temperatureSampleQueue.front());
+            }
+            catch (std::exception& anyException)
             {
-                temperatureDataNotify->wait(temperatureDataWait);
+                std::cout << "ERROR: GRPC Write Failed: " << anyException.what() << std::endl;
             }
-            else
+            catch (...)
             {
-                // Attempt to write the packet to the gRPC stream writer
-                try {
-                    // WARNING - THIS WILL BLOCK IF WRITER BUFFER IS FULL DUE TO SLOW READING BY CLIENT
-                    temperatureWriter->Write(*temperatureSampleQueue.front());
-
-                    // Clean up the current sample from the list
-                    temperatureSampleQueue.pop();
-                }
-                catch (std::exception& anyException)
-                {
-                    std::cout << "ERROR: GRPC Write Failed: " << anyException.what() << std::endl;
-                }
-                catch (...)
-                {
-                    std::cout << "ERROR: GRPC Write Buffer Failed. No reason." << std::endl;
-                }
+                std::cout << "ERROR: GRPC Write Buffer Failed. No reason." << std::endl;
             }
+
+            // Clean up the current sample from the list, a failed write is not retried
+            delete temperatureSampleQueue.front();
+            temperatureSampleQueue.pop();
+            streamQueued[STATUS_STREAM_TEMPERATURE]--;
         }
     }
 
@@ -1784,6 +2199,18 @@ namespace BICGRPCHelperNamespace
     /// <param name="temperature">New implanted device's temperature</param>
     void BICListener::onTemperatureChanged(const double temperature)
     {
+        // Keep the latest value for reads that do not need to reach the device
+        telemetryCache.update(TELEMETRY_TEMPERATURE, temperature);
+
+        // Add it to the unified telemetry stream if one is open
+        if (telemetryStreamingState)
+        {
+            TelemetryUpdate* telemetryMessage = new TelemetryUpdate();
+            telemetryMessage->mutable_temperature()->set_temperature(temperature);
+            telemetryMessage->mutable_temperature()->set_units("celsius");
+            publishTelemetry(TELEMETRY_SOURCE_TEMPERATURE, telemetryMessage);
+        }
+
         // If gRPC temperature streaming is enabled, write out the update
         if (temperatureStreamingState)
         {
@@ -1792,14 +2219,16 @@ namespace BICGRPCHelperNamespace
             temperatureMessage->set_units("celsius");
 
             // Add it to the buffer if there is room
-            if (temperatureSampleQueue.size() < 100)
+            if (streamQueued[STATUS_STREAM_TEMPERATURE] < 100)
             {
+                streamQueued[STATUS_STREAM_TEMPERATURE]++;
                 temperatureSampleQueue.push(temperatureMessage);
-                temperatureDataNotify->notify_all();
+                temperatureDrain.signal();
             }
             else
             {
                 delete temperatureMessage;
+                streamDrops[STATUS_STREAM_TEMPERATURE]++;
                 std::cout << "WARNING: GRPC Temperature Queue Size Overflow, streaming data skipped" << std::endl;
             }
         }
@@ -1809,7 +2238,7 @@ namespace BICGRPCHelperNamespace
     /// <summary>
     /// Enable or disable humidity streaming to a gRPC client. 
     /// Function instructs BIC to start streaming, resulting in data being received by "onHumidityChanged" event handler function.  
-    /// onHumidityChanged puts data in a queue for independent transmission to client by thread utilizing "grpcHumidityStreamThread" function.
+    /// onHumidityChanged puts data in a queue for independent transmission to client by the "drainHumidityQueue" task on the shared executor.
     /// </summary>
     /// <param name="enableSensing">True if streaming is being requested to be enabled, false otherwise</param>
     /// <param name="aWriter">gRPC client writing inteface.</param>
@@ -1824,62 +2253,41 @@ namespace BICGRPCHelperNamespace
             // Prepare to stream humidity data
             humidityStreamingState = true;
             humidityWriter = aWriter;
-            humidityDataNotify = new std::condition_variable();
-            humidityProcessingThread = new std::thread(&BICListener::grpcHumidityStreamThread, this);
+            humidityDrain.open();
         }
         else if (!enableSensing && humidityStreamingState == true)
         {
-            // Shut down streaming. First notify and wait for streaming handling thread to stop.
+            // Shut down streaming. Wait for a drain in progress so the writer is not used after the stream ends.
             humidityStreamingState = false;
-            humidityDataNotify->notify_all();
-            humidityProcessingThread->join();
-
-            // Delete generated resources to free memory
-            humidityProcessingThread->~thread();
-            delete humidityProcessingThread;
-            humidityProcessingThread = NULL;
-
-            humidityDataNotify->~condition_variable();
-            delete humidityDataNotify;
-            humidityDataNotify = NULL;
+            humidityDrain.close();
         }
     }
     
     /// <summary>
-    /// Private function that reads humidity data from queue and sends to gRPC client. Intended to be run as a thread by enableHumiditySensing.
+    /// Private function that writes queued humidity data to the gRPC client. Run on the shared executor whenever data is queued.
     /// </summary>
-    void BICListener::grpcHumidityStreamThread()
+    void BICListener::drainHumidityQueue()
     {
-        // Prepare the waiting for data variables
-        std::mutex humidityDataLock;
-        std::unique_lock<std::mutex> humidityDataWait(humidityDataLock);
-
-        // Loop while streaming is active
-        while (humidityStreamingState)
+        while (humidityStreamingState && !humiditySampleQueue.empty())
         {
-            if (humiditySampleQueue.empty())
+            // Attempt to write the packet to the gRPC stream writer
+            try {
+                // WARNING - THIS WILL BLOCK IF WRITER BUFFER IS FULL DUE TO SLOW READING BY CLIENT
+                humidityWriter->Write(*humiditySampleQueue.front());
+            }
+            catch (std::exception& anyException)
             {
-                humidityDataNotify->wait(humidityDataWait);
+                std::cout << "ERROR: GRPC Write Failed: " << anyException.what() << std::endl;
             }
-            else
+            catch (...)
             {
-                // Attempt to write the packet to the gRPC stream writer
-                try {
-                    // WARNING - THIS WILL BLOCK IF WRITER BUFFER IS FULL DUE TO SLOW READING BY CLIENT
-                    humidityWriter->Write(*humiditySampleQueue.front());
-
-                    // Clean up the current sample from the list
-                    humiditySampleQueue.pop();
-                }
-                catch (std::exception& anyException)
-                {
-                    std::cout << "ERROR: GRPC Write Failed: " << anyException.what() << std::endl;
-                }
-                catch (...)
-                {
-                    std::cout << "ERROR: GRPC Write Buffer Failed. No reason." << std::endl;
-                }
+                std::cout << "ERROR: GRPC Write Buffer Failed. No reason." << std::endl;
             }
+
+            // Clean up the current sample from the list, a failed write is not retried
+            delete humiditySampleQueue.front();
+            humiditySampleQueue.pop();
+            streamQueued[STATUS_STREAM_HUMIDITY]--;
         }
     }
 
@@ -1889,6 +2297,18 @@ namespace BICGRPCHelperNamespace
     /// <param name="humidity">New implanted device's humidity level</param>
     void BICListener::onHumidityChanged(const double humidity)
     {
+        // Keep the latest value for reads that do not need to reach the device
+        telemetryCache.update(TELEMETRY_HUMIDITY, humidity);
+
+        // Add it to the unified telemetry stream if one is open
+        if (telemetryStreamingState)
+        {
+            TelemetryUpdate* telemetryMessage = new TelemetryUpdate();
+            telemetryMessage->mutable_humidity()->set_humidity(humidity);
+            telemetryMessage->mutable_humidity()->set_units("rh");
+            publishTelemetry(TELEMETRY_SOURCE_HUMIDITY, telemetryMessage);
+        }
+
         // If gRPC humidity streaming is enabled, write out the update
         if (humidityStreamingState)
         {
@@ -1897,24 +2317,89 @@ namespace BICGRPCHelperNamespace
             humidityMessage->set_units("rh");
 
             // Add it to the buffer if there is room
-            if (humiditySampleQueue.size() < 100)
+            if (streamQueued[STATUS_STREAM_HUMIDITY] < 100)
             {
+                streamQueued[STATUS_STREAM_HUMIDITY]++;
                 humiditySampleQueue.push(humidityMessage);
-                humidityDataNotify->notify_all();
+                humidityDrain.signal();
             }
             else
             {
                 delete humidityMessage;
+                streamDrops[STATUS_STREAM_HUMIDITY]++;
                 std::cout << "WARNING: GRPC Humidity Queue Size Overflow, streaming data skipped" << std::endl;
             }
         }
     }
 
+    //*************************************************** Unified Telemetry Streaming Functions ***************************************************
+    /// <summary>
+    /// Attaches the multiplexer of an opened telemetry stream. The event handlers publish temperature, humidity, power, connection and
+    /// error updates to it and the gRPC thread serving the stream writes them out, so the stream needs no listener thread.
+    /// </summary>
+    /// <param name="theMultiplexer">Multiplexer of the stream, owned by the stream and detached by stopTelemetryStream() before it is freed</param>
+    /// <returns>True if attached, false if a telemetry stream is already open</returns>
+    bool BICListener::attachTelemetryMultiplexer(TelemetryMultiplexer* theMultiplexer)
+    {
+        std::lock_guard<std::mutex> lock(m_telemetryLock);
+        if (telemetryMultiplexer != NULL)
+        {
+            return false;
+        }
+        telemetryMultiplexer = theMultiplexer;
+        telemetryStreamingState = true;
+        return true;
+    }
+
+    /// <summary>
+    /// Detaches a telemetry stream's multiplexer when its writer finishes. Nothing is published to it after this returns.
+    /// </summary>
+    /// <param name="theMultiplexer">Multiplexer of the finishing stream, left alone if another stream has replaced it</param>
+    void BICListener::detachTelemetryMultiplexer(TelemetryMultiplexer* theMultiplexer)
+    {
+        std::lock_guard<std::mutex> lock(m_telemetryLock);
+        if (telemetryMultiplexer == theMultiplexer)
+        {
+            telemetryMultiplexer = NULL;
+            telemetryStreamingState = false;
+        }
+    }
+
+    /// <summary>
+    /// Stops and detaches the open telemetry stream, waking its writer. Nothing is published to the multiplexer after this returns.
+    /// </summary>
+    void BICListener::stopTelemetryStream()
+    {
+        std::lock_guard<std::mutex> lock(m_telemetryLock);
+        if (telemetryMultiplexer != NULL)
+        {
+            telemetryMultiplexer->stop();
+            telemetryMultiplexer = NULL;
+        }
+        telemetryStreamingState = false;
+    }
+
+    /// <summary>
+    /// Publishes an update to the open telemetry stream
+    /// </summary>
+    /// <param name="source">Update source</param>
+    /// <param name="anUpdate">Update, owned by the listener until published and freed if no stream takes it</param>
+    void BICListener::publishTelemetry(TelemetrySource source, TelemetryUpdate* anUpdate)
+    {
+        std::lock_guard<std::mutex> lock(m_telemetryLock);
+        if (telemetryMultiplexer == NULL)
+        {
+            delete anUpdate;
+            return;
+        }
+        telemetryMultiplexer->publish(source, anUpdate);
+    }
+
     //*************************************************** Error Streaming Functions ***************************************************
     /// <summary>
     /// Enable or disable error streaming to a gRPC client. 
     /// Function instructs BIC to start streaming, resulting in data being received by "onError" event handler function.  
-    /// onError puts data in a queue for independent transmission to client by thread utilizing "grpcErrorStreamThread" function.
+    /// onError puts data in a queue for independent transmission to client by the "drainErrorQueue" task on the shared executor.
     /// </summary>
     /// <param name="enableSensing">True if streaming is being requested to be enabled, false otherwise</param>
     /// <param name="aWriter">gRPC client writing inteface.</param>
@@ -1929,62 +2414,41 @@ namespace BICGRPCHelperNamespace
             // Prepare to stream error data
             errorStreamingState = true;
             errorWriter = aWriter;
-            errorDataNotify = new std::condition_variable();
-            errorProcessingThread = new std::thread(&BICListener::grpcErrorStreamThread, this);
+            errorDrain.open();
         }
         else if (!enableSensing && errorStreamingState == true)
         {
-            // Shut down streaming. First notify and wait for streaming handling thread to stop.
+            // Shut down streaming. Wait for a drain in progress so the writer is not used after the stream ends.
             errorStreamingState = false;
-            errorDataNotify->notify_all();
-            errorProcessingThread->join();
-
-            // Delete generated resources to free memory
-            errorProcessingThread->~thread();
-            delete errorProcessingThread;
-            errorProcessingThread = NULL;
-
-            errorDataNotify->~condition_variable();
-            delete errorDataNotify;
-            errorDataNotify = NULL;
+            errorDrain.close();
         }
     }
 
     /// <summary>
-    /// Private function that reads error data from queue and sends to gRPC client. Intended to be run as a thread by enableErrorSensing.
+    /// Private function that writes queued error data to the gRPC client. Run on the shared executor whenever data is queued.
     /// </summary>
-    void BICListener::grpcErrorStreamThread()
+    void BICListener::drainErrorQueue()
     {
-        // Prepare the waiting for data variables
-        std::mutex errorDataLock;
-        std::unique_lock<std::mutex> errorDataWait(errorDataLock);
-
-        // Loop while streaming is active
-        while (errorStreamingState)
+        while (errorStreamingState && !errorSampleQueue.empty())
         {
-            if (errorSampleQueue.empty())
+            // Attempt to write the packet to the gRPC stream writer
+            try {
+                // WARNING - THIS WILL BLOCK IF WRITER BUFFER IS FULL DUE TO SLOW READING BY CLIENT
+                errorWriter->Write(*errorSampleQueue.front());
+            }
+            catch (std::exception& anyException)
             {
-                errorDataNotify->wait(errorDataWait);
+                std::cout << "ERROR: GRPC Write Failed. Reason: " << anyException.what() << std::endl;
             }
-            else
+            catch (...)
             {
-                // Attempt to write the packet to the gRPC stream writer
-                try {
-                    // WARNING - THIS WILL BLOCK IF WRITER BUFFER IS FULL DUE TO SLOW READING BY CLIENT
-                    errorWriter->Write(*errorSampleQueue.front());
-
-                    // Clean up the current sample from the list
-                    errorSampleQueue.pop();
-                }
-                catch (std::exception& anyException)
-                {
-                    std::cout << "ERROR: GRPC Write Failed. Reason: " << anyException.what() << std::endl;
-                }
-                catch (...)
-                {
-                    std::cout << "ERROR: GRPC Write Buffer Failed. No reason." << std::endl;
-                }
+                std::cout << "ERROR: GRPC Write Buffer Failed. No reason." << std::endl;
             }
+
+            // Clean up the current sample from the list, a failed write is not retried
+            delete errorSampleQueue.front();
+            errorSampleQueue.pop();
+            streamQueued[STATUS_STREAM_ERROR]--;
         }
     }
 
@@ -1994,6 +2458,14 @@ namespace BICGRPCHelperNamespace
     /// <param name="err">Error information from BIC DLL</param>
     void BICListener::onError(const std::exception& err)
     {
+        // Add it to the unified telemetry stream if one is open
+        if (telemetryStreamingState)
+        {
+            TelemetryUpdate* telemetryMessage = new TelemetryUpdate();
+            telemetryMessage->mutable_error()->set_message(err.what());
+            publishTelemetry(TELEMETRY_SOURCE_ERROR, telemetryMessage);
+        }
+
         // If gRPC error streaming is enabled, write out the update
         if (errorStreamingState)
         {
@@ -2001,14 +2473,16 @@ namespace BICGRPCHelperNamespace
             errorMessage->set_message(err.what());
 
             // Add it to the buffer if there is room
-            if (errorSampleQueue.size() < 100)
+            if (streamQueued[STATUS_STREAM_ERROR] < 100)
             {
+                streamQueued[STATUS_STREAM_ERROR]++;
                 errorSampleQueue.push(errorMessage);
-                errorDataNotify->notify_all();
+                errorDrain.signal();
             }
             else
             {
                 delete errorMessage;
+                streamDrops[STATUS_STREAM_ERROR]++;
                 std::cout << "WARNING: GRPC Error Queue Size Overflow, streaming data skipped" << std::endl;
             }
         }
@@ -2021,7 +2495,15 @@ namespace BICGRPCHelperNamespace
     {
         // Important event, write it out to the console
         std::cout << "CRITICAL WARNING: Data processing too slow" << std::endl;
-        
+
+        // Add it to the unified telemetry stream if one is open
+        if (telemetryStreamingState)
+        {
+            TelemetryUpdate* telemetryMessage = new TelemetryUpdate();
+            telemetryMessage->mutable_error()->set_message("CRITICAL WARNING: Data processing too slow");
+            publishTelemetry(TELEMETRY_SOURCE_ERROR, telemetryMessage);
+        }
+
         // If gRPC error streaming is enabled, write out the update
         if (errorStreamingState)
         {
@@ -2029,14 +2511,16 @@ namespace BICGRPCHelperNamespace
             errorMessage->set_message("CRITICAL WARNING: Data processing too slow");
 
             // Add it to the buffer if there is room
-            if (errorSampleQueue.size() < 100)
+            if (streamQueued[STATUS_STREAM_ERROR] < 100)
             {
+                streamQueued[STATUS_STREAM_ERROR]++;
                 errorSampleQueue.push(errorMessage);
-                errorDataNotify->notify_all();
+                errorDrain.signal();
             }
             else
             {
                 delete errorMessage;
+                streamDrops[STATUS_STREAM_ERROR]++;
                 std::cout << "WARNING: GRPC Error Queue Size Overflow, streaming data skipped" << std::endl;
             }
         }
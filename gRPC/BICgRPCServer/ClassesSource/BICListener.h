@@ -1,37 +1,82 @@
 #pragma once
 #include <cppapi/bicapi.h>
 #include <cppapi/Sample.h>
+#include <atomic>
 #include <queue>
 #include <thread>
 #include <grpcpp/grpcpp.h>
 #include "BICgRPC.grpc.pb.h"
+#include "SampleBlock.h"
+#include "GapInterpolator.h"
+#include "ClosedLoopController.h"
+#include "ControllerPlugin.h"
+#include "DeviceStatus.h"
+#include "OpenLoopScheduler.h"
+#include "SharedExecutor.h"
+#include "ShadowEvaluator.h"
+#include "StimulationStateNotifier.h"
+#include "TelemetryMultiplexer.h"
+#include "TelemetryReadCache.h"
+#include "TriggerMailbox.h"
 
 namespace BICGRPCHelperNamespace
 {
+    /// <summary>
+    /// Closed-loop processing outputs that can be included in streamed neural samples, combined as a bitmask
+    /// </summary>
+    enum DspOutputs : uint32_t
+    {
+        DSP_OUTPUT_NONE = 0x00,
+        DSP_OUTPUT_FILT_SAMPLE = 0x01,
+        DSP_OUTPUT_PHASE = 0x02,
+        DSP_OUTPUT_TRIGGER_PHASE = 0x04,
+        DSP_OUTPUT_PRE_FILT_SAMPLE = 0x08,
+        DSP_OUTPUT_HAMPEL_FILT_SAMPLE = 0x10,
+        DSP_OUTPUT_VALID_TARGET = 0x20,
+        DSP_OUTPUT_ALL = 0x3F
+    };
+
     struct StimTimes
     {
         uint64_t beforeStimTimeStamp;
         uint64_t afterStimTimeStamp;
         std::string recordedException;
+        uint64_t scheduledStimTimeStamp = 0;    // Deadline the stimulation was scheduled for (system_clock ticks), 0 if issued on trigger
+        int64_t schedulingErrorNs = 0;          // Issue time minus scheduled deadline
+        int32_t controllerId = -1;              // Closed-loop controller that triggered the stimulation, -1 for open loop
+        double triggerPhase = 0;                // Trigger phase of the controller when it triggered
+        uint64_t eventTimeStamp = 0;            // Receive time of the sample that caused the trigger (system_clock ticks), 0 if not known
     };
 
+    // Stimulation function index of a controller that starts the current stimulation command instead of a preloaded function
+    static const int64_t NO_STIM_FUNCTION_INDEX = -1;
+
     class BICListener : public cortec::implantapi::IImplantListener
     {
     public:
         // ************************* Public Sensing Management **********************
-        void enableNeuralStreaming(bool enableSensing, uint32_t dataBufferSize, uint32_t interplationThreshold, grpc::ServerWriter<BICgRPC::NeuralUpdate>* aWriter);
+        void enableNeuralStreaming(bool enableSensing, uint32_t dataBufferSize, uint32_t interplationThreshold, InterpolationMethod interpolationMethod, GapHandlingMode gapHandling, uint32_t dspOutputs, double samplingRate, grpc::ServerWriter<BICgRPC::NeuralUpdate>* aWriter, grpc::ServerWriter<BICgRPC::NeuralBlockUpdate>* aBlockWriter);
         void enableTemperatureStreaming(bool enableSensing, grpc::ServerWriter<BICgRPC::TemperatureUpdate>* aWriter);
         void enableHumidityeStreaming(bool enableSensing, grpc::ServerWriter<BICgRPC::HumidityUpdate>* aWriter);
         void enableConnectionStreaming(bool enableSensing, grpc::ServerWriter<BICgRPC::ConnectionUpdate>* aWriter);
         void enableErrorStreaming(bool enableSensing, grpc::ServerWriter<BICgRPC::ErrorUpdate>* aWriter);
         void enablePowerStreaming(bool enableSensing, grpc::ServerWriter<BICgRPC::PowerUpdate>* aWriter);
+        bool attachTelemetryMultiplexer(TelemetryMultiplexer* theMultiplexer);
+        void detachTelemetryMultiplexer(TelemetryMultiplexer* theMultiplexer);
+        void stopTelemetryStream();
 
         // ************************* Public Distributed Algorithm Stimulation Management *************************
-        void enableOpenLoopStim(bool enableOpenLoop, uint32_t watchdogInterval);
-        void enableDistributedStim(bool enableDistributed, int phaseSensingChannel, std::vector<double> filtCoeff_B, std::vector<double> filtCoeff_A, uint32_t triggeredFunctionIndex, double stimThreshold, double triggerPhase, double targetPhase);
+        void enableOpenLoopStim(bool enableOpenLoop, uint32_t watchdogInterval, double targetRateHz);
+        bool getOpenLoopJitterStats(OpenLoopJitterStats* stats);
+        bool enableDistributedStim(bool enableDistributed, int phaseSensingChannel, std::vector<double> filtCoeff_B, std::vector<double> filtCoeff_A, uint32_t triggeredFunctionIndex, double stimThreshold, double triggerPhase, double targetPhase, PhaseEstimatorType phaseEstimatorType, uint32_t phaseEstimatorWindow, uint32_t predictionHorizon, bool predictiveScheduling, TriggerWaitMode triggerWaitMode, uint32_t triggerSpinMicroseconds, double samplingRate);
+        bool enableClosedLoopController(uint32_t controllerId, bool enable, const ClosedLoopControllerConfig& config, bool predictiveScheduling, int64_t stimFunctionIndex, TriggerWaitMode triggerWaitMode, uint32_t triggerSpinMicroseconds);
+        bool updateClosedLoopController(uint32_t controllerId, const ClosedLoopParameters& parameters);
+        bool attachShadowEvaluator(ShadowEvaluator* theEvaluator);
+        void detachShadowEvaluator(ShadowEvaluator* theEvaluator);
+        bool attachBlockController(uint32_t controllerId, IBlockController* theController, int64_t stimFunctionIndex, TriggerWaitMode triggerWaitMode, uint32_t triggerSpinMicroseconds);
+        bool detachBlockController(uint32_t controllerId, BlockControllerKind kind);
         void addImplantPointer(cortec::implantapi::IImplant* theImplantedDevice);
         void enableStimTimeLogging(bool enableSensing);
-        double processingHelper(double newData, uint64_t currSamp, std::vector<int> stimSampHistory, std::vector<double>* dataHistory, std::vector<double>* stimHistory, std::vector<double>* hampelDataHistory, std::vector<double>* dcFiltHistory, double filterGain);
 
         // ************************* Public Event Handlers *************************
         void onStimulationStateChanged(const bool isStimulating);
@@ -58,142 +103,166 @@ namespace BICGRPCHelperNamespace
         bool isStimulating();
         bool isMeasuring();
         bool isTriggeringStimulation();
+        ListenerStatus getStatus();
+        InterpolationStatistics getInterpolationStatistics();
+        PhaseEstimatorCost getPhaseEstimatorCost();
+        StimulationStateNotifier stimStateNotifier;     // Stimulation state changes for threads that wait on them instead of polling isStimulating()
+        TelemetryReadCache telemetryCache;              // Latest temperature, humidity and power values pushed by the device
         bool neuralStreamingState = false;
         bool temperatureStreamingState = false;
         bool humidityStreamingState = false;
         bool connectionStreamingState = false;
         bool errorStreamingState = false;
         bool powerStreamingState = false;
+        bool telemetryStreamingState = false;
         bool stimTimeLoggingState = false;
+        bool shadowStreamingState = false;
        
     private:
         // ************************* Private General State Objects and Methods *************************
         // Stim Logging Functions
-        void logStimTimeThread(void);
+        void drainStimTimeLog(void);
+        void queueStimTime(const StimTimes& stimulationTimes);
         
         // Generic state variables.
         std::mutex m_mutex;                     // General purpose mutex used for protecting against multi-threaded state access.
         std::mutex m_neuroBufferLock;           // General purpose mutex for protecting the neurobuffer against incomplete read/writes
         std::mutex m_stimTimeBufferLock;        // General purpose mutex for protecting stimtimebuffer against incomplete read/writes
+        std::mutex m_interpolatorLock;          // Protects neuralInterpolator, used by the data callback and reconfigured or read by other threads
         bool m_isStimulating;                   // State variable indicating latest stimulation state received from device.
         bool m_isMeasuring;                     // State variable indicating latest measurement state received from device.
         cortec::implantapi::IImplant* theImplantedDevice;   // Pointer to the implanted device that is generating BICListener events
 
+        // Device status reported in snapshots
+        std::mutex m_statusLock;                // Protects the connection and RF quality status
+        ConnectionStatus usbConnection;
+        ConnectionStatus inductiveConnection;
+        ConnectionStatus overallConnection;
+        RfQualityStatus rfQuality;
+        std::atomic<uint32_t> streamQueued[STATUS_STREAM_COUNT] = {};  // Messages in each stream's queue, raised before each push and lowered after each pop so readers never see it go negative
+        std::atomic<uint64_t> streamDrops[STATUS_STREAM_COUNT] = {};   // Messages discarded by each stream because its queue was full
+        void recordConnection(ConnectionStatus* theConnection, bool isConnected);
+
         // ************************* Private Stream Coordination Objects and Methods *************************
         // gRPC Streaming Threads
         void grpcNeuralStreamThread(void);
-        void grpcTemperatureStreamThread(void);
-        void grpcHumidityStreamThread(void);
-        void grpcConnectionStreamThread(void);
-        void grpcPowerStreamThread(void);
-        void grpcErrorStreamThread(void);
+        void drainTemperatureQueue(void);
+        void drainHumidityQueue(void);
+        void drainConnectionQueue(void);
+        void drainPowerQueue(void);
+        void drainErrorQueue(void);
+        void serializeNeuralSample(const SampleBlock& theBlock, uint32_t sampleIndex, BICgRPC::NeuralSample* aSample);
+        void serializeNeuralBlock(const SampleBlock& theBlock, BICgRPC::NeuralBlockUpdate* anUpdate);
+        void writeNeuralUpdate(BICgRPC::NeuralUpdate* anUpdate);
+        void writeNeuralBlockUpdate(BICgRPC::NeuralBlockUpdate* anUpdate);
 
         // Neural streaming Objects
             // Neural streaming requires additional state variables because of data buffering and interpolation functionality.
             // Other streams do not have data buffering and interpolation functionality.
         int neuroDataBufferThreshold;      // Neural data tranmission buffer size, provided to Listener using enableNeuralSensing()
-        uint32_t neuroInterplationThreshold;    // Neural interpolation length limit, provided to Listener using enableNeuralSensing()
+        GapInterpolator neuralInterpolator;     // Fills telemetry gaps, configured with the interpolation limit and method provided to enableNeuralSensing()
+        GapHandlingMode neuralGapHandling = GAP_HANDLING_SEND_INTERPOLATED;    // Whether gaps are streamed as interpolated samples or gap markers
+        uint32_t neuralDspOutputs = DSP_OUTPUT_NONE;    // DspOutputs bitmask of closed-loop outputs requested by the neural stream subscriber
+        double neuralSamplingRate = 0;          // Sampling rate reported in NeuralBlockUpdate headers
+        uint32_t neuralBlockNextCounter = 0;    // Counter expected for the next sample serialized into a NeuralBlockUpdate
+        bool neuralBlockHasHistory = false;     // False until the first sample of the session has been serialized into a NeuralBlockUpdate
+        bool neuralBlockPendingFilledGap = false;   // True if interpolated samples were skipped since the last serialized block sample
         uint32_t lastNeuroCount = 0;            // Used to determine the number of samples required for interpolation
-        double latestData[32] = { 0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0 };
         uint64_t latestTimeStamp;                   // Keep track of latest timestamp for interpolation samples
+        size_t neuralQueuedSampleCount = 0;     // Number of samples across all blocks waiting in neuralSampleQueue, protected by m_neuroBufferLock
 
         // Pointers for gRPC-managed streaming interfaces. Set by the BICDeviceServiceImpl class, null when not in use.
         grpc::ServerWriter<BICgRPC::NeuralUpdate>* neuralWriter;
+        grpc::ServerWriter<BICgRPC::NeuralBlockUpdate>* neuralBlockWriter = NULL;
         grpc::ServerWriter<BICgRPC::TemperatureUpdate>* temperatureWriter = NULL;
         grpc::ServerWriter<BICgRPC::HumidityUpdate>* humidityWriter = NULL;
         grpc::ServerWriter<BICgRPC::ConnectionUpdate>* connectionWriter = NULL;
         grpc::ServerWriter<BICgRPC::ErrorUpdate>* errorWriter = NULL;
         grpc::ServerWriter<BICgRPC::PowerUpdate>* powerWriter = NULL;
 
+        // Unified telemetry stream, written by the gRPC thread that serves it instead of a listener thread
+        void publishTelemetry(TelemetrySource source, BICgRPC::TelemetryUpdate* anUpdate);
+        std::mutex m_telemetryLock;                                 // Protects the multiplexer against detachment while an event publishes to it
+        TelemetryMultiplexer* telemetryMultiplexer = NULL;          // Open telemetry stream, owned by the stream
+
         //  Streaming Data Queues 
-        std::queue<BICgRPC::NeuralSample*> neuralSampleQueue;
+        std::queue<SampleBlock*> neuralSampleQueue;
         std::queue<BICgRPC::TemperatureUpdate*> temperatureSampleQueue;
         std::queue<BICgRPC::HumidityUpdate*> humiditySampleQueue;
         std::queue<BICgRPC::ConnectionUpdate*> connectionSampleQueue;
         std::queue<BICgRPC::ErrorUpdate*> errorSampleQueue;
         std::queue<BICgRPC::PowerUpdate*> powerSampleQueue;
 
-        // Stream processing threads
+        // Stream draining on the shared executor. Declared after the queues so they are closed before the queues go away.
+        SerialTask temperatureDrain{ EXECUTOR_TASK_STREAM_DRAIN, [this] { drainTemperatureQueue(); } };
+        SerialTask humidityDrain{ EXECUTOR_TASK_STREAM_DRAIN, [this] { drainHumidityQueue(); } };
+        SerialTask connectionDrain{ EXECUTOR_TASK_STREAM_DRAIN, [this] { drainConnectionQueue(); } };
+        SerialTask errorDrain{ EXECUTOR_TASK_STREAM_DRAIN, [this] { drainErrorQueue(); } };
+        SerialTask powerDrain{ EXECUTOR_TASK_STREAM_DRAIN, [this] { drainPowerQueue(); } };
+
+        // Dedicated threads, the neural stream and stimulation triggering are latency-critical
         std::thread* neuralProcessingThread;
-        std::thread* temperatureProcessingThread;
-        std::thread* humidityProcessingThread;
-        std::thread* connectionProcessingThread;
-        std::thread* errorProcessingThread;
-        std::thread* powerProcessingThread;
         std::thread* distributedStimThread;
-        std::thread* openLoopStimThread;
 
         // Stream data ready signals
         std::condition_variable* neuralDataNotify;
-        std::condition_variable* temperatureDataNotify;
-        std::condition_variable* humidityDataNotify;
-        std::condition_variable* connectionDataNotify;
-        std::condition_variable* errorDataNotify;
-        std::condition_variable* powerDataNotify;
-        std::condition_variable* stimTrigger;
+        TriggerMailbox* stimMailbox = NULL;
 
         // ************************* Private Logging Objects and Methods *************************
         // Logging data queues
         std::queue<StimTimes> stimTimeSampleQueue;
+        std::string stimTimeLogFileName;        // Log file of the current logging session
 
-        // Logging threads
-        std::thread* stimTimeLoggingThread;
-
-        // Logging ready signals
-        std::condition_variable* stimTimeDataNotify;
+        // Log writing on the shared executor, in batches
+        SerialTask stimTimeLogDrain{ EXECUTOR_TASK_STIM_TIME_LOG, [this] { drainStimTimeLog(); } };
 
         // ************************* Private Distributed Algorithm Objects and Methods *************************
         // Distributed Stim Functions
         void triggeredSendStimThread(void);
-        void openLoopStimLoopThread(void);
-        double filterIIR(double currSamp, std::vector<double>* prevFiltOut, std::vector<double>* prevInput, std::vector<double>* b, std::vector<double>* a, double gainVal);
-        bool isPosZeroCrossing(std::vector<double> dataArray);
-        bool isNegZeroCrossing(std::vector<double> dataArray);
-        bool isMax(std::vector<double> dataArray);
-        bool isMin(std::vector<double> dataArray);
-        double calcPhase(std::vector<double> dataArray, uint64_t currSamp, std::vector<double>* prevSigFreq, std::vector<double>* prevPhase);
-        bool detectTriggerPhase(std::vector<double> prevPhase, double triggerPhase);
-        void updateTriggerPhase(double prevStimPhase, std::vector<double>* prevTrigPhase);
-        void detectSelfTriggering(std::vector<int> stimSampArray, double selfTrigThresh);
-        double findMedian(std::vector<double>* inputArray);
+        bool fireOpenLoopStim(const ScheduledStimulation& firedStimulation);
+        void processSampleBlock(SampleBlock* theBlock);
+        void postControllerTrigger(uint32_t controllerId);
+        void issueControllerStimulation(uint32_t controllerId, const ScheduledStimulation* scheduledStimulation);
+        void issueScheduledStimulation(uint32_t controllerId);
+        void schedulePredictiveStim(uint32_t controllerId, double currentPhase, uint64_t sampleTimeStamp);
+        void runBlockControllers(SampleBlock* theBlock);
+        void issueBlockControllerTrigger(uint32_t controllerId, SampleBlock* theBlock, const ControllerDecision& decision);
+        void firePredictiveStim(uint32_t controllerId, const ScheduledStimulation& firedStimulation);
+        void startTriggeredStim(TriggerWaitMode triggerWaitMode, uint32_t triggerSpinMicroseconds);
+        void stopTriggeredStimIfIdle(bool isAnyEnabled);
 
         // Generic Distributed Variables
-        bool isCLStimEn = false;                    // State tracking boolean indicates whether distributed stim is active or not
+        std::atomic<bool> isCLStimEn{ false };      // State tracking boolean indicates whether any closed-loop controller is enabled and the stimulation thread is running
         bool isOLStimEn = false;                    // State tracking boolean indicates whether open loop stim is active or not
-        uint32_t openLoopSleepTimeDuration;
+        std::atomic<uint32_t> openLoopScheduleId{ 0 };   // Schedule of this device in the shared open-loop scheduler, 0 while open loop stim is off
         UINT_PTR openLoopTimerPointer;
-        uint32_t distributedInputChannel = 0;       // Distributed algorithm sensing channel (input)
+        uint32_t distributedInputChannel = 0;       // Sensing channel of controller 0, reported as the filtered channel of streamed blocks
         uint32_t distributedOutputChannel = 31;     // Distributed algorithm stimulation channel (output)
         double distributedCathodeAmplitude = -1000; // Distributed algorithm cathode (negative pulse) amplitude (input)
         uint64_t distributedCathodeDuration = 400;  // Distributed algorithm cathode (negative pulse) duration (input)
         double distributedAnodeAmplitude = 250;     // Distributed algorithm anode (positive pulse) amplitude (input)
         uint64_t distributedAnodeDuration = 1600;   // Distributed algorithm anode (positive pulse) duration (input)
-        double distributedStimThreshold = 10;       // Distributed algorithm threshold to trigger stimulation (input)
         
-        // Signal Processing Variables
-        std::vector<double> bpFiltData = std::vector<double>(5, 0);            // IIR filter output history
-        std::vector<double> rawPrevData = std::vector<double>(15, 0);           // Data history for raw input samples
-        std::vector<double> hampelPrevData = std::vector<double>(15, 0);        // Data history for hampel filtered input samples
-        std::vector<double> dcFiltPrevData = std::vector<double>(15, 0);    
-        std::vector<double> betaBandPassIIR_B = { 0.0009447, 0, -0.001889, 0, 0.0009447 };      // IIR "B" filter coefficients for a beta-range band-pass
-        std::vector<double> betaBandPassIIR_A = { 1, -3.8610, 5.6398, -3.6932, 0.9150 };        // IIR "A" filter coefficients for a beta-range band-pass
-        double sampGain = 1;                                                // Filter gain
-        bool isSelfTrig = false;                                            // State tracking boolean to determine if system is self-triggering
-        bool isValidTarget = false;                                         // State tracking boolean to determine if the system is in a state to be stimulating (limit self-triggering)
-        std::vector<double> stimOnset = std::vector<double>(15, 0);         // history of stimulation output to facilitate blanking                                      
-        std::vector<int> stimSampStamp = std::vector<int>(4, 0);            // history of sample number for stim onset
-
-        // Phase-Locked Loop (PLL) Variables
-        int phasicStimTarget = 0;                                   // Category for phase-specific stim: 0- ascending hyperpolarizing, 1- descending hyperpolarizing, 2- descending depolarizing, 3- ascending depolarizing
-        uint32_t refPoint = 0;                                      // Phase (degrees) being used as a reference to estimate phase
-        uint64_t refSamp = 0;                                       // Sample number to use for estimating phase
-        double stimTriggerPhase = 25;                               // Phase for triggering stimulation
-        double stimTargetPhase = 210;                               // Ideal phase to deliver stimulation
-        double lowerBound = 0;                                      // Lower bound for triggering phase
-        double upperBound = 90;                                     // Upper bound for triggering phase
-        bool prevStimActive = false;                                // State for previous stimulation 
-        std::vector<double> sigFreqData = { 0, 0, 0, 0 };           // History of frequency estimates 
-        std::vector<double> phaseData = { 0, 0, 0, 0 };             // History for previous estimated phase calculations
-        std::vector<double> triggerPhaseData = { 0, 0, 0, 0, 0 };   // History of previous trigger phases used 
+        // Closed-Loop Controller Variables
+        ClosedLoopController* controllers[MAX_CLOSED_LOOP_CONTROLLERS] = {};   // Controllers indexed by ID, controller 0 is created on first use so its outputs can be streamed
+        IBlockController* blockControllers[MAX_CLOSED_LOOP_CONTROLLERS] = {};  // Block controllers (e.g. loaded plugins) indexed by ID, an ID holds either a phase or a block controller
+        StimulationScheduler* blockControllerSchedulers[MAX_CLOSED_LOOP_CONTROLLERS] = {};  // Issue delayed triggers of block controllers that use them
+        bool controllerEnabled[MAX_CLOSED_LOOP_CONTROLLERS] = {};              // True if the controller may trigger stimulation
+        std::mutex m_controllerLock;                                            // Protects the controllers against replacement while a block is being processed
+        std::mutex m_stimLifecycleLock;                                         // Serializes enabling and disabling controllers with starting and stopping the stimulation thread
+        bool prevBlockStimActive = false;                                       // Stimulation active flag of the previous processed sample
+        ShadowEvaluator* shadowEvaluator = NULL;                                // Receives every processed block while a shadow evaluation stream is open, owned by the stream
+
+        // Shared between the processing thread, the stimulation thread and the predictive schedulers
+        std::atomic<uint32_t> stimPendingControllers{ 0 };                      // Bit per controller with a triggered stimulation not yet issued
+        std::atomic<uint32_t> stimFiredControllers{ 0 };                        // Bit per controller that issued a stimulation since the last stimulation onset
+        std::atomic<uint32_t> stimScheduledControllers{ 0 };                    // Bit per controller whose predictive deadline passed and awaits the stimulation thread
+        ScheduledStimulation controllerFiredStimulation[MAX_CLOSED_LOOP_CONTROLLERS] = {};  // Deadline of each controller's fired predictive stimulation, guarded by m_scheduledStimLock
+        std::mutex m_scheduledStimLock;
+        uint64_t skippedScheduledStims = 0;                                     // Predictive stimulations dropped because a stimulation was already active, stimulation thread only
+        std::atomic<int64_t> controllerStimFunction[MAX_CLOSED_LOOP_CONTROLLERS] = {};  // Preloaded function started by each controller, NO_STIM_FUNCTION_INDEX for the current command
+        std::atomic<double> controllerTriggerPhase[MAX_CLOSED_LOOP_CONTROLLERS] = {};   // Trigger phase of each controller at its latest valid target, for the stim time log
+        std::atomic<uint64_t> controllerEventTimeStamp[MAX_CLOSED_LOOP_CONTROLLERS] = {};   // Receive time of the sample behind each controller's latest trigger, for the stim time log
+        std::atomic<int64_t> controllerTriggerStimFunction[MAX_CLOSED_LOOP_CONTROLLERS] = {};   // Function requested by a block controller's latest trigger, NO_STIM_FUNCTION_INDEX for the controller's default
     };
 }
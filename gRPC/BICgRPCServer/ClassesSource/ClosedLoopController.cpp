@@ -0,0 +1,555 @@
+#include "ClosedLoopController.h"
+#include <algorithm>
+#include <cmath>
+
+namespace BICGRPCHelperNamespace
+{
+    /// <summary>
+    /// Constructs a controller with fresh signal history. The phase estimator is created now if the sampling rate is known, otherwise on first use.
+    /// </summary>
+    /// <param name="config">Controller parameters</param>
+    ClosedLoopController::ClosedLoopController(const ClosedLoopControllerConfig& config)
+        : config(config), stimTriggerPhase(config.triggerPhase)
+    {
+        applyTargetPhase();
+
+        if (config.samplingRate > 0)
+        {
+            ensurePhaseEstimator(config.samplingRate);
+        }
+    }
+
+    /// <summary>
+    /// Releases the phase estimator, any predictive stimulation scheduler and any parameter blocks still held
+    /// </summary>
+    ClosedLoopController::~ClosedLoopController()
+    {
+        delete stimScheduler;
+        delete phaseEstimator;
+        for (ClosedLoopParameterUpdate* anUpdate : { pendingUpdate.load(), retiredUpdate.load() })
+        {
+            if (anUpdate != NULL)
+            {
+                delete anUpdate->replacementEstimator;
+                delete anUpdate;
+            }
+        }
+    }
+
+    /// <summary>
+    /// Derives the trigger phase bounds and the phasic target category from the target phase
+    /// </summary>
+    void ClosedLoopController::applyTargetPhase()
+    {
+        // assign upper and lower bounds for determining trigger phase depending on target phase
+        if ((config.targetPhase > 0) && (config.targetPhase < 90)) // ascending hyperpolarizing
+        {
+            lowerBound = 225;
+            upperBound = 360;
+            phasicStimTarget = 0;
+        }
+        else if ((config.targetPhase > 90) && (config.targetPhase < 180)) // descending hyperpolarizing
+        {
+            lowerBound = -45;
+            upperBound = 90;
+            phasicStimTarget = 1;
+        }
+        else if ((config.targetPhase > 180) && (config.targetPhase < 270)) // descending depolarizing
+        {
+            lowerBound = 0;
+            upperBound = 135;
+            phasicStimTarget = 2;
+        }
+        else if ((config.targetPhase > 270) && (config.targetPhase < 360)) // ascending depolarizing
+        {
+            lowerBound = 90;
+            upperBound = 225;
+            phasicStimTarget = 3;
+        }
+    }
+
+    /// <summary>
+    /// Builds a parameter block for postParameterUpdate(), including a replacement phase estimator when the new filter needs one.
+    /// Works from a copy of the controller's configuration so the estimator can be built without blocking sample processing.
+    /// </summary>
+    /// <param name="currentConfig">Configuration of the controller at the time of the request</param>
+    /// <param name="parameters">New parameters</param>
+    /// <returns>Parameter block owned by the caller until posted</returns>
+    ClosedLoopParameterUpdate* ClosedLoopController::buildParameterUpdate(const ClosedLoopControllerConfig& currentConfig, const ClosedLoopParameters& parameters)
+    {
+        ClosedLoopParameterUpdate* theUpdate = new ClosedLoopParameterUpdate();
+        theUpdate->parameters = parameters;
+
+        // ECHT is designed around the band-pass response, so a new filter needs a new estimator. Other estimators keep their history.
+        bool isNewFilter = !parameters.filtCoeff_B.empty() && (parameters.filtCoeff_B != currentConfig.filtCoeff_B || parameters.filtCoeff_A != currentConfig.filtCoeff_A);
+        if (isNewFilter && currentConfig.phaseEstimatorType == PHASE_ESTIMATOR_ECHT && currentConfig.samplingRate > 0)
+        {
+            theUpdate->replacementEstimator = createPhaseEstimator(currentConfig.phaseEstimatorType, currentConfig.samplingRate, currentConfig.phaseEstimatorWindow,
+                currentConfig.predictionHorizon, parameters.filtCoeff_B, parameters.filtCoeff_A);
+        }
+        return theUpdate;
+    }
+
+    /// <summary>
+    /// Posts a parameter block to a running controller, taking ownership of it. The parameters take effect at the next processed sample;
+    /// an update that has not been picked up yet is replaced. Called from the gRPC thread while the owner prevents the controller from being deleted.
+    /// </summary>
+    /// <param name="theUpdate">Parameter block from buildParameterUpdate()</param>
+    void ClosedLoopController::postParameterUpdate(ClosedLoopParameterUpdate* theUpdate)
+    {
+        // Release the parameters retired by the previous swap
+        ClosedLoopParameterUpdate* theRetired = retiredUpdate.exchange(NULL);
+        if (theRetired != NULL)
+        {
+            delete theRetired->replacementEstimator;
+            delete theRetired;
+        }
+
+        // Replace any update the processing thread has not picked up yet
+        ClosedLoopParameterUpdate* theUnconsumed = pendingUpdate.exchange(theUpdate);
+        if (theUnconsumed != NULL)
+        {
+            delete theUnconsumed->replacementEstimator;
+            delete theUnconsumed;
+        }
+    }
+
+    /// <summary>
+    /// Swaps in posted parameters, if any. Filter history is kept when the new filter has the same order as the current one,
+    /// and the adapted trigger phase is kept unless the initial trigger phase changed.
+    /// </summary>
+    void ClosedLoopController::applyPendingParameters()
+    {
+        ClosedLoopParameterUpdate* theUpdate = pendingUpdate.exchange(NULL);
+        if (theUpdate == NULL)
+        {
+            return;
+        }
+        ClosedLoopParameters& newParameters = theUpdate->parameters;
+
+        // Filter coefficients, swapped so the update block holds the previous ones without reallocating
+        if (!newParameters.filtCoeff_B.empty())
+        {
+            bool isCompatible = newParameters.filtCoeff_B.size() == config.filtCoeff_B.size() && newParameters.filtCoeff_A.size() == config.filtCoeff_A.size();
+            std::swap(config.filtCoeff_B, newParameters.filtCoeff_B);
+            std::swap(config.filtCoeff_A, newParameters.filtCoeff_A);
+            if (!isCompatible)
+            {
+                std::fill(bpFiltData.begin(), bpFiltData.end(), 0);
+                std::fill(hampelPrevData.begin(), hampelPrevData.end(), 0);
+            }
+        }
+        // An estimator not created yet is built from the new filter on first use instead
+        if (theUpdate->replacementEstimator != NULL && phaseEstimator != NULL)
+        {
+            std::swap(phaseEstimator, theUpdate->replacementEstimator);
+        }
+
+        // Threshold and phase targets, only those the update sets
+        if (newParameters.isStimThresholdSet)
+        {
+            config.stimThreshold = newParameters.stimThreshold;
+        }
+        if (newParameters.isTriggerPhaseSet && newParameters.triggerPhase != config.triggerPhase)
+        {
+            config.triggerPhase = newParameters.triggerPhase;
+            stimTriggerPhase = newParameters.triggerPhase;
+            std::fill(triggerPhaseData.begin(), triggerPhaseData.end(), 0);
+        }
+        if (newParameters.isTargetPhaseSet && newParameters.targetPhase != config.targetPhase)
+        {
+            config.targetPhase = newParameters.targetPhase;
+            applyTargetPhase();
+        }
+
+        // Hand the previous parameters back for release on the updating thread
+        ClosedLoopParameterUpdate* theRetired = retiredUpdate.exchange(theUpdate);
+        if (theRetired != NULL)
+        {
+            delete theRetired->replacementEstimator;
+            delete theRetired;
+        }
+    }
+
+    /// <summary>
+    /// Creates the configured phase estimator if it does not exist yet
+    /// </summary>
+    /// <param name="samplingRate">Sampling rate to use if the configuration did not provide one</param>
+    void ClosedLoopController::ensurePhaseEstimator(double samplingRate)
+    {
+        if (phaseEstimator == NULL)
+        {
+            phaseEstimator = createPhaseEstimator(config.phaseEstimatorType, config.samplingRate > 0 ? config.samplingRate : samplingRate, config.phaseEstimatorWindow,
+                config.predictionHorizon, config.filtCoeff_B, config.filtCoeff_A);
+        }
+    }
+
+    /// <summary>
+    /// Runs the closed-loop chain for one sample of the sensing channel
+    /// </summary>
+    /// <param name="newData">Sample of the sensing channel</param>
+    /// <param name="currSamp">Measurement counter of the sample</param>
+    /// <param name="isStimActive">Stimulation active flag reported with the sample</param>
+    /// <param name="isTriggeringEnabled">True if the controller is enabled and may flag valid stimulation targets</param>
+    /// <param name="isOwnStimOnset">True if a stimulation starting at this sample was triggered by this controller, used to adapt the trigger phase</param>
+    /// <param name="outputs">Filled in with the sample's processing outputs</param>
+    void ClosedLoopController::processSample(double newData, uint64_t currSamp, bool isStimActive, bool isTriggeringEnabled, bool isOwnStimOnset, ClosedLoopOutputs* outputs)
+    {
+        // Parameter updates take effect at a sample boundary
+        applyPendingParameters();
+        outputs->triggerPhase = stimTriggerPhase;
+
+        // Filter the sample so the estimator sees the current filtered history
+        outputs->filtSample = processingHelper(newData);
+        outputs->preFiltSample = dcFiltPrevData[0];
+        outputs->hampelFiltSample = hampelPrevData[0];
+
+        // Estimate current sample's phase
+        PhaseEstimatorInput estimatorInput = { &bpFiltData, hampelPrevData[0], currSamp };
+        outputs->phase = phaseEstimator->estimatePhase(estimatorInput);
+        phaseData.insert(phaseData.begin(), outputs->phase);
+        phaseData.pop_back();
+
+        // Test for a valid target with the current sample's phase
+        outputs->isValidTarget = detectValidTarget(isTriggeringEnabled);
+
+        // Update stimulation history window
+        if (isStimActive == true && prevStimActive == false)
+        {
+            stimOnset.insert(stimOnset.begin(), 1);
+            if (isOwnStimOnset)
+            {
+                updateTriggerPhase(outputs->phase, &triggerPhaseData);
+            }
+            prevStimActive = true;
+            stimSampStamp.insert(stimSampStamp.begin(), (int)currSamp);
+            stimSampStamp.pop_back();
+        }
+        else
+        {
+            stimOnset.insert(stimOnset.begin(), 0);
+        }
+
+        // Mitigate self-triggering
+        if (isSelfTrig == false)
+        {
+            detectSelfTriggering(stimSampStamp, 1.25 * 1 / (phaseEstimator->getFrequency()) * 1000);
+        }
+        else
+        {
+            if (currSamp - stimSampStamp[0] > 150)
+            {
+                isSelfTrig = false;
+            }
+        }
+
+        if (isStimActive == false && prevStimActive == true)
+        {
+            // update state variable on stimActive state
+            prevStimActive = false;
+        }
+        stimOnset.pop_back();
+    }
+
+    /// <summary>
+    /// Handles the time-domain processing to be performed on each new datapoint
+    /// </summary>
+    /// <param name="newData">Latest datapoint to be processed for potential triggering of stimulation</param>
+    /// <returns>Band-pass filtered sample</returns>
+    double ClosedLoopController::processingHelper(double newData)
+    {
+        double stimCount = 0;
+        double dcFiltSamp;
+        double hampelSamp;
+        double MAD;
+        double medianVal;
+
+        std::vector<double> modifier(rawPrevData.size());
+        std::vector<double> sorted(rawPrevData.size());
+
+        // store most recent raw sample
+        rawPrevData.insert(rawPrevData.begin(), newData);
+        rawPrevData.pop_back();
+
+        // Artifact rejection
+        for (int i = 0; i < stimOnset.size(); i++)
+        {
+            stimCount += stimOnset.at(i);
+        }
+
+        // Blank artifact or send data through DC block filter
+        if (stimCount > 0)
+        {
+            dcFiltSamp = hampelPrevData.at(0);
+        }
+        else
+        {
+            dcFiltSamp = 0.945 * dcFiltPrevData.at(0) + rawPrevData.at(0) - rawPrevData.at(1);
+        }
+        dcFiltPrevData.insert(dcFiltPrevData.begin(), dcFiltSamp);
+        dcFiltPrevData.pop_back();
+
+        // Hampel filter for outlier detection
+        // Identify median of a given window
+        sorted = dcFiltPrevData;
+        sort(sorted.begin(), sorted.end());
+        medianVal = sorted[((sorted.size() - 1) / 2) + 1];
+
+        // Calculate median absolute deviation (MAD)
+        for (int i = 0; i < dcFiltPrevData.size(); i++)
+        {
+            modifier[i] = abs(dcFiltPrevData.at(i) - medianVal);
+        }
+
+        sort(modifier.begin(), modifier.end());
+        MAD = 1.4826 * modifier[((modifier.size() - 1) / 2) + 1];
+
+        // Determine if a sample is an outlier and needs to be replaced by calculated median value
+        if (abs(dcFiltSamp - medianVal) <= 3 * MAD)
+        {
+            hampelSamp = dcFiltSamp;
+        }
+        else
+        {
+            hampelSamp = medianVal;
+        }
+
+        // Band pass filter for beta activity
+        double filtSamp = filterIIR(hampelSamp, &bpFiltData, &hampelPrevData, &config.filtCoeff_B, &config.filtCoeff_A, 1);
+
+        // Return the filtered sample for visualization purposes
+        return filtSamp;
+    }
+
+    /// <summary>
+    /// Tests the latest filtered sample and phase estimate for a valid stimulation target
+    /// </summary>
+    /// <param name="isTriggeringEnabled">True if the controller may flag valid stimulation targets</param>
+    /// <returns>True if stimulation should be triggered at this sample</returns>
+    bool ClosedLoopController::detectValidTarget(bool isTriggeringEnabled)
+    {
+        // Determine if we have a valid target to initiate stimulation 
+        if (phasicStimTarget == 1)
+        {
+            if (!isSelfTrig && isTriggeringEnabled && detectTriggerPhase(phaseData, stimTriggerPhase) && abs(findMedian(&bpFiltData)) > config.stimThreshold)
+            {
+                // If conditions have been met, then it's a valid target
+                isValidTarget = true;
+            }
+            else
+            {
+                isValidTarget = false;
+            }
+        }
+        else 
+        {
+            if (!isSelfTrig && isTriggeringEnabled && detectTriggerPhase(phaseData, stimTriggerPhase) && abs(bpFiltData[0]) > config.stimThreshold)
+            {
+                // If conditions have been met, then it's a valid target
+                isValidTarget = true;
+            }
+            else
+            {
+                isValidTarget = false;
+            }
+        }
+
+        return isValidTarget;
+    }
+
+    /// <summary>
+    /// Private function that applies an IIR filter to incoming neural data
+    /// </summary>
+    /// <param name="currSamp">Latest neural sample</param>
+    /// <param name="prevFiltOut">History of filtered data samples</param>
+    /// <param name="prevInput">History of raw data samples</param>
+    /// <param name="b">B-array for IIR constants</param>
+    /// <param name="a">A-array for IIR constants</param>
+    /// <param name="gainVal">Gain for IIR bandpass filter</param>
+    /// <returns>Current filtered output sample</returns>
+    double ClosedLoopController::filterIIR(double currSamp, std::vector<double>* prevFiltOut, std::vector<double>* prevInput, std::vector<double>* b, std::vector<double>* a, double gainVal)
+    {
+       double filtTemp;
+
+       // 2nd order IIR filter
+       filtTemp = b->at(0) * currSamp + b->at(1) * prevInput->at(0) + b->at(2) * prevInput->at(1) + b->at(3) * prevInput->at(2) + b->at(4) * prevInput->at(3)
+            - a->at(1) * prevFiltOut->at(0) - a->at(2) * prevFiltOut->at(1) - a->at(3) * prevFiltOut->at(2) - a->at(4) * prevFiltOut->at(3);
+
+        // remove the last sample and insert the most recent sample to the front of the vector
+        prevFiltOut->insert(prevFiltOut->begin(), filtTemp);
+        prevFiltOut->pop_back();
+
+        // Store most recent sample at the beginning of history window
+        prevInput->insert(prevInput->begin(), currSamp);
+        prevInput->pop_back();
+
+        return filtTemp;
+    }
+
+    /// <summary>
+    /// Helper function to identify if a certain phase has passed
+    /// </summary>
+    /// <param name="prevPhase">Vector of previous phase data</param>
+    /// <param name="triggerPhase">Current triggering phase value</param>
+    /// <returns>Boolean indicating if the phase for triggering stim has passed</returns>
+    bool ClosedLoopController::detectTriggerPhase(std::vector<double> prevPhase, double triggerPhase)
+    {
+        bool wasTriggerPhase = false;
+        double currTrigPhase = triggerPhase;
+        double latestPhase = prevPhase[0];
+        double oldestPhase = prevPhase[3];
+
+        // for the ascending hyperpolarizing case, may need to convert phase estimations
+        if (phasicStimTarget == 1)
+        {
+            // convert the appropriate phases to enable proper comparison
+            if (triggerPhase > 270)
+            {
+                double currTrigPhase = triggerPhase - 360;
+            }
+            if (oldestPhase > 270)
+            {
+                double oldestPhase = prevPhase[3] - 360;
+            }
+            if (latestPhase > 270)
+            {
+                double latestPhase = prevPhase[0] - 360;
+            }
+        }
+
+        if (latestPhase > currTrigPhase && oldestPhase < currTrigPhase)
+        {
+            wasTriggerPhase = true;
+        }
+        return wasTriggerPhase;
+    }
+
+    /// <summary>
+    /// Function for updating the triggering phase value
+    /// </summary>
+    /// <param name="prevStimPhase">phase of current sample that just triggered stimulation</param>
+    void ClosedLoopController::updateTriggerPhase(double prevStimPhase, std::vector<double>* prevTrigPhase)
+    {
+        double phaseDiff = 0;
+        double actPhaseDiff = 0;
+        bool isValidTrigPhase = false;
+
+        // find phase difference and use that to update stimTriggerPhase alongside arbitrary gain
+        phaseDiff = prevStimPhase - config.targetPhase; 
+
+        if (phaseDiff > 180)
+        {
+            actPhaseDiff = phaseDiff - 360;
+        }
+        else if (phaseDiff < -180)
+        {
+            actPhaseDiff = phaseDiff + 360;
+        }
+        else
+        {
+            actPhaseDiff = phaseDiff;
+        }
+        stimTriggerPhase -= (0.1) * actPhaseDiff;
+
+        // make "conversions" in order to minimize issues when updating trigger phase
+        if (stimTriggerPhase < 0)
+        {
+            stimTriggerPhase += 360; 
+        }
+        else if (stimTriggerPhase > 360)
+        {
+            stimTriggerPhase -= 360; 
+        }
+
+        // Do appropriate conversions in order to enable trigger phase comparison for the ascending hyperpolarizing case
+        if (phasicStimTarget == 1)
+        {
+            // In the case where stimTriggerPhase is 270 - 360
+            if ((stimTriggerPhase >= 270) && (stimTriggerPhase <= 360))
+            {
+                // "convert" the phase to enable appropriate comparison
+                if (((stimTriggerPhase - 360) > lowerBound) && ((stimTriggerPhase - 360) < upperBound))
+                {
+                    isValidTrigPhase = true;
+                }
+            }
+            else
+            {
+                // otherwise, just go ahead and make the comparison to determine if stimTriggerPhase is out of bounds
+                if ((stimTriggerPhase > lowerBound) && (stimTriggerPhase < upperBound))
+                {
+                    isValidTrigPhase = true;
+                }
+            }
+            
+        }
+        // for all other phase targets
+        else 
+        {
+            // Check to reset stimTriggerPhase if out of bounds
+            if ((stimTriggerPhase > lowerBound) && (stimTriggerPhase < upperBound))
+            {
+                isValidTrigPhase = true;
+            }
+        }
+        
+        if (isValidTrigPhase)
+        {
+            // if newly calculated trigger phase is within bounds, add to the history 
+            prevTrigPhase->insert(prevTrigPhase->begin(), stimTriggerPhase);
+            prevTrigPhase->pop_back();
+        }
+        else
+        {
+            // otherwise, update the trigger phase to be the median of previous trigger phases
+            stimTriggerPhase = findMedian(prevTrigPhase);
+            if (stimTriggerPhase == 0) // in the case that there hasn't been enough stimulation to establish a steady history of trigger phases, the median will yield 0
+            {
+                stimTriggerPhase = (lowerBound + upperBound) * 0.5;
+            }
+        }
+    }
+
+    /// <summary>
+    /// Function for detecting if too many stimulation pulses have been sent out consecutively
+    /// </summary>
+    /// <param name="stimSampArray">Container of sample numbers indicating the onset of stimulation</param>
+    /// <param name="selfTrigThresh">Value dictating the maximum amount of time between two stimulation onsets to be considered self triggering </param>
+    void ClosedLoopController::detectSelfTriggering(std::vector<int> stimSampArray, double selfTrigThresh)
+    {
+        int counter = 0;
+
+        // Identify consecutive stimulation pulses
+        for (int i = 0; i < stimSampArray.size() - 1; i++)
+        {
+            if ((stimSampArray[i] - stimSampArray[i + 1]) <= selfTrigThresh)
+            {
+                // For every instance they are back to back, increase the counter
+                counter++;
+            }
+        }
+
+        // Check if the number of self-triggering pulses exceeds the threshold limit and return boolean state
+        if (counter < stimSampArray.size() - 1)
+        {
+            isSelfTrig = false;
+        }
+        else
+        {
+            isSelfTrig = true;
+        }
+    }
+
+    double ClosedLoopController::findMedian(std::vector<double>* inputArray)
+    {
+        // Copy the input and sort its contents
+        std::vector<double>sorted(inputArray->size());
+        sorted= *inputArray;
+        sort(sorted.begin(), sorted.end());
+
+        // Determine the median value for the input and return it
+        double medianVal = sorted[((sorted.size() - 1) / 2) + 1];
+
+        return medianVal;
+    }
+}
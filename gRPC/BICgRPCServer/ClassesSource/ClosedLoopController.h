@@ -0,0 +1,132 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <vector>
+#include "PhaseEstimator.h"
+#include "StimulationScheduler.h"
+
+namespace BICGRPCHelperNamespace
+{
+    // Number of closed-loop controllers that can run concurrently on one implant, controller IDs are 0 to MAX_CLOSED_LOOP_CONTROLLERS - 1
+    static const uint32_t MAX_CLOSED_LOOP_CONTROLLERS = 8;
+
+    // Coefficients per array of the closed-loop controller's IIR band-pass filter (filterIIR)
+    static const int IIR_FILTER_COEFFICIENTS = 5;
+
+    /// <summary>
+    /// Parameters of a closed-loop controller, fixed for the lifetime of the controller
+    /// </summary>
+    struct ClosedLoopControllerConfig
+    {
+        uint32_t sensingChannel = 0;                                                    // Channel the controller senses on
+        std::vector<double> filtCoeff_B = { 0.0009447, 0, -0.001889, 0, 0.0009447 };    // IIR "B" filter coefficients, beta-range band-pass by default
+        std::vector<double> filtCoeff_A = { 1, -3.8610, 5.6398, -3.6932, 0.9150 };      // IIR "A" filter coefficients, beta-range band-pass by default
+        double stimThreshold = 10;                                                      // Band-passed amplitude required to trigger stimulation
+        double triggerPhase = 25;                                                       // Initial phase for triggering stimulation
+        double targetPhase = 210;                                                       // Ideal phase to deliver stimulation
+        PhaseEstimatorType phaseEstimatorType = PHASE_ESTIMATOR_ZERO_CROSSING;
+        uint32_t phaseEstimatorWindow = 0;                                              // Estimator window length in samples, 0 for the estimator's default
+        uint32_t predictionHorizon = 0;                                                 // Samples ahead at which forecasting estimators report phase
+        double samplingRate = 0;                                                        // Device sampling rate in Hz, 0 if not yet known
+    };
+
+    /// <summary>
+    /// Controller parameters that can be changed while the controller runs. Empty filter coefficients keep the current filter,
+    /// and each value is only applied if its flag is set, so a partial update keeps the remaining parameters.
+    /// </summary>
+    struct ClosedLoopParameters
+    {
+        std::vector<double> filtCoeff_B;
+        std::vector<double> filtCoeff_A;
+        double stimThreshold = 10;
+        double triggerPhase = 25;
+        double targetPhase = 210;
+        bool isStimThresholdSet = false;
+        bool isTriggerPhaseSet = false;
+        bool isTargetPhaseSet = false;
+    };
+
+    /// <summary>
+    /// Parameter block handed from the updating thread to the processing thread. After the swap it holds the previous parameters
+    /// until the updating thread releases it, so the processing thread never frees memory.
+    /// </summary>
+    struct ClosedLoopParameterUpdate
+    {
+        ClosedLoopParameters parameters;
+        IPhaseEstimator* replacementEstimator = NULL;   // Estimator built for the new filter when the current one depends on the filter shape
+    };
+
+    /// <summary>
+    /// Per-sample outputs of a closed-loop controller
+    /// </summary>
+    struct ClosedLoopOutputs
+    {
+        double filtSample;          // Band-pass filtered sample
+        double preFiltSample;       // DC-blocked sample
+        double hampelFiltSample;    // Hampel filtered sample
+        double phase;               // Estimated phase in degrees
+        double triggerPhase;        // Trigger phase in use for this sample
+        bool isValidTarget;         // True if stimulation should be triggered at this sample
+    };
+
+    /// <summary>
+    /// One phase-locked closed-loop controller: DC block, Hampel filter, IIR band-pass, phase estimation, threshold and trigger phase
+    /// adaptation on a single sensing channel. All signal history is held per controller so several controllers can process the same
+    /// sample block independently.
+    /// </summary>
+    class ClosedLoopController
+    {
+    public:
+        explicit ClosedLoopController(const ClosedLoopControllerConfig& config);
+        ~ClosedLoopController();
+        void processSample(double newData, uint64_t currSamp, bool isStimActive, bool isTriggeringEnabled, bool isOwnStimOnset, ClosedLoopOutputs* outputs);
+        void ensurePhaseEstimator(double samplingRate);
+        static ClosedLoopParameterUpdate* buildParameterUpdate(const ClosedLoopControllerConfig& currentConfig, const ClosedLoopParameters& parameters);
+        void postParameterUpdate(ClosedLoopParameterUpdate* theUpdate);
+        const ClosedLoopControllerConfig& getConfig() const { return config; }
+        uint32_t getSensingChannel() const { return config.sensingChannel; }
+        double getTargetPhase() const { return config.targetPhase; }
+        IPhaseEstimator* getPhaseEstimator() { return phaseEstimator; }
+
+        StimulationScheduler* stimScheduler = NULL;                 // Issues stimulation at the predicted target phase time, NULL when stimulation is issued on trigger
+
+    private:
+        void applyTargetPhase();
+        void applyPendingParameters();
+        double processingHelper(double newData);
+        bool detectValidTarget(bool isTriggeringEnabled);
+        double filterIIR(double currSamp, std::vector<double>* prevFiltOut, std::vector<double>* prevInput, std::vector<double>* b, std::vector<double>* a, double gainVal);
+        bool detectTriggerPhase(std::vector<double> prevPhase, double triggerPhase);
+        void updateTriggerPhase(double prevStimPhase, std::vector<double>* prevTrigPhase);
+        void detectSelfTriggering(std::vector<int> stimSampArray, double selfTrigThresh);
+        double findMedian(std::vector<double>* inputArray);
+
+        ClosedLoopControllerConfig config;
+
+        // Signal Processing Variables
+        std::vector<double> bpFiltData = std::vector<double>(5, 0);            // IIR filter output history
+        std::vector<double> rawPrevData = std::vector<double>(15, 0);           // Data history for raw input samples
+        std::vector<double> hampelPrevData = std::vector<double>(15, 0);        // Data history for hampel filtered input samples
+        std::vector<double> dcFiltPrevData = std::vector<double>(15, 0);
+        bool isSelfTrig = false;                                            // State tracking boolean to determine if system is self-triggering
+        bool isValidTarget = false;                                         // State tracking boolean to determine if the system is in a state to be stimulating (limit self-triggering)
+        std::vector<double> stimOnset = std::vector<double>(15, 0);         // history of stimulation output to facilitate blanking
+        std::vector<int> stimSampStamp = std::vector<int>(4, 0);            // history of sample number for stim onset
+
+        // Phase-Locked Loop (PLL) Variables
+        int phasicStimTarget = 0;                                   // Category for phase-specific stim: 0- ascending hyperpolarizing, 1- descending hyperpolarizing, 2- descending depolarizing, 3- ascending depolarizing
+        double stimTriggerPhase = 25;                               // Phase for triggering stimulation
+        double lowerBound = 0;                                      // Lower bound for triggering phase
+        double upperBound = 90;                                     // Upper bound for triggering phase
+        bool prevStimActive = false;                                // State for previous stimulation
+        std::vector<double> phaseData = { 0, 0, 0, 0 };             // History for previous estimated phase calculations
+        std::vector<double> triggerPhaseData = { 0, 0, 0, 0, 0 };   // History of previous trigger phases used
+
+        // Phase Estimation Variables
+        IPhaseEstimator* phaseEstimator = NULL;                     // Estimator selected by the configuration, created once the sampling rate is known
+
+        // Hot Parameter Update Variables
+        std::atomic<ClosedLoopParameterUpdate*> pendingUpdate{ NULL };  // Posted by postParameterUpdate(), swapped in at the next sample
+        std::atomic<ClosedLoopParameterUpdate*> retiredUpdate{ NULL };  // Previous parameters after a swap, released by the next update
+    };
+}
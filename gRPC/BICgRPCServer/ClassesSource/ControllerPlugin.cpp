@@ -0,0 +1,227 @@
+#include "ControllerPlugin.h"
+#include <iostream>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#endif
+
+namespace BICGRPCHelperNamespace
+{
+    /// <summary>
+    /// Opens a shared library
+    /// </summary>
+    /// <param name="libraryPath">Path of the library</param>
+    /// <param name="errorMessage">Set to the loader's error if opening fails</param>
+    /// <returns>Library handle, NULL on failure</returns>
+    static void* openLibrary(const std::string& libraryPath, std::string* errorMessage)
+    {
+#ifdef _WIN32
+        void* handle = (void*)LoadLibraryA(libraryPath.c_str());
+        if (handle == NULL)
+        {
+            *errorMessage = "LoadLibrary failed with error " + std::to_string(GetLastError());
+        }
+#else
+        void* handle = dlopen(libraryPath.c_str(), RTLD_NOW | RTLD_LOCAL);
+        if (handle == NULL)
+        {
+            const char* loaderError = dlerror();
+            *errorMessage = loaderError != NULL ? loaderError : "dlopen failed";
+        }
+#endif
+        return handle;
+    }
+
+    /// <summary>
+    /// Looks up an exported symbol in an open library
+    /// </summary>
+    static void* findSymbol(void* handle, const char* symbolName)
+    {
+#ifdef _WIN32
+        return (void*)GetProcAddress((HMODULE)handle, symbolName);
+#else
+        return dlsym(handle, symbolName);
+#endif
+    }
+
+    /// <summary>
+    /// Closes a library opened by openLibrary()
+    /// </summary>
+    static void closeLibrary(void* handle)
+    {
+#ifdef _WIN32
+        FreeLibrary((HMODULE)handle);
+#else
+        dlclose(handle);
+#endif
+    }
+
+    /// <summary>
+    /// Resolves a client-supplied plugin name inside the server's plugin directory. Absolute paths and ".." components are rejected so that
+    /// clients can only load libraries the server operator placed in that directory.
+    /// </summary>
+    /// <param name="pluginDirectory">Plugin directory given on the server command line</param>
+    /// <param name="libraryPath">Library path relative to the plugin directory</param>
+    /// <param name="resolvedPath">Set to the library path inside the plugin directory</param>
+    /// <param name="errorMessage">Set to the reason the path was rejected</param>
+    /// <returns>True if the path stays inside the plugin directory</returns>
+    bool PluginBlockController::resolveLibraryPath(const std::string& pluginDirectory, const std::string& libraryPath, std::string* resolvedPath, std::string* errorMessage)
+    {
+        if (libraryPath.empty())
+        {
+            *errorMessage = "Library path is empty";
+            return false;
+        }
+        if (libraryPath[0] == '/' || libraryPath[0] == '\\' || libraryPath.find(':') != std::string::npos)
+        {
+            *errorMessage = "Library path must be relative to the plugin directory";
+            return false;
+        }
+
+        // Check every path component, either separator is accepted
+        size_t componentStart = 0;
+        while (componentStart <= libraryPath.size())
+        {
+            size_t componentEnd = libraryPath.find_first_of("/\\", componentStart);
+            if (componentEnd == std::string::npos)
+            {
+                componentEnd = libraryPath.size();
+            }
+            if (libraryPath.compare(componentStart, componentEnd - componentStart, "..") == 0)
+            {
+                *errorMessage = "Library path must not leave the plugin directory";
+                return false;
+            }
+            componentStart = componentEnd + 1;
+        }
+
+        char lastCharacter = pluginDirectory[pluginDirectory.size() - 1];
+        *resolvedPath = (lastCharacter == '/' || lastCharacter == '\\') ? pluginDirectory + libraryPath : pluginDirectory + "/" + libraryPath;
+        return true;
+    }
+
+    /// <summary>
+    /// Loads a controller plugin, checks its ABI version and creates a controller instance
+    /// </summary>
+    /// <param name="libraryPath">Path of the plugin library on the server</param>
+    /// <param name="config">Opaque configuration string handed to the plugin</param>
+    /// <param name="samplingRate">Device sampling rate in Hz</param>
+    /// <param name="errorMessage">Set to the reason the plugin was rejected</param>
+    /// <returns>The loaded controller, NULL if the library could not be loaded or is incompatible</returns>
+    PluginBlockController* PluginBlockController::load(const std::string& libraryPath, const std::string& config, double samplingRate, std::string* errorMessage)
+    {
+        void* handle = openLibrary(libraryPath, errorMessage);
+        if (handle == NULL)
+        {
+            return NULL;
+        }
+
+        // Find and call the entry point
+        BicGetControllerPluginFn entryPoint = (BicGetControllerPluginFn)findSymbol(handle, BIC_CONTROLLER_PLUGIN_ENTRY_NAME);
+        const BicControllerPluginApi* pluginApi = entryPoint != NULL ? entryPoint(BIC_CONTROLLER_PLUGIN_ABI_VERSION) : NULL;
+        if (pluginApi == NULL)
+        {
+            *errorMessage = entryPoint == NULL ? "Library does not export " BIC_CONTROLLER_PLUGIN_ENTRY_NAME : "Plugin declined the server's ABI version";
+            closeLibrary(handle);
+            return NULL;
+        }
+
+        // Same major version, a minor version no newer than the server's, and at least the 1.0 function table.
+        // Fields appended after 1.0 must be checked with BIC_CONTROLLER_PLUGIN_API_HAS before they are read.
+        uint32_t pluginMajor = pluginApi->abiVersion >> 16;
+        uint32_t pluginMinor = pluginApi->abiVersion & 0xFFFF;
+        bool isVersionSupported = pluginMajor == BIC_CONTROLLER_PLUGIN_ABI_MAJOR && pluginMinor <= BIC_CONTROLLER_PLUGIN_ABI_MINOR;
+        if (!isVersionSupported)
+        {
+            *errorMessage = "Incompatible plugin ABI " + std::to_string(pluginMajor) + "." + std::to_string(pluginMinor) + ", server supports "
+                + std::to_string(BIC_CONTROLLER_PLUGIN_ABI_MAJOR) + ".0 to " + std::to_string(BIC_CONTROLLER_PLUGIN_ABI_MAJOR) + "." + std::to_string(BIC_CONTROLLER_PLUGIN_ABI_MINOR);
+            closeLibrary(handle);
+            return NULL;
+        }
+        if (pluginApi->structSize < BIC_CONTROLLER_PLUGIN_API_V1_0_SIZE)
+        {
+            *errorMessage = "Plugin function table size " + std::to_string(pluginApi->structSize) + " is smaller than the ABI 1.0 table ("
+                + std::to_string(BIC_CONTROLLER_PLUGIN_API_V1_0_SIZE) + " bytes)";
+            closeLibrary(handle);
+            return NULL;
+        }
+        if (pluginApi->create == NULL || pluginApi->destroy == NULL || pluginApi->process == NULL || pluginApi->telemetryCount == NULL || pluginApi->telemetryName == NULL)
+        {
+            *errorMessage = "Plugin function table is incomplete";
+            closeLibrary(handle);
+            return NULL;
+        }
+
+        // Create the controller instance
+        void* instance = pluginApi->create(config.c_str(), samplingRate);
+        if (instance == NULL)
+        {
+            *errorMessage = "Plugin rejected the configuration";
+            closeLibrary(handle);
+            return NULL;
+        }
+
+        PluginBlockController* theController = new PluginBlockController();
+        theController->libraryHandle = handle;
+        theController->pluginApi = pluginApi;
+        theController->instance = instance;
+        uint32_t telemetryCount = pluginApi->telemetryCount(instance);
+        theController->telemetry.assign(telemetryCount, 0);
+        for (uint32_t i = 0; i < telemetryCount; i++)
+        {
+            const char* telemetryName = pluginApi->telemetryName(instance, i);
+            theController->telemetryNames.push_back(telemetryName != NULL ? telemetryName : "");
+        }
+        return theController;
+    }
+
+    /// <summary>
+    /// Destroys the controller instance and unloads the library
+    /// </summary>
+    PluginBlockController::~PluginBlockController()
+    {
+        if (errorCount > 0)
+        {
+            std::cout << "WARNING: Controller plugin " << pluginApi->name << " reported " << errorCount << " processing errors" << std::endl;
+        }
+        pluginApi->destroy(instance);
+        closeLibrary(libraryHandle);
+    }
+
+    /// <summary>
+    /// Hands a sample block to the plugin
+    /// </summary>
+    /// <param name="theBlock">Block to process</param>
+    /// <param name="decision">Filled in with the plugin's trigger decision</param>
+    /// <returns>True if the plugin processed the block without error</returns>
+    bool PluginBlockController::processBlock(const SampleBlock& theBlock, ControllerDecision* decision)
+    {
+        BicPluginSampleBlock blockView;
+        blockView.channelCount = theBlock.channelCount();
+        blockView.sampleCount = theBlock.size();
+        blockView.channelStride = theBlock.capacity();
+        blockView.measurements = theBlock.channelCount() > 0 ? theBlock.channel(0) : NULL;
+        blockView.sampleCounters = theBlock.sampleCounter.data();
+        blockView.timeStamps = theBlock.timeStamp.data();
+        blockView.flags = theBlock.flags.data();
+
+        BicPluginResult result;
+        result.triggerStimulation = 0;
+        result.triggerSampleIndex = 0;
+        result.stimFunctionIndex = -1;
+        result.telemetry = telemetry.data();
+        result.telemetryCount = (uint32_t)telemetry.size();
+
+        if (pluginApi->process(instance, &blockView, &result) != 0)
+        {
+            errorCount++;
+            return false;
+        }
+
+        decision->triggerStimulation = result.triggerStimulation != 0;
+        decision->triggerSampleIndex = result.triggerSampleIndex;
+        decision->stimFunctionIndex = result.stimFunctionIndex;
+        return true;
+    }
+}
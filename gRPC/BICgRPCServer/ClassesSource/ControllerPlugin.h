@@ -0,0 +1,75 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "ControllerPluginApi.h"
+#include "SampleBlock.h"
+
+namespace BICGRPCHelperNamespace
+{
+    /// <summary>
+    /// Trigger decision of a block controller for one sample block
+    /// </summary>
+    struct ControllerDecision
+    {
+        bool triggerStimulation = false;            // True to issue stimulation once the block has been processed
+        uint32_t triggerSampleIndex = 0;            // Block index of the sample that caused the trigger
+        int64_t stimFunctionIndex = -1;             // Preloaded stimulation function to start, -1 for the controller's configured default
+        uint32_t triggerDelayMicroseconds = 0;      // Delay from the receive time of the triggering sample to stimulation, 0 to stimulate at once
+    };
+
+    /// <summary>
+    /// Kinds of block controller, each attached and detached by its own RPC
+    /// </summary>
+    enum BlockControllerKind
+    {
+        BLOCK_CONTROLLER_PLUGIN = 0,            // Shared library loaded by bicLoadControllerPlugin
+        BLOCK_CONTROLLER_DSP_PIPELINE = 1,      // Pipeline compiled by bicSetDspPipeline
+        BLOCK_CONTROLLER_TRIGGER_INPUT = 2      // Trigger input controller of bicEnableTriggerInputController
+    };
+
+    /// <summary>
+    /// Closed-loop controller that works on whole sample blocks. Runs on the data callback thread ahead of the built-in phase controllers,
+    /// so implementations must not block.
+    /// </summary>
+    class IBlockController
+    {
+    public:
+        virtual ~IBlockController() {}
+        virtual const char* getName() const = 0;
+        virtual BlockControllerKind getKind() const = 0;
+        virtual bool hasDelayedTriggers() const { return false; }       // True if decisions may carry a trigger delay, which needs a timer thread
+        virtual bool processBlock(const SampleBlock& theBlock, ControllerDecision* decision) = 0;
+        virtual void onTriggerRejected() {}                             // Called after processBlock() when its trigger is dropped because a delayed stimulation is still pending
+        virtual const std::vector<std::string>& getTelemetryNames() const = 0;
+        virtual const std::vector<double>& getTelemetry() const = 0;
+    };
+
+    /// <summary>
+    /// Block controller implemented by a shared library exporting the versioned C plugin ABI of ControllerPluginApi.h.
+    /// Owns the library handle and the controller instance; both are released on destruction.
+    /// </summary>
+    class PluginBlockController : public IBlockController
+    {
+    public:
+        static bool resolveLibraryPath(const std::string& pluginDirectory, const std::string& libraryPath, std::string* resolvedPath, std::string* errorMessage);
+        static PluginBlockController* load(const std::string& libraryPath, const std::string& config, double samplingRate, std::string* errorMessage);
+        ~PluginBlockController();
+        const char* getName() const override { return pluginApi->name; }
+        BlockControllerKind getKind() const override { return BLOCK_CONTROLLER_PLUGIN; }
+        bool processBlock(const SampleBlock& theBlock, ControllerDecision* decision) override;
+        const std::vector<std::string>& getTelemetryNames() const override { return telemetryNames; }
+        const std::vector<double>& getTelemetry() const override { return telemetry; }
+        uint32_t getAbiVersion() const { return pluginApi->abiVersion; }
+
+    private:
+        PluginBlockController() {}
+
+        void* libraryHandle = NULL;
+        const BicControllerPluginApi* pluginApi = NULL;
+        void* instance = NULL;
+        std::vector<std::string> telemetryNames;
+        std::vector<double> telemetry;              // Written in place by the plugin through BicPluginResult::telemetry
+        uint32_t errorCount = 0;                    // Failed process() calls, reported when the controller is unloaded
+    };
+}
@@ -0,0 +1,95 @@
+#pragma once
+/*
+ * Closed-loop controller plugin ABI.
+ *
+ * A plugin is a shared library (.dll / .so) exporting BIC_CONTROLLER_PLUGIN_ENTRY_NAME with the signature of
+ * BicGetControllerPluginFn. Everything crossing the library boundary is plain C, so plugins can be built with any compiler
+ * or language that produces C-callable functions. The server calls process() on its data callback thread for every
+ * sample block while the controller is enabled; it must not block and should not allocate.
+ *
+ * Versioning: the major version changes whenever an existing field changes meaning or position, the minor version when
+ * fields are appended to the end of a struct. The server rejects a plugin whose major version differs from its own or
+ * whose minor version is newer than its own. Plugins built against an older minor version are accepted: structSize must
+ * cover at least the version 1.0 fields, and the server only reads appended fields that structSize covers.
+ */
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BIC_CONTROLLER_PLUGIN_ABI_MAJOR 1
+#define BIC_CONTROLLER_PLUGIN_ABI_MINOR 0
+#define BIC_CONTROLLER_PLUGIN_ABI_VERSION ((BIC_CONTROLLER_PLUGIN_ABI_MAJOR << 16) | BIC_CONTROLLER_PLUGIN_ABI_MINOR)
+#define BIC_CONTROLLER_PLUGIN_ENTRY_NAME "bicGetControllerPlugin"
+
+#ifdef _WIN32
+#define BIC_CONTROLLER_PLUGIN_EXPORT __declspec(dllexport)
+#else
+#define BIC_CONTROLLER_PLUGIN_EXPORT __attribute__((visibility("default")))
+#endif
+
+/* Per-sample flag bits, identical to the server's SampleFlags */
+#define BIC_PLUGIN_FLAG_CONNECTED 0x01
+#define BIC_PLUGIN_FLAG_STIM_ACTIVE 0x02
+#define BIC_PLUGIN_FLAG_INTERPOLATED 0x04
+#define BIC_PLUGIN_FLAG_INPUT_TRIG_HIGH 0x08
+
+/* Read-only view of one sample block. All pointers are valid only for the duration of the process() call. */
+typedef struct BicPluginSampleBlock
+{
+    uint32_t channelCount;
+    uint32_t sampleCount;
+    uint32_t channelStride;             /* Distance between the starts of two channel planes, in samples */
+    const double* measurements;         /* Channel-major: sample i of channel c is measurements[c * channelStride + i] */
+    const uint32_t* sampleCounters;     /* Device measurement counter per sample */
+    const uint64_t* timeStamps;         /* Server receive time per sample (system_clock ticks) */
+    const uint8_t* flags;               /* BIC_PLUGIN_FLAG_* bitmask per sample */
+} BicPluginSampleBlock;
+
+/* Decision and telemetry written by process(). The server clears the decision fields before every call. */
+typedef struct BicPluginResult
+{
+    uint32_t triggerStimulation;        /* Nonzero to issue stimulation once the block has been processed */
+    uint32_t triggerSampleIndex;        /* Sample whose content caused the trigger, for logging */
+    int64_t stimFunctionIndex;          /* Preloaded stimulation function to start, -1 for the controller's configured default */
+    double* telemetry;                  /* Server-owned array of telemetryCount values, kept between calls */
+    uint32_t telemetryCount;
+} BicPluginResult;
+
+/* Function table returned by the entry point. Fields may only be appended, see the versioning rules above. */
+typedef struct BicControllerPluginApi
+{
+    uint32_t abiVersion;                /* BIC_CONTROLLER_PLUGIN_ABI_VERSION the plugin was built against */
+    uint32_t structSize;                /* sizeof(BicControllerPluginApi) as built by the plugin */
+    const char* name;                   /* Human readable controller name */
+
+    /* Creates a controller instance. config is the opaque string passed to the load request. Returns NULL on failure. */
+    void* (*create)(const char* config, double samplingRate);
+
+    /* Destroys an instance created by create() */
+    void (*destroy)(void* instance);
+
+    /* Processes one block. Returns 0 on success, nonzero to report an error (the block's decision is then ignored). */
+    int32_t (*process)(void* instance, const BicPluginSampleBlock* block, BicPluginResult* result);
+
+    /* Number of telemetry values the instance reports, fixed for its lifetime */
+    uint32_t (*telemetryCount)(void* instance);
+
+    /* Name of one telemetry value, valid for the lifetime of the instance */
+    const char* (*telemetryName)(void* instance, uint32_t index);
+} BicControllerPluginApi;
+
+/* Size of the function table in ABI 1.0, the smallest structSize the server accepts */
+#define BIC_CONTROLLER_PLUGIN_API_V1_0_SIZE (offsetof(BicControllerPluginApi, telemetryName) + sizeof(((BicControllerPluginApi*)0)->telemetryName))
+
+/* True if a plugin's function table, as built by the plugin, includes the given field */
+#define BIC_CONTROLLER_PLUGIN_API_HAS(api, field) ((api)->structSize >= offsetof(BicControllerPluginApi, field) + sizeof((api)->field))
+
+/* Entry point. hostAbiVersion is the server's BIC_CONTROLLER_PLUGIN_ABI_VERSION; a plugin may return NULL if it cannot serve that host. */
+typedef const BicControllerPluginApi* (*BicGetControllerPluginFn)(uint32_t hostAbiVersion);
+
+#ifdef __cplusplus
+}
+#endif
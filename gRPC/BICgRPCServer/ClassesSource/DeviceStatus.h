@@ -0,0 +1,74 @@
+#pragma once
+#include <cstdint>
+
+namespace BICGRPCHelperNamespace
+{
+    /// <summary>
+    /// Listener streams whose queues are reported in device status snapshots
+    /// </summary>
+    enum StatusStream
+    {
+        STATUS_STREAM_NEURAL = 0,
+        STATUS_STREAM_TEMPERATURE,
+        STATUS_STREAM_HUMIDITY,
+        STATUS_STREAM_CONNECTION,
+        STATUS_STREAM_ERROR,
+        STATUS_STREAM_POWER,
+        STATUS_STREAM_STIM_TIME_LOG,
+        STATUS_STREAM_COUNT
+    };
+
+    /// <summary>
+    /// Latest reported state of one connection
+    /// </summary>
+    struct ConnectionStatus
+    {
+        bool isKnown = false;               // False until the device reports the connection
+        bool isConnected = false;
+        uint64_t timeStamp = 0;             // Time of the last report (system_clock ticks)
+    };
+
+    /// <summary>
+    /// Latest RF link quality report
+    /// </summary>
+    struct RfQualityStatus
+    {
+        bool isKnown = false;               // False until the device reports the link quality
+        int32_t antennaQualitydBm = 0;
+        uint32_t validFramesReceived = 0;
+        uint32_t invalidHandshake = 0;
+        uint32_t radioCrcErrors = 0;
+        uint32_t otherRxErrors = 0;
+        uint32_t rxQueueOverflows = 0;
+        uint32_t txQueueOverflows = 0;
+        uint32_t rfChannel = 0;
+        uint64_t timeStamp = 0;             // Time of the last report (system_clock ticks)
+    };
+
+    /// <summary>
+    /// Queue state of one listener stream
+    /// </summary>
+    struct StreamQueueStatus
+    {
+        bool isEnabled = false;
+        uint32_t queued = 0;                // Messages waiting to be sent (sample blocks for the neural stream)
+        uint64_t dropped = 0;               // Messages discarded because the queue was full, since the listener was created
+    };
+
+    /// <summary>
+    /// State the listener holds for a device, gathered without calling the device
+    /// </summary>
+    struct ListenerStatus
+    {
+        bool isStimulating = false;
+        bool isMeasuring = false;
+        bool isOpenLoopEnabled = false;
+        bool isClosedLoopEnabled = false;
+        bool isShadowStreaming = false;
+        ConnectionStatus usbConnection;         // PC to external unit
+        ConnectionStatus inductiveConnection;   // External unit to implant
+        ConnectionStatus overallConnection;
+        RfQualityStatus rfQuality;
+        StreamQueueStatus streams[STATUS_STREAM_COUNT];
+    };
+}
@@ -0,0 +1,374 @@
+#include "DspPipeline.h"
+#include <algorithm>
+#include <cmath>
+#include "ClosedLoopController.h"
+
+namespace BICGRPCHelperNamespace
+{
+    // Defaults for stage parameters left at zero, matching the hardwired closed-loop chain where it has an equivalent
+    static const double DEFAULT_DC_BLOCK_POLE = 0.945;
+    static const double DEFAULT_NOTCH_Q = 30;
+    static const uint32_t DEFAULT_HAMPEL_WINDOW = 15;
+    static const double DEFAULT_HAMPEL_DEVIATIONS = 3;
+    static const double DEFAULT_ENVELOPE_TIME_CONSTANT_MS = 20;
+    static const uint32_t PHASE_HISTORY_LENGTH = 5;
+    static const double PI = 3.14159265358979323846;
+
+    /// <summary>
+    /// Display name of a stage type for telemetry names
+    /// </summary>
+    static const char* stageTypeName(DspStageType type)
+    {
+        switch (type)
+        {
+        case DSP_STAGE_DC_BLOCK:
+            return "dcBlock";
+        case DSP_STAGE_NOTCH:
+            return "notch";
+        case DSP_STAGE_HAMPEL:
+            return "hampel";
+        case DSP_STAGE_SOS_FILTER:
+            return "sosFilter";
+        case DSP_STAGE_ENVELOPE:
+            return "envelope";
+        case DSP_STAGE_PHASE:
+            return "phase";
+        case DSP_STAGE_THRESHOLD:
+            return "threshold";
+        default:
+            return "unknown";
+        }
+    }
+
+    /// <summary>
+    /// Compiles a pipeline description into a flat stage array with preallocated coefficients and state
+    /// </summary>
+    /// <param name="config">Pipeline description</param>
+    /// <param name="samplingRate">Device sampling rate in Hz, used to design frequency-dependent stages</param>
+    /// <param name="errorMessage">Set to the reason the description was rejected</param>
+    /// <returns>The compiled pipeline, NULL if the description is invalid</returns>
+    DspPipeline* DspPipeline::compile(const DspPipelineConfig& config, double samplingRate, std::string* errorMessage)
+    {
+        if (config.stages.empty())
+        {
+            *errorMessage = "Pipeline has no stages";
+            return NULL;
+        }
+        if (!(samplingRate > 0))
+        {
+            *errorMessage = "Sampling rate unknown";
+            return NULL;
+        }
+
+        DspPipeline* thePipeline = new DspPipeline();
+        thePipeline->sensingChannel = config.sensingChannel;
+        thePipeline->refractorySamples = config.refractorySamples;
+        uint32_t scratchLength = 0;
+        bool hasThreshold = false;
+
+        for (uint32_t stageIndex = 0; stageIndex < config.stages.size(); stageIndex++)
+        {
+            const DspStageConfig& stageConfig = config.stages[stageIndex];
+            std::string stageLabel = "Stage " + std::to_string(stageIndex + 1) + " (" + stageTypeName(stageConfig.type) + "): ";
+            CompiledDspStage theStage = {};
+            theStage.type = stageConfig.type;
+            theStage.paramOffset = (uint32_t)thePipeline->params.size();
+            theStage.stateOffset = (uint32_t)thePipeline->state.size();
+
+            // Resolve the input to a value slot, only earlier stages can feed a stage
+            if (stageConfig.input == DSP_INPUT_PREVIOUS_STAGE)
+            {
+                theStage.inputSlot = stageIndex;
+            }
+            else if (stageConfig.input == DSP_INPUT_SENSING_CHANNEL)
+            {
+                theStage.inputSlot = 0;
+            }
+            else if (stageConfig.input > 0 && (uint32_t)stageConfig.input <= stageIndex)
+            {
+                theStage.inputSlot = stageConfig.input;
+            }
+            else
+            {
+                *errorMessage = stageLabel + "input must be an earlier stage";
+                delete thePipeline;
+                return NULL;
+            }
+
+            switch (stageConfig.type)
+            {
+            case DSP_STAGE_DC_BLOCK:
+            {
+                double pole = stageConfig.pole != 0 ? stageConfig.pole : DEFAULT_DC_BLOCK_POLE;
+                if (pole <= 0 || pole >= 1)
+                {
+                    *errorMessage = stageLabel + "pole must be between 0 and 1";
+                    delete thePipeline;
+                    return NULL;
+                }
+                thePipeline->params.push_back(pole);
+                thePipeline->state.resize(thePipeline->state.size() + 2, 0);     // Previous input, previous output
+                theStage.flag = stageConfig.blankDuringStim;
+                break;
+            }
+            case DSP_STAGE_NOTCH:
+            {
+                double qualityFactor = stageConfig.qualityFactor != 0 ? stageConfig.qualityFactor : DEFAULT_NOTCH_Q;
+                if (stageConfig.frequency <= 0 || stageConfig.frequency >= samplingRate / 2 || qualityFactor <= 0)
+                {
+                    *errorMessage = stageLabel + "frequency must be between 0 and Nyquist and Q positive";
+                    delete thePipeline;
+                    return NULL;
+                }
+
+                // Biquad notch, normalized so a0 = 1
+                double w0 = 2 * PI * stageConfig.frequency / samplingRate;
+                double alpha = std::sin(w0) / (2 * qualityFactor);
+                double a0 = 1 + alpha;
+                double section[5] = { 1 / a0, -2 * std::cos(w0) / a0, 1 / a0, -2 * std::cos(w0) / a0, (1 - alpha) / a0 };
+                thePipeline->params.insert(thePipeline->params.end(), section, section + 5);
+                thePipeline->state.resize(thePipeline->state.size() + 2, 0);
+                theStage.length = 1;
+                break;
+            }
+            case DSP_STAGE_HAMPEL:
+            {
+                uint32_t window = stageConfig.window != 0 ? stageConfig.window : DEFAULT_HAMPEL_WINDOW;
+                if (window < 3)
+                {
+                    *errorMessage = stageLabel + "window must be at least 3 samples";
+                    delete thePipeline;
+                    return NULL;
+                }
+                thePipeline->params.push_back(stageConfig.deviations != 0 ? stageConfig.deviations : DEFAULT_HAMPEL_DEVIATIONS);
+                thePipeline->state.resize(thePipeline->state.size() + window, 0);
+                theStage.length = window;
+                scratchLength = std::max(scratchLength, window);
+                break;
+            }
+            case DSP_STAGE_SOS_FILTER:
+            {
+                if (stageConfig.sections.empty() || stageConfig.sections.size() % 6 != 0)
+                {
+                    *errorMessage = stageLabel + "needs six coefficients (b0 b1 b2 a0 a1 a2) per section";
+                    delete thePipeline;
+                    return NULL;
+                }
+                for (size_t sectionStart = 0; sectionStart < stageConfig.sections.size(); sectionStart += 6)
+                {
+                    double a0 = stageConfig.sections[sectionStart + 3];
+                    if (a0 == 0)
+                    {
+                        *errorMessage = stageLabel + "a0 must not be zero";
+                        delete thePipeline;
+                        return NULL;
+                    }
+                    thePipeline->params.push_back(stageConfig.sections[sectionStart] / a0);
+                    thePipeline->params.push_back(stageConfig.sections[sectionStart + 1] / a0);
+                    thePipeline->params.push_back(stageConfig.sections[sectionStart + 2] / a0);
+                    thePipeline->params.push_back(stageConfig.sections[sectionStart + 4] / a0);
+                    thePipeline->params.push_back(stageConfig.sections[sectionStart + 5] / a0);
+                }
+                theStage.length = (uint32_t)(stageConfig.sections.size() / 6);
+                thePipeline->state.resize(thePipeline->state.size() + 2 * theStage.length, 0);
+                break;
+            }
+            case DSP_STAGE_ENVELOPE:
+            {
+                double timeConstantMs = stageConfig.timeConstantMs != 0 ? stageConfig.timeConstantMs : DEFAULT_ENVELOPE_TIME_CONSTANT_MS;
+                if (timeConstantMs < 0)
+                {
+                    *errorMessage = stageLabel + "time constant must be positive";
+                    delete thePipeline;
+                    return NULL;
+                }
+                thePipeline->params.push_back(1 - std::exp(-1000 / (timeConstantMs * samplingRate)));
+                thePipeline->state.push_back(0);
+                break;
+            }
+            case DSP_STAGE_PHASE:
+            {
+                ClosedLoopControllerConfig defaultBand;
+                const std::vector<double>& filtCoeff_B = stageConfig.filtCoeff_B.empty() ? defaultBand.filtCoeff_B : stageConfig.filtCoeff_B;
+                const std::vector<double>& filtCoeff_A = stageConfig.filtCoeff_A.empty() ? defaultBand.filtCoeff_A : stageConfig.filtCoeff_A;
+
+                // The estimator sees the stage feeding the phase input as its band-pass input
+                theStage.bandInputSlot = theStage.inputSlot > 0 ? thePipeline->stages[theStage.inputSlot - 1].inputSlot : 0;
+                theStage.estimatorIndex = (uint32_t)thePipeline->phaseEstimators.size();
+                thePipeline->phaseEstimators.push_back(createPhaseEstimator(stageConfig.phaseEstimatorType, samplingRate, stageConfig.window, stageConfig.predictionHorizon, filtCoeff_B, filtCoeff_A));
+                thePipeline->phaseHistories.push_back(std::vector<double>(PHASE_HISTORY_LENGTH, 0));
+                break;
+            }
+            case DSP_STAGE_THRESHOLD:
+            {
+                thePipeline->params.push_back(stageConfig.level);
+                thePipeline->state.push_back(0);     // Previous input
+                theStage.flag = stageConfig.isRisingCrossing;
+                theStage.isAbsolute = stageConfig.isAbsolute;
+                hasThreshold = true;
+                break;
+            }
+            default:
+                *errorMessage = stageLabel + "unknown stage type";
+                delete thePipeline;
+                return NULL;
+            }
+
+            thePipeline->stages.push_back(theStage);
+            thePipeline->telemetryNames.push_back(std::to_string(stageIndex + 1) + ":" + stageTypeName(stageConfig.type));
+        }
+
+        if (!hasThreshold)
+        {
+            *errorMessage = "Pipeline needs at least one threshold stage to trigger stimulation";
+            delete thePipeline;
+            return NULL;
+        }
+
+        thePipeline->values.assign(thePipeline->stages.size() + 1, 0);
+        thePipeline->scratch.assign(scratchLength, 0);
+        thePipeline->telemetry.assign(thePipeline->stages.size(), 0);
+        return thePipeline;
+    }
+
+    /// <summary>
+    /// Releases the phase estimators
+    /// </summary>
+    DspPipeline::~DspPipeline()
+    {
+        for (IPhaseEstimator* theEstimator : phaseEstimators)
+        {
+            delete theEstimator;
+        }
+    }
+
+    /// <summary>
+    /// Runs every stage over every sample of the sensing channel
+    /// </summary>
+    /// <param name="theBlock">Block to process</param>
+    /// <param name="decision">Set to trigger at the first sample where all threshold stages were met</param>
+    /// <returns>False if the sensing channel is not present in the block</returns>
+    bool DspPipeline::processBlock(const SampleBlock& theBlock, ControllerDecision* decision)
+    {
+        if (sensingChannel >= theBlock.channelCount())
+        {
+            return false;
+        }
+
+        const double* sensingData = theBlock.channel(sensingChannel);
+        for (uint32_t row = 0; row < theBlock.size(); row++)
+        {
+            bool isStimActive = theBlock.hasFlag(row, SAMPLE_FLAG_STIM_ACTIVE);
+            bool isTriggerMet = true;
+            values[0] = sensingData[row];
+
+            for (uint32_t stageIndex = 0; stageIndex < stages.size(); stageIndex++)
+            {
+                CompiledDspStage& theStage = stages[stageIndex];
+                double* stageParams = params.data() + theStage.paramOffset;
+                double* stageState = state.data() + theStage.stateOffset;
+                double input = values[theStage.inputSlot];
+                double output = 0;
+
+                switch (theStage.type)
+                {
+                case DSP_STAGE_DC_BLOCK:
+                    output = theStage.flag && isStimActive ? stageState[1] : stageParams[0] * stageState[1] + input - stageState[0];
+                    stageState[0] = input;
+                    stageState[1] = output;
+                    break;
+                case DSP_STAGE_NOTCH:
+                case DSP_STAGE_SOS_FILTER:
+                    // Transposed direct form II, one biquad per section
+                    output = input;
+                    for (uint32_t section = 0; section < theStage.length; section++)
+                    {
+                        const double* coeff = stageParams + 5 * section;
+                        double* delay = stageState + 2 * section;
+                        double sectionInput = output;
+                        output = coeff[0] * sectionInput + delay[0];
+                        delay[0] = coeff[1] * sectionInput - coeff[3] * output + delay[1];
+                        delay[1] = coeff[2] * sectionInput - coeff[4] * output;
+                    }
+                    break;
+                case DSP_STAGE_HAMPEL:
+                    output = runHampel(theStage, input);
+                    break;
+                case DSP_STAGE_ENVELOPE:
+                    stageState[0] += stageParams[0] * (std::fabs(input) - stageState[0]);
+                    output = stageState[0];
+                    break;
+                case DSP_STAGE_PHASE:
+                {
+                    std::vector<double>& history = phaseHistories[theStage.estimatorIndex];
+                    std::copy_backward(history.begin(), history.end() - 1, history.end());
+                    history[0] = input;
+                    PhaseEstimatorInput estimatorInput = { &history, values[theStage.bandInputSlot], theBlock.sampleCounter[row] };
+                    output = phaseEstimators[theStage.estimatorIndex]->estimatePhase(estimatorInput);
+                    break;
+                }
+                case DSP_STAGE_THRESHOLD:
+                {
+                    double level = stageParams[0];
+                    double compared = theStage.isAbsolute ? std::fabs(input) : input;
+                    double previous = theStage.isAbsolute ? std::fabs(stageState[0]) : stageState[0];
+                    bool isMet = theStage.flag ? (previous < level && compared >= level) : compared > level;
+                    stageState[0] = input;
+                    output = isMet ? 1 : 0;
+                    isTriggerMet = isTriggerMet && isMet;
+                    break;
+                }
+                default:
+                    break;
+                }
+                values[stageIndex + 1] = output;
+            }
+
+            // Trigger on the first qualifying sample once the refractory period has passed
+            samplesSinceTrigger++;
+            if (isTriggerMet && !isStimActive && (!hasTriggered || samplesSinceTrigger > refractorySamples))
+            {
+                if (!decision->triggerStimulation)
+                {
+                    decision->triggerStimulation = true;
+                    decision->triggerSampleIndex = row;
+                }
+                hasTriggered = true;
+                samplesSinceTrigger = 0;
+            }
+        }
+
+        std::copy(values.begin() + 1, values.end(), telemetry.begin());
+        return true;
+    }
+
+    /// <summary>
+    /// Hampel filter step: replaces the newest sample with the window median if it lies more than the configured number of scaled MADs from it
+    /// </summary>
+    /// <param name="theStage">Hampel stage, its ring buffer cursor is advanced</param>
+    /// <param name="newData">Newest input sample</param>
+    /// <returns>Filtered sample</returns>
+    double DspPipeline::runHampel(CompiledDspStage& theStage, double newData)
+    {
+        double* window = state.data() + theStage.stateOffset;
+        window[theStage.cursor] = newData;
+        theStage.cursor = (theStage.cursor + 1) % theStage.length;
+
+        // Median of the window
+        double* workspace = scratch.data();
+        uint32_t middle = theStage.length / 2;
+        std::copy(window, window + theStage.length, workspace);
+        std::nth_element(workspace, workspace + middle, workspace + theStage.length);
+        double medianVal = workspace[middle];
+
+        // Median absolute deviation
+        for (uint32_t i = 0; i < theStage.length; i++)
+        {
+            workspace[i] = std::fabs(window[i] - medianVal);
+        }
+        std::nth_element(workspace, workspace + middle, workspace + theStage.length);
+        double mad = 1.4826 * workspace[middle];
+
+        return std::fabs(newData - medianVal) <= params[theStage.paramOffset] * mad ? newData : medianVal;
+    }
+}
@@ -0,0 +1,117 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "ControllerPlugin.h"
+#include "PhaseEstimator.h"
+
+namespace BICGRPCHelperNamespace
+{
+    /// <summary>
+    /// Processing stages available to a DSP pipeline. Values match the field numbers of the gRPC DspStage oneof.
+    /// </summary>
+    enum DspStageType
+    {
+        DSP_STAGE_DC_BLOCK = 2,         // First-order DC blocking filter
+        DSP_STAGE_NOTCH = 3,            // Second-order notch at a given frequency
+        DSP_STAGE_HAMPEL = 4,           // Sliding-window Hampel outlier filter
+        DSP_STAGE_SOS_FILTER = 5,       // Cascade of second-order IIR sections, e.g. a band-pass
+        DSP_STAGE_ENVELOPE = 6,         // Rectification followed by a one-pole low-pass
+        DSP_STAGE_PHASE = 7,            // Phase estimate of the input oscillation, in degrees
+        DSP_STAGE_THRESHOLD = 8         // Trigger condition, outputs 1 while met and 0 otherwise
+    };
+
+    // Special input slots of a stage, other values are the 1-based index of the stage feeding it
+    static const int32_t DSP_INPUT_PREVIOUS_STAGE = 0;     // Output of the preceding stage, the sensing channel for the first stage
+    static const int32_t DSP_INPUT_SENSING_CHANNEL = -1;   // Raw sensing channel
+
+    /// <summary>
+    /// Description of one pipeline stage. Only the parameters of the stage's type are used; zero selects the documented default.
+    /// </summary>
+    struct DspStageConfig
+    {
+        DspStageType type = DSP_STAGE_DC_BLOCK;
+        int32_t input = DSP_INPUT_PREVIOUS_STAGE;
+
+        double pole = 0;                                // DC block: pole, default 0.945
+        bool blankDuringStim = false;                   // DC block: hold the previous output while stimulation is active
+        double frequency = 0;                           // Notch: centre frequency in Hz
+        double qualityFactor = 0;                       // Notch: centre frequency over bandwidth, default 30
+        uint32_t window = 0;                            // Hampel: window in samples, default 15. Phase: estimator window, 0 for the estimator's default
+        double deviations = 0;                          // Hampel: outlier threshold in scaled MADs, default 3
+        std::vector<double> sections;                   // SOS filter: b0 b1 b2 a0 a1 a2 per section
+        double timeConstantMs = 0;                      // Envelope: smoothing time constant in ms, default 20
+        PhaseEstimatorType phaseEstimatorType = PHASE_ESTIMATOR_ZERO_CROSSING;    // Phase: estimation method
+        uint32_t predictionHorizon = 0;                 // Phase: samples ahead for forecasting estimators
+        std::vector<double> filtCoeff_B;                // Phase: band-pass response assumed by ECHT, the closed-loop default if empty
+        std::vector<double> filtCoeff_A;
+        double level = 0;                               // Threshold: level the input is compared against
+        bool isRisingCrossing = false;                  // Threshold: met only on the sample where the input rises through level, e.g. for a phase
+        bool isAbsolute = false;                        // Threshold: compare the magnitude of the input
+    };
+
+    /// <summary>
+    /// Description of a complete pipeline. Stimulation is triggered on every sample where all threshold stages are met,
+    /// at most once per refractory period.
+    /// </summary>
+    struct DspPipelineConfig
+    {
+        uint32_t sensingChannel = 0;
+        std::vector<DspStageConfig> stages;
+        uint32_t refractorySamples = 0;                 // Minimum samples between triggers
+    };
+
+    /// <summary>
+    /// Stage compiled for execution. Parameters and state live in the pipeline's shared pools at the given offsets.
+    /// </summary>
+    struct CompiledDspStage
+    {
+        DspStageType type;
+        uint32_t inputSlot;         // Value slot read by the stage: 0 is the sensing channel, n the output of stage n
+        uint32_t bandInputSlot;     // Phase: slot feeding the input stage, presented to the estimator as the band-pass input
+        uint32_t paramOffset;       // First parameter in the parameter pool
+        uint32_t stateOffset;       // First state value in the state pool
+        uint32_t length;            // Hampel: window length. SOS filter: number of sections
+        uint32_t estimatorIndex;    // Phase: index of the stage's estimator and filtered history
+        uint32_t cursor;            // Hampel: next ring buffer position
+        bool flag;                  // DC block: blank during stimulation. Threshold: rising crossing
+        bool isAbsolute;            // Threshold: compare the magnitude of the input
+    };
+
+    /// <summary>
+    /// DSP chain compiled from a declarative pipeline description. All coefficients and filter state are laid out in flat pools when the
+    /// pipeline is compiled, so processing a block walks a fixed stage array without allocating.
+    /// </summary>
+    class DspPipeline : public IBlockController
+    {
+    public:
+        static DspPipeline* compile(const DspPipelineConfig& config, double samplingRate, std::string* errorMessage);
+        ~DspPipeline();
+        const char* getName() const override { return "DspPipeline"; }
+        BlockControllerKind getKind() const override { return BLOCK_CONTROLLER_DSP_PIPELINE; }
+        bool processBlock(const SampleBlock& theBlock, ControllerDecision* decision) override;
+        const std::vector<std::string>& getTelemetryNames() const override { return telemetryNames; }
+        const std::vector<double>& getTelemetry() const override { return telemetry; }
+        uint32_t getStageCount() const { return (uint32_t)stages.size(); }
+
+    private:
+        DspPipeline() {}
+        double runHampel(CompiledDspStage& theStage, double newData);
+
+        uint32_t sensingChannel = 0;
+        uint32_t refractorySamples = 0;
+        uint32_t samplesSinceTrigger = 0;
+        bool hasTriggered = false;
+
+        std::vector<CompiledDspStage> stages;
+        std::vector<double> params;                         // Stage coefficients
+        std::vector<double> state;                          // Stage filter state
+        std::vector<double> values;                         // Per-sample value slots, see CompiledDspStage::inputSlot
+        std::vector<double> scratch;                        // Hampel median workspace, sized for the longest window
+        std::vector<IPhaseEstimator*> phaseEstimators;      // One per phase stage
+        std::vector<std::vector<double>> phaseHistories;    // Filtered history handed to each phase estimator, newest first
+
+        std::vector<std::string> telemetryNames;            // Stage outputs at the last sample of each block
+        std::vector<double> telemetry;
+    };
+}
@@ -0,0 +1,196 @@
+#include "GapInterpolator.h"
+#include <algorithm>
+
+namespace BICGRPCHelperNamespace
+{
+    /// <summary>
+    /// Selects the interpolation method and the longest gap that will be filled
+    /// </summary>
+    /// <param name="newMethod">Interpolation method to use for future gaps</param>
+    /// <param name="newMaxGapLength">Maximum number of missing samples that will be synthesized for a single gap</param>
+    void GapInterpolator::configure(InterpolationMethod newMethod, uint32_t newMaxGapLength)
+    {
+        method = newMethod;
+        maxGapLength = newMaxGapLength;
+    }
+
+    /// <summary>
+    /// Starts a new streaming session, clearing sample history and gap statistics
+    /// </summary>
+    /// <param name="numChannels">Number of channels expected in each sample</param>
+    void GapInterpolator::resetSession(uint32_t numChannels)
+    {
+        lastData.assign(numChannels, 0);
+        previousData.assign(numChannels, 0);
+        hasHistory = false;
+        hasSlopeHistory = false;
+        statistics = InterpolationStatistics();
+    }
+
+    /// <summary>
+    /// Records a received sample as the start point for the next gap
+    /// </summary>
+    /// <param name="sampleData">Measurements of the received sample, one per channel</param>
+    /// <param name="numChannels">Number of channels in the sample</param>
+    void GapInterpolator::updateHistory(const double* sampleData, uint32_t numChannels)
+    {
+        if (lastData.size() != numChannels)
+        {
+            lastData.assign(numChannels, 0);
+            previousData.assign(numChannels, 0);
+            hasHistory = false;
+        }
+        previousData.swap(lastData);
+        std::copy(sampleData, sampleData + numChannels, lastData.begin());
+
+        // A slope is only available once two samples have been received
+        hasSlopeHistory = hasHistory;
+        hasHistory = true;
+    }
+
+    /// <summary>
+    /// Appends a complete gap of synthesized samples to a block. Counters and the interpolated flag are set, status columns are left for the caller.
+    /// </summary>
+    /// <param name="theBlock">Block to append the synthesized samples to</param>
+    /// <param name="firstCounter">Measurement counter of the first missing sample</param>
+    /// <param name="gapLength">Number of missing samples</param>
+    /// <param name="nextData">Measurements of the first sample received after the gap</param>
+    /// <returns>Index of the first synthesized sample within the block</returns>
+    uint32_t GapInterpolator::fillGap(SampleBlock* theBlock, uint32_t firstCounter, uint32_t gapLength, const double* nextData)
+    {
+        uint32_t numChannels = theBlock->channelCount();
+        if (lastData.size() != numChannels)
+        {
+            lastData.assign(numChannels, 0);
+            previousData.assign(numChannels, 0);
+            hasSlopeHistory = false;
+        }
+
+        uint32_t firstRow = theBlock->appendSamples(gapLength);
+        for (uint32_t k = 0; k < gapLength; k++)
+        {
+            theBlock->sampleCounter[firstRow + k] = firstCounter + k;
+            theBlock->flags[firstRow + k] = SAMPLE_FLAG_INTERPOLATED;
+        }
+
+        // Weights depend only on the gap length, so they are shared by every channel
+        computeWeights(gapLength);
+        const double* w0 = startWeight.data();
+        const double* w1 = endWeight.data();
+        const double* s0 = startSlopeWeight.data();
+        const double* s1 = endSlopeWeight.data();
+
+        for (uint32_t channelIndex = 0; channelIndex < numChannels; channelIndex++)
+        {
+            double* out = theBlock->channel(channelIndex) + firstRow;
+            double p0 = lastData[channelIndex];
+            double p1 = nextData[channelIndex];
+
+            switch (method)
+            {
+            case INTERPOLATION_HOLD_LAST:
+                std::fill(out, out + gapLength, p0);
+                break;
+
+            case INTERPOLATION_CUBIC_HERMITE:
+            {
+                // Tangents are expressed over the whole gap span (gapLength + 1 sample periods)
+                double secant = p1 - p0;
+                double m0 = hasSlopeHistory ? 0.5 * (((p0 - previousData[channelIndex]) * (gapLength + 1)) + secant) : secant;
+                double m1 = secant;
+                for (uint32_t k = 0; k < gapLength; k++)
+                {
+                    out[k] = (w0[k] * p0) + (s0[k] * m0) + (w1[k] * p1) + (s1[k] * m1);
+                }
+                break;
+            }
+
+            case INTERPOLATION_LINEAR:
+            default:
+                for (uint32_t k = 0; k < gapLength; k++)
+                {
+                    out[k] = (w0[k] * p0) + (w1[k] * p1);
+                }
+                break;
+            }
+
+            // The last synthesized sample is now the latest known value, so the next received sample measures its slope from it
+            lastData[channelIndex] = out[gapLength - 1];
+        }
+
+        // Update session statistics
+        statistics.interpolatedSamples += gapLength;
+        statistics.gapsFilled++;
+        recordGapLength(gapLength);
+
+        return firstRow;
+    }
+
+    /// <summary>
+    /// Records a gap that exceeded the interpolation limit and was left unfilled
+    /// </summary>
+    /// <param name="gapLength">Number of missing samples</param>
+    void GapInterpolator::recordDroppedGap(uint32_t gapLength)
+    {
+        statistics.gapsDropped++;
+        statistics.droppedSamples += gapLength;
+        recordGapLength(gapLength);
+
+        // A slope measured across a dropped gap would be meaningless, restart the slope history
+        hasHistory = false;
+        hasSlopeHistory = false;
+    }
+
+    /// <summary>
+    /// Adds a gap to the longest-gap tracker and the gap length histogram
+    /// </summary>
+    /// <param name="gapLength">Number of missing samples</param>
+    void GapInterpolator::recordGapLength(uint32_t gapLength)
+    {
+        statistics.longestGap = std::max(statistics.longestGap, gapLength);
+
+        // Power-of-two bins: 1, 2, 3-4, 5-8, ..., last bin collects everything longer
+        size_t binIndex = 0;
+        for (uint32_t remaining = gapLength - 1; remaining > 0; remaining >>= 1)
+        {
+            binIndex++;
+        }
+        binIndex = std::min(binIndex, statistics.gapLengthHistogram.size() - 1);
+        statistics.gapLengthHistogram[binIndex]++;
+    }
+
+    /// <summary>
+    /// Computes the per-position interpolation weights for a gap of the given length
+    /// </summary>
+    /// <param name="gapLength">Number of missing samples</param>
+    void GapInterpolator::computeWeights(uint32_t gapLength)
+    {
+        startWeight.resize(gapLength);
+        endWeight.resize(gapLength);
+        startSlopeWeight.resize(gapLength);
+        endSlopeWeight.resize(gapLength);
+
+        for (uint32_t k = 0; k < gapLength; k++)
+        {
+            // Normalized position of the synthesized sample between the two received samples
+            double t = (double)(k + 1) / (gapLength + 1);
+            if (method == INTERPOLATION_CUBIC_HERMITE)
+            {
+                // Cubic Hermite basis functions
+                double t2 = t * t;
+                double t3 = t2 * t;
+                startWeight[k] = (2 * t3) - (3 * t2) + 1;
+                startSlopeWeight[k] = t3 - (2 * t2) + t;
+                endWeight[k] = (-2 * t3) + (3 * t2);
+                endSlopeWeight[k] = t3 - t2;
+            }
+            else
+            {
+                startWeight[k] = 1 - t;
+                startSlopeWeight[k] = 0;
+                endWeight[k] = t;
+                endSlopeWeight[k] = 0;
+            }
+        }
+    }
+}
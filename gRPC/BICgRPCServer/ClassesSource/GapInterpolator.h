@@ -0,0 +1,77 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "SampleBlock.h"
+
+namespace BICGRPCHelperNamespace
+{
+    /// <summary>
+    /// Methods available for synthesizing samples lost to telemetry dropouts. Values match the gRPC InterpolationMethod enum.
+    /// </summary>
+    enum InterpolationMethod
+    {
+        INTERPOLATION_LINEAR = 0,           // Straight line between the last received and the next received sample
+        INTERPOLATION_CUBIC_HERMITE = 1,    // Cubic Hermite spline, entry slope taken from the samples before the gap
+        INTERPOLATION_HOLD_LAST = 2         // Repeat the last received sample
+    };
+
+    /// <summary>
+    /// How telemetry gaps are presented to neural stream clients. Values match the gRPC GapHandlingMode enum.
+    /// </summary>
+    enum GapHandlingMode
+    {
+        GAP_HANDLING_SEND_INTERPOLATED = 0, // Interpolated samples are streamed as regular samples flagged isInterpolated
+        GAP_HANDLING_SEND_MARKERS = 1       // Only a compact gap marker is streamed, interpolation is kept server-side for closed-loop processing
+    };
+
+    /// <summary>
+    /// Per-session gap statistics gathered by the GapInterpolator
+    /// </summary>
+    struct InterpolationStatistics
+    {
+        uint64_t interpolatedSamples = 0;   // Total number of synthesized samples
+        uint64_t gapsFilled = 0;            // Number of gaps filled by interpolation
+        uint64_t gapsDropped = 0;           // Number of gaps longer than the interpolation limit, left unfilled
+        uint64_t droppedSamples = 0;        // Number of samples lost in unfilled gaps
+        uint32_t longestGap = 0;            // Longest gap observed, filled or not
+        std::vector<uint64_t> gapLengthHistogram = std::vector<uint64_t>(8, 0);    // Gap counts in power-of-two length bins: 1, 2, 3-4, 5-8, ..., 65+
+    };
+
+    /// <summary>
+    /// Fills whole telemetry gaps in a SampleBlock at once. Interpolation weights are computed once per gap and applied to each
+    /// contiguous channel plane, so the per-channel loops are simple multiply-adds the compiler can vectorize.
+    /// </summary>
+    class GapInterpolator
+    {
+    public:
+        void configure(InterpolationMethod method, uint32_t maxGapLength);
+        void resetSession(uint32_t numChannels);
+        void updateHistory(const double* sampleData, uint32_t numChannels);
+        uint32_t fillGap(SampleBlock* theBlock, uint32_t firstCounter, uint32_t gapLength, const double* nextData);
+        void recordDroppedGap(uint32_t gapLength);
+        bool canFill(uint32_t gapLength) const { return gapLength <= maxGapLength; }
+        const double* lastSample() const { return lastData.data(); }
+        InterpolationMethod getMethod() const { return method; }
+        const InterpolationStatistics& getStatistics() const { return statistics; }
+
+    private:
+        void recordGapLength(uint32_t gapLength);
+        void computeWeights(uint32_t gapLength);
+
+        InterpolationMethod method = INTERPOLATION_LINEAR;
+        uint32_t maxGapLength = 0;
+        InterpolationStatistics statistics;
+
+        // Sample history used as the gap start point (and entry slope for cubic interpolation)
+        std::vector<double> lastData;
+        std::vector<double> previousData;
+        bool hasHistory = false;
+        bool hasSlopeHistory = false;
+
+        // Per-gap interpolation weights, kept between gaps to avoid reallocating
+        std::vector<double> startWeight;
+        std::vector<double> startSlopeWeight;
+        std::vector<double> endWeight;
+        std::vector<double> endSlopeWeight;
+    };
+}
@@ -0,0 +1,47 @@
+#include "ImpedanceCache.h"
+
+namespace BICGRPCHelperNamespace
+{
+    /// <summary>
+    /// Looks up a measurement that is no older than the given age
+    /// </summary>
+    /// <param name="channel">Channel measured</param>
+    /// <param name="maxAge">Oldest acceptable measurement, 0 to never use the cache</param>
+    /// <param name="measurement">Filled with the cached measurement if one is found</param>
+    /// <returns>True if a recent enough measurement was found</returns>
+    bool ImpedanceCache::lookup(uint32_t channel, std::chrono::milliseconds maxAge, ImpedanceMeasurement* measurement)
+    {
+        if (maxAge <= std::chrono::milliseconds::zero())
+        {
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(cacheLock);
+        std::unordered_map<uint32_t, ImpedanceMeasurement>::iterator it = measurements.find(channel);
+        if (it == measurements.end() || std::chrono::steady_clock::now() - it->second.measuredAt > maxAge)
+        {
+            return false;
+        }
+        *measurement = it->second;
+        return true;
+    }
+
+    /// <summary>
+    /// Records a measurement that just finished
+    /// </summary>
+    /// <param name="channel">Channel measured</param>
+    /// <param name="impedance">Measured impedance in ohms</param>
+    /// <param name="measurementStart">Time the measurement was requested from the device</param>
+    /// <returns>The stored measurement</returns>
+    ImpedanceMeasurement ImpedanceCache::store(uint32_t channel, double impedance, std::chrono::steady_clock::time_point measurementStart)
+    {
+        ImpedanceMeasurement measurement;
+        measurement.impedance = impedance;
+        measurement.measuredAt = std::chrono::steady_clock::now();
+        measurement.timeStamp = std::chrono::system_clock::now().time_since_epoch().count();
+        measurement.measurementNs = std::chrono::duration_cast<std::chrono::nanoseconds>(measurement.measuredAt - measurementStart).count();
+
+        std::lock_guard<std::mutex> lock(cacheLock);
+        measurements[channel] = measurement;
+        return measurement;
+    }
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+
+namespace BICGRPCHelperNamespace
+{
+    /// <summary>
+    /// Impedance measured on one channel
+    /// </summary>
+    struct ImpedanceMeasurement
+    {
+        double impedance = 0;                                   // Ohms
+        uint64_t timeStamp = 0;                                 // Time the measurement finished (system_clock ticks)
+        std::chrono::steady_clock::time_point measuredAt;       // Same time on the steady clock, for the age check
+        uint64_t measurementNs = 0;                             // Duration of the measurement on the device
+    };
+
+    /// <summary>
+    /// Latest impedance measurement of each channel of a device, so queries within a client-chosen age are answered from memory
+    /// </summary>
+    class ImpedanceCache
+    {
+    public:
+        bool lookup(uint32_t channel, std::chrono::milliseconds maxAge, ImpedanceMeasurement* measurement);
+        ImpedanceMeasurement store(uint32_t channel, double impedance, std::chrono::steady_clock::time_point measurementStart);
+
+    private:
+        std::mutex cacheLock;
+        std::unordered_map<uint32_t, ImpedanceMeasurement> measurements;
+    };
+}
@@ -0,0 +1,266 @@
+#include "OpenLoopScheduler.h"
+#include <algorithm>
+#include <cmath>
+#include "ThreadRoleRegistry.h"
+#ifdef _WIN32
+#include <windows.h>
+#pragma comment(lib, "winmm.lib")
+#endif
+
+namespace BICGRPCHelperNamespace
+{
+    // Time before a deadline at which the timer thread stops sleeping and starts spinning
+    static const std::chrono::microseconds SPIN_MARGIN(1500);
+
+    // Time between attempts while the previous stimulation of a schedule is still running, in case its end is never reported to wake()
+    static const std::chrono::milliseconds BUSY_RETRY_INTERVAL(10);
+
+    /// <summary>
+    /// Accessor for the process-wide scheduler
+    /// </summary>
+    /// <returns>The scheduler</returns>
+    OpenLoopScheduler& OpenLoopScheduler::instance()
+    {
+        static OpenLoopScheduler theScheduler;
+        return theScheduler;
+    }
+
+    /// <summary>
+    /// Adds a schedule whose first deadline is now. Starts the timer thread if this is the only schedule.
+    /// </summary>
+    /// <param name="periodNs">Period between deadlines in nanoseconds</param>
+    /// <param name="fireCallback">Function called from the timer thread at each deadline, returns false if it could not stimulate yet</param>
+    /// <returns>Identifier of the schedule</returns>
+    uint32_t OpenLoopScheduler::add(double periodNs, std::function<bool(const ScheduledStimulation&)> fireCallback)
+    {
+        std::lock_guard<std::mutex> lifecycle(lifecycleLock);
+        std::unique_lock<std::mutex> lock(schedulerLock);
+
+        uint32_t scheduleId = nextScheduleId++;
+        Schedule& theSchedule = schedules[scheduleId];
+        theSchedule.fireCallback = fireCallback;
+        theSchedule.periodNs = periodNs;
+        theSchedule.startTime = std::chrono::steady_clock::now();
+        theSchedule.retryTime = theSchedule.startTime;
+        theSchedule.stats.periodNs = (int64_t)std::llround(periodNs);
+
+        if (schedulerThread == NULL)
+        {
+#ifdef _WIN32
+            // Raise the system timer resolution so the sleep phase ends close to the spin margin
+            timeBeginPeriod(1);
+#endif
+            isStopping = false;
+            schedulerThread = new std::thread(&OpenLoopScheduler::timerThread, this);
+        }
+        lock.unlock();
+        schedulerNotify.notify_all();
+        return scheduleId;
+    }
+
+    /// <summary>
+    /// Removes a schedule, waiting for its callback if it is running. Stops the timer thread if no schedules remain.
+    /// </summary>
+    /// <param name="scheduleId">Identifier returned by add()</param>
+    /// <param name="finalStats">Filled with the statistics of the schedule, may be NULL</param>
+    /// <returns>True if the schedule existed</returns>
+    bool OpenLoopScheduler::remove(uint32_t scheduleId, OpenLoopJitterStats* finalStats)
+    {
+        std::lock_guard<std::mutex> lifecycle(lifecycleLock);
+        std::unique_lock<std::mutex> lock(schedulerLock);
+
+        schedulerNotify.wait(lock, [this, scheduleId] { return firingScheduleId != scheduleId; });
+        std::map<uint32_t, Schedule>::iterator it = schedules.find(scheduleId);
+        if (it == schedules.end())
+        {
+            return false;
+        }
+        if (finalStats != NULL)
+        {
+            finishStats(it->second, finalStats);
+        }
+        schedules.erase(it);
+        if (!schedules.empty())
+        {
+            return true;
+        }
+
+        // Last schedule gone, stop the timer thread
+        isStopping = true;
+        lock.unlock();
+        schedulerNotify.notify_all();
+        schedulerThread->join();
+        delete schedulerThread;
+        schedulerThread = NULL;
+#ifdef _WIN32
+        timeEndPeriod(1);
+#endif
+        return true;
+    }
+
+    /// <summary>
+    /// Reads the running statistics of a schedule
+    /// </summary>
+    /// <param name="scheduleId">Identifier returned by add()</param>
+    /// <param name="stats">Filled with the statistics</param>
+    /// <returns>True if the schedule exists</returns>
+    bool OpenLoopScheduler::getStats(uint32_t scheduleId, OpenLoopJitterStats* stats)
+    {
+        std::lock_guard<std::mutex> lock(schedulerLock);
+        std::map<uint32_t, Schedule>::iterator it = schedules.find(scheduleId);
+        if (it == schedules.end())
+        {
+            return false;
+        }
+        finishStats(it->second, stats);
+        return true;
+    }
+
+    /// <summary>
+    /// Retries a schedule that is waiting for its previous stimulation to finish right away. Called when the stimulation state changes.
+    /// </summary>
+    /// <param name="scheduleId">Identifier returned by add()</param>
+    void OpenLoopScheduler::wake(uint32_t scheduleId)
+    {
+        {
+            std::lock_guard<std::mutex> lock(schedulerLock);
+            std::map<uint32_t, Schedule>::iterator it = schedules.find(scheduleId);
+            if (it == schedules.end())
+            {
+                return;
+            }
+            Schedule& theSchedule = it->second;
+            if (firingScheduleId == scheduleId)
+            {
+                // The callback may have seen the old state, let the timer thread retry once it returns
+                theSchedule.isWakeRequested = true;
+            }
+            else if (theSchedule.retryTime > deadlineOf(theSchedule, theSchedule.periodIndex))
+            {
+                // Waiting after a busy attempt
+                theSchedule.retryTime = std::chrono::steady_clock::now();
+            }
+        }
+        schedulerNotify.notify_all();
+    }
+
+    /// <summary>
+    /// Computes a deadline from the start of its schedule, so rounding never accumulates
+    /// </summary>
+    std::chrono::steady_clock::time_point OpenLoopScheduler::deadlineOf(const Schedule& theSchedule, uint64_t periodIndex)
+    {
+        return theSchedule.startTime + std::chrono::nanoseconds(std::llround((double)periodIndex * theSchedule.periodNs));
+    }
+
+    /// <summary>
+    /// Copies the statistics of a schedule and derives the error mean and deviation from its running sums
+    /// </summary>
+    void OpenLoopScheduler::finishStats(const Schedule& theSchedule, OpenLoopJitterStats* stats)
+    {
+        *stats = theSchedule.stats;
+        if (stats->issuedPeriods > 0)
+        {
+            stats->meanErrorNs = theSchedule.sumErrorNs / stats->issuedPeriods;
+            stats->stdDevErrorNs = std::sqrt(std::max(0.0, theSchedule.sumSquaredErrorNs / stats->issuedPeriods - stats->meanErrorNs * stats->meanErrorNs));
+        }
+    }
+
+    /// <summary>
+    /// Timer thread: waits for the earliest pending attempt of any schedule, fires it and moves that schedule on
+    /// </summary>
+    void OpenLoopScheduler::timerThread()
+    {
+        // Apply the configured scheduling for this thread
+        ThreadRoleRegistry::instance().applyRole(THREAD_ROLE_OPEN_LOOP_STIM);
+
+        std::unique_lock<std::mutex> lock(schedulerLock);
+        while (!isStopping)
+        {
+            if (schedules.empty())
+            {
+                schedulerNotify.wait(lock);
+                continue;
+            }
+
+            // Earliest attempt over all schedules
+            std::map<uint32_t, Schedule>::iterator next = schedules.begin();
+            for (std::map<uint32_t, Schedule>::iterator it = schedules.begin(); it != schedules.end(); it++)
+            {
+                if (it->second.retryTime < next->second.retryTime)
+                {
+                    next = it;
+                }
+            }
+            uint32_t scheduleId = next->first;
+            std::chrono::steady_clock::time_point attemptTime = next->second.retryTime;
+
+            // Coarse sleep, woken early if schedules change or the scheduler stops
+            if (std::chrono::steady_clock::now() < attemptTime - SPIN_MARGIN)
+            {
+                schedulerNotify.wait_until(lock, attemptTime - SPIN_MARGIN);
+                continue;
+            }
+
+            // Fine wait without the lock held
+            lock.unlock();
+            while (std::chrono::steady_clock::now() < attemptTime)
+            {
+                std::this_thread::yield();
+            }
+            lock.lock();
+
+            // Only fire if the schedule was not removed or replaced while spinning
+            std::map<uint32_t, Schedule>::iterator it = schedules.find(scheduleId);
+            if (isStopping || it == schedules.end() || it->second.retryTime != attemptTime)
+            {
+                continue;
+            }
+            Schedule& theSchedule = it->second;
+
+            // Fire without the lock held; remove() waits for firingScheduleId so the schedule stays valid
+            ScheduledStimulation firedStimulation;
+            firedStimulation.deadline = deadlineOf(theSchedule, theSchedule.periodIndex);
+            firingScheduleId = scheduleId;
+            theSchedule.isWakeRequested = false;
+            lock.unlock();
+            firedStimulation.issueTime = std::chrono::steady_clock::now();
+            firedStimulation.schedulingErrorNs = std::chrono::duration_cast<std::chrono::nanoseconds>(firedStimulation.issueTime - firedStimulation.deadline).count();
+            bool isIssued = theSchedule.fireCallback(firedStimulation);
+            lock.lock();
+            firingScheduleId = 0;
+            schedulerNotify.notify_all();
+
+            // Move on to the next period, or retry this one while there is time left in it
+            std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+            if (isIssued)
+            {
+                theSchedule.stats.issuedPeriods++;
+                theSchedule.sumErrorNs += (double)firedStimulation.schedulingErrorNs;
+                theSchedule.sumSquaredErrorNs += (double)firedStimulation.schedulingErrorNs * (double)firedStimulation.schedulingErrorNs;
+                theSchedule.stats.maxErrorNs = std::max(theSchedule.stats.maxErrorNs, firedStimulation.schedulingErrorNs);
+                theSchedule.periodIndex++;
+            }
+            else
+            {
+                theSchedule.stats.busyRetries++;
+                std::chrono::steady_clock::time_point retryTime = theSchedule.isWakeRequested ? now : now + BUSY_RETRY_INTERVAL;
+                if (retryTime < deadlineOf(theSchedule, theSchedule.periodIndex + 1))
+                {
+                    // Keep the retry after the deadline so wake() can tell a busy schedule from one waiting for its deadline
+                    theSchedule.retryTime = std::max(retryTime, firedStimulation.deadline + std::chrono::nanoseconds(1));
+                    continue;
+                }
+                theSchedule.stats.missedPeriods++;
+                theSchedule.periodIndex++;
+            }
+
+            // Periods that ended while this one was being served are skipped rather than fired back to back
+            while (deadlineOf(theSchedule, theSchedule.periodIndex + 1) <= now)
+            {
+                theSchedule.stats.missedPeriods++;
+                theSchedule.periodIndex++;
+            }
+            theSchedule.retryTime = deadlineOf(theSchedule, theSchedule.periodIndex);
+        }
+    }
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include "StimulationScheduler.h"
+
+namespace BICGRPCHelperNamespace
+{
+    /// <summary>
+    /// Running timing statistics of one open-loop stimulation schedule
+    /// </summary>
+    struct OpenLoopJitterStats
+    {
+        int64_t periodNs = 0;               // Nominal period
+        uint64_t issuedPeriods = 0;         // Periods in which stimulation was issued
+        uint64_t missedPeriods = 0;         // Periods skipped because the previous stimulation was still running at the next deadline
+        uint64_t busyRetries = 0;           // Attempts made while the previous stimulation was still running
+        double meanErrorNs = 0;             // Mean of issue time minus deadline over issued periods
+        double stdDevErrorNs = 0;           // Standard deviation of issue time minus deadline
+        int64_t maxErrorNs = 0;             // Largest issue time minus deadline
+    };
+
+    /// <summary>
+    /// Process-wide scheduler for open-loop stimulation of all devices. Every schedule has a fixed start time and deadlines at exact
+    /// multiples of its period from it, so the rate does not drift however long a session runs. One timer thread sleeps until shortly
+    /// before the earliest deadline and spins for the remainder, like the StimulationScheduler.
+    ///
+    /// Fire callbacks run on the timer thread and return false while their device is still stimulating; the schedule is then retried
+    /// as soon as wake() reports the stimulation finished, with a slow poll as fallback, until the deadline after, at which point
+    /// the period counts as missed. Callbacks of different devices run one after another, so
+    /// a slow callback shows up as jitter of the next schedule.
+    /// </summary>
+    class OpenLoopScheduler
+    {
+    public:
+        static OpenLoopScheduler& instance();
+        uint32_t add(double periodNs, std::function<bool(const ScheduledStimulation&)> fireCallback);
+        bool remove(uint32_t scheduleId, OpenLoopJitterStats* finalStats);
+        bool getStats(uint32_t scheduleId, OpenLoopJitterStats* stats);
+        void wake(uint32_t scheduleId);
+
+    private:
+        struct Schedule
+        {
+            std::function<bool(const ScheduledStimulation&)> fireCallback;
+            std::chrono::steady_clock::time_point startTime;
+            double periodNs;                                    // Fractional so rates that are not whole nanosecond periods stay exact
+            uint64_t periodIndex = 0;                           // Index of the next deadline, counted from startTime
+            std::chrono::steady_clock::time_point retryTime;    // Next attempt for the current period, later than its deadline after busy retries
+            bool isWakeRequested = false;                       // wake() was called while the callback was running
+            OpenLoopJitterStats stats;
+            double sumErrorNs = 0;
+            double sumSquaredErrorNs = 0;
+        };
+
+        OpenLoopScheduler() {}
+        void timerThread(void);
+        static std::chrono::steady_clock::time_point deadlineOf(const Schedule& theSchedule, uint64_t periodIndex);
+        static void finishStats(const Schedule& theSchedule, OpenLoopJitterStats* stats);
+
+        std::mutex lifecycleLock;                               // Serializes starting and stopping the timer thread
+        std::mutex schedulerLock;
+        std::condition_variable schedulerNotify;
+        std::thread* schedulerThread = NULL;
+        std::map<uint32_t, Schedule> schedules;
+        uint32_t nextScheduleId = 1;
+        uint32_t firingScheduleId = 0;                          // Schedule whose callback is running, 0 for none
+        bool isStopping = false;
+    };
+}
@@ -0,0 +1,582 @@
+#include "PhaseEstimator.h"
+#include "ThreadRoleRegistry.h"
+#include <algorithm>
+#include <cmath>
+
+namespace BICGRPCHelperNamespace
+{
+    static const double PI = 3.14159265358979323846;
+    static const double DEFAULT_SAMPLING_RATE = 1000;      // Sampling rate assumed when the device did not report one
+    static const uint32_t DEFAULT_FIR_HILBERT_TAPS = 127;
+    static const uint32_t DEFAULT_ECHT_WINDOW = 500;
+    static const uint32_t DEFAULT_AR_FIT_WINDOW = 500;
+    static const uint32_t AR_MODEL_ORDER = 10;
+    static const double AR_LOWEST_FREQUENCY = 8;          // Lowest oscillation frequency (Hz) the forecaster searches a full cycle for
+
+    /// <summary>
+    /// Wraps a phase in degrees into [0, 360)
+    /// </summary>
+    static double wrapPhase(double phaseDegrees)
+    {
+        phaseDegrees = std::fmod(phaseDegrees, 360.0);
+        return phaseDegrees < 0 ? phaseDegrees + 360 : phaseDegrees;
+    }
+
+    //*************************************************** Frequency Tracking ***************************************************
+    /// <summary>
+    /// Updates the frequency estimate from the phase advance since the previous sample
+    /// </summary>
+    /// <param name="phaseDegrees">Latest phase estimate</param>
+    void PhaseFrequencyTracker::update(double phaseDegrees)
+    {
+        if (hasLastPhase)
+        {
+            double phaseAdvance = phaseDegrees - lastPhase;
+            if (phaseAdvance > 180)
+            {
+                phaseAdvance -= 360;
+            }
+            else if (phaseAdvance <= -180)
+            {
+                phaseAdvance += 360;
+            }
+
+            // Only forward rotation is a valid oscillation, ignore steps where the estimate jittered backwards
+            double instantFrequency = phaseAdvance / 360 * samplingRate;
+            if (instantFrequency > 0)
+            {
+                frequency = (frequency == 0) ? instantFrequency : frequency + 0.05 * (instantFrequency - frequency);
+            }
+        }
+        lastPhase = phaseDegrees;
+        hasLastPhase = true;
+    }
+
+    //*************************************************** Zero Crossing Estimator ***************************************************
+    /// <summary>
+    /// Constructs the zero crossing estimator
+    /// </summary>
+    /// <param name="samplingRate">Device sampling rate in Hz</param>
+    ZeroCrossingPhasePolicy::ZeroCrossingPhasePolicy(double samplingRate)
+        : samplePeriod(1 / samplingRate)
+    {
+    }
+
+    /// <summary>
+    /// Function for calculating the phase of a sample
+    /// </summary>
+    /// <param name="input">Filtered sensing data and counter of the current sample</param>
+    /// <returns>Calculated phase of the current sample</returns>
+    double ZeroCrossingPhasePolicy::estimatePhase(const PhaseEstimatorInput& input)
+    {
+        const std::vector<double>& dataArray = *input.filtHistory;
+        uint64_t currSamp = input.sampleCounter;
+        double avgSigFreq = 0;
+        double sigFreq = 0;
+        double currPhase = 0;
+
+        // Identify sample difference
+        uint64_t sampDiff = currSamp - refSamp;
+
+        // Classify the latest point: zero crossings are checked on the newest pair, extrema on the previous sample
+        bool isPosZeroCrossing = dataArray[0] > 0 && dataArray[1] < 0;
+        bool isNegZeroCrossing = dataArray[0] < 0 && dataArray[1] > 0;
+        bool isMax = dataArray[0] < dataArray[1] && dataArray[1] > dataArray[2];
+        bool isMin = dataArray[0] > dataArray[1] && dataArray[1] < dataArray[2];
+
+        // Estimate oscillation frequency
+        if (isPosZeroCrossing || isNegZeroCrossing || isMax || isMin)
+        {
+            // If so, calculate the frequency
+            sigFreq = 1 / (4 * sampDiff * samplePeriod);
+
+            // Check that the calculated frequency is within reasonable bounds
+            if (sigFreq > 10 && sigFreq < 30)
+            {
+                prevSigFreq.insert(prevSigFreq.begin(), sigFreq);
+                prevSigFreq.pop_back();
+            }
+
+            // Depending on its type, identify the current phase and reassign reference point for estimating phase
+            if (isPosZeroCrossing)
+            {
+                refPoint = 0;
+            }
+            else if (isNegZeroCrossing)
+            {
+                refPoint = 180;
+            }
+            else if (isMax)
+            {
+                refPoint = 90;
+            }
+            else
+            {
+                refPoint = 270;
+            }
+            currPhase = refPoint;
+            refSamp = currSamp;
+        }
+
+        // Calculate the phase value using previously recorded signal frequencies
+        else
+        {
+            for (size_t i = 0; i < prevSigFreq.size(); i++)
+            {
+                avgSigFreq += prevSigFreq[i];
+            }
+            avgSigFreq /= prevSigFreq.size();
+
+            currPhase = refPoint + (samplePeriod * sampDiff * avgSigFreq * 360);
+        }
+
+        return currPhase;
+    }
+
+    //*************************************************** FIR Hilbert Estimator ***************************************************
+    /// <summary>
+    /// Constructs the FIR Hilbert estimator with a Hamming-windowed type III transformer
+    /// </summary>
+    /// <param name="samplingRate">Device sampling rate in Hz</param>
+    /// <param name="numTaps">Transformer length, forced to an odd number of at least 3</param>
+    FirHilbertPhasePolicy::FirHilbertPhasePolicy(double samplingRate, uint32_t numTaps)
+        : samplingRate(samplingRate), numTaps(numTaps < 3 ? 3 : (numTaps | 1)), frequencyTracker(samplingRate)
+    {
+        groupDelay = (this->numTaps - 1) / 2;
+        reversedTaps.assign(this->numTaps, 0);
+        history.assign(2 * (size_t)this->numTaps, 0);
+
+        // Ideal transformer is 2 / (pi * m) on odd offsets from the center, zero on even offsets
+        for (uint32_t k = 0; k < this->numTaps; k++)
+        {
+            int offset = (int)k - (int)groupDelay;
+            if (offset % 2 != 0)
+            {
+                double hamming = 0.54 - 0.46 * std::cos(2 * PI * k / (this->numTaps - 1));
+                reversedTaps[this->numTaps - 1 - k] = 2 / (PI * offset) * hamming;
+            }
+        }
+    }
+
+    /// <summary>
+    /// Magnitude response of the transformer at a given frequency
+    /// </summary>
+    /// <param name="frequency">Frequency in Hz</param>
+    /// <returns>Transformer gain, ideally 1</returns>
+    double FirHilbertPhasePolicy::transformerGain(double frequency) const
+    {
+        double omega = 2 * PI * frequency / samplingRate;
+        double response = 0;
+        for (uint32_t m = 1; m <= groupDelay; m++)
+        {
+            // Tap at center + m, stored reversed
+            response += reversedTaps[groupDelay - m] * std::sin(omega * m);
+        }
+        return 2 * response;
+    }
+
+    /// <summary>
+    /// Estimates the phase of the newest filtered sample
+    /// </summary>
+    /// <param name="input">Filtered sensing data of the current sample</param>
+    /// <returns>Estimated phase of the current sample in degrees</returns>
+    double FirHilbertPhasePolicy::estimatePhase(const PhaseEstimatorInput& input)
+    {
+        // Store the sample in both halves, the window [writeIndex + 1, writeIndex + numTaps] is then contiguous, oldest first
+        double newest = (*input.filtHistory)[0];
+        history[writeIndex] = newest;
+        history[writeIndex + numTaps] = newest;
+        const double* windowStart = history.data() + writeIndex + 1;
+        writeIndex = (writeIndex + 1 == numTaps) ? 0 : writeIndex + 1;
+
+        double quadrature = 0;
+        for (uint32_t j = 0; j < numTaps; j++)
+        {
+            quadrature += reversedTaps[j] * windowStart[j];
+        }
+        double inPhase = windowStart[groupDelay];
+
+        // Correct the transformer's low-frequency droop at the tracked frequency
+        double frequency = frequencyTracker.getFrequency();
+        if (frequency > 0 && std::abs(frequency - gainFrequency) > 0.25)
+        {
+            gain = std::max(transformerGain(frequency), 0.05);
+            gainFrequency = frequency;
+        }
+
+        // Phase of the delayed sample, then advanced over the group delay
+        double delayedPhase = std::atan2(quadrature / gain, inPhase) * 180 / PI;
+        frequencyTracker.update(delayedPhase);
+        return wrapPhase(delayedPhase + 90 + (360 * frequencyTracker.getFrequency() * groupDelay / samplingRate));
+    }
+
+    //*************************************************** ECHT Estimator ***************************************************
+    /// <summary>
+    /// Constructs the ECHT estimator and precomputes the endpoint weights from the band-pass filter response
+    /// </summary>
+    /// <param name="samplingRate">Device sampling rate in Hz</param>
+    /// <param name="windowLength">Number of samples in the sliding window, at least 16</param>
+    /// <param name="filtCoeff_B">Band-pass filter numerator coefficients</param>
+    /// <param name="filtCoeff_A">Band-pass filter denominator coefficients</param>
+    EchtPhasePolicy::EchtPhasePolicy(double samplingRate, uint32_t windowLength, const std::vector<double>& filtCoeff_B, const std::vector<double>& filtCoeff_A)
+        : windowLength(windowLength < 16 ? 16 : windowLength), frequencyTracker(samplingRate)
+    {
+        uint32_t N = this->windowLength;
+        numBins = N / 2 + 1;
+        window.assign(N, 0);
+        spectrum.assign(numBins, std::complex<double>(0, 0));
+
+        twiddle.resize(N);
+        for (uint32_t t = 0; t < N; t++)
+        {
+            twiddle[t] = std::polar(1.0, -2 * PI * t / N);
+        }
+
+        endpointWeight.resize(numBins);
+        for (uint32_t k = 0; k < numBins; k++)
+        {
+            // Analytic signal: drop DC, double the positive frequencies, keep Nyquist as is
+            double analyticWeight = (k == 0) ? 0 : ((2 * k == N) ? 1 : 2);
+
+            // Band-pass response B(e^jw) / A(e^jw)
+            std::complex<double> numerator(0, 0);
+            std::complex<double> denominator(0, 0);
+            for (size_t i = 0; i < filtCoeff_B.size(); i++)
+            {
+                numerator += filtCoeff_B[i] * twiddle[(k * i) % N];
+            }
+            for (size_t i = 0; i < filtCoeff_A.size(); i++)
+            {
+                denominator += filtCoeff_A[i] * twiddle[(k * i) % N];
+            }
+            std::complex<double> response(1, 0);
+            if (!filtCoeff_B.empty() && std::abs(denominator) > 1e-12)
+            {
+                response = numerator / denominator;
+            }
+
+            // Inverse DFT kernel for the newest sample of the window (index N - 1)
+            endpointWeight[k] = analyticWeight * response * twiddle[k] / (double)N;
+        }
+    }
+
+    /// <summary>
+    /// Estimates the phase of the newest band-pass input sample
+    /// </summary>
+    /// <param name="input">Band-pass input of the current sample</param>
+    /// <returns>Estimated phase of the current sample in degrees</returns>
+    double EchtPhasePolicy::estimatePhase(const PhaseEstimatorInput& input)
+    {
+        uint32_t N = windowLength;
+
+        // Slide the window by one sample
+        double delta = input.bandInput - window[writeIndex];
+        window[writeIndex] = input.bandInput;
+        writeIndex = (writeIndex + 1 == N) ? 0 : writeIndex + 1;
+        for (uint32_t k = 0; k < numBins; k++)
+        {
+            spectrum[k] = (spectrum[k] + delta) * std::conj(twiddle[k]);
+        }
+
+        // Recompute one bin directly from the window, oldest sample first
+        std::complex<double> refreshed(0, 0);
+        uint32_t t = 0;
+        for (uint32_t m = 0; m < N; m++)
+        {
+            uint32_t windowIndex = writeIndex + m;
+            if (windowIndex >= N)
+            {
+                windowIndex -= N;
+            }
+            refreshed += window[windowIndex] * twiddle[t];
+            t += refreshBin;
+            if (t >= N)
+            {
+                t -= N;
+            }
+        }
+        spectrum[refreshBin] = refreshed;
+        refreshBin = (refreshBin + 1 == numBins) ? 0 : refreshBin + 1;
+
+        // Filtered analytic signal at the newest sample
+        std::complex<double> endpoint(0, 0);
+        for (uint32_t k = 0; k < numBins; k++)
+        {
+            endpoint += endpointWeight[k] * spectrum[k];
+        }
+
+        double analyticPhase = std::atan2(endpoint.imag(), endpoint.real()) * 180 / PI;
+        frequencyTracker.update(analyticPhase);
+        return wrapPhase(analyticPhase + 90);
+    }
+
+    //*************************************************** AR Forecast Estimator ***************************************************
+    /// <summary>
+    /// Constructs the AR forecaster and starts its refit thread
+    /// </summary>
+    /// <param name="samplingRate">Device sampling rate in Hz</param>
+    /// <param name="fitWindowLength">Number of recent samples each model is fit on</param>
+    /// <param name="predictionHorizon">Samples past the newest sample at which the phase is reported</param>
+    ArForecastPhasePolicy::ArForecastPhasePolicy(double samplingRate, uint32_t fitWindowLength, uint32_t predictionHorizon)
+        : samplingRate(samplingRate), fitWindowLength(std::max(fitWindowLength, 4 * AR_MODEL_ORDER)), predictionHorizon(predictionHorizon)
+    {
+        uint32_t lowestPeriod = (uint32_t)std::ceil(samplingRate / AR_LOWEST_FREQUENCY);
+        pastLength = lowestPeriod;
+        forecastLength = predictionHorizon + lowestPeriod;
+        history.assign(std::max(this->fitWindowLength, pastLength), 0);
+        series.reserve((size_t)pastLength + forecastLength);
+        pendingFitData.reserve(this->fitWindowLength);
+
+        fitThread = new std::thread(&ArForecastPhasePolicy::refitThread, this);
+    }
+
+    /// <summary>
+    /// Stops the refit thread
+    /// </summary>
+    ArForecastPhasePolicy::~ArForecastPhasePolicy()
+    {
+        refitLock.lock();
+        isRefitStopping = true;
+        refitLock.unlock();
+        refitNotify.notify_all();
+
+        fitThread->join();
+        delete fitThread;
+        fitThread = NULL;
+    }
+
+    /// <summary>
+    /// Estimates the phase the band-passed signal will have predictionHorizon samples after the newest sample
+    /// </summary>
+    /// <param name="input">Filtered sensing data of the current sample</param>
+    /// <returns>Forecast phase in degrees</returns>
+    double ArForecastPhasePolicy::estimatePhase(const PhaseEstimatorInput& input)
+    {
+        uint32_t historyLength = (uint32_t)history.size();
+        history[writeIndex] = (*input.filtHistory)[0];
+        writeIndex = (writeIndex + 1 == historyLength) ? 0 : writeIndex + 1;
+
+        // Hand a new fitting window to the refit thread every half window, retrying on the next sample if it is busy
+        if (++samplesSinceRefit >= fitWindowLength / 2 && requestRefit())
+        {
+            samplesSinceRefit = 0;
+        }
+
+        // Recent samples, oldest first
+        series.resize(pastLength);
+        uint32_t historyIndex = (writeIndex + historyLength - pastLength) % historyLength;
+        for (uint32_t m = 0; m < pastLength; m++)
+        {
+            series[m] = history[historyIndex];
+            historyIndex = (historyIndex + 1 == historyLength) ? 0 : historyIndex + 1;
+        }
+
+        // Extend with the forecast of the latest model, if one has been fit yet
+        std::shared_ptr<const std::vector<double>> currentModel = std::atomic_load(&model);
+        double target = pastLength - 1.0;
+        if (currentModel)
+        {
+            const std::vector<double>& coefficients = *currentModel;
+            for (uint32_t f = 0; f < forecastLength; f++)
+            {
+                size_t newest = series.size() - 1;
+                double prediction = 0;
+                for (size_t k = 0; k < coefficients.size(); k++)
+                {
+                    prediction += coefficients[k] * series[newest - k];
+                }
+                series.push_back(prediction);
+            }
+            target += predictionHorizon;
+        }
+
+        // Rising zero crossings around the target, interpolated to fractional sample positions
+        uint32_t targetIndex = (uint32_t)target;
+        double previousCrossing = -1;
+        double nextCrossing = -1;
+        for (uint32_t k = targetIndex; k >= 1; k--)
+        {
+            if (series[k - 1] < 0 && series[k] >= 0)
+            {
+                previousCrossing = (k - 1) + (-series[k - 1] / (series[k] - series[k - 1]));
+                break;
+            }
+        }
+        for (size_t k = targetIndex + 1; k < series.size(); k++)
+        {
+            if (series[k - 1] < 0 && series[k] >= 0)
+            {
+                double crossing = (k - 1) + (-series[k - 1] / (series[k] - series[k - 1]));
+                if (crossing > target)
+                {
+                    nextCrossing = crossing;
+                    break;
+                }
+            }
+        }
+
+        // Phase advances linearly between rising crossings
+        if (previousCrossing < 0)
+        {
+            return 0;
+        }
+        if (nextCrossing > previousCrossing)
+        {
+            frequency = samplingRate / (nextCrossing - previousCrossing);
+            return wrapPhase(360 * (target - previousCrossing) / (nextCrossing - previousCrossing));
+        }
+        return wrapPhase(360 * (target - previousCrossing) * frequency / samplingRate);
+    }
+
+    /// <summary>
+    /// Copies the latest fitting window for the refit thread without blocking the sample path
+    /// </summary>
+    /// <returns>True if the window was handed off</returns>
+    bool ArForecastPhasePolicy::requestRefit()
+    {
+        std::unique_lock<std::mutex> lock(refitLock, std::try_to_lock);
+        if (!lock.owns_lock() || isRefitRequested)
+        {
+            return false;
+        }
+
+        uint32_t historyLength = (uint32_t)history.size();
+        uint32_t historyIndex = (writeIndex + historyLength - fitWindowLength) % historyLength;
+        pendingFitData.resize(fitWindowLength);
+        for (uint32_t m = 0; m < fitWindowLength; m++)
+        {
+            pendingFitData[m] = history[historyIndex];
+            historyIndex = (historyIndex + 1 == historyLength) ? 0 : historyIndex + 1;
+        }
+        isRefitRequested = true;
+        lock.unlock();
+
+        refitNotify.notify_one();
+        return true;
+    }
+
+    /// <summary>
+    /// Refit thread: fits a model on each handed-off window and publishes it for the sample path
+    /// </summary>
+    void ArForecastPhasePolicy::refitThread()
+    {
+        // Apply the configured scheduling for this thread
+        ThreadRoleRegistry::instance().applyRole(THREAD_ROLE_ESTIMATOR_FIT);
+
+        std::vector<double> fitData;
+        std::vector<double> coefficients;
+        std::unique_lock<std::mutex> lock(refitLock);
+        while (!isRefitStopping)
+        {
+            if (!isRefitRequested)
+            {
+                refitNotify.wait(lock);
+                continue;
+            }
+
+            // Take the window and fit without holding the lock
+            fitData.swap(pendingFitData);
+            isRefitRequested = false;
+            lock.unlock();
+
+            if (fitBurg(fitData, AR_MODEL_ORDER, &coefficients))
+            {
+                std::shared_ptr<const std::vector<double>> newModel(new std::vector<double>(coefficients));
+                std::atomic_store(&model, newModel);
+            }
+
+            lock.lock();
+        }
+    }
+
+    /// <summary>
+    /// Fits an autoregressive model with Burg's method, x[n] = sum_k coefficients[k] * x[n - 1 - k]
+    /// </summary>
+    /// <param name="data">Samples to fit, oldest first</param>
+    /// <param name="order">Model order</param>
+    /// <param name="coefficients">Receives the model coefficients</param>
+    /// <returns>False if the data could not be fit (too short or all zero)</returns>
+    bool ArForecastPhasePolicy::fitBurg(const std::vector<double>& data, uint32_t order, std::vector<double>* coefficients)
+    {
+        size_t n = data.size();
+        if (n < 2 * (size_t)order + 2)
+        {
+            return false;
+        }
+
+        // Forward and backward prediction errors
+        std::vector<double> forwardError(data.begin(), data.end() - 1);
+        std::vector<double> backwardError(data.begin() + 1, data.end());
+        std::vector<double> previous(order, 0);
+        coefficients->assign(order, 0);
+
+        for (uint32_t k = 0; k < order; k++)
+        {
+            double numerator = 0;
+            double denominator = 0;
+            size_t numErrors = n - k - 1;
+            for (size_t j = 0; j < numErrors; j++)
+            {
+                numerator += forwardError[j] * backwardError[j];
+                denominator += (forwardError[j] * forwardError[j]) + (backwardError[j] * backwardError[j]);
+            }
+            if (denominator <= 0)
+            {
+                return false;
+            }
+
+            // Reflection coefficient and Levinson update of the lower-order coefficients
+            double reflection = 2 * numerator / denominator;
+            (*coefficients)[k] = reflection;
+            for (uint32_t i = 0; i < k; i++)
+            {
+                (*coefficients)[i] = previous[i] - reflection * previous[k - 1 - i];
+            }
+            if (k + 1 == order)
+            {
+                break;
+            }
+            std::copy(coefficients->begin(), coefficients->begin() + k + 1, previous.begin());
+
+            // Update the prediction errors for the next order
+            for (size_t j = 0; j + 1 < numErrors; j++)
+            {
+                forwardError[j] -= previous[k] * backwardError[j];
+                backwardError[j] = backwardError[j + 1] - previous[k] * forwardError[j + 1];
+            }
+        }
+        return true;
+    }
+
+    //*************************************************** Estimator Factory ***************************************************
+    /// <summary>
+    /// Creates a timed phase estimator of the requested type. Caller owns the returned object.
+    /// </summary>
+    /// <param name="type">Estimation method</param>
+    /// <param name="samplingRate">Device sampling rate in Hz, 0 if unknown</param>
+    /// <param name="windowLength">FIR Hilbert taps, ECHT window length or AR fit window length, 0 for the default</param>
+    /// <param name="predictionHorizon">Samples ahead at which the AR forecaster reports phase</param>
+    /// <param name="filtCoeff_B">Band-pass filter numerator coefficients</param>
+    /// <param name="filtCoeff_A">Band-pass filter denominator coefficients</param>
+    /// <returns>New phase estimator</returns>
+    IPhaseEstimator* createPhaseEstimator(PhaseEstimatorType type, double samplingRate, uint32_t windowLength, uint32_t predictionHorizon, const std::vector<double>& filtCoeff_B, const std::vector<double>& filtCoeff_A)
+    {
+        if (samplingRate <= 0)
+        {
+            samplingRate = DEFAULT_SAMPLING_RATE;
+        }
+
+        switch (type)
+        {
+        case PHASE_ESTIMATOR_FIR_HILBERT:
+            return new TimedPhaseEstimator<FirHilbertPhasePolicy>(samplingRate, windowLength == 0 ? DEFAULT_FIR_HILBERT_TAPS : windowLength);
+        case PHASE_ESTIMATOR_ECHT:
+            return new TimedPhaseEstimator<EchtPhasePolicy>(samplingRate, windowLength == 0 ? DEFAULT_ECHT_WINDOW : windowLength, filtCoeff_B, filtCoeff_A);
+        case PHASE_ESTIMATOR_AR_FORECAST:
+            return new TimedPhaseEstimator<ArForecastPhasePolicy>(samplingRate, windowLength == 0 ? DEFAULT_AR_FIT_WINDOW : windowLength, predictionHorizon);
+        case PHASE_ESTIMATOR_ZERO_CROSSING:
+        default:
+            return new TimedPhaseEstimator<ZeroCrossingPhasePolicy>(samplingRate);
+        }
+    }
+}
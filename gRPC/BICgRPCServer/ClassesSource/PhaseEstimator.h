@@ -0,0 +1,224 @@
+#pragma once
+#include <chrono>
+#include <complex>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace BICGRPCHelperNamespace
+{
+    /// <summary>
+    /// Phase estimation methods available to closed-loop stimulation. Values match the gRPC PhaseEstimator enum.
+    /// </summary>
+    enum PhaseEstimatorType
+    {
+        PHASE_ESTIMATOR_ZERO_CROSSING = 0,  // Zero crossings and extrema of the band-passed signal, extrapolated linearly in between
+        PHASE_ESTIMATOR_FIR_HILBERT = 1,    // Causal FIR Hilbert transformer, group delay compensated with the tracked frequency
+        PHASE_ESTIMATOR_ECHT = 2,           // Endpoint-corrected Hilbert transform over a sliding window
+        PHASE_ESTIMATOR_AR_FORECAST = 3     // Autoregressive forecast of the band-passed signal, phase read off the forecast
+    };
+
+    /// <summary>
+    /// Signal history handed to a phase estimator for each processed sample
+    /// </summary>
+    struct PhaseEstimatorInput
+    {
+        const std::vector<double>* filtHistory;     // Band-pass filtered samples, newest first
+        double bandInput;                           // Newest sample presented to the band-pass filter
+        uint64_t sampleCounter;                     // Measurement counter of the sample being estimated
+    };
+
+    /// <summary>
+    /// Per-sample execution cost of a phase estimator
+    /// </summary>
+    struct PhaseEstimatorCost
+    {
+        uint64_t samples = 0;                       // Number of estimates computed
+        double totalMicroseconds = 0;               // Summed estimation time
+        double maxMicroseconds = 0;                 // Slowest single estimate
+    };
+
+    /// <summary>
+    /// Interface used by the closed-loop path to estimate the phase of the sensed oscillation. Phase is reported in degrees,
+    /// 0 at the rising zero crossing, 90 at the peak, 180 at the falling zero crossing and 270 at the trough.
+    /// </summary>
+    class IPhaseEstimator
+    {
+    public:
+        virtual ~IPhaseEstimator() {}
+        virtual double estimatePhase(const PhaseEstimatorInput& input) = 0;
+        virtual double getFrequency() const = 0;
+        virtual const char* getName() const = 0;
+        virtual PhaseEstimatorCost getCost() const = 0;
+    };
+
+    /// <summary>
+    /// Adapts an estimator policy to IPhaseEstimator and times every estimate. A policy provides
+    /// double estimatePhase(const PhaseEstimatorInput&), double getFrequency() const and static const char* name().
+    /// </summary>
+    template <class EstimatorPolicy>
+    class TimedPhaseEstimator : public IPhaseEstimator
+    {
+    public:
+        template <class... PolicyArgs>
+        explicit TimedPhaseEstimator(PolicyArgs&&... policyArgs) : policy(std::forward<PolicyArgs>(policyArgs)...) {}
+
+        double estimatePhase(const PhaseEstimatorInput& input) override
+        {
+            std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+            double phase = policy.estimatePhase(input);
+            double elapsed = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - startTime).count();
+
+            cost.samples++;
+            cost.totalMicroseconds += elapsed;
+            if (elapsed > cost.maxMicroseconds)
+            {
+                cost.maxMicroseconds = elapsed;
+            }
+            return phase;
+        }
+
+        double getFrequency() const override { return policy.getFrequency(); }
+        const char* getName() const override { return EstimatorPolicy::name(); }
+        PhaseEstimatorCost getCost() const override { return cost; }
+
+    private:
+        EstimatorPolicy policy;
+        PhaseEstimatorCost cost;
+    };
+
+    /// <summary>
+    /// Tracks oscillation frequency from successive phase estimates with an exponential moving average
+    /// </summary>
+    class PhaseFrequencyTracker
+    {
+    public:
+        explicit PhaseFrequencyTracker(double samplingRate) : samplingRate(samplingRate) {}
+        void update(double phaseDegrees);
+        double getFrequency() const { return frequency; }
+
+    private:
+        double samplingRate;
+        double frequency = 0;
+        double lastPhase = 0;
+        bool hasLastPhase = false;
+    };
+
+    /// <summary>
+    /// Original estimator: phase is anchored at zero crossings and extrema of the band-passed signal and extrapolated linearly
+    /// from the recent frequency estimates in between.
+    /// </summary>
+    class ZeroCrossingPhasePolicy
+    {
+    public:
+        explicit ZeroCrossingPhasePolicy(double samplingRate);
+        double estimatePhase(const PhaseEstimatorInput& input);
+        double getFrequency() const { return prevSigFreq[0]; }
+        static const char* name() { return "ZeroCrossing"; }
+
+    private:
+        double samplePeriod;                                        // Seconds between samples
+        uint32_t refPoint = 0;                                      // Phase (degrees) being used as a reference to estimate phase
+        uint64_t refSamp = 0;                                       // Sample number to use for estimating phase
+        std::vector<double> prevSigFreq = { 0, 0, 0, 0 };           // History of frequency estimates
+    };
+
+    /// <summary>
+    /// Causal FIR Hilbert transformer on the band-passed signal. The analytic signal is known (numTaps - 1) / 2 samples in the past,
+    /// so the phase is advanced over that delay with the tracked frequency. The magnitude droop of the transformer is corrected at the tracked frequency.
+    /// </summary>
+    class FirHilbertPhasePolicy
+    {
+    public:
+        FirHilbertPhasePolicy(double samplingRate, uint32_t numTaps);
+        double estimatePhase(const PhaseEstimatorInput& input);
+        double getFrequency() const { return frequencyTracker.getFrequency(); }
+        static const char* name() { return "FirHilbert"; }
+
+    private:
+        double transformerGain(double frequency) const;
+
+        double samplingRate;
+        uint32_t numTaps;
+        uint32_t groupDelay;
+        std::vector<double> reversedTaps;           // Transformer taps, oldest sample first
+        std::vector<double> history;                // Filtered samples stored twice so the window is always contiguous
+        uint32_t writeIndex = 0;
+        PhaseFrequencyTracker frequencyTracker;
+        double gainFrequency = -1;                  // Frequency the cached gain was computed at
+        double gain = 1;
+    };
+
+    /// <summary>
+    /// Endpoint-corrected Hilbert transform. A sliding DFT of the band-pass input is kept per positive frequency bin, weighted into an
+    /// analytic spectrum, shaped with the closed-loop band-pass response and evaluated at the newest sample only, so each estimate costs O(window).
+    /// One bin is recomputed directly per sample to stop rounding errors from accumulating in the sliding update.
+    /// </summary>
+    class EchtPhasePolicy
+    {
+    public:
+        EchtPhasePolicy(double samplingRate, uint32_t windowLength, const std::vector<double>& filtCoeff_B, const std::vector<double>& filtCoeff_A);
+        double estimatePhase(const PhaseEstimatorInput& input);
+        double getFrequency() const { return frequencyTracker.getFrequency(); }
+        static const char* name() { return "ECHT"; }
+
+    private:
+        uint32_t windowLength;
+        uint32_t numBins;
+        std::vector<double> window;                         // Ring buffer of band-pass input samples
+        uint32_t writeIndex = 0;                            // Oldest sample in the ring buffer
+        uint32_t refreshBin = 0;                            // Next bin to recompute directly
+        std::vector<std::complex<double>> twiddle;          // exp(-j 2 pi t / N)
+        std::vector<std::complex<double>> spectrum;         // Sliding DFT bins 0..N/2
+        std::vector<std::complex<double>> endpointWeight;   // Analytic weighting, filter response and inverse DFT kernel for the newest sample
+        PhaseFrequencyTracker frequencyTracker;
+    };
+
+    /// <summary>
+    /// Forward-prediction estimator. A Burg autoregressive model of the band-passed signal is refit on a background thread and swapped in atomically;
+    /// the per-sample path only extends the recent signal with the model's forecast and reads the phase at the prediction horizon from the
+    /// zero crossings around it, so stimulation can be aimed ahead of the pipeline delay.
+    /// </summary>
+    class ArForecastPhasePolicy
+    {
+    public:
+        ArForecastPhasePolicy(double samplingRate, uint32_t fitWindowLength, uint32_t predictionHorizon);
+        ~ArForecastPhasePolicy();
+        double estimatePhase(const PhaseEstimatorInput& input);
+        double getFrequency() const { return frequency; }
+        static const char* name() { return "ArForecast"; }
+
+    private:
+        void refitThread(void);
+        bool requestRefit(void);
+        static bool fitBurg(const std::vector<double>& data, uint32_t order, std::vector<double>* coefficients);
+
+        double samplingRate;
+        uint32_t fitWindowLength;
+        uint32_t predictionHorizon;
+        uint32_t pastLength;                                    // Received samples searched for the preceding rising zero crossing
+        uint32_t forecastLength;                                // Samples predicted past the newest sample
+        double frequency = 0;
+
+        // Per-sample path state
+        std::vector<double> history;                            // Ring buffer of filtered samples, long enough for fitting and the crossing search
+        uint32_t writeIndex = 0;
+        uint32_t samplesSinceRefit = 0;
+        std::vector<double> series;                             // Scratch buffer: recent samples followed by the forecast
+        std::shared_ptr<const std::vector<double>> model;       // Current AR coefficients, only accessed through std::atomic_load / std::atomic_store
+
+        // Background refit state
+        std::thread* fitThread = NULL;
+        std::mutex refitLock;
+        std::condition_variable refitNotify;
+        std::vector<double> pendingFitData;                     // Snapshot handed to the refit thread, protected by refitLock
+        bool isRefitRequested = false;
+        bool isRefitStopping = false;
+    };
+
+    IPhaseEstimator* createPhaseEstimator(PhaseEstimatorType type, double samplingRate, uint32_t windowLength, uint32_t predictionHorizon, const std::vector<double>& filtCoeff_B, const std::vector<double>& filtCoeff_A);
+}
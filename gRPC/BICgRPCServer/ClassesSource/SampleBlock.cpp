@@ -0,0 +1,148 @@
+#include "SampleBlock.h"
+#include <algorithm>
+
+namespace BICGRPCHelperNamespace
+{
+    /// <summary>
+    /// Constructs an empty sample block with room for the requested number of samples on every channel
+    /// </summary>
+    /// <param name="numChannels">Number of measurement channels in each sample</param>
+    /// <param name="sampleCapacity">Initial number of samples that fit before the planes are re-laid out</param>
+    SampleBlock::SampleBlock(uint32_t numChannels, uint32_t sampleCapacity)
+        : numChannels(numChannels), sampleCapacity(0), numSamples(0)
+    {
+        reserve(std::max<uint32_t>(sampleCapacity, 1));
+    }
+
+    /// <summary>
+    /// Grows the block so that at least newCapacity samples fit. Existing samples are preserved, measurement planes are re-laid out with the new stride.
+    /// </summary>
+    /// <param name="newCapacity">Requested sample capacity</param>
+    void SampleBlock::reserve(uint32_t newCapacity)
+    {
+        if (newCapacity <= sampleCapacity)
+        {
+            return;
+        }
+
+        // Re-lay out the channel planes with the new stride
+        std::vector<double> newMeasurements((size_t)numChannels * newCapacity, 0);
+        for (uint32_t channelIndex = 0; channelIndex < numChannels; channelIndex++)
+        {
+            std::copy(channel(channelIndex), channel(channelIndex) + numSamples, newMeasurements.begin() + ((size_t)channelIndex * newCapacity));
+        }
+        measurements.swap(newMeasurements);
+        sampleCapacity = newCapacity;
+
+        // Per-sample columns only need their storage extended
+        sampleCounter.reserve(newCapacity);
+        timeStamp.reserve(newCapacity);
+        supplyVoltage.reserve(newCapacity);
+        stimulationNumber.reserve(newCapacity);
+        flags.reserve(newCapacity);
+        filtSample.reserve(newCapacity);
+        phase.reserve(newCapacity);
+        triggerPhase.reserve(newCapacity);
+        preFiltSample.reserve(newCapacity);
+        hampelFiltSample.reserve(newCapacity);
+    }
+
+    /// <summary>
+    /// Appends a zero-initialized sample to the end of the block, growing the planes if needed
+    /// </summary>
+    /// <returns>Index of the appended sample</returns>
+    uint32_t SampleBlock::appendSample()
+    {
+        if (numSamples == sampleCapacity)
+        {
+            reserve(sampleCapacity * 2);
+        }
+
+        for (uint32_t channelIndex = 0; channelIndex < numChannels; channelIndex++)
+        {
+            channel(channelIndex)[numSamples] = 0;
+        }
+        sampleCounter.push_back(0);
+        timeStamp.push_back(0);
+        supplyVoltage.push_back(0);
+        stimulationNumber.push_back(0);
+        flags.push_back(0);
+        filtSample.push_back(0);
+        phase.push_back(0);
+        triggerPhase.push_back(0);
+        preFiltSample.push_back(0);
+        hampelFiltSample.push_back(0);
+
+        return numSamples++;
+    }
+
+    /// <summary>
+    /// Appends a run of zero-initialized samples to the end of the block with a single resize of each column
+    /// </summary>
+    /// <param name="count">Number of samples to append</param>
+    /// <returns>Index of the first appended sample</returns>
+    uint32_t SampleBlock::appendSamples(uint32_t count)
+    {
+        uint32_t firstIndex = numSamples;
+        if (numSamples + count > sampleCapacity)
+        {
+            reserve(std::max(numSamples + count, sampleCapacity * 2));
+        }
+
+        for (uint32_t channelIndex = 0; channelIndex < numChannels; channelIndex++)
+        {
+            std::fill(channel(channelIndex) + numSamples, channel(channelIndex) + numSamples + count, 0.0);
+        }
+        numSamples += count;
+        sampleCounter.resize(numSamples, 0);
+        timeStamp.resize(numSamples, 0);
+        supplyVoltage.resize(numSamples, 0);
+        stimulationNumber.resize(numSamples, 0);
+        flags.resize(numSamples, 0);
+        filtSample.resize(numSamples, 0);
+        phase.resize(numSamples, 0);
+        triggerPhase.resize(numSamples, 0);
+        preFiltSample.resize(numSamples, 0);
+        hampelFiltSample.resize(numSamples, 0);
+
+        return firstIndex;
+    }
+
+    /// <summary>
+    /// Removes all samples while keeping the allocated storage for reuse
+    /// </summary>
+    void SampleBlock::clear()
+    {
+        numSamples = 0;
+        sampleCounter.clear();
+        timeStamp.clear();
+        supplyVoltage.clear();
+        stimulationNumber.clear();
+        flags.clear();
+        filtSample.clear();
+        phase.clear();
+        triggerPhase.clear();
+        preFiltSample.clear();
+        hampelFiltSample.clear();
+        gaps.clear();
+        controllerTelemetry.clear();
+    }
+
+    /// <summary>
+    /// Sets or clears a single flag for one sample
+    /// </summary>
+    /// <param name="sampleIndex">Index of the sample within the block</param>
+    /// <param name="flag">Flag to update</param>
+    /// <param name="value">New flag state</param>
+    void SampleBlock::setFlag(uint32_t sampleIndex, SampleFlags flag, bool value)
+    {
+        if (value)
+        {
+            flags[sampleIndex] |= flag;
+        }
+        else
+        {
+            flags[sampleIndex] &= ~flag;
+        }
+    }
+}
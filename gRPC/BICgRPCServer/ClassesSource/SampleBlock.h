@@ -0,0 +1,93 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace BICGRPCHelperNamespace
+{
+    /// <summary>
+    /// Per-sample boolean states, packed into the SampleBlock flag column
+    /// </summary>
+    enum SampleFlags : uint8_t
+    {
+        SAMPLE_FLAG_CONNECTED = 0x01,           // External unit reported the implant as connected
+        SAMPLE_FLAG_STIM_ACTIVE = 0x02,         // Stimulation was active when the sample was taken
+        SAMPLE_FLAG_INTERPOLATED = 0x04,        // Sample was synthesized to fill a telemetry gap
+        SAMPLE_FLAG_INPUT_TRIG_HIGH = 0x08,     // External measurement trigger input was high
+        SAMPLE_FLAG_VALID_TARGET = 0x10         // Closed-loop processing marked the sample as a valid stimulation target
+    };
+
+    /// <summary>
+    /// Description of a telemetry gap detected while the block was assembled
+    /// </summary>
+    struct SampleGap
+    {
+        uint32_t startCounter;      // Measurement counter of the first missing sample
+        uint32_t length;            // Number of missing samples
+        uint32_t sampleIndex;       // Block index of the first sample at or after the gap (first interpolated sample when filled)
+        bool isFilled;              // True if the gap was filled with interpolated samples
+    };
+
+    /// <summary>
+    /// Telemetry values reported by a block controller after processing the block
+    /// </summary>
+    struct ControllerTelemetry
+    {
+        uint32_t controllerId;      // Controller that reported the values
+        std::vector<double> values; // Values in the order of the controller's telemetry names
+    };
+
+    /// <summary>
+    /// Structure-of-arrays container for a block of neural samples, used as the internal neural data type between ingest and the gRPC boundary.
+    /// Measurements are stored as contiguous channel-major planes, so every stage that walks one channel over time reads sequential memory.
+    /// </summary>
+    class SampleBlock
+    {
+    public:
+        SampleBlock(uint32_t numChannels, uint32_t sampleCapacity);
+
+        // ************************* Sizing *************************
+        void reserve(uint32_t newCapacity);
+        uint32_t appendSample();
+        uint32_t appendSamples(uint32_t count);
+        void clear();
+        uint32_t size() const { return numSamples; }
+        uint32_t channelCount() const { return numChannels; }
+        uint32_t capacity() const { return sampleCapacity; }
+
+        // ************************* Measurement Plane Accessors *************************
+        double* channel(uint32_t channelIndex) { return measurements.data() + ((size_t)channelIndex * sampleCapacity); }
+        const double* channel(uint32_t channelIndex) const { return measurements.data() + ((size_t)channelIndex * sampleCapacity); }
+        double& measurement(uint32_t channelIndex, uint32_t sampleIndex) { return channel(channelIndex)[sampleIndex]; }
+        double measurement(uint32_t channelIndex, uint32_t sampleIndex) const { return channel(channelIndex)[sampleIndex]; }
+
+        // ************************* Flag Column Accessors *************************
+        bool hasFlag(uint32_t sampleIndex, SampleFlags flag) const { return (flags[sampleIndex] & flag) != 0; }
+        void setFlag(uint32_t sampleIndex, SampleFlags flag, bool value);
+
+        // ************************* Per-Sample Columns *************************
+        std::vector<uint32_t> sampleCounter;        // Device measurement counter
+        std::vector<uint64_t> timeStamp;            // Server receive time (system_clock ticks)
+        std::vector<uint32_t> supplyVoltage;        // Implant supply voltage
+        std::vector<uint32_t> stimulationNumber;    // Active stimulation function ID
+        std::vector<uint8_t> flags;                 // SampleFlags bitmask
+
+        // ************************* DSP Output Columns *************************
+        std::vector<double> filtSample;             // Band-pass filtered sample of the closed-loop input channel
+        std::vector<double> phase;                  // Estimated phase (degrees) of the closed-loop input channel
+        std::vector<double> triggerPhase;           // Trigger phase in use when the sample was processed
+        std::vector<double> preFiltSample;          // DC-blocked sample of the closed-loop input channel
+        std::vector<double> hampelFiltSample;       // Hampel filtered sample of the closed-loop input channel
+
+        // ************************* Block-Level Metadata *************************
+        uint32_t filtChannel = 0;                   // Channel the DSP output columns were computed from
+        std::vector<SampleGap> gaps;                // Telemetry gaps in sample order
+        std::vector<ControllerTelemetry> controllerTelemetry;  // Block controller telemetry, one entry per controller that processed the block
+
+    private:
+        uint32_t numChannels;
+        uint32_t sampleCapacity;
+        uint32_t numSamples;
+        std::vector<double> measurements;           // Channel c occupies [c * sampleCapacity, c * sampleCapacity + numSamples)
+    };
+}
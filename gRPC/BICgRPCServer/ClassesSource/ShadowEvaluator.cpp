@@ -0,0 +1,163 @@
+#include "ShadowEvaluator.h"
+#include <algorithm>
+#include "ThreadRoleRegistry.h"
+
+namespace BICGRPCHelperNamespace
+{
+    // Blocks a worker may fall behind by before new blocks are dropped for it
+    static const size_t MAX_QUEUED_BLOCKS = 64;
+
+    /// <summary>
+    /// Creates one controller per candidate configuration and starts the workers
+    /// </summary>
+    /// <param name="candidateConfigs">Candidate controller configurations</param>
+    /// <param name="workerCount">Number of worker threads, 0 to pick from the available cores. Never more than the number of candidates.</param>
+    /// <param name="samplingRate">Device sampling rate in Hz</param>
+    ShadowEvaluator::ShadowEvaluator(const std::vector<ClosedLoopControllerConfig>& candidateConfigs, uint32_t workerCount, double samplingRate)
+        : samplingRate(samplingRate), stats(candidateConfigs.size())
+    {
+        for (const ClosedLoopControllerConfig& candidateConfig : candidateConfigs)
+        {
+            candidates.push_back(new ClosedLoopController(candidateConfig));
+        }
+
+        // Leave a core for the data callback and stimulation threads when picking the worker count
+        if (workerCount == 0)
+        {
+            uint32_t hardwareThreads = std::thread::hardware_concurrency();
+            workerCount = hardwareThreads > 2 ? hardwareThreads - 2 : 1;
+        }
+        workerCount = std::max<uint32_t>(1, std::min<uint32_t>(workerCount, (uint32_t)candidates.size()));
+
+        // Deal candidates round-robin, then start the workers once their candidate lists are complete
+        for (uint32_t workerIndex = 0; workerIndex < workerCount; workerIndex++)
+        {
+            workers.push_back(new Worker());
+        }
+        for (uint32_t candidateId = 0; candidateId < candidates.size(); candidateId++)
+        {
+            workers[candidateId % workerCount]->candidateIds.push_back(candidateId);
+        }
+        for (Worker* theWorker : workers)
+        {
+            theWorker->workerThread = new std::thread(&ShadowEvaluator::workerThread, this, theWorker);
+        }
+    }
+
+    /// <summary>
+    /// Stops the workers and releases the candidate controllers
+    /// </summary>
+    ShadowEvaluator::~ShadowEvaluator()
+    {
+        isRunning = false;
+        for (Worker* theWorker : workers)
+        {
+            {
+                std::lock_guard<std::mutex> queueLock(theWorker->queueLock);
+                theWorker->queueNotify.notify_one();
+            }
+            theWorker->workerThread->join();
+            delete theWorker->workerThread;
+            delete theWorker;
+        }
+        for (ClosedLoopController* theController : candidates)
+        {
+            delete theController;
+        }
+    }
+
+    /// <summary>
+    /// Queues a processed sample block for every worker. Called on the data callback thread; copies the block once and only holds each queue lock for a push.
+    /// </summary>
+    /// <param name="theBlock">Block to evaluate</param>
+    void ShadowEvaluator::submitBlock(const SampleBlock& theBlock)
+    {
+        std::shared_ptr<const SampleBlock> sharedBlock = std::make_shared<const SampleBlock>(theBlock);
+        for (Worker* theWorker : workers)
+        {
+            std::lock_guard<std::mutex> queueLock(theWorker->queueLock);
+            if (theWorker->blockQueue.size() >= MAX_QUEUED_BLOCKS)
+            {
+                droppedBlocks++;
+                continue;
+            }
+            theWorker->blockQueue.push_back(sharedBlock);
+            theWorker->queueNotify.notify_one();
+        }
+    }
+
+    /// <summary>
+    /// Takes the would-be triggers recorded since the last call and the running totals of every candidate
+    /// </summary>
+    /// <param name="triggers">Filled with the triggers in the order they were found per worker</param>
+    /// <param name="candidateStats">Filled with one entry per candidate</param>
+    void ShadowEvaluator::collectResults(std::vector<ShadowTrigger>* triggers, std::vector<ShadowCandidateStats>* candidateStats)
+    {
+        std::lock_guard<std::mutex> lock(resultLock);
+        triggers->swap(pendingTriggers);
+        pendingTriggers.clear();
+        *candidateStats = stats;
+    }
+
+    /// <summary>
+    /// Worker thread: runs this worker's candidates over each queued block in sample order
+    /// </summary>
+    /// <param name="theWorker">Worker the thread serves</param>
+    void ShadowEvaluator::workerThread(Worker* theWorker)
+    {
+        // Apply the configured scheduling for this thread
+        ThreadRoleRegistry::instance().applyRole(THREAD_ROLE_SHADOW_EVALUATION);
+
+        std::vector<ShadowTrigger> blockTriggers;
+        while (isRunning)
+        {
+            // Wait for the next block
+            std::shared_ptr<const SampleBlock> theBlock;
+            {
+                std::unique_lock<std::mutex> queueLock(theWorker->queueLock);
+                theWorker->queueNotify.wait(queueLock, [this, theWorker] { return !theWorker->blockQueue.empty() || !isRunning; });
+                if (!isRunning)
+                {
+                    break;
+                }
+                theBlock = theWorker->blockQueue.front();
+                theWorker->blockQueue.pop_front();
+            }
+
+            // Shadow controllers never stimulate, so no stimulation onset is their own and their trigger phase does not adapt
+            blockTriggers.clear();
+            for (uint32_t candidateId : theWorker->candidateIds)
+            {
+                ClosedLoopController* theController = candidates[candidateId];
+                if (theController->getSensingChannel() >= theBlock->channelCount())
+                {
+                    continue;
+                }
+                theController->ensurePhaseEstimator(samplingRate);
+
+                const double* sensingData = theBlock->channel(theController->getSensingChannel());
+                for (uint32_t row = 0; row < theBlock->size(); row++)
+                {
+                    ClosedLoopOutputs outputs;
+                    theController->processSample(sensingData[row], theBlock->sampleCounter[row], theBlock->hasFlag(row, SAMPLE_FLAG_STIM_ACTIVE), true, false, &outputs);
+                    if (outputs.isValidTarget)
+                    {
+                        blockTriggers.push_back({ candidateId, theBlock->sampleCounter[row], theBlock->timeStamp[row], outputs.phase, outputs.triggerPhase });
+                    }
+                }
+            }
+
+            // Publish this block's results
+            std::lock_guard<std::mutex> lock(resultLock);
+            for (uint32_t candidateId : theWorker->candidateIds)
+            {
+                stats[candidateId].samples += theBlock->size();
+            }
+            for (const ShadowTrigger& aTrigger : blockTriggers)
+            {
+                stats[aTrigger.candidateId].triggers++;
+                pendingTriggers.push_back(aTrigger);
+            }
+        }
+    }
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "ClosedLoopController.h"
+#include "SampleBlock.h"
+
+namespace BICGRPCHelperNamespace
+{
+    /// <summary>
+    /// Would-be stimulation trigger of a shadow controller
+    /// </summary>
+    struct ShadowTrigger
+    {
+        uint32_t candidateId;       // Index of the candidate configuration
+        uint32_t sampleCounter;     // Measurement counter of the triggering sample
+        uint64_t timeStamp;         // Receive time of the triggering sample (system_clock ticks)
+        double phase;               // Estimated phase at the triggering sample
+        double triggerPhase;        // Trigger phase in use at the triggering sample
+    };
+
+    /// <summary>
+    /// Running totals of a shadow controller
+    /// </summary>
+    struct ShadowCandidateStats
+    {
+        uint64_t triggers = 0;      // Would-be triggers since the evaluation started
+        uint64_t samples = 0;       // Samples evaluated since the evaluation started
+    };
+
+    /// <summary>
+    /// Runs candidate closed-loop controller configurations on the live neural stream without issuing stimulation. Candidates are spread
+    /// over worker threads that receive copies of the processed sample blocks, so the primary controllers never wait for them; blocks
+    /// arriving while a worker's queue is full are dropped and counted.
+    /// </summary>
+    class ShadowEvaluator
+    {
+    public:
+        ShadowEvaluator(const std::vector<ClosedLoopControllerConfig>& candidateConfigs, uint32_t workerCount, double samplingRate);
+        ~ShadowEvaluator();
+        void submitBlock(const SampleBlock& theBlock);
+        void collectResults(std::vector<ShadowTrigger>* triggers, std::vector<ShadowCandidateStats>* candidateStats);
+        uint64_t getDroppedBlocks() const { return droppedBlocks; }
+        uint32_t getCandidateCount() const { return (uint32_t)candidates.size(); }
+
+    private:
+        struct Worker
+        {
+            std::thread* workerThread = NULL;
+            std::vector<uint32_t> candidateIds;                         // Candidates evaluated by this worker, each candidate belongs to one worker
+            std::deque<std::shared_ptr<const SampleBlock>> blockQueue;
+            std::mutex queueLock;
+            std::condition_variable queueNotify;
+        };
+
+        void workerThread(Worker* theWorker);
+
+        std::vector<ClosedLoopController*> candidates;
+        std::vector<Worker*> workers;
+        std::atomic<bool> isRunning{ true };
+        std::atomic<uint64_t> droppedBlocks{ 0 };
+        double samplingRate;
+
+        // Results, filled by the workers and drained by the streaming RPC
+        std::mutex resultLock;
+        std::vector<ShadowTrigger> pendingTriggers;
+        std::vector<ShadowCandidateStats> stats;
+    };
+}
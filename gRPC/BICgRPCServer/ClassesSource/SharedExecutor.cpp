@@ -0,0 +1,547 @@
+#include "SharedExecutor.h"
+#include <algorithm>
+#include <iostream>
+#include "ThreadRoleRegistry.h"
+
+namespace BICGRPCHelperNamespace
+{
+    static const char* const TASK_TYPE_NAMES[EXECUTOR_TASK_TYPE_COUNT] = { "streamDrain", "stimTimeLog" };
+
+    // Worker the calling thread is, -1 for threads outside the pool
+    static thread_local int currentWorkerIndex = -1;
+
+    /// <summary>
+    /// Accessor for the process-wide executor
+    /// </summary>
+    /// <returns>The executor</returns>
+    SharedExecutor& SharedExecutor::instance()
+    {
+        static SharedExecutor theExecutor;
+        return theExecutor;
+    }
+
+    /// <summary>
+    /// Stops the threads at process exit
+    /// </summary>
+    SharedExecutor::~SharedExecutor()
+    {
+        std::lock_guard<std::mutex> lifecycle(lifecycleLock);
+        if (!isStarted)
+        {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(idleLock);
+            isStopping = true;
+        }
+        workAvailable.notify_all();
+        {
+            std::lock_guard<std::mutex> lock(timerLock);
+        }
+        timerNotify.notify_all();
+        for (Worker* aWorker : workers)
+        {
+            aWorker->thread->join();
+            delete aWorker->thread;
+            delete aWorker;
+        }
+        timerQueueThread->join();
+        delete timerQueueThread;
+    }
+
+    /// <summary>
+    /// Sets the number of worker threads. Only has an effect before the first task is submitted.
+    /// </summary>
+    /// <param name="workerCount">Number of workers, at least MIN_EXECUTOR_WORKERS, or 0 for the default</param>
+    /// <returns>True if the size was applied</returns>
+    bool SharedExecutor::configure(uint32_t workerCount)
+    {
+        std::lock_guard<std::mutex> lifecycle(lifecycleLock);
+        if (workerCount != 0 && workerCount < MIN_EXECUTOR_WORKERS)
+        {
+            std::cout << "WARNING: Executor needs at least " << MIN_EXECUTOR_WORKERS << " workers, size change ignored" << std::endl;
+            return false;
+        }
+        if (isStarted)
+        {
+            std::cout << "WARNING: Executor already running with " << workers.size() << " workers, size change ignored" << std::endl;
+            return false;
+        }
+        configuredWorkers = workerCount;
+        return true;
+    }
+
+    /// <summary>
+    /// Starts the workers and the timer thread on first use
+    /// </summary>
+    void SharedExecutor::start()
+    {
+        std::lock_guard<std::mutex> lifecycle(lifecycleLock);
+        if (isStarted)
+        {
+            return;
+        }
+
+        // Stream draining and logging are mostly waiting on gRPC and the disk, a few workers serve many implants
+        uint32_t workerCount = configuredWorkers;
+        if (workerCount == 0)
+        {
+            workerCount = std::max(MIN_EXECUTOR_WORKERS, std::thread::hardware_concurrency() / 2);
+        }
+        for (uint32_t workerIndex = 0; workerIndex < workerCount; workerIndex++)
+        {
+            workers.push_back(new Worker());
+        }
+
+        // Stream drains block in gRPC writes while a client reads slowly, always leave a worker for the other kinds of task
+        taskLimits[EXECUTOR_TASK_STREAM_DRAIN] = workerCount - 1;
+        for (uint32_t workerIndex = 0; workerIndex < workerCount; workerIndex++)
+        {
+            workers[workerIndex]->thread = new std::thread(&SharedExecutor::workerThread, this, workerIndex);
+        }
+        timerQueueThread = new std::thread(&SharedExecutor::timerThread, this);
+        std::cout << "EXECUTOR INFO: Started " << workerCount << " shared workers, at most " << taskLimits[EXECUTOR_TASK_STREAM_DRAIN] << " draining streams" << std::endl;
+        isStarted = true;
+    }
+
+    /// <summary>
+    /// Queues a task to run as soon as a worker is free. Tasks submitted from a worker go on its own queue.
+    /// </summary>
+    /// <param name="type">Kind of task, for the metrics</param>
+    /// <param name="task">Function to run</param>
+    void SharedExecutor::submit(ExecutorTaskType type, std::function<void()> task)
+    {
+        if (!isStarted)
+        {
+            start();
+        }
+
+        uint32_t workerIndex = currentWorkerIndex >= 0 ? (uint32_t)currentWorkerIndex : nextWorker++ % workers.size();
+        {
+            std::lock_guard<std::mutex> lock(statsLock);
+            stats[type].submitted++;
+        }
+        queueTask(workerIndex, { type, task, std::chrono::steady_clock::now() });
+    }
+
+    /// <summary>
+    /// Adds a task to a worker's queue and wakes an idle worker
+    /// </summary>
+    /// <param name="workerIndex">Worker whose queue takes the task</param>
+    /// <param name="theTask">Task to queue</param>
+    void SharedExecutor::queueTask(uint32_t workerIndex, Task theTask)
+    {
+        {
+            std::lock_guard<std::mutex> lock(workers[workerIndex]->queueLock);
+            workers[workerIndex]->tasks.push_back(std::move(theTask));
+        }
+
+        // Counted before taking the idle lock, so a worker checking for work under it cannot miss the task
+        pendingTasks++;
+        {
+            std::lock_guard<std::mutex> lock(idleLock);
+        }
+        workAvailable.notify_one();
+    }
+
+    /// <summary>
+    /// Claims a worker for a task, or sets the task aside if its kind already runs on as many workers as its limit allows
+    /// </summary>
+    /// <param name="theTask">Task taken, moved to the deferred tasks if it may not run now</param>
+    /// <returns>True if the worker should run the task</returns>
+    bool SharedExecutor::claimWorker(Task* theTask)
+    {
+        std::lock_guard<std::mutex> lock(limitLock);
+        ExecutorTaskType type = theTask->type;
+        if (taskLimits[type] > 0 && runningTasks[type] >= taskLimits[type])
+        {
+            deferredTasks[type].push_back(std::move(*theTask));
+            std::lock_guard<std::mutex> statsLockInst(statsLock);
+            stats[type].deferred++;
+            return false;
+        }
+        runningTasks[type]++;
+        return true;
+    }
+
+    /// <summary>
+    /// Releases a worker after a task, queueing the oldest task of the same kind that was set aside, if any
+    /// </summary>
+    /// <param name="workerIndex">Worker that ran the task</param>
+    /// <param name="type">Kind of task that finished</param>
+    void SharedExecutor::releaseWorker(uint32_t workerIndex, ExecutorTaskType type)
+    {
+        std::unique_lock<std::mutex> lock(limitLock);
+        runningTasks[type]--;
+        if (deferredTasks[type].empty())
+        {
+            return;
+        }
+        Task theTask = std::move(deferredTasks[type].front());
+        deferredTasks[type].pop_front();
+        lock.unlock();
+        queueTask(workerIndex, std::move(theTask));
+    }
+
+    /// <summary>
+    /// Queues a task to be submitted at a deadline
+    /// </summary>
+    /// <param name="type">Kind of task, for the metrics</param>
+    /// <param name="deadline">Time at which the task is handed to the workers</param>
+    /// <param name="task">Function to run</param>
+    /// <returns>Identifier of the timer, for cancel()</returns>
+    uint64_t SharedExecutor::schedule(ExecutorTaskType type, std::chrono::steady_clock::time_point deadline, std::function<void()> task)
+    {
+        if (!isStarted)
+        {
+            start();
+        }
+
+        uint64_t timerId;
+        bool isEarliest;
+        {
+            std::lock_guard<std::mutex> lock(timerLock);
+            timerId = nextTimerId++;
+            timers[timerId] = { type, task };
+            isEarliest = timerDeadlines.empty() || deadline < timerDeadlines.top().first;
+            timerDeadlines.push({ deadline, timerId });
+        }
+        {
+            std::lock_guard<std::mutex> lock(statsLock);
+            stats[type].timersScheduled++;
+        }
+        if (isEarliest)
+        {
+            timerNotify.notify_all();
+        }
+        return timerId;
+    }
+
+    /// <summary>
+    /// Cancels a timer that has not fired yet
+    /// </summary>
+    /// <param name="timerId">Identifier returned by schedule()</param>
+    /// <returns>True if the timer was cancelled, false if its task has already been submitted</returns>
+    bool SharedExecutor::cancel(uint64_t timerId)
+    {
+        ExecutorTaskType type;
+        {
+            std::lock_guard<std::mutex> lock(timerLock);
+            std::map<uint64_t, Timer>::iterator it = timers.find(timerId);
+            if (it == timers.end())
+            {
+                return false;
+            }
+            type = it->second.type;
+            timers.erase(it);
+        }
+        std::lock_guard<std::mutex> lock(statsLock);
+        stats[type].timersCancelled++;
+        return true;
+    }
+
+    /// <summary>
+    /// Takes the next task for a worker: the oldest on its own queue, otherwise the newest on another worker's queue
+    /// </summary>
+    /// <param name="workerIndex">Worker looking for a task</param>
+    /// <param name="theTask">Filled with the task</param>
+    /// <param name="isStolen">Set if the task came from another worker's queue</param>
+    /// <returns>True if a task was found</returns>
+    bool SharedExecutor::takeTask(uint32_t workerIndex, Task* theTask, bool* isStolen)
+    {
+        for (size_t offset = 0; offset < workers.size(); offset++)
+        {
+            Worker* aWorker = workers[(workerIndex + offset) % workers.size()];
+            std::lock_guard<std::mutex> lock(aWorker->queueLock);
+            if (aWorker->tasks.empty())
+            {
+                continue;
+            }
+            if (offset == 0)
+            {
+                *theTask = std::move(aWorker->tasks.front());
+                aWorker->tasks.pop_front();
+            }
+            else
+            {
+                // Steal from the other end so the owner keeps working through its queue in order
+                *theTask = std::move(aWorker->tasks.back());
+                aWorker->tasks.pop_back();
+            }
+            *isStolen = offset != 0;
+            pendingTasks--;
+            return true;
+        }
+        return false;
+    }
+
+    /// <summary>
+    /// Worker thread: runs tasks from its own queue or stolen from others, sleeps while there are none
+    /// </summary>
+    /// <param name="workerIndex">Index of this worker</param>
+    void SharedExecutor::workerThread(uint32_t workerIndex)
+    {
+        // Apply the configured scheduling for this thread
+        ThreadRoleRegistry::instance().applyRole(THREAD_ROLE_EXECUTOR);
+        currentWorkerIndex = (int)workerIndex;
+
+        Task theTask;
+        bool isStolen = false;
+        while (true)
+        {
+            if (!takeTask(workerIndex, &theTask, &isStolen))
+            {
+                std::unique_lock<std::mutex> lock(idleLock);
+                workAvailable.wait(lock, [this] { return pendingTasks > 0 || isStopping; });
+                if (isStopping)
+                {
+                    return;
+                }
+                continue;
+            }
+            if (!claimWorker(&theTask))
+            {
+                continue;
+            }
+
+            std::chrono::steady_clock::time_point runStart = std::chrono::steady_clock::now();
+            try
+            {
+                theTask.run();
+            }
+            catch (std::exception& anyException)
+            {
+                std::cout << "ERROR: Executor " << TASK_TYPE_NAMES[theTask.type] << " task failed: " << anyException.what() << std::endl;
+            }
+            catch (...)
+            {
+                std::cout << "ERROR: Executor " << TASK_TYPE_NAMES[theTask.type] << " task failed. No reason." << std::endl;
+            }
+            std::chrono::steady_clock::time_point runEnd = std::chrono::steady_clock::now();
+            releaseWorker(workerIndex, theTask.type);
+
+            uint64_t queueNs = std::chrono::duration_cast<std::chrono::nanoseconds>(runStart - theTask.queuedAt).count();
+            uint64_t runNs = std::chrono::duration_cast<std::chrono::nanoseconds>(runEnd - runStart).count();
+            std::lock_guard<std::mutex> lock(statsLock);
+            ExecutorTaskStats& typeStats = stats[theTask.type];
+            typeStats.completed++;
+            typeStats.stolen += isStolen ? 1 : 0;
+            typeStats.totalQueueNs += queueNs;
+            typeStats.maxQueueNs = std::max(typeStats.maxQueueNs, queueNs);
+            typeStats.totalRunNs += runNs;
+            typeStats.maxRunNs = std::max(typeStats.maxRunNs, runNs);
+        }
+    }
+
+    /// <summary>
+    /// Timer thread: sleeps until the earliest deadline and submits the timers that are due
+    /// </summary>
+    void SharedExecutor::timerThread()
+    {
+        // Apply the configured scheduling for this thread
+        ThreadRoleRegistry::instance().applyRole(THREAD_ROLE_EXECUTOR);
+
+        std::unique_lock<std::mutex> lock(timerLock);
+        while (true)
+        {
+            {
+                std::lock_guard<std::mutex> idle(idleLock);
+                if (isStopping)
+                {
+                    return;
+                }
+            }
+            if (timerDeadlines.empty())
+            {
+                timerNotify.wait_for(lock, std::chrono::seconds(1));
+                continue;
+            }
+            if (std::chrono::steady_clock::now() < timerDeadlines.top().first)
+            {
+                timerNotify.wait_until(lock, timerDeadlines.top().first);
+                continue;
+            }
+
+            // Due, unless it was cancelled
+            uint64_t timerId = timerDeadlines.top().second;
+            timerDeadlines.pop();
+            std::map<uint64_t, Timer>::iterator it = timers.find(timerId);
+            if (it == timers.end())
+            {
+                continue;
+            }
+            Timer theTimer = std::move(it->second);
+            timers.erase(it);
+
+            lock.unlock();
+            submit(theTimer.type, theTimer.run);
+            lock.lock();
+        }
+    }
+
+    /// <summary>
+    /// Accessor for the counters of one kind of task
+    /// </summary>
+    /// <param name="type">Kind of task</param>
+    /// <returns>Copy of the counters</returns>
+    ExecutorTaskStats SharedExecutor::getStats(ExecutorTaskType type)
+    {
+        std::lock_guard<std::mutex> lock(statsLock);
+        return stats[type];
+    }
+
+    /// <summary>
+    /// Writes the counters of every kind of task to the console
+    /// </summary>
+    void SharedExecutor::reportStats()
+    {
+        for (int typeIndex = 0; typeIndex < EXECUTOR_TASK_TYPE_COUNT; typeIndex++)
+        {
+            ExecutorTaskStats typeStats = getStats((ExecutorTaskType)typeIndex);
+            uint64_t meanQueueNs = typeStats.completed > 0 ? typeStats.totalQueueNs / typeStats.completed : 0;
+            uint64_t meanRunNs = typeStats.completed > 0 ? typeStats.totalRunNs / typeStats.completed : 0;
+            std::cout << "EXECUTOR INFO: " << TASK_TYPE_NAMES[typeIndex] << " - " << typeStats.completed << " of " << typeStats.submitted << " tasks run ("
+                << typeStats.stolen << " stolen, " << typeStats.deferred << " deferred at the worker limit), queued mean " << meanQueueNs / 1000 << " us max " << typeStats.maxQueueNs / 1000 << " us, ran mean "
+                << meanRunNs / 1000 << " us max " << typeStats.maxRunNs / 1000 << " us, " << typeStats.timersScheduled << " timers (" << typeStats.timersCancelled << " cancelled)" << std::endl;
+        }
+    }
+
+    /// <summary>
+    /// Accessor for the name of a kind of task
+    /// </summary>
+    /// <param name="type">Kind of task</param>
+    /// <returns>Name used in reports</returns>
+    const char* SharedExecutor::taskTypeName(ExecutorTaskType type)
+    {
+        return type < EXECUTOR_TASK_TYPE_COUNT ? TASK_TYPE_NAMES[type] : "unknown";
+    }
+
+    // ************************* Serial Task *************************
+    /// <summary>
+    /// Constructs a closed task
+    /// </summary>
+    /// <param name="type">Kind of task, for the executor metrics</param>
+    /// <param name="body">Function run for each signal, or once for several that arrive before it starts</param>
+    SerialTask::SerialTask(ExecutorTaskType type, std::function<void()> body)
+        : type(type), body(body)
+    {
+    }
+
+    /// <summary>
+    /// Waits for a queued or running run before the task goes away
+    /// </summary>
+    SerialTask::~SerialTask()
+    {
+        close();
+    }
+
+    /// <summary>
+    /// Runs the task as soon as a worker is free, moving forward a run waiting on a timer
+    /// </summary>
+    void SerialTask::signal()
+    {
+        std::lock_guard<std::mutex> lock(taskLock);
+        if (isClosed)
+        {
+            return;
+        }
+        if (isRunning)
+        {
+            isRerunRequested = true;
+            return;
+        }
+        if (isQueued && (timerId == 0 || !SharedExecutor::instance().cancel(timerId)))
+        {
+            // Already on a worker queue
+            return;
+        }
+        timerId = 0;
+        isQueued = true;
+        SharedExecutor::instance().submit(type, [this] { run(); });
+    }
+
+    /// <summary>
+    /// Runs the task at a deadline, unless a run is already queued or running. Lets a producer batch work.
+    /// </summary>
+    /// <param name="deadline">Latest time to start the run</param>
+    void SerialTask::signalAt(std::chrono::steady_clock::time_point deadline)
+    {
+        std::lock_guard<std::mutex> lock(taskLock);
+        if (isClosed)
+        {
+            return;
+        }
+        if (isRunning)
+        {
+            isRerunRequested = true;
+            return;
+        }
+        if (isQueued)
+        {
+            return;
+        }
+        isQueued = true;
+        timerId = SharedExecutor::instance().schedule(type, deadline, [this] { run(); });
+    }
+
+    /// <summary>
+    /// Accepts signals from now on
+    /// </summary>
+    void SerialTask::open()
+    {
+        std::lock_guard<std::mutex> lock(taskLock);
+        isClosed = false;
+    }
+
+    /// <summary>
+    /// Stops accepting signals and waits until no run is queued or running. A run that is still queued does not call the body.
+    /// </summary>
+    void SerialTask::close()
+    {
+        std::unique_lock<std::mutex> lock(taskLock);
+        isClosed = true;
+        isRerunRequested = false;
+        if (timerId != 0 && SharedExecutor::instance().cancel(timerId))
+        {
+            timerId = 0;
+            isQueued = false;
+        }
+        taskIdle.wait(lock, [this] { return !isQueued && !isRunning; });
+    }
+
+    /// <summary>
+    /// Executor entry point, runs the body unless the task was closed while queued
+    /// </summary>
+    void SerialTask::run()
+    {
+        std::unique_lock<std::mutex> lock(taskLock);
+        isQueued = false;
+        timerId = 0;
+        if (!isClosed)
+        {
+            isRunning = true;
+            lock.unlock();
+            try
+            {
+                body();
+            }
+            catch (...)
+            {
+                // Leave the task closable, the executor reports the error
+                lock.lock();
+                isRunning = false;
+                taskIdle.notify_all();
+                throw;
+            }
+            lock.lock();
+            isRunning = false;
+            if (isRerunRequested && !isClosed)
+            {
+                isRerunRequested = false;
+                isQueued = true;
+                SharedExecutor::instance().submit(type, [this] { run(); });
+            }
+        }
+        taskIdle.notify_all();
+    }
+}
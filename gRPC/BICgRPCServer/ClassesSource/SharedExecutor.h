@@ -0,0 +1,152 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace BICGRPCHelperNamespace
+{
+    // Smallest pool, stream drains may occupy all workers but one
+    static const uint32_t MIN_EXECUTOR_WORKERS = 2;
+
+    /// <summary>
+    /// Kinds of work run on the shared executor, metrics are kept per kind
+    /// </summary>
+    enum ExecutorTaskType
+    {
+        EXECUTOR_TASK_STREAM_DRAIN = 0,     // Writing queued temperature, humidity, connection, power and error updates to their gRPC streams
+        EXECUTOR_TASK_STIM_TIME_LOG,        // Appending queued stimulation times to the stim time log file
+        EXECUTOR_TASK_TYPE_COUNT
+    };
+
+    /// <summary>
+    /// Counters of one kind of executor task
+    /// </summary>
+    struct ExecutorTaskStats
+    {
+        uint64_t submitted = 0;             // Tasks handed to the workers, including fired timers
+        uint64_t completed = 0;
+        uint64_t stolen = 0;                // Tasks run by a worker other than the one they were queued on
+        uint64_t deferred = 0;              // Tasks set aside because their kind already had its limit of workers
+        uint64_t timersScheduled = 0;
+        uint64_t timersCancelled = 0;
+        uint64_t totalQueueNs = 0;          // Time from submission to start, summed over completed tasks
+        uint64_t maxQueueNs = 0;
+        uint64_t totalRunNs = 0;
+        uint64_t maxRunNs = 0;
+    };
+
+    /// <summary>
+    /// Process-wide pool of worker threads for the listeners' non-latency-critical work, so a connected implant does not keep a
+    /// sleeping thread per stream. Each worker has its own task queue; idle workers steal from the others. A timer thread
+    /// submits tasks at their deadlines. Latency-critical work (stimulation triggering, predictive and open-loop stimulation
+    /// timing, the neural stream) stays on dedicated threads. Kinds of task that may block, such as gRPC writes to a slow client,
+    /// are limited to a number of workers at a time, so they cannot occupy the whole pool.
+    /// </summary>
+    class SharedExecutor
+    {
+    public:
+        static SharedExecutor& instance();
+        bool configure(uint32_t workerCount);
+        void submit(ExecutorTaskType type, std::function<void()> task);
+        uint64_t schedule(ExecutorTaskType type, std::chrono::steady_clock::time_point deadline, std::function<void()> task);
+        bool cancel(uint64_t timerId);
+        ExecutorTaskStats getStats(ExecutorTaskType type);
+        void reportStats();
+        static const char* taskTypeName(ExecutorTaskType type);
+
+    private:
+        struct Task
+        {
+            ExecutorTaskType type;
+            std::function<void()> run;
+            std::chrono::steady_clock::time_point queuedAt;
+        };
+
+        struct Worker
+        {
+            std::mutex queueLock;
+            std::deque<Task> tasks;
+            std::thread* thread = NULL;
+        };
+
+        struct Timer
+        {
+            ExecutorTaskType type;
+            std::function<void()> run;
+        };
+
+        SharedExecutor() {}
+        ~SharedExecutor();
+        void start();
+        void workerThread(uint32_t workerIndex);
+        bool takeTask(uint32_t workerIndex, Task* theTask, bool* isStolen);
+        bool claimWorker(Task* theTask);
+        void releaseWorker(uint32_t workerIndex, ExecutorTaskType type);
+        void queueTask(uint32_t workerIndex, Task theTask);
+        void timerThread(void);
+
+        std::mutex lifecycleLock;                                   // Serializes starting and stopping the threads
+        uint32_t configuredWorkers = 0;                             // 0 until configured, then the pool size used at start
+        std::vector<Worker*> workers;
+        std::atomic<bool> isStarted{ false };
+        std::atomic<uint32_t> nextWorker{ 0 };                      // Round-robin queue for submissions from outside the pool
+        std::atomic<uint64_t> pendingTasks{ 0 };                    // Queued tasks across all workers
+        std::mutex idleLock;
+        std::condition_variable workAvailable;
+        bool isStopping = false;
+
+        // Per kind limit on workers running it at once, 0 for no limit. Tasks over the limit wait in deferredTasks until one finishes.
+        std::mutex limitLock;
+        uint32_t taskLimits[EXECUTOR_TASK_TYPE_COUNT] = {};
+        uint32_t runningTasks[EXECUTOR_TASK_TYPE_COUNT] = {};
+        std::deque<Task> deferredTasks[EXECUTOR_TASK_TYPE_COUNT];
+
+        // Timer queue, ordered by deadline. Cancelled timers are removed from timers and skipped when they come up.
+        std::mutex timerLock;
+        std::condition_variable timerNotify;
+        std::thread* timerQueueThread = NULL;
+        std::priority_queue<std::pair<std::chrono::steady_clock::time_point, uint64_t>, std::vector<std::pair<std::chrono::steady_clock::time_point, uint64_t>>,
+            std::greater<std::pair<std::chrono::steady_clock::time_point, uint64_t>>> timerDeadlines;
+        std::map<uint64_t, Timer> timers;
+        uint64_t nextTimerId = 1;
+
+        std::mutex statsLock;
+        ExecutorTaskStats stats[EXECUTOR_TASK_TYPE_COUNT];
+    };
+
+    /// <summary>
+    /// Runs one function on the shared executor whenever it is signalled, never concurrently with itself. Signals that arrive while
+    /// it runs cause one more run, so nothing signalled is left unprocessed. Takes the place of a thread waiting on a condition variable.
+    /// </summary>
+    class SerialTask
+    {
+    public:
+        SerialTask(ExecutorTaskType type, std::function<void()> body);
+        ~SerialTask();
+        void signal();
+        void signalAt(std::chrono::steady_clock::time_point deadline);
+        void open();
+        void close();
+
+    private:
+        void run();
+
+        ExecutorTaskType type;
+        std::function<void()> body;
+        std::mutex taskLock;
+        std::condition_variable taskIdle;
+        bool isClosed = true;                   // Signals are ignored until open() is called
+        bool isQueued = false;                  // A run is waiting on a worker queue or the timer queue
+        bool isRunning = false;
+        bool isRerunRequested = false;          // Signalled while running
+        uint64_t timerId = 0;                   // Timer of a run queued by signalAt(), 0 if none
+    };
+}
@@ -0,0 +1,157 @@
+#include "StimulationCommandCache.h"
+#include <algorithm>
+#include <chrono>
+
+using namespace cortec::implantapi;
+
+namespace BICGRPCHelperNamespace
+{
+    /// <summary>
+    /// Constructs an empty cache. The single-argument constructor creates the factory with the implant API; the unit tests supply their own.
+    /// </summary>
+    /// <param name="capacity">Largest number of commands kept</param>
+    /// <param name="createFactory">Creates the factory the commands are built with, called on the first build</param>
+    StimulationCommandCache::StimulationCommandCache(size_t capacity, std::function<IStimulationCommandFactory*()> createFactory)
+        : capacity(std::max<size_t>(1, capacity)), createFactory(createFactory)
+    {
+    }
+
+    /// <summary>
+    /// 64-bit FNV-1a hash of a canonical command definition
+    /// </summary>
+    /// <param name="canonicalDefinition">Serialized definition</param>
+    /// <returns>Cache key</returns>
+    uint64_t StimulationCommandCache::hashDefinition(const std::string& canonicalDefinition)
+    {
+        uint64_t hash = 14695981039346656037ULL;
+        for (unsigned char aByte : canonicalDefinition)
+        {
+            hash ^= aByte;
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }
+
+    /// <summary>
+    /// Looks up a command for a request that supplies no definition. Counts a hit or a miss.
+    /// </summary>
+    /// <param name="key">Hash of the command definition</param>
+    /// <param name="canonicalDefinition">Set to the definition of the cached command</param>
+    /// <returns>The cached command, empty if not cached</returns>
+    std::shared_ptr<IStimulationCommand> StimulationCommandCache::find(uint64_t key, std::string* canonicalDefinition)
+    {
+        std::lock_guard<std::mutex> lock(cacheLock);
+        stats.lastKey = key;
+        EntryList::iterator theEntry = lookup(key, NULL);
+        if (theEntry == entries.end())
+        {
+            stats.misses++;
+            return std::shared_ptr<IStimulationCommand>();
+        }
+        stats.hits++;
+        *canonicalDefinition = theEntry->canonicalDefinition;
+        return theEntry->command;
+    }
+
+    /// <summary>
+    /// Returns the cached command for a definition, building and caching it on a miss. Builds are serialized, so concurrent
+    /// requests for the same new definition build it once.
+    /// </summary>
+    /// <param name="key">Hash of the command definition</param>
+    /// <param name="canonicalDefinition">Serialized definition, a cached command with the same key but another definition is replaced</param>
+    /// <param name="buildCommand">Builds the command with the cache's factory; may throw, in which case nothing is cached</param>
+    /// <returns>The cached command</returns>
+    std::shared_ptr<IStimulationCommand> StimulationCommandCache::findOrBuild(uint64_t key, const std::string& canonicalDefinition, std::function<IStimulationCommand*(IStimulationCommandFactory*)> buildCommand)
+    {
+        // Fast path without waiting for a build in progress
+        {
+            std::lock_guard<std::mutex> lock(cacheLock);
+            stats.lastKey = key;
+            EntryList::iterator theEntry = lookup(key, &canonicalDefinition);
+            if (theEntry != entries.end())
+            {
+                stats.hits++;
+                return theEntry->command;
+            }
+        }
+
+        std::lock_guard<std::mutex> build(buildLock);
+        {
+            // Another request may have built it while this one waited
+            std::lock_guard<std::mutex> lock(cacheLock);
+            EntryList::iterator theEntry = lookup(key, &canonicalDefinition);
+            if (theEntry != entries.end())
+            {
+                stats.hits++;
+                return theEntry->command;
+            }
+        }
+        if (!theFactory)
+        {
+            theFactory.reset(createFactory());
+        }
+        std::chrono::steady_clock::time_point buildStart = std::chrono::steady_clock::now();
+        std::shared_ptr<IStimulationCommand> theCommand(buildCommand(theFactory.get()));
+        uint64_t buildNs = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - buildStart).count();
+
+        std::lock_guard<std::mutex> lock(cacheLock);
+        stats.misses++;
+        stats.totalBuildNs += buildNs;
+        stats.maxBuildNs = std::max(stats.maxBuildNs, buildNs);
+        std::unordered_map<uint64_t, EntryList::iterator>::iterator collidingEntry = entryIndex.find(key);
+        if (collidingEntry != entryIndex.end())
+        {
+            // Another definition with the same hash makes way for this one
+            entries.erase(collidingEntry->second);
+            entryIndex.erase(collidingEntry);
+            stats.evictions++;
+        }
+        else if (entries.size() >= capacity)
+        {
+            entryIndex.erase(entries.back().key);
+            entries.pop_back();
+            stats.evictions++;
+        }
+        entries.push_front(CacheEntry{ key, canonicalDefinition, theCommand });
+        entryIndex[key] = entries.begin();
+        return theCommand;
+    }
+
+    /// <summary>
+    /// Finds a command and marks it as most recently used. Called with cacheLock held.
+    /// </summary>
+    /// <param name="key">Hash of the command definition</param>
+    /// <param name="canonicalDefinition">Definition the cached command must match, NULL to accept any command with this key</param>
+    /// <returns>The cache entry, entries.end() if not cached</returns>
+    StimulationCommandCache::EntryList::iterator StimulationCommandCache::lookup(uint64_t key, const std::string* canonicalDefinition)
+    {
+        std::unordered_map<uint64_t, EntryList::iterator>::iterator it = entryIndex.find(key);
+        if (it == entryIndex.end() || (canonicalDefinition != NULL && it->second->canonicalDefinition != *canonicalDefinition))
+        {
+            return entries.end();
+        }
+        entries.splice(entries.begin(), entries, it->second);
+        return it->second;
+    }
+
+    /// <summary>
+    /// Counts a persistent command that was not enqueued because the device already held it
+    /// </summary>
+    void StimulationCommandCache::countSkippedEnqueue()
+    {
+        std::lock_guard<std::mutex> lock(cacheLock);
+        stats.skippedEnqueues++;
+    }
+
+    /// <summary>
+    /// Accessor for the cache counters
+    /// </summary>
+    /// <returns>Copy of the counters</returns>
+    StimulationCommandCacheStats StimulationCommandCache::getStats()
+    {
+        std::lock_guard<std::mutex> lock(cacheLock);
+        StimulationCommandCacheStats currentStats = stats;
+        currentStats.entries = (uint32_t)entries.size();
+        return currentStats;
+    }
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include <cppapi/bicapi.h>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace BICGRPCHelperNamespace
+{
+    /// <summary>
+    /// Counters of a stimulation command cache
+    /// </summary>
+    struct StimulationCommandCacheStats
+    {
+        uint64_t hits = 0;                  // Requests served from the cache
+        uint64_t misses = 0;                // Requests that built a new command
+        uint64_t evictions = 0;             // Commands dropped to stay within the capacity
+        uint64_t skippedEnqueues = 0;       // Persistent commands not enqueued again because the device already held them
+        uint64_t totalBuildNs = 0;          // Time spent building commands on misses
+        uint64_t maxBuildNs = 0;            // Longest single build
+        uint32_t entries = 0;               // Commands currently cached
+        uint64_t lastKey = 0;               // Key of the most recently requested command
+    };
+
+    /// <summary>
+    /// Keeps built stimulation commands keyed by a hash of their canonical (serialized) definition, so waveforms that are requested
+    /// again are not rebuilt from the gRPC request. Each entry keeps its definition, which is compared on every hit so a hash collision
+    /// is a miss rather than the wrong waveform. All commands come from one factory that lives as long as the cache. Commands are
+    /// shared pointers so an eviction never frees a command another thread is enqueueing. The least recently used command is evicted
+    /// once the capacity is reached.
+    /// </summary>
+    class StimulationCommandCache
+    {
+    public:
+        explicit StimulationCommandCache(size_t capacity = 64)
+            : StimulationCommandCache(capacity, [] { using namespace cortec::implantapi; return createStimulationCommandFactory(); }) {}
+        StimulationCommandCache(size_t capacity, std::function<cortec::implantapi::IStimulationCommandFactory*()> createFactory);
+        static uint64_t hashDefinition(const std::string& canonicalDefinition);
+        std::shared_ptr<cortec::implantapi::IStimulationCommand> find(uint64_t key, std::string* canonicalDefinition);
+        std::shared_ptr<cortec::implantapi::IStimulationCommand> findOrBuild(uint64_t key, const std::string& canonicalDefinition, std::function<cortec::implantapi::IStimulationCommand*(cortec::implantapi::IStimulationCommandFactory*)> buildCommand);
+        void countSkippedEnqueue();
+        StimulationCommandCacheStats getStats();
+
+    private:
+        struct CacheEntry
+        {
+            uint64_t key;
+            std::string canonicalDefinition;
+            std::shared_ptr<cortec::implantapi::IStimulationCommand> command;
+        };
+        typedef std::list<CacheEntry> EntryList;
+
+        EntryList::iterator lookup(uint64_t key, const std::string* canonicalDefinition);
+
+        size_t capacity;
+        std::function<cortec::implantapi::IStimulationCommandFactory*()> createFactory;  // Creates theFactory on the first build
+        std::mutex buildLock;                                                           // Serializes use of the factory, taken before cacheLock
+        std::mutex cacheLock;
+        std::unique_ptr<cortec::implantapi::IStimulationCommandFactory> theFactory;    // Outlives every cached command it created
+        EntryList entries;                                                              // Most recently used first
+        std::unordered_map<uint64_t, EntryList::iterator> entryIndex;
+        StimulationCommandCacheStats stats;
+    };
+}
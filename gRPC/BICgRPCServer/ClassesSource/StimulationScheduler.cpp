@@ -0,0 +1,135 @@
+#include "StimulationScheduler.h"
+#include "ThreadRoleRegistry.h"
+#ifdef _WIN32
+#include <windows.h>
+#pragma comment(lib, "winmm.lib")
+#endif
+
+namespace BICGRPCHelperNamespace
+{
+    // Time before the deadline at which the timer thread stops sleeping and starts spinning
+    static const std::chrono::microseconds SPIN_MARGIN(1500);
+
+    /// <summary>
+    /// Constructs the scheduler and starts its timer thread
+    /// </summary>
+    /// <param name="fireCallback">Function called from the timer thread when a deadline is reached</param>
+    StimulationScheduler::StimulationScheduler(std::function<void(const ScheduledStimulation&)> fireCallback)
+        : fireCallback(fireCallback)
+    {
+#ifdef _WIN32
+        // Raise the system timer resolution so the sleep phase ends close to the spin margin
+        timeBeginPeriod(1);
+#endif
+        schedulerThread = new std::thread(&StimulationScheduler::timerThread, this);
+    }
+
+    /// <summary>
+    /// Cancels any pending stimulation and stops the timer thread
+    /// </summary>
+    StimulationScheduler::~StimulationScheduler()
+    {
+        schedulerLock.lock();
+        isStopping = true;
+        hasPendingDeadline = false;
+        schedulerLock.unlock();
+        schedulerNotify.notify_all();
+
+        schedulerThread->join();
+        delete schedulerThread;
+        schedulerThread = NULL;
+#ifdef _WIN32
+        timeEndPeriod(1);
+#endif
+    }
+
+    /// <summary>
+    /// Schedules a stimulation, unless one is already pending
+    /// </summary>
+    /// <param name="deadline">Time at which the stimulation should be issued</param>
+    /// <returns>True if the stimulation was scheduled</returns>
+    bool StimulationScheduler::schedule(std::chrono::steady_clock::time_point deadline)
+    {
+        std::unique_lock<std::mutex> lock(schedulerLock);
+        if (hasPendingDeadline || isStopping)
+        {
+            return false;
+        }
+        pendingDeadline = deadline;
+        hasPendingDeadline = true;
+        lock.unlock();
+
+        schedulerNotify.notify_all();
+        return true;
+    }
+
+    /// <summary>
+    /// Drops the pending stimulation, if any
+    /// </summary>
+    void StimulationScheduler::cancel()
+    {
+        std::lock_guard<std::mutex> lock(schedulerLock);
+        hasPendingDeadline = false;
+    }
+
+    /// <summary>
+    /// Accessor indicating whether a stimulation is waiting for its deadline
+    /// </summary>
+    /// <returns>True if a stimulation is pending</returns>
+    bool StimulationScheduler::isPending()
+    {
+        std::lock_guard<std::mutex> lock(schedulerLock);
+        return hasPendingDeadline;
+    }
+
+    /// <summary>
+    /// Timer thread: sleeps until the spin margin before the pending deadline, spins to the deadline and fires the callback
+    /// </summary>
+    void StimulationScheduler::timerThread()
+    {
+        // Apply the configured scheduling for this thread
+        ThreadRoleRegistry::instance().applyRole(THREAD_ROLE_STIM_SCHEDULER);
+
+        std::unique_lock<std::mutex> lock(schedulerLock);
+        while (!isStopping)
+        {
+            if (!hasPendingDeadline)
+            {
+                schedulerNotify.wait(lock);
+                continue;
+            }
+
+            // Coarse sleep, woken early if the deadline is cancelled or the scheduler stops
+            std::chrono::steady_clock::time_point deadline = pendingDeadline;
+            if (std::chrono::steady_clock::now() < deadline - SPIN_MARGIN)
+            {
+                schedulerNotify.wait_until(lock, deadline - SPIN_MARGIN);
+                continue;
+            }
+
+            // Fine wait without the lock held
+            lock.unlock();
+            while (std::chrono::steady_clock::now() < deadline)
+            {
+                std::this_thread::yield();
+            }
+            lock.lock();
+
+            // Only fire if the deadline was not cancelled while spinning
+            if (!hasPendingDeadline || isStopping || pendingDeadline != deadline)
+            {
+                continue;
+            }
+            hasPendingDeadline = false;
+            lock.unlock();
+
+            ScheduledStimulation firedStimulation;
+            firedStimulation.deadline = deadline;
+            firedStimulation.issueTime = std::chrono::steady_clock::now();
+            firedStimulation.schedulingErrorNs = std::chrono::duration_cast<std::chrono::nanoseconds>(firedStimulation.issueTime - deadline).count();
+            fireCallback(firedStimulation);
+
+            lock.lock();
+        }
+    }
+}
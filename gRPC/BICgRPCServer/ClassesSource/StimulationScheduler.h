@@ -0,0 +1,45 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace BICGRPCHelperNamespace
+{
+    /// <summary>
+    /// Timing of a stimulation issued by the StimulationScheduler
+    /// </summary>
+    struct ScheduledStimulation
+    {
+        std::chrono::steady_clock::time_point deadline;     // Requested issue time
+        std::chrono::steady_clock::time_point issueTime;    // Time the fire callback was entered
+        int64_t schedulingErrorNs;                          // issueTime - deadline
+    };
+
+    /// <summary>
+    /// Issues a single pending stimulation at a computed future time from a dedicated timer thread. The thread sleeps until shortly
+    /// before the deadline and spins for the remainder, so the issue time is not tied to sample arrival or the OS sleep granularity.
+    /// </summary>
+    class StimulationScheduler
+    {
+    public:
+        explicit StimulationScheduler(std::function<void(const ScheduledStimulation&)> fireCallback);
+        ~StimulationScheduler();
+        bool schedule(std::chrono::steady_clock::time_point deadline);
+        void cancel();
+        bool isPending();
+
+    private:
+        void timerThread(void);
+
+        std::function<void(const ScheduledStimulation&)> fireCallback;
+        std::thread* schedulerThread = NULL;
+        std::mutex schedulerLock;
+        std::condition_variable schedulerNotify;
+        std::chrono::steady_clock::time_point pendingDeadline;
+        bool hasPendingDeadline = false;
+        bool isStopping = false;
+    };
+}
@@ -0,0 +1,44 @@
+#include "StimulationSequence.h"
+#include <algorithm>
+#include <random>
+
+namespace BICGRPCHelperNamespace
+{
+    /// <summary>
+    /// Plans the trials of a sequence
+    /// </summary>
+    /// <param name="config">Sequence configuration, at most MAX_SEQUENCE_TRIALS trials</param>
+    StimulationSequence::StimulationSequence(const StimulationSequenceConfig& config)
+        : randomSeed(config.randomSeed)
+    {
+        if (randomSeed == 0)
+        {
+            std::random_device seedSource;
+            randomSeed = ((uint64_t)seedSource() << 32) | seedSource();
+        }
+        std::mt19937_64 generator(randomSeed);
+
+        // Every set once per repetition, in turn unless shuffled
+        trials.reserve((size_t)config.repetitions * config.waveformSetCount);
+        for (uint32_t repetition = 0; repetition < config.repetitions; repetition++)
+        {
+            for (uint32_t setIndex = 0; setIndex < config.waveformSetCount; setIndex++)
+            {
+                trials.push_back({ setIndex, 0 });
+            }
+        }
+        if (config.randomizeOrder)
+        {
+            std::shuffle(trials.begin(), trials.end(), generator);
+        }
+
+        // Offsets are absolute from the first trial, so a late trial does not delay the ones after it
+        std::uniform_int_distribution<uint64_t> jitterDistribution(0, config.interTrialJitterUs);
+        uint64_t startOffsetUs = 0;
+        for (StimulationSequenceTrial& theTrial : trials)
+        {
+            theTrial.startOffsetUs = startOffsetUs;
+            startOffsetUs += config.interTrialIntervalUs + (config.interTrialJitterUs > 0 ? jitterDistribution(generator) : 0);
+        }
+    }
+}
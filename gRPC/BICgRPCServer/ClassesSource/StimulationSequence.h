@@ -0,0 +1,47 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+namespace BICGRPCHelperNamespace
+{
+    // Largest number of trials (repetitions times waveform sets) a sequence may plan, as every trial is allocated up front
+    static const uint64_t MAX_SEQUENCE_TRIALS = 1000000;
+
+    /// <summary>
+    /// Parameters of a server-side stimulation sequence that decide its trial order and timing
+    /// </summary>
+    struct StimulationSequenceConfig
+    {
+        uint32_t waveformSetCount = 0;          // Number of uploaded waveform sets
+        uint32_t repetitions = 1;               // Trials per waveform set
+        bool randomizeOrder = false;            // Shuffle the trials instead of running the sets in turn
+        uint64_t interTrialIntervalUs = 0;      // Time from the start of one trial to the start of the next
+        uint64_t interTrialJitterUs = 0;        // Uniformly distributed extra time added to each interval
+        uint64_t randomSeed = 0;                // Seed of the order and jitter, 0 to pick one
+    };
+
+    /// <summary>
+    /// One planned trial
+    /// </summary>
+    struct StimulationSequenceTrial
+    {
+        uint32_t waveformSetIndex;              // Waveform set stimulated in this trial
+        uint64_t startOffsetUs;                 // Start time relative to the start of the first trial
+    };
+
+    /// <summary>
+    /// Plans every trial of a sequence up front, so the order and timing depend only on the configuration and seed and can be
+    /// reproduced offline
+    /// </summary>
+    class StimulationSequence
+    {
+    public:
+        explicit StimulationSequence(const StimulationSequenceConfig& config);
+        const std::vector<StimulationSequenceTrial>& getTrials() const { return trials; }
+        uint64_t getRandomSeed() const { return randomSeed; }
+
+    private:
+        std::vector<StimulationSequenceTrial> trials;
+        uint64_t randomSeed;
+    };
+}
@@ -0,0 +1,57 @@
+#include "StimulationStateNotifier.h"
+
+namespace BICGRPCHelperNamespace
+{
+    /// <summary>
+    /// Records a stimulation state change and wakes every waiter
+    /// </summary>
+    /// <param name="isStimulating">New stimulation state</param>
+    void StimulationStateNotifier::publish(bool isStimulating)
+    {
+        {
+            std::lock_guard<std::mutex> lock(stateLock);
+            latestEvent.sequence++;
+            latestEvent.isStimulating = isStimulating;
+            latestEvent.timeStamp = std::chrono::system_clock::now().time_since_epoch().count();
+        }
+        stateNotify.notify_all();
+    }
+
+    /// <summary>
+    /// Accessor for the latest state and its sequence number
+    /// </summary>
+    /// <returns>The latest state</returns>
+    StimulationStateEvent StimulationStateNotifier::current()
+    {
+        std::lock_guard<std::mutex> lock(stateLock);
+        return latestEvent;
+    }
+
+    /// <summary>
+    /// Waits until the state changes after a known sequence number, the timeout passes or wakeAll() is called
+    /// </summary>
+    /// <param name="lastSequence">Sequence number the caller has already seen</param>
+    /// <param name="timeout">Longest time to wait</param>
+    /// <param name="latest">Filled with the latest state when the function returns</param>
+    /// <returns>True if the state changed after lastSequence</returns>
+    bool StimulationStateNotifier::waitForChange(uint64_t lastSequence, std::chrono::steady_clock::duration timeout, StimulationStateEvent* latest)
+    {
+        std::unique_lock<std::mutex> lock(stateLock);
+        uint64_t startGeneration = wakeGeneration;
+        stateNotify.wait_for(lock, timeout, [this, lastSequence, startGeneration] { return latestEvent.sequence != lastSequence || wakeGeneration != startGeneration; });
+        *latest = latestEvent;
+        return latestEvent.sequence != lastSequence;
+    }
+
+    /// <summary>
+    /// Wakes every waiter without a state change, so they can check their own stop conditions
+    /// </summary>
+    void StimulationStateNotifier::wakeAll()
+    {
+        {
+            std::lock_guard<std::mutex> lock(stateLock);
+            wakeGeneration++;
+        }
+        stateNotify.notify_all();
+    }
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+namespace BICGRPCHelperNamespace
+{
+    /// <summary>
+    /// Stimulation state after a change
+    /// </summary>
+    struct StimulationStateEvent
+    {
+        uint64_t sequence = 0;              // Number of state changes published so far, 0 before the first
+        bool isStimulating = false;
+        uint64_t timeStamp = 0;             // Time the change was received (system_clock ticks)
+    };
+
+    /// <summary>
+    /// Publishes stimulation state changes from the implant event handler to waiting threads. Every change advances a sequence
+    /// number, so a waiter that passes the last sequence it saw cannot miss a change between checking the state and waiting.
+    /// </summary>
+    class StimulationStateNotifier
+    {
+    public:
+        void publish(bool isStimulating);
+        StimulationStateEvent current();
+        bool waitForChange(uint64_t lastSequence, std::chrono::steady_clock::duration timeout, StimulationStateEvent* latest);
+        void wakeAll();
+
+    private:
+        std::mutex stateLock;
+        std::condition_variable stateNotify;
+        StimulationStateEvent latestEvent;
+        uint64_t wakeGeneration = 0;        // Advanced by wakeAll() so waiters return without a state change
+    };
+}
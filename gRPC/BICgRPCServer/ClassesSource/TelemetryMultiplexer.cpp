@@ -0,0 +1,200 @@
+#include "TelemetryMultiplexer.h"
+#include <algorithm>
+
+namespace BICGRPCHelperNamespace
+{
+    /// <summary>
+    /// Sets up a stream for the requested types
+    /// </summary>
+    /// <param name="subscriptions">Types to stream and their rate limits, empty for every type without a rate limit</param>
+    TelemetryMultiplexer::TelemetryMultiplexer(const google::protobuf::RepeatedPtrField<BICgRPC::TelemetrySubscription>& subscriptions)
+    {
+        for (int sourceIndex = 0; sourceIndex < TELEMETRY_SOURCE_COUNT; sourceIndex++)
+        {
+            SourceState& theSource = sources[sourceIndex];
+            theSource.isSubscribed = subscriptions.size() == 0;
+            for (const BICgRPC::TelemetrySubscription& aSubscription : subscriptions)
+            {
+                if (aSubscription.type() == sourceType((TelemetrySource)sourceIndex))
+                {
+                    theSource.isSubscribed = true;
+                    theSource.minInterval = std::chrono::milliseconds(aSubscription.minintervalms());
+                }
+            }
+        }
+    }
+
+    /// <summary>
+    /// Frees every update that was not sent
+    /// </summary>
+    TelemetryMultiplexer::~TelemetryMultiplexer()
+    {
+        while (!updateQueue.empty())
+        {
+            delete updateQueue.front();
+            updateQueue.pop();
+        }
+        for (SourceState& theSource : sources)
+        {
+            delete theSource.pending;
+        }
+    }
+
+    /// <summary>
+    /// Type of the updates of a source
+    /// </summary>
+    /// <param name="source">Update source</param>
+    /// <returns>Type subscribed to by clients</returns>
+    BICgRPC::TelemetryType TelemetryMultiplexer::sourceType(TelemetrySource source)
+    {
+        switch (source)
+        {
+        case TELEMETRY_SOURCE_TEMPERATURE:
+            return BICgRPC::TELEMETRY_TYPE_TEMPERATURE;
+        case TELEMETRY_SOURCE_HUMIDITY:
+            return BICgRPC::TELEMETRY_TYPE_HUMIDITY;
+        case TELEMETRY_SOURCE_VOLTAGE:
+        case TELEMETRY_SOURCE_COIL_CURRENT:
+        case TELEMETRY_SOURCE_CONTROL_VALUE:
+            return BICgRPC::TELEMETRY_TYPE_POWER;
+        case TELEMETRY_SOURCE_USB_CONNECTION:
+        case TELEMETRY_SOURCE_INDUCTIVE_CONNECTION:
+        case TELEMETRY_SOURCE_OVERALL_CONNECTION:
+            return BICgRPC::TELEMETRY_TYPE_CONNECTION;
+        default:
+            return BICgRPC::TELEMETRY_TYPE_ERROR;
+        }
+    }
+
+    /// <summary>
+    /// Status of a source's subscription, fixed when the stream is created
+    /// </summary>
+    /// <param name="source">Update source</param>
+    /// <returns>True if updates of the source are streamed</returns>
+    bool TelemetryMultiplexer::isSubscribed(TelemetrySource source)
+    {
+        return sources[source].isSubscribed;
+    }
+
+    /// <summary>
+    /// Adds an update to the stream. Called from the listener's event handlers.
+    /// </summary>
+    /// <param name="source">Update source</param>
+    /// <param name="anUpdate">Update without its time stamp, owned by the multiplexer from here on</param>
+    void TelemetryMultiplexer::publish(TelemetrySource source, BICgRPC::TelemetryUpdate* anUpdate)
+    {
+        anUpdate->set_timestamp(std::chrono::system_clock::now().time_since_epoch().count());
+
+        std::lock_guard<std::mutex> lock(streamLock);
+        SourceState& theSource = sources[source];
+        if (!theSource.isSubscribed || isStopRequested)
+        {
+            delete anUpdate;
+            return;
+        }
+        stats.published++;
+
+        if (theSource.minInterval > std::chrono::milliseconds::zero())
+        {
+            // Rate limited, the newest update replaces any that is still waiting
+            if (theSource.pending != NULL)
+            {
+                delete theSource.pending;
+                theSource.pendingConflated++;
+                stats.conflated++;
+            }
+            theSource.pending = anUpdate;
+        }
+        else if (updateQueue.size() < MAX_QUEUED_UPDATES)
+        {
+            updateQueue.push(anUpdate);
+        }
+        else
+        {
+            delete anUpdate;
+            stats.dropped++;
+            return;
+        }
+        updateNotify.notify_all();
+    }
+
+    /// <summary>
+    /// Waits for the next update to write. Rate-limited updates that are due go before queued ones, so a busy type cannot hold them back.
+    /// </summary>
+    /// <param name="maxWait">Longest time to wait, so the writer can check for a client that went away</param>
+    /// <returns>The update, owned by the caller, or NULL if none was ready in time or the stream was stopped</returns>
+    BICgRPC::TelemetryUpdate* TelemetryMultiplexer::next(std::chrono::milliseconds maxWait)
+    {
+        std::chrono::steady_clock::time_point waitEnd = std::chrono::steady_clock::now() + maxWait;
+        std::unique_lock<std::mutex> lock(streamLock);
+        while (!isStopRequested)
+        {
+            // Release the first rate-limited update that is due, noting when the next one will be
+            std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+            std::chrono::steady_clock::time_point wakeAt = waitEnd;
+            for (SourceState& theSource : sources)
+            {
+                if (theSource.pending == NULL)
+                {
+                    continue;
+                }
+                std::chrono::steady_clock::time_point dueAt = theSource.lastSentAt + theSource.minInterval;
+                if (dueAt <= now)
+                {
+                    BICgRPC::TelemetryUpdate* anUpdate = theSource.pending;
+                    anUpdate->set_conflatedupdates(theSource.pendingConflated);
+                    theSource.pending = NULL;
+                    theSource.pendingConflated = 0;
+                    theSource.lastSentAt = now;
+                    stats.sent++;
+                    return anUpdate;
+                }
+                wakeAt = std::min(wakeAt, dueAt);
+            }
+
+            if (!updateQueue.empty())
+            {
+                BICgRPC::TelemetryUpdate* anUpdate = updateQueue.front();
+                updateQueue.pop();
+                stats.sent++;
+                return anUpdate;
+            }
+            if (now >= waitEnd)
+            {
+                return NULL;
+            }
+            updateNotify.wait_until(lock, wakeAt);
+        }
+        return NULL;
+    }
+
+    /// <summary>
+    /// Ends the stream, waking the writer
+    /// </summary>
+    void TelemetryMultiplexer::stop()
+    {
+        std::lock_guard<std::mutex> lock(streamLock);
+        isStopRequested = true;
+        updateNotify.notify_all();
+    }
+
+    /// <summary>
+    /// Status of the stream
+    /// </summary>
+    /// <returns>True once stop() was called</returns>
+    bool TelemetryMultiplexer::isStopped()
+    {
+        std::lock_guard<std::mutex> lock(streamLock);
+        return isStopRequested;
+    }
+
+    /// <summary>
+    /// Accessor for the stream counters
+    /// </summary>
+    /// <returns>Copy of the counters</returns>
+    TelemetryMultiplexerStats TelemetryMultiplexer::getStats()
+    {
+        std::lock_guard<std::mutex> lock(streamLock);
+        return stats;
+    }
+}
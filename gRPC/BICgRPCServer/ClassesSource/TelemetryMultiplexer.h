@@ -0,0 +1,76 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <queue>
+#include "BICgRPC.grpc.pb.h"
+
+namespace BICGRPCHelperNamespace
+{
+    /// <summary>
+    /// Origin of a telemetry update. Rate limits apply per source, so e.g. a coil current update never replaces a pending voltage update.
+    /// </summary>
+    enum TelemetrySource
+    {
+        TELEMETRY_SOURCE_TEMPERATURE = 0,
+        TELEMETRY_SOURCE_HUMIDITY,
+        TELEMETRY_SOURCE_VOLTAGE,
+        TELEMETRY_SOURCE_COIL_CURRENT,
+        TELEMETRY_SOURCE_CONTROL_VALUE,
+        TELEMETRY_SOURCE_USB_CONNECTION,
+        TELEMETRY_SOURCE_INDUCTIVE_CONNECTION,
+        TELEMETRY_SOURCE_OVERALL_CONNECTION,
+        TELEMETRY_SOURCE_ERROR,
+        TELEMETRY_SOURCE_COUNT
+    };
+
+    /// <summary>
+    /// Counters of a telemetry stream
+    /// </summary>
+    struct TelemetryMultiplexerStats
+    {
+        uint64_t published = 0;         // Updates accepted from the listener
+        uint64_t sent = 0;              // Updates handed to the writer
+        uint64_t conflated = 0;         // Updates replaced by a newer one of the same source because of a rate limit
+        uint64_t dropped = 0;           // Unlimited updates discarded because the queue was full
+    };
+
+    /// <summary>
+    /// Merges the telemetry updates of a device into one stream served by a single writer thread. Updates of types without a rate
+    /// limit are queued in arrival order. A rate-limited source keeps only its latest pending update, which is released once the
+    /// source's interval since its previous update has passed.
+    /// </summary>
+    class TelemetryMultiplexer
+    {
+    public:
+        TelemetryMultiplexer(const google::protobuf::RepeatedPtrField<BICgRPC::TelemetrySubscription>& subscriptions);
+        ~TelemetryMultiplexer();
+        static BICgRPC::TelemetryType sourceType(TelemetrySource source);
+        bool isSubscribed(TelemetrySource source);
+        void publish(TelemetrySource source, BICgRPC::TelemetryUpdate* anUpdate);
+        BICgRPC::TelemetryUpdate* next(std::chrono::milliseconds maxWait);
+        void stop();
+        bool isStopped();
+        TelemetryMultiplexerStats getStats();
+
+    private:
+        struct SourceState
+        {
+            bool isSubscribed = false;
+            std::chrono::milliseconds minInterval{ 0 };
+            BICgRPC::TelemetryUpdate* pending = NULL;               // Latest unsent update of a rate-limited source
+            uint32_t pendingConflated = 0;                          // Updates the pending one replaced
+            std::chrono::steady_clock::time_point lastSentAt;
+        };
+
+        static const size_t MAX_QUEUED_UPDATES = 500;
+
+        std::mutex streamLock;
+        std::condition_variable updateNotify;
+        SourceState sources[TELEMETRY_SOURCE_COUNT];
+        std::queue<BICgRPC::TelemetryUpdate*> updateQueue;          // Updates of sources without a rate limit
+        bool isStopRequested = false;
+        TelemetryMultiplexerStats stats;
+    };
+}
@@ -0,0 +1,108 @@
+#include "TelemetryReadCache.h"
+
+namespace BICGRPCHelperNamespace
+{
+    /// <summary>
+    /// Records a value pushed by the device
+    /// </summary>
+    /// <param name="quantity">Quantity reported</param>
+    /// <param name="value">Reported value</param>
+    void TelemetryReadCache::update(TelemetryQuantity quantity, double value)
+    {
+        std::lock_guard<std::mutex> lock(cacheLock);
+        record(quantities[quantity], value);
+    }
+
+    /// <summary>
+    /// Accessor for the latest value of a quantity, regardless of its age
+    /// </summary>
+    /// <param name="quantity">Quantity requested</param>
+    /// <returns>Copy of the latest value, isValid is false if none was received yet</returns>
+    TelemetryReading TelemetryReadCache::latest(TelemetryQuantity quantity)
+    {
+        std::lock_guard<std::mutex> lock(cacheLock);
+        TelemetryReading theReading = quantities[quantity].reading;
+        theReading.isCached = true;
+        return theReading;
+    }
+
+    /// <summary>
+    /// Returns a value no older than the staleness bound, reading it from the device if needed. Only one device read per quantity
+    /// is in flight at a time; readers arriving during it are given its result.
+    /// </summary>
+    /// <param name="quantity">Quantity requested</param>
+    /// <param name="maxAge">Oldest acceptable value, 0 to always wait for a device read</param>
+    /// <param name="readDevice">Reads the quantity from the device; may throw, in which case the error is rethrown to every waiter</param>
+    /// <returns>The value and when it was received</returns>
+    TelemetryReading TelemetryReadCache::read(TelemetryQuantity quantity, std::chrono::milliseconds maxAge, std::function<double()> readDevice)
+    {
+        QuantityState& state = quantities[quantity];
+        std::unique_lock<std::mutex> lock(cacheLock);
+
+        // Fresh enough already
+        if (maxAge > std::chrono::milliseconds::zero() && state.reading.isValid
+            && std::chrono::steady_clock::now() - state.reading.receivedAt <= maxAge)
+        {
+            TelemetryReading theReading = state.reading;
+            theReading.isCached = true;
+            return theReading;
+        }
+
+        // Join a device read already in flight
+        if (state.isReadInFlight)
+        {
+            uint64_t joinedGeneration = state.readGeneration;
+            state.readDone.wait(lock, [&] { return state.readGeneration != joinedGeneration; });
+            if (state.readError)
+            {
+                std::rethrow_exception(state.readError);
+            }
+            TelemetryReading theReading = state.reading;
+            theReading.isCached = true;
+            return theReading;
+        }
+
+        // Make the device read without holding the lock so events and other quantities are not blocked
+        state.isReadInFlight = true;
+        lock.unlock();
+        double value = 0;
+        std::exception_ptr readError;
+        try
+        {
+            value = readDevice();
+        }
+        catch (...)
+        {
+            readError = std::current_exception();
+        }
+        lock.lock();
+
+        state.isReadInFlight = false;
+        state.readGeneration++;
+        state.readError = readError;
+        if (!readError)
+        {
+            record(state, value);
+        }
+        state.readDone.notify_all();
+        if (readError)
+        {
+            std::rethrow_exception(readError);
+        }
+        return state.reading;
+    }
+
+    /// <summary>
+    /// Stores a new value. Called with cacheLock held.
+    /// </summary>
+    /// <param name="state">Quantity updated</param>
+    /// <param name="value">New value</param>
+    void TelemetryReadCache::record(QuantityState& state, double value)
+    {
+        state.reading.isValid = true;
+        state.reading.value = value;
+        state.reading.timeStamp = std::chrono::system_clock::now().time_since_epoch().count();
+        state.reading.receivedAt = std::chrono::steady_clock::now();
+        state.reading.isCached = false;
+    }
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+
+namespace BICGRPCHelperNamespace
+{
+    /// <summary>
+    /// Slowly changing implant quantities reported by the listener events
+    /// </summary>
+    enum TelemetryQuantity
+    {
+        TELEMETRY_TEMPERATURE = 0,
+        TELEMETRY_HUMIDITY,
+        TELEMETRY_IMPLANT_VOLTAGE,
+        TELEMETRY_COIL_CURRENT,
+        TELEMETRY_CONTROL_VALUE,
+        TELEMETRY_QUANTITY_COUNT
+    };
+
+    /// <summary>
+    /// Latest value of one quantity
+    /// </summary>
+    struct TelemetryReading
+    {
+        bool isValid = false;                                   // A value has been received or read
+        double value = 0;
+        uint64_t timeStamp = 0;                                 // Time the value was received (system_clock ticks)
+        std::chrono::steady_clock::time_point receivedAt;       // Same time on the steady clock, for the age check
+        bool isCached = false;                                  // Served without a device call of its own
+    };
+
+    /// <summary>
+    /// Read-through cache of the latest value of each quantity. Values pushed by the listener events and values read from the
+    /// device are both recorded. A read within the staleness bound is answered from memory; otherwise a single device call is
+    /// made and concurrent readers of the same quantity wait for its result instead of issuing their own.
+    /// </summary>
+    class TelemetryReadCache
+    {
+    public:
+        void update(TelemetryQuantity quantity, double value);
+        TelemetryReading latest(TelemetryQuantity quantity);
+        TelemetryReading read(TelemetryQuantity quantity, std::chrono::milliseconds maxAge, std::function<double()> readDevice);
+
+    private:
+        struct QuantityState
+        {
+            TelemetryReading reading;
+            bool isReadInFlight = false;
+            uint64_t readGeneration = 0;                        // Incremented when a device read finishes
+            std::exception_ptr readError;                       // Error of the last finished device read, shared with its waiters
+            std::condition_variable readDone;
+        };
+
+        static void record(QuantityState& state, double value);
+
+        std::mutex cacheLock;
+        QuantityState quantities[TELEMETRY_QUANTITY_COUNT];
+    };
+}
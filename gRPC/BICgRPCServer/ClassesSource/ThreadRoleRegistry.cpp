@@ -0,0 +1,363 @@
+#include "ThreadRoleRegistry.h"
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#ifdef _WIN32
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#endif
+
+namespace BICGRPCHelperNamespace
+{
+    // Role names used in the configuration file and console output, indexed by ThreadRole
+    static const char* const ROLE_NAMES[THREAD_ROLE_COUNT] = { "dataCallback", "stimTrigger", "stimScheduler", "openLoopStim", "streamWriter", "executor", "estimatorFit", "shadowEval" };
+
+    // Number of CPUs a role can be pinned to, CPU ids must be below this
+#if defined(_WIN32)
+    static const long CPU_ID_LIMIT = (long)(sizeof(DWORD_PTR) * 8);
+#elif defined(__linux__)
+    static const long CPU_ID_LIMIT = CPU_SETSIZE;
+#else
+    static const long CPU_ID_LIMIT = 1024;
+#endif
+
+    /// <summary>
+    /// Formats a CPU list for console output
+    /// </summary>
+    static std::string describeCpus(const std::vector<int>& cpus)
+    {
+        if (cpus.empty())
+        {
+            return "any";
+        }
+        std::ostringstream description;
+        for (size_t i = 0; i < cpus.size(); i++)
+        {
+            description << (i > 0 ? "," : "") << cpus[i];
+        }
+        return description.str();
+    }
+
+    /// <summary>
+    /// Formats a scheduling policy for console output
+    /// </summary>
+    static const char* describePolicy(ThreadSchedulingPolicy policy)
+    {
+        switch (policy)
+        {
+        case THREAD_POLICY_FIFO:
+            return "fifo";
+        case THREAD_POLICY_RR:
+            return "rr";
+        default:
+            return "default";
+        }
+    }
+
+    /// <summary>
+    /// Accessor for the process-wide registry
+    /// </summary>
+    /// <returns>The registry</returns>
+    ThreadRoleRegistry& ThreadRoleRegistry::instance()
+    {
+        static ThreadRoleRegistry theRegistry;
+        return theRegistry;
+    }
+
+    /// <summary>
+    /// Accessor for the configuration file name of a role
+    /// </summary>
+    /// <param name="role">Thread role</param>
+    /// <returns>Role name</returns>
+    const char* ThreadRoleRegistry::roleName(ThreadRole role)
+    {
+        return role < THREAD_ROLE_COUNT ? ROLE_NAMES[role] : "unknown";
+    }
+
+    /// <summary>
+    /// Loads the thread role configuration file and locks memory if requested. Must be called before any server thread starts.
+    /// </summary>
+    /// <param name="configPath">Path of the configuration file</param>
+    /// <returns>True if the file was read without errors</returns>
+    bool ThreadRoleRegistry::loadConfig(const std::string& configPath)
+    {
+        std::ifstream configFile(configPath);
+        if (!configFile.is_open())
+        {
+            std::cout << "ERROR: Could not open thread configuration file " << configPath << std::endl;
+            return false;
+        }
+
+        bool isValid = true;
+        std::string line;
+        uint32_t lineNumber = 0;
+        while (std::getline(configFile, line))
+        {
+            lineNumber++;
+            line = line.substr(0, line.find('#'));
+            std::istringstream fields(line);
+            std::string name;
+            if (!(fields >> name))
+            {
+                continue;
+            }
+
+            if (name == "lockMemory")
+            {
+                isLockMemoryRequested = true;
+                continue;
+            }
+
+            // The stream and log threads this role configured now share the executor's workers
+            if (name == "logging")
+            {
+                std::cout << "WARNING: Thread configuration line " << lineNumber << " role \"logging\" is now named \"" << ROLE_NAMES[THREAD_ROLE_EXECUTOR] << "\", applying it to the executor workers" << std::endl;
+                name = ROLE_NAMES[THREAD_ROLE_EXECUTOR];
+            }
+
+            int roleIndex = 0;
+            while (roleIndex < THREAD_ROLE_COUNT && name != ROLE_NAMES[roleIndex])
+            {
+                roleIndex++;
+            }
+
+            std::string cpuList;
+            std::string policyName;
+            int priority = 0;
+            if (roleIndex == THREAD_ROLE_COUNT || !(fields >> cpuList >> policyName >> priority))
+            {
+                std::cout << "WARNING: Thread configuration line " << lineNumber << " ignored: " << line << std::endl;
+                isValid = false;
+                continue;
+            }
+
+            ThreadRoleConfig& roleConfig = roles[roleIndex];
+            roleConfig.cpus.clear();
+            if (cpuList != "-")
+            {
+                std::istringstream cpuFields(cpuList);
+                std::string cpu;
+                while (std::getline(cpuFields, cpu, ','))
+                {
+                    // Only whole non-negative numbers within the platform's CPU set are usable
+                    char* cpuEnd = NULL;
+                    long cpuId = std::strtol(cpu.c_str(), &cpuEnd, 10);
+                    if (cpu.empty() || *cpuEnd != '\0' || cpuId < 0 || cpuId >= CPU_ID_LIMIT)
+                    {
+                        std::cout << "WARNING: Thread configuration line " << lineNumber << " CPU \"" << cpu << "\" ignored, expected 0 to " << CPU_ID_LIMIT - 1 << std::endl;
+                        isValid = false;
+                        continue;
+                    }
+                    roleConfig.cpus.push_back((int)cpuId);
+                }
+            }
+
+            if (policyName == "fifo")
+            {
+                roleConfig.policy = THREAD_POLICY_FIFO;
+            }
+            else if (policyName == "rr")
+            {
+                roleConfig.policy = THREAD_POLICY_RR;
+            }
+            else
+            {
+                if (policyName != "default")
+                {
+                    std::cout << "WARNING: Thread configuration line " << lineNumber << " policy \"" << policyName << "\" unknown, using default scheduling" << std::endl;
+                    isValid = false;
+                }
+                roleConfig.policy = THREAD_POLICY_DEFAULT;
+            }
+            roleConfig.priority = priority;
+        }
+
+        // Lock memory now so that pages touched by the real-time threads never fault
+        if (isLockMemoryRequested)
+        {
+#if defined(__linux__)
+            if (mlockall(MCL_CURRENT | MCL_FUTURE) == 0)
+            {
+                lockMemoryResult = "locked (MCL_CURRENT | MCL_FUTURE)";
+            }
+            else
+            {
+                lockMemoryResult = std::string("mlockall failed: ") + std::strerror(errno);
+            }
+#else
+            lockMemoryResult = "not supported on this platform";
+#endif
+        }
+        return isValid;
+    }
+
+    /// <summary>
+    /// Prints the configured thread roles and the process-wide settings in effect
+    /// </summary>
+    void ThreadRoleRegistry::reportStartup()
+    {
+        for (int roleIndex = 0; roleIndex < THREAD_ROLE_COUNT; roleIndex++)
+        {
+            const ThreadRoleConfig& roleConfig = roles[roleIndex];
+            std::cout << "THREAD INFO: " << ROLE_NAMES[roleIndex] << " - CPUs " << describeCpus(roleConfig.cpus) << ", policy " << describePolicy(roleConfig.policy);
+            if (roleConfig.policy != THREAD_POLICY_DEFAULT)
+            {
+                std::cout << " priority " << roleConfig.priority;
+            }
+            std::cout << std::endl;
+        }
+        std::cout << "THREAD INFO: Memory locking " << lockMemoryResult << std::endl;
+
+#if defined(__linux__)
+        // Real-time policies fail without privileges, warn up front rather than on the first stimulation
+        struct rlimit rtLimit;
+        if (getrlimit(RLIMIT_RTPRIO, &rtLimit) == 0)
+        {
+            for (int roleIndex = 0; roleIndex < THREAD_ROLE_COUNT; roleIndex++)
+            {
+                if (roles[roleIndex].policy != THREAD_POLICY_DEFAULT && rtLimit.rlim_cur != RLIM_INFINITY && (rlim_t)roles[roleIndex].priority > rtLimit.rlim_cur)
+                {
+                    std::cout << "WARNING: " << ROLE_NAMES[roleIndex] << " priority " << roles[roleIndex].priority << " exceeds RLIMIT_RTPRIO (" << rtLimit.rlim_cur
+                        << "), it will only be applied with CAP_SYS_NICE" << std::endl;
+                }
+            }
+        }
+#endif
+    }
+
+    /// <summary>
+    /// Names the calling thread after its role and applies the role's configured affinity and scheduling. The effective settings are
+    /// printed the first time each role is applied, failures every time.
+    /// </summary>
+    /// <param name="role">Role of the calling thread</param>
+    void ThreadRoleRegistry::applyRole(ThreadRole role)
+    {
+        if (role >= THREAD_ROLE_COUNT)
+        {
+            return;
+        }
+        const ThreadRoleConfig& roleConfig = roles[role];
+        std::string failure;
+
+#if defined(__linux__)
+        std::string threadName = std::string("bic-") + ROLE_NAMES[role];
+        pthread_setname_np(pthread_self(), threadName.substr(0, 15).c_str());
+
+        if (!roleConfig.cpus.empty())
+        {
+            cpu_set_t cpuSet;
+            CPU_ZERO(&cpuSet);
+            for (int cpu : roleConfig.cpus)
+            {
+                if (cpu >= 0 && cpu < CPU_SETSIZE)
+                {
+                    CPU_SET(cpu, &cpuSet);
+                }
+            }
+            int result = pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet);
+            if (result != 0)
+            {
+                failure += std::string(" affinity: ") + std::strerror(result) + ";";
+            }
+        }
+
+        if (roleConfig.policy != THREAD_POLICY_DEFAULT)
+        {
+            int policy = roleConfig.policy == THREAD_POLICY_FIFO ? SCHED_FIFO : SCHED_RR;
+            sched_param schedParam;
+            schedParam.sched_priority = roleConfig.priority;
+            if (schedParam.sched_priority < sched_get_priority_min(policy))
+            {
+                schedParam.sched_priority = sched_get_priority_min(policy);
+            }
+            else if (schedParam.sched_priority > sched_get_priority_max(policy))
+            {
+                schedParam.sched_priority = sched_get_priority_max(policy);
+            }
+            int result = pthread_setschedparam(pthread_self(), policy, &schedParam);
+            if (result != 0)
+            {
+                failure += std::string(" scheduling: ") + std::strerror(result) + ";";
+            }
+        }
+#elif defined(_WIN32)
+        if (!roleConfig.cpus.empty())
+        {
+            DWORD_PTR affinityMask = 0;
+            for (int cpu : roleConfig.cpus)
+            {
+                if (cpu >= 0 && cpu < (int)(sizeof(DWORD_PTR) * 8))
+                {
+                    affinityMask |= (DWORD_PTR)1 << cpu;
+                }
+            }
+            if (SetThreadAffinityMask(GetCurrentThread(), affinityMask) == 0)
+            {
+                failure += " affinity: error " + std::to_string(GetLastError()) + ";";
+            }
+        }
+
+        if (roleConfig.policy != THREAD_POLICY_DEFAULT && !SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL))
+        {
+            failure += " priority: error " + std::to_string(GetLastError()) + ";";
+        }
+#endif
+
+        std::lock_guard<std::mutex> lock(registryLock);
+        if (!failure.empty())
+        {
+            std::cout << "WARNING: Could not apply thread configuration to " << ROLE_NAMES[role] << " thread -" << failure << std::endl;
+        }
+        if (!roles[role].isReported)
+        {
+            roles[role].isReported = true;
+            std::cout << "THREAD INFO: " << ROLE_NAMES[role] << " thread running with " << describeEffective(role) << std::endl;
+        }
+    }
+
+    /// <summary>
+    /// Reads back the calling thread's scheduling for console output
+    /// </summary>
+    /// <param name="role">Role of the calling thread, its configured CPUs are reported where the platform cannot read them back</param>
+    /// <returns>Description of the effective settings</returns>
+    std::string ThreadRoleRegistry::describeEffective(ThreadRole role)
+    {
+        std::ostringstream description;
+#if defined(__linux__)
+        int policy = 0;
+        sched_param schedParam;
+        pthread_getschedparam(pthread_self(), &policy, &schedParam);
+        description << (policy == SCHED_FIFO ? "SCHED_FIFO" : policy == SCHED_RR ? "SCHED_RR" : "SCHED_OTHER") << " priority " << schedParam.sched_priority;
+
+        cpu_set_t cpuSet;
+        if (pthread_getaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet) == 0)
+        {
+            std::vector<int> cpus;
+            for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+            {
+                if (CPU_ISSET(cpu, &cpuSet))
+                {
+                    cpus.push_back(cpu);
+                }
+            }
+            description << ", CPUs " << describeCpus(cpus);
+        }
+        else
+        {
+            description << ", CPUs " << describeCpus(roles[role].cpus) << " (configured)";
+        }
+#elif defined(_WIN32)
+        description << "priority " << GetThreadPriority(GetCurrentThread()) << ", CPUs " << describeCpus(roles[role].cpus);
+#else
+        description << "OS default scheduling, CPUs " << describeCpus(roles[role].cpus) << " (configured)";
+#endif
+        return description.str();
+    }
+}
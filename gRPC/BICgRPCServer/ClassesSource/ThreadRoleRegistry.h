@@ -0,0 +1,74 @@
+#pragma once
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace BICGRPCHelperNamespace
+{
+    /// <summary>
+    /// Named roles of the server's long-running threads. Each thread declares its role when it starts so the configured
+    /// scheduling can be applied to it.
+    /// </summary>
+    enum ThreadRole
+    {
+        THREAD_ROLE_DATA_CALLBACK = 0,      // Implant API callback thread running onData() and the closed-loop DSP
+        THREAD_ROLE_STIM_TRIGGER,           // triggeredSendStimThread
+        THREAD_ROLE_STIM_SCHEDULER,         // Predictive stimulation timer thread
+        THREAD_ROLE_OPEN_LOOP_STIM,         // Shared open-loop stimulation scheduler thread
+        THREAD_ROLE_STREAM_WRITER,          // Neural stream writer thread
+        THREAD_ROLE_EXECUTOR,               // Shared executor workers and timer: other stream writing and stimulation time logging
+        THREAD_ROLE_ESTIMATOR_FIT,          // Background phase estimator model fitting
+        THREAD_ROLE_SHADOW_EVALUATION,      // Shadow controller evaluation workers
+        THREAD_ROLE_COUNT
+    };
+
+    /// <summary>
+    /// Scheduling policy requested for a thread role
+    /// </summary>
+    enum ThreadSchedulingPolicy
+    {
+        THREAD_POLICY_DEFAULT = 0,          // Leave the thread on the normal time-sharing scheduler
+        THREAD_POLICY_FIFO,                 // SCHED_FIFO on Linux, time-critical priority on Windows
+        THREAD_POLICY_RR                    // SCHED_RR on Linux, time-critical priority on Windows
+    };
+
+    /// <summary>
+    /// Configured scheduling of one thread role
+    /// </summary>
+    struct ThreadRoleConfig
+    {
+        std::vector<int> cpus;                          // CPUs the role may run on, empty for any
+        ThreadSchedulingPolicy policy = THREAD_POLICY_DEFAULT;
+        int priority = 0;                               // Real-time priority, used with FIFO and RR
+        bool isReported = false;                        // Effective settings printed for this role already
+    };
+
+    /// <summary>
+    /// Process-wide registry of thread roles and their scheduling configuration. The configuration is loaded once at startup;
+    /// threads then call applyRole() from their own context. Roles without configuration keep the OS defaults.
+    ///
+    /// Configuration file format, one role per line, '#' starts a comment:
+    ///     role cpus policy priority       e.g. "stimTrigger 3 fifo 90", "dataCallback 2,3 rr 80", "streamWriter - default 0"
+    ///     lockMemory                      lock current and future pages into RAM (mlockall)
+    /// The former role name "logging" is still accepted for "executor", with a warning.
+    /// </summary>
+    class ThreadRoleRegistry
+    {
+    public:
+        static ThreadRoleRegistry& instance();
+        bool loadConfig(const std::string& configPath);
+        void reportStartup();
+        void applyRole(ThreadRole role);
+        static const char* roleName(ThreadRole role);
+
+    private:
+        ThreadRoleRegistry() {}
+        std::string describeEffective(ThreadRole role);
+
+        std::mutex registryLock;
+        ThreadRoleConfig roles[THREAD_ROLE_COUNT];
+        bool isLockMemoryRequested = false;
+        std::string lockMemoryResult = "not requested";
+    };
+}
@@ -0,0 +1,85 @@
+#include "TriggerInputController.h"
+#include <iostream>
+
+namespace BICGRPCHelperNamespace
+{
+    /// <summary>
+    /// Constructs a trigger input controller
+    /// </summary>
+    /// <param name="edge">Edges that cause stimulation</param>
+    /// <param name="delayMicroseconds">Delay from receiving the edge to stimulating, 0 to stimulate at once</param>
+    /// <param name="holdoffSamples">Samples after an accepted edge during which further edges are ignored</param>
+    TriggerInputController::TriggerInputController(TriggerInputEdge edge, uint32_t delayMicroseconds, uint32_t holdoffSamples)
+        : edge(edge), delayMicroseconds(delayMicroseconds), holdoffSamples(holdoffSamples)
+    {
+        telemetryNames = { "inputHigh", "acceptedEdges", "ignoredEdges", "rejectedEdges" };
+        telemetry.assign(telemetryNames.size(), 0);
+    }
+
+    /// <summary>
+    /// Reports the edge counts of the session
+    /// </summary>
+    TriggerInputController::~TriggerInputController()
+    {
+        std::cout << "STIM INFO: Trigger input controller accepted " << acceptedEdges << " edges, ignored " << ignoredEdges << ", rejected " << rejectedEdges
+            << " while a delayed stimulation was pending" << std::endl;
+    }
+
+    /// <summary>
+    /// Looks for trigger input edges in a block. Interpolated samples carry no trigger information and are skipped.
+    /// </summary>
+    /// <param name="theBlock">Block to process</param>
+    /// <param name="decision">Set to trigger at the first accepted edge of the block</param>
+    /// <returns>Always true</returns>
+    bool TriggerInputController::processBlock(const SampleBlock& theBlock, ControllerDecision* decision)
+    {
+        for (uint32_t row = 0; row < theBlock.size(); row++)
+        {
+            if (theBlock.hasFlag(row, SAMPLE_FLAG_INTERPOLATED))
+            {
+                continue;
+            }
+            bool isInputHigh = theBlock.hasFlag(row, SAMPLE_FLAG_INPUT_TRIG_HIGH);
+            samplesSinceEdge++;
+
+            // The first sample only establishes the input level
+            bool isEdge = hasPrevInput && isInputHigh != prevInputHigh
+                && (edge == TRIGGER_INPUT_BOTH || (edge == TRIGGER_INPUT_RISING) == isInputHigh);
+            hasPrevInput = true;
+            prevInputHigh = isInputHigh;
+            if (!isEdge)
+            {
+                continue;
+            }
+
+            if (decision->triggerStimulation || (hasAcceptedEdge && samplesSinceEdge <= holdoffSamples))
+            {
+                ignoredEdges++;
+                continue;
+            }
+            decision->triggerStimulation = true;
+            decision->triggerSampleIndex = row;
+            decision->triggerDelayMicroseconds = delayMicroseconds;
+            hasAcceptedEdge = true;
+            samplesSinceEdge = 0;
+            acceptedEdges++;
+        }
+
+        telemetry[0] = prevInputHigh ? 1 : 0;
+        telemetry[1] = (double)acceptedEdges;
+        telemetry[2] = (double)ignoredEdges;
+        telemetry[3] = (double)rejectedEdges;
+        return true;
+    }
+
+    /// <summary>
+    /// Moves the edge accepted by the last processBlock() call to the rejected count, its stimulation was not scheduled
+    /// </summary>
+    void TriggerInputController::onTriggerRejected()
+    {
+        acceptedEdges--;
+        rejectedEdges++;
+        telemetry[1] = (double)acceptedEdges;
+        telemetry[3] = (double)rejectedEdges;
+    }
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "ControllerPlugin.h"
+
+namespace BICGRPCHelperNamespace
+{
+    /// <summary>
+    /// Edges of the external measurement trigger input that cause stimulation. Values match the gRPC TriggerInputEdge enum.
+    /// </summary>
+    enum TriggerInputEdge
+    {
+        TRIGGER_INPUT_RISING = 0,
+        TRIGGER_INPUT_FALLING = 1,
+        TRIGGER_INPUT_BOTH = 2
+    };
+
+    /// <summary>
+    /// Block controller that stimulates on edges of the external measurement trigger input, optionally after a fixed delay, so a TTL
+    /// can drive stimulation without a client round trip
+    /// </summary>
+    class TriggerInputController : public IBlockController
+    {
+    public:
+        TriggerInputController(TriggerInputEdge edge, uint32_t delayMicroseconds, uint32_t holdoffSamples);
+        ~TriggerInputController();
+        const char* getName() const override { return "TriggerInput"; }
+        BlockControllerKind getKind() const override { return BLOCK_CONTROLLER_TRIGGER_INPUT; }
+        bool hasDelayedTriggers() const override { return delayMicroseconds > 0; }
+        bool processBlock(const SampleBlock& theBlock, ControllerDecision* decision) override;
+        void onTriggerRejected() override;
+        const std::vector<std::string>& getTelemetryNames() const override { return telemetryNames; }
+        const std::vector<double>& getTelemetry() const override { return telemetry; }
+
+    private:
+        TriggerInputEdge edge;
+        uint32_t delayMicroseconds;
+        uint32_t holdoffSamples;                    // Edges within this many samples of the last accepted edge are ignored
+
+        bool hasPrevInput = false;
+        bool prevInputHigh = false;
+        uint32_t samplesSinceEdge = 0;
+        bool hasAcceptedEdge = false;
+        uint64_t acceptedEdges = 0;                 // Edges that triggered stimulation
+        uint64_t ignoredEdges = 0;                  // Edges inside the holdoff or after another edge in the same block
+        uint64_t rejectedEdges = 0;                 // Edges that triggered while the previous delayed stimulation was still pending
+
+        std::vector<std::string> telemetryNames;
+        std::vector<double> telemetry;
+    };
+}
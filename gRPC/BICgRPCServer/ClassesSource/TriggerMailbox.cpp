@@ -0,0 +1,150 @@
+#include "TriggerMailbox.h"
+#include <thread>
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#include <intrin.h>
+#endif
+
+namespace BICGRPCHelperNamespace
+{
+    // Polling iterations between clock reads while spinning
+    static const uint32_t SPIN_CHECK_INTERVAL = 64;
+
+    /// <summary>
+    /// Hints to the processor that the thread is in a polling loop
+    /// </summary>
+    static inline void spinPause()
+    {
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+        _mm_pause();
+#elif defined(__i386__) || defined(__x86_64__)
+        __builtin_ia32_pause();
+#else
+        std::this_thread::yield();
+#endif
+    }
+
+    /// <summary>
+    /// Constructs an empty, open mailbox
+    /// </summary>
+    /// <param name="waitMode">Whether wait() sleeps immediately or polls first</param>
+    /// <param name="spinMicroseconds">Spin mode polling time before falling back to sleeping, 0 to poll until a trigger arrives</param>
+    TriggerMailbox::TriggerMailbox(TriggerWaitMode waitMode, uint32_t spinMicroseconds)
+        : waitMode(waitMode), spinBudget(spinMicroseconds), postedSequence(0), lastPostTicks(0), isWaiterAsleep(false), isClosed(false), spinDeliveryCount(0)
+    {
+    }
+
+    /// <summary>
+    /// Posts a trigger. Never blocks unless the consumer is asleep, in which case the wake lock is held only long enough to notify.
+    /// </summary>
+    void TriggerMailbox::post()
+    {
+        lastPostTicks.store(std::chrono::steady_clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+        postedSequence.fetch_add(1, std::memory_order_seq_cst);
+
+        // Sequentially consistent with the consumer's flag store and sequence re-check, so either it sees this post or we see it asleep
+        if (isWaiterAsleep.load(std::memory_order_seq_cst))
+        {
+            wakeLock.lock();
+            wakeLock.unlock();
+            wakeNotify.notify_one();
+        }
+    }
+
+    /// <summary>
+    /// Waits for the next trigger. Returns immediately if a trigger was posted since the previous delivery.
+    /// </summary>
+    /// <param name="delivery">Filled in with the delivered trigger</param>
+    /// <returns>True if a trigger was delivered, false if the mailbox was closed</returns>
+    bool TriggerMailbox::wait(TriggerDelivery* delivery)
+    {
+        if (take(delivery))
+        {
+            return true;
+        }
+
+        // Poll the sequence counter
+        if (waitMode == TRIGGER_WAIT_SPIN)
+        {
+            std::chrono::steady_clock::time_point spinEnd = std::chrono::steady_clock::now() + spinBudget;
+            uint32_t spinCount = 0;
+            while (!isClosed.load(std::memory_order_relaxed))
+            {
+                if (take(delivery))
+                {
+                    spinDeliveryCount.fetch_add(1, std::memory_order_relaxed);
+                    return true;
+                }
+                spinPause();
+                if (++spinCount % SPIN_CHECK_INTERVAL == 0 && spinBudget.count() > 0 && std::chrono::steady_clock::now() >= spinEnd)
+                {
+                    break;
+                }
+            }
+        }
+
+        // Blocking wait, predicated on the sequence counter so neither early nor spurious wakeups drop a trigger
+        std::unique_lock<std::mutex> lock(wakeLock);
+        isWaiterAsleep.store(true, std::memory_order_seq_cst);
+        while (!take(delivery))
+        {
+            if (isClosed.load(std::memory_order_seq_cst))
+            {
+                isWaiterAsleep.store(false, std::memory_order_seq_cst);
+                return false;
+            }
+            wakeNotify.wait(lock);
+        }
+        isWaiterAsleep.store(false, std::memory_order_seq_cst);
+        return true;
+    }
+
+    /// <summary>
+    /// Closes the mailbox, releasing a waiting consumer. Triggers still pending are discarded.
+    /// </summary>
+    void TriggerMailbox::close()
+    {
+        wakeLock.lock();
+        isClosed.store(true, std::memory_order_seq_cst);
+        wakeLock.unlock();
+        wakeNotify.notify_all();
+    }
+
+    /// <summary>
+    /// Snapshot of the mailbox counters. The delivery counts are only exact once the consumer has stopped.
+    /// </summary>
+    /// <returns>Posted and delivered trigger counts</returns>
+    TriggerMailboxStats TriggerMailbox::getStats() const
+    {
+        TriggerMailboxStats stats;
+        stats.posted = postedSequence.load(std::memory_order_relaxed);
+        stats.delivered = deliveredCount;
+        stats.spinDeliveries = spinDeliveryCount.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+    /// <summary>
+    /// Consumer side: takes every trigger posted since the previous delivery, if any
+    /// </summary>
+    /// <param name="delivery">Filled in when a trigger is taken</param>
+    /// <returns>True if a trigger was taken</returns>
+    bool TriggerMailbox::take(TriggerDelivery* delivery)
+    {
+        if (isClosed.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+
+        uint64_t currentSequence = postedSequence.load(std::memory_order_seq_cst);
+        if (currentSequence == takenSequence)
+        {
+            return false;
+        }
+
+        delivery->sequence = currentSequence;
+        delivery->coalesced = currentSequence - takenSequence - 1;
+        delivery->postTime = std::chrono::steady_clock::time_point(std::chrono::steady_clock::duration(lastPostTicks.load(std::memory_order_relaxed)));
+        takenSequence = currentSequence;
+        deliveredCount++;
+        return true;
+    }
+}
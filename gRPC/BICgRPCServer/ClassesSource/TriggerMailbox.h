@@ -0,0 +1,69 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+namespace BICGRPCHelperNamespace
+{
+    /// <summary>
+    /// How the stimulation thread waits for a trigger. Values match the gRPC TriggerWaitMode enum.
+    /// </summary>
+    enum TriggerWaitMode
+    {
+        TRIGGER_WAIT_BLOCKING = 0,      // Sleep on a condition variable until a trigger is posted
+        TRIGGER_WAIT_SPIN = 1           // Poll the trigger sequence counter, falling back to the blocking wait once the spin budget is spent
+    };
+
+    /// <summary>
+    /// A trigger handed from the processing thread to the stimulation thread
+    /// </summary>
+    struct TriggerDelivery
+    {
+        uint64_t sequence;                                  // Sequence number of the newest trigger taken
+        uint64_t coalesced;                                 // Additional triggers posted since the previous delivery and folded into this one
+        std::chrono::steady_clock::time_point postTime;     // Time the newest trigger was posted
+    };
+
+    /// <summary>
+    /// Running counts of a trigger mailbox
+    /// </summary>
+    struct TriggerMailboxStats
+    {
+        uint64_t posted = 0;            // Triggers posted
+        uint64_t delivered = 0;         // Deliveries taken by the waiting thread
+        uint64_t spinDeliveries = 0;    // Deliveries picked up while polling, without sleeping
+    };
+
+    /// <summary>
+    /// Single-consumer trigger mailbox. Posting bumps an atomic sequence counter, so a trigger posted while the consumer is busy
+    /// stays pending and is delivered by its next wait instead of being lost. Triggers posted between two waits are delivered once,
+    /// with the number folded together reported in the delivery. The consumer either sleeps on a condition variable or polls the
+    /// counter for a bounded time first; the producer only takes the lock when the consumer is actually asleep.
+    /// </summary>
+    class TriggerMailbox
+    {
+    public:
+        TriggerMailbox(TriggerWaitMode waitMode, uint32_t spinMicroseconds);
+        void post(void);
+        bool wait(TriggerDelivery* delivery);
+        void close(void);
+        TriggerMailboxStats getStats() const;
+
+    private:
+        bool take(TriggerDelivery* delivery);
+
+        TriggerWaitMode waitMode;
+        std::chrono::microseconds spinBudget;                   // Polling time before sleeping in spin mode, zero to poll indefinitely
+        std::atomic<uint64_t> postedSequence;
+        std::atomic<int64_t> lastPostTicks;                     // steady_clock ticks of the newest post
+        std::atomic<bool> isWaiterAsleep;
+        std::atomic<bool> isClosed;
+        uint64_t takenSequence = 0;                             // Only touched by the consumer
+        uint64_t deliveredCount = 0;                            // Only touched by the consumer
+        std::atomic<uint64_t> spinDeliveryCount;
+        std::mutex wakeLock;
+        std::condition_variable wakeNotify;
+    };
+}
@@ -0,0 +1,148 @@
+// Unit tests of the telemetry read cache and the impedance cache
+
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "UnitTest.h"
+#include "../ClassesSource/ImpedanceCache.h"
+#include "../ClassesSource/TelemetryReadCache.h"
+
+using namespace BICGRPCHelperNamespace;
+
+static void testReadUsesFreshPushedValue()
+{
+    TelemetryReadCache theCache;
+    UNIT_CHECK(!theCache.latest(TELEMETRY_HUMIDITY).isValid);
+
+    theCache.update(TELEMETRY_HUMIDITY, 41.5);
+    uint32_t deviceReads = 0;
+    TelemetryReading theReading = theCache.read(TELEMETRY_HUMIDITY, std::chrono::milliseconds(1000), [&] { deviceReads++; return 0.0; });
+    UNIT_CHECK(deviceReads == 0);
+    UNIT_CHECK(theReading.isValid);
+    UNIT_CHECK(theReading.isCached);
+    UNIT_CHECK(theReading.value == 41.5);
+
+    // A zero bound always reads the device
+    theReading = theCache.read(TELEMETRY_HUMIDITY, std::chrono::milliseconds(0), [&] { deviceReads++; return 43.0; });
+    UNIT_CHECK(deviceReads == 1);
+    UNIT_CHECK(!theReading.isCached);
+    UNIT_CHECK(theReading.value == 43.0);
+    UNIT_CHECK(theCache.latest(TELEMETRY_HUMIDITY).value == 43.0);
+}
+
+static void testStaleValueIsReadAgain()
+{
+    TelemetryReadCache theCache;
+    theCache.update(TELEMETRY_TEMPERATURE, 36.0);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    uint32_t deviceReads = 0;
+    TelemetryReading theReading = theCache.read(TELEMETRY_TEMPERATURE, std::chrono::milliseconds(5), [&] { deviceReads++; return 37.0; });
+    UNIT_CHECK(deviceReads == 1);
+    UNIT_CHECK(theReading.value == 37.0);
+}
+
+static void testConcurrentReadsShareOneDeviceCall()
+{
+    TelemetryReadCache theCache;
+    std::atomic<uint32_t> deviceReads{ 0 };
+    std::atomic<bool> isReadStarted{ false };
+    std::atomic<bool> isReadReleased{ false };
+    std::function<double()> slowRead = [&] {
+        deviceReads++;
+        isReadStarted = true;
+        while (!isReadReleased)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return 36.6;
+    };
+
+    TelemetryReading firstReading;
+    std::thread firstReader([&] { firstReading = theCache.read(TELEMETRY_TEMPERATURE, std::chrono::milliseconds(0), slowRead); });
+    UNIT_CHECK(UnitTest::waitFor([&] { return (bool)isReadStarted; }, std::chrono::milliseconds(2000)));
+
+    // Readers arriving during the device call join it
+    const uint32_t joinerCount = 4;
+    std::vector<TelemetryReading> joinedReadings(joinerCount);
+    std::vector<std::thread> joiners;
+    for (uint32_t i = 0; i < joinerCount; i++)
+    {
+        joiners.emplace_back([&, i] { joinedReadings[i] = theCache.read(TELEMETRY_TEMPERATURE, std::chrono::milliseconds(0), slowRead); });
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    isReadReleased = true;
+    firstReader.join();
+    for (std::thread& aJoiner : joiners)
+    {
+        aJoiner.join();
+    }
+
+    UNIT_CHECK(deviceReads == 1);
+    UNIT_CHECK(!firstReading.isCached);
+    UNIT_CHECK(firstReading.value == 36.6);
+    for (const TelemetryReading& aReading : joinedReadings)
+    {
+        UNIT_CHECK(aReading.isCached);
+        UNIT_CHECK(aReading.value == 36.6);
+    }
+}
+
+static void testDeviceErrorIsRethrown()
+{
+    TelemetryReadCache theCache;
+    bool isThrown = false;
+    try
+    {
+        theCache.read(TELEMETRY_IMPLANT_VOLTAGE, std::chrono::milliseconds(100), []() -> double { throw std::runtime_error("implant not connected"); });
+    }
+    catch (const std::runtime_error&)
+    {
+        isThrown = true;
+    }
+    UNIT_CHECK(isThrown);
+    UNIT_CHECK(!theCache.latest(TELEMETRY_IMPLANT_VOLTAGE).isValid);
+
+    // The failed read is not remembered
+    TelemetryReading theReading = theCache.read(TELEMETRY_IMPLANT_VOLTAGE, std::chrono::milliseconds(100), [] { return 3.3; });
+    UNIT_CHECK(theReading.isValid);
+    UNIT_CHECK(theReading.value == 3.3);
+}
+
+static void testImpedanceLookupHonoursAge()
+{
+    ImpedanceCache theCache;
+    ImpedanceMeasurement theMeasurement;
+    UNIT_CHECK(!theCache.lookup(3, std::chrono::milliseconds(1000), &theMeasurement));
+
+    std::chrono::steady_clock::time_point measurementStart = std::chrono::steady_clock::now() - std::chrono::milliseconds(5);
+    ImpedanceMeasurement stored = theCache.store(3, 1250.0, measurementStart);
+    UNIT_CHECK(stored.measurementNs >= 5000000);
+
+    UNIT_CHECK(theCache.lookup(3, std::chrono::milliseconds(1000), &theMeasurement));
+    UNIT_CHECK(theMeasurement.impedance == 1250.0);
+    UNIT_CHECK(theMeasurement.timeStamp == stored.timeStamp);
+
+    // Other channels, a zero bound and old measurements miss
+    UNIT_CHECK(!theCache.lookup(4, std::chrono::milliseconds(1000), &theMeasurement));
+    UNIT_CHECK(!theCache.lookup(3, std::chrono::milliseconds(0), &theMeasurement));
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    UNIT_CHECK(!theCache.lookup(3, std::chrono::milliseconds(5), &theMeasurement));
+
+    // A new measurement replaces the old one
+    theCache.store(3, 990.0, std::chrono::steady_clock::now());
+    UNIT_CHECK(theCache.lookup(3, std::chrono::milliseconds(1000), &theMeasurement));
+    UNIT_CHECK(theMeasurement.impedance == 990.0);
+}
+
+int main()
+{
+    UNIT_RUN(testReadUsesFreshPushedValue);
+    UNIT_RUN(testStaleValueIsReadAgain);
+    UNIT_RUN(testConcurrentReadsShareOneDeviceCall);
+    UNIT_RUN(testDeviceErrorIsRethrown);
+    UNIT_RUN(testImpedanceLookupHonoursAge);
+    return UnitTest::report();
+}
@@ -0,0 +1,179 @@
+// Unit tests of the shared executor: pool size limits, per-kind worker limits, timers and SerialTask ordering.
+// The executor is a process-wide singleton, so the tests share one pool configured at the start of main().
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+#include "UnitTest.h"
+#include "../ClassesSource/SharedExecutor.h"
+
+using namespace BICGRPCHelperNamespace;
+
+static const uint32_t TEST_WORKERS = 3;
+
+static void testConfigureRejectsSingleWorker()
+{
+    // The pool is not started yet, so only the size check can refuse the change
+    UNIT_CHECK(!SharedExecutor::instance().configure(1));
+    UNIT_CHECK(SharedExecutor::instance().configure(TEST_WORKERS));
+}
+
+static void testDrainsLeaveAWorkerFree()
+{
+    SharedExecutor& theExecutor = SharedExecutor::instance();
+    std::atomic<bool> isReleased{ false };
+    std::atomic<uint32_t> runningDrains{ 0 };
+    std::atomic<uint32_t> maxRunningDrains{ 0 };
+    std::atomic<uint32_t> finishedDrains{ 0 };
+    ExecutorTaskStats statsBefore = theExecutor.getStats(EXECUTOR_TASK_STREAM_DRAIN);
+
+    // Drains that block like a gRPC write to a client that stopped reading
+    const uint32_t drainCount = 5;
+    for (uint32_t i = 0; i < drainCount; i++)
+    {
+        theExecutor.submit(EXECUTOR_TASK_STREAM_DRAIN, [&] {
+            uint32_t running = ++runningDrains;
+            uint32_t maxRunning = maxRunningDrains;
+            while (running > maxRunning && !maxRunningDrains.compare_exchange_weak(maxRunning, running))
+            {
+            }
+            while (!isReleased)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            runningDrains--;
+            finishedDrains++;
+        });
+    }
+    UNIT_CHECK(UnitTest::waitFor([&] { return runningDrains == TEST_WORKERS - 1; }, std::chrono::milliseconds(2000)));
+
+    // Other kinds of task still get a worker
+    std::atomic<bool> isLogWritten{ false };
+    theExecutor.submit(EXECUTOR_TASK_STIM_TIME_LOG, [&] { isLogWritten = true; });
+    UNIT_CHECK(UnitTest::waitFor([&] { return (bool)isLogWritten; }, std::chrono::milliseconds(2000)));
+
+    isReleased = true;
+    UNIT_CHECK(UnitTest::waitFor([&] { return finishedDrains == drainCount; }, std::chrono::milliseconds(2000)));
+    UNIT_CHECK(maxRunningDrains == TEST_WORKERS - 1);
+    ExecutorTaskStats statsAfter = theExecutor.getStats(EXECUTOR_TASK_STREAM_DRAIN);
+    UNIT_CHECK(statsAfter.deferred - statsBefore.deferred >= drainCount - (TEST_WORKERS - 1));
+    UNIT_CHECK(UnitTest::waitFor([&] { return theExecutor.getStats(EXECUTOR_TASK_STREAM_DRAIN).completed - statsBefore.completed == drainCount; }, std::chrono::milliseconds(2000)));
+}
+
+static void testTimerRunsAtDeadline()
+{
+    SharedExecutor& theExecutor = SharedExecutor::instance();
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(30);
+    std::atomic<bool> hasRun{ false };
+    std::chrono::steady_clock::time_point runAt;
+    std::mutex runAtLock;
+    uint64_t timerId = theExecutor.schedule(EXECUTOR_TASK_STIM_TIME_LOG, deadline, [&] {
+        std::lock_guard<std::mutex> lock(runAtLock);
+        runAt = std::chrono::steady_clock::now();
+        hasRun = true;
+    });
+    UNIT_CHECK(timerId != 0);
+    UNIT_CHECK(UnitTest::waitFor([&] { return (bool)hasRun; }, std::chrono::milliseconds(2000)));
+    {
+        std::lock_guard<std::mutex> lock(runAtLock);
+        UNIT_CHECK(runAt >= deadline);
+    }
+
+    // A timer that has fired can no longer be cancelled
+    UNIT_CHECK(!theExecutor.cancel(timerId));
+}
+
+static void testCancelledTimerNeverRuns()
+{
+    SharedExecutor& theExecutor = SharedExecutor::instance();
+    std::atomic<bool> hasRun{ false };
+    uint64_t timerId = theExecutor.schedule(EXECUTOR_TASK_STIM_TIME_LOG, std::chrono::steady_clock::now() + std::chrono::milliseconds(50), [&] { hasRun = true; });
+    UNIT_CHECK(theExecutor.cancel(timerId));
+    UNIT_CHECK(!theExecutor.cancel(timerId));
+    std::this_thread::sleep_for(std::chrono::milliseconds(150));
+    UNIT_CHECK(!hasRun);
+}
+
+static void testSerialTaskRunsAfterEverySignal()
+{
+    std::atomic<uint32_t> produced{ 0 };
+    std::atomic<uint32_t> consumed{ 0 };
+    std::atomic<bool> isRunning{ false };
+    std::atomic<bool> hasOverlapped{ false };
+    std::atomic<uint32_t> runs{ 0 };
+
+    SerialTask theTask(EXECUTOR_TASK_STIM_TIME_LOG, [&] {
+        if (isRunning.exchange(true))
+        {
+            hasOverlapped = true;
+        }
+        runs++;
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        consumed = (uint32_t)produced;
+        isRunning = false;
+    });
+
+    // Signals before open() are ignored
+    theTask.signal();
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    UNIT_CHECK(runs == 0);
+
+    theTask.open();
+    const uint32_t signalCount = 50;
+    for (uint32_t i = 1; i <= signalCount; i++)
+    {
+        produced = i;
+        theTask.signal();
+        if (i % 10 == 0)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    // The last signal is always followed by a run that sees everything produced, and runs never overlap
+    UNIT_CHECK(UnitTest::waitFor([&] { return consumed == signalCount; }, std::chrono::milliseconds(2000)));
+    UNIT_CHECK(!hasOverlapped);
+    UNIT_CHECK(runs <= signalCount);
+
+    // Closed tasks ignore signals
+    theTask.close();
+    uint32_t runsAtClose = runs;
+    theTask.signal();
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    UNIT_CHECK(runs == runsAtClose);
+}
+
+static void testSerialTaskSignalAtDefersTheRun()
+{
+    std::atomic<uint32_t> runs{ 0 };
+    SerialTask theTask(EXECUTOR_TASK_STIM_TIME_LOG, [&] { runs++; });
+    theTask.open();
+
+    // Batched signals share one timed run
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(40);
+    theTask.signalAt(deadline);
+    theTask.signalAt(deadline);
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    UNIT_CHECK(runs == 0);
+    UNIT_CHECK(UnitTest::waitFor([&] { return runs == 1; }, std::chrono::milliseconds(2000)));
+
+    // signal() moves a timed run forward
+    theTask.signalAt(std::chrono::steady_clock::now() + std::chrono::seconds(10));
+    theTask.signal();
+    UNIT_CHECK(UnitTest::waitFor([&] { return runs == 2; }, std::chrono::milliseconds(2000)));
+    theTask.close();
+    UNIT_CHECK(runs == 2);
+}
+
+int main()
+{
+    UNIT_RUN(testConfigureRejectsSingleWorker);
+    UNIT_RUN(testDrainsLeaveAWorkerFree);
+    UNIT_RUN(testTimerRunsAtDeadline);
+    UNIT_RUN(testCancelledTimerNeverRuns);
+    UNIT_RUN(testSerialTaskRunsAfterEverySignal);
+    UNIT_RUN(testSerialTaskSignalAtDefersTheRun);
+    return UnitTest::report();
+}
@@ -0,0 +1,306 @@
+// Unit tests of the neural signal processing path: gap interpolation, the phase estimators and DSP pipelines
+
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "UnitTest.h"
+#include "../ClassesSource/ClosedLoopController.h"
+#include "../ClassesSource/DspPipeline.h"
+#include "../ClassesSource/GapInterpolator.h"
+#include "../ClassesSource/PhaseEstimator.h"
+#include "../ClassesSource/SampleBlock.h"
+
+using namespace BICGRPCHelperNamespace;
+
+static const double PI = 3.14159265358979323846;
+static const double SAMPLING_RATE = 1000;
+
+// ************************* Gap Interpolation *************************
+
+// Fills a three-sample gap on two channels between a history of (previous, last) and the next received sample
+static uint32_t fillTestGap(GapInterpolator* theInterpolator, InterpolationMethod method, SampleBlock* theBlock, const double* previous, const double* last, const double* next)
+{
+    theInterpolator->configure(method, 4);
+    theInterpolator->resetSession(2);
+    theInterpolator->updateHistory(previous, 2);
+    theInterpolator->updateHistory(last, 2);
+    return theInterpolator->fillGap(theBlock, 100, 3, next);
+}
+
+static void testLinearGapFill()
+{
+    GapInterpolator theInterpolator;
+    SampleBlock theBlock(2, 8);
+    theBlock.appendSample();
+    const double previous[] = { 0, 0 };
+    const double last[] = { 10, -4 };
+    const double next[] = { 30, 4 };
+    uint32_t firstRow = fillTestGap(&theInterpolator, INTERPOLATION_LINEAR, &theBlock, previous, last, next);
+
+    UNIT_CHECK(firstRow == 1);
+    UNIT_CHECK(theBlock.size() == 4);
+    for (uint32_t k = 0; k < 3; k++)
+    {
+        UNIT_CHECK(theBlock.sampleCounter[firstRow + k] == 100 + k);
+        UNIT_CHECK(theBlock.hasFlag(firstRow + k, SAMPLE_FLAG_INTERPOLATED));
+        UNIT_CHECK(std::fabs(theBlock.measurement(0, firstRow + k) - (10 + 5.0 * (k + 1))) < 1e-9);
+        UNIT_CHECK(std::fabs(theBlock.measurement(1, firstRow + k) - (-4 + 2.0 * (k + 1))) < 1e-9);
+    }
+
+    // The last synthesized sample becomes the start of the next gap
+    UNIT_CHECK(std::fabs(theInterpolator.lastSample()[0] - 25) < 1e-9);
+}
+
+static void testHoldLastGapFill()
+{
+    GapInterpolator theInterpolator;
+    SampleBlock theBlock(2, 8);
+    const double previous[] = { 0, 0 };
+    const double last[] = { 10, -4 };
+    const double next[] = { 30, 4 };
+    uint32_t firstRow = fillTestGap(&theInterpolator, INTERPOLATION_HOLD_LAST, &theBlock, previous, last, next);
+    for (uint32_t k = 0; k < 3; k++)
+    {
+        UNIT_CHECK(theBlock.measurement(0, firstRow + k) == 10);
+        UNIT_CHECK(theBlock.measurement(1, firstRow + k) == -4);
+    }
+}
+
+static void testCubicGapFollowsSlope()
+{
+    // On a straight line the entry slope and the secant agree, so the spline reproduces the line
+    GapInterpolator theInterpolator;
+    SampleBlock theBlock(2, 8);
+    const double previous[] = { 5, 1 };
+    const double last[] = { 10, 2 };
+    const double next[] = { 30, 6 };
+    uint32_t firstRow = fillTestGap(&theInterpolator, INTERPOLATION_CUBIC_HERMITE, &theBlock, previous, last, next);
+    for (uint32_t k = 0; k < 3; k++)
+    {
+        UNIT_CHECK(std::fabs(theBlock.measurement(0, firstRow + k) - (10 + 5.0 * (k + 1))) < 1e-9);
+        UNIT_CHECK(std::fabs(theBlock.measurement(1, firstRow + k) - (2 + 1.0 * (k + 1))) < 1e-9);
+    }
+}
+
+static void testGapStatistics()
+{
+    GapInterpolator theInterpolator;
+    SampleBlock theBlock(2, 8);
+    const double previous[] = { 0, 0 };
+    const double last[] = { 10, -4 };
+    const double next[] = { 30, 4 };
+    fillTestGap(&theInterpolator, INTERPOLATION_LINEAR, &theBlock, previous, last, next);
+    UNIT_CHECK(theInterpolator.canFill(4));
+    UNIT_CHECK(!theInterpolator.canFill(5));
+    theInterpolator.recordDroppedGap(70);
+
+    const InterpolationStatistics& statistics = theInterpolator.getStatistics();
+    UNIT_CHECK(statistics.interpolatedSamples == 3);
+    UNIT_CHECK(statistics.gapsFilled == 1);
+    UNIT_CHECK(statistics.gapsDropped == 1);
+    UNIT_CHECK(statistics.droppedSamples == 70);
+    UNIT_CHECK(statistics.longestGap == 70);
+    UNIT_CHECK(statistics.gapLengthHistogram[2] == 1);
+    UNIT_CHECK(statistics.gapLengthHistogram[7] == 1);
+
+    // A new session starts from clean statistics
+    theInterpolator.resetSession(2);
+    UNIT_CHECK(theInterpolator.getStatistics().gapsFilled == 0);
+}
+
+// ************************* Phase Estimation *************************
+
+// Mean absolute phase error in degrees of an estimator tracking a 20 Hz sine passed through the closed-loop band-pass
+static double measurePhaseError(PhaseEstimatorType type, double* frequency)
+{
+    const double sineFrequency = 20;
+    ClosedLoopControllerConfig band;
+    IPhaseEstimator* theEstimator = createPhaseEstimator(type, SAMPLING_RATE, 0, 0, band.filtCoeff_B, band.filtCoeff_A);
+
+    // Phase shift of the band-pass at the sine frequency, the estimators report the phase of the filtered signal
+    std::complex<double> z = std::polar(1.0, -2 * PI * sineFrequency / SAMPLING_RATE);
+    std::complex<double> zPower = 1;
+    std::complex<double> numerator = 0;
+    std::complex<double> denominator = 0;
+    for (size_t k = 0; k < band.filtCoeff_B.size(); k++)
+    {
+        numerator += band.filtCoeff_B[k] * zPower;
+        denominator += band.filtCoeff_A[k] * zPower;
+        zPower *= z;
+    }
+    double filterShift = std::arg(numerator / denominator) * 180 / PI;
+
+    std::vector<double> bandInput(band.filtCoeff_B.size(), 0);
+    std::vector<double> bandOutput(band.filtCoeff_A.size(), 0);
+    std::vector<double> filtHistory(4, 0);
+    double totalError = 0;
+    uint32_t measuredSamples = 0;
+    for (uint32_t i = 0; i < 6000; i++)
+    {
+        std::copy_backward(bandInput.begin(), bandInput.end() - 1, bandInput.end());
+        std::copy_backward(bandOutput.begin(), bandOutput.end() - 1, bandOutput.end());
+        bandInput[0] = std::sin(2 * PI * sineFrequency * i / SAMPLING_RATE);
+        double filtered = 0;
+        for (size_t k = 0; k < bandInput.size(); k++)
+        {
+            filtered += band.filtCoeff_B[k] * bandInput[k];
+        }
+        for (size_t k = 1; k < bandOutput.size(); k++)
+        {
+            filtered -= band.filtCoeff_A[k] * bandOutput[k];
+        }
+        bandOutput[0] = filtered;
+        std::copy_backward(filtHistory.begin(), filtHistory.end() - 1, filtHistory.end());
+        filtHistory[0] = filtered;
+
+        PhaseEstimatorInput estimatorInput = { &filtHistory, bandInput[0], i };
+        double phase = theEstimator->estimatePhase(estimatorInput);
+
+        // Give the forecast estimator's refit thread a chance to run
+        if (i % 500 == 0)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+        if (i >= 4000)
+        {
+            double truePhase = std::fmod((360 * sineFrequency * i / SAMPLING_RATE) + filterShift + 720, 360);
+            totalError += std::fabs(std::fmod(phase - truePhase + 540, 360) - 180);
+            measuredSamples++;
+        }
+    }
+    *frequency = theEstimator->getFrequency();
+    UNIT_CHECK(theEstimator->getCost().samples == 6000);
+    delete theEstimator;
+    return totalError / measuredSamples;
+}
+
+static void testPhaseEstimatorsTrackASine()
+{
+    double frequency = 0;
+
+    // The zero-crossing estimator extrapolates from the last anchor and lags the extrema by a sample
+    UNIT_CHECK(measurePhaseError(PHASE_ESTIMATOR_ZERO_CROSSING, &frequency) < 15);
+    UNIT_CHECK(std::fabs(frequency - 20) < 2);
+
+    UNIT_CHECK(measurePhaseError(PHASE_ESTIMATOR_FIR_HILBERT, &frequency) < 1);
+    UNIT_CHECK(std::fabs(frequency - 20) < 0.1);
+    UNIT_CHECK(measurePhaseError(PHASE_ESTIMATOR_ECHT, &frequency) < 1);
+    UNIT_CHECK(std::fabs(frequency - 20) < 0.1);
+    UNIT_CHECK(measurePhaseError(PHASE_ESTIMATOR_AR_FORECAST, &frequency) < 1);
+    UNIT_CHECK(std::fabs(frequency - 20) < 0.1);
+}
+
+// ************************* DSP Pipelines *************************
+
+static DspStageConfig createThresholdStage(double level, bool isRisingCrossing)
+{
+    DspStageConfig theStage;
+    theStage.type = DSP_STAGE_THRESHOLD;
+    theStage.level = level;
+    theStage.isRisingCrossing = isRisingCrossing;
+    return theStage;
+}
+
+static void testPipelineCompileErrors()
+{
+    std::string errorMessage;
+    DspPipelineConfig config;
+    UNIT_CHECK(DspPipeline::compile(config, SAMPLING_RATE, &errorMessage) == NULL);
+    UNIT_CHECK(errorMessage == "Pipeline has no stages");
+
+    config.stages.push_back(createThresholdStage(5, true));
+    UNIT_CHECK(DspPipeline::compile(config, 0, &errorMessage) == NULL);
+    UNIT_CHECK(errorMessage == "Sampling rate unknown");
+
+    // Without a threshold the pipeline could never trigger
+    DspStageConfig envelope;
+    envelope.type = DSP_STAGE_ENVELOPE;
+    config.stages[0] = envelope;
+    UNIT_CHECK(DspPipeline::compile(config, SAMPLING_RATE, &errorMessage) == NULL);
+
+    DspStageConfig badFilter;
+    badFilter.type = DSP_STAGE_SOS_FILTER;
+    badFilter.sections = { 1, 0, 0, 1, 0 };
+    config.stages[0] = badFilter;
+    config.stages.push_back(createThresholdStage(5, true));
+    UNIT_CHECK(DspPipeline::compile(config, SAMPLING_RATE, &errorMessage) == NULL);
+    UNIT_CHECK(errorMessage.find("six coefficients") != std::string::npos);
+}
+
+static void testPipelineTriggersOnCrossing()
+{
+    DspPipelineConfig config;
+    config.sensingChannel = 1;
+    config.refractorySamples = 10;
+    DspStageConfig passThrough;
+    passThrough.type = DSP_STAGE_SOS_FILTER;
+    passThrough.sections = { 2, 0, 0, 2, 0, 0 };
+    config.stages.push_back(passThrough);
+    config.stages.push_back(createThresholdStage(5, true));
+    std::string errorMessage;
+    DspPipeline* thePipeline = DspPipeline::compile(config, SAMPLING_RATE, &errorMessage);
+    UNIT_CHECK(thePipeline != NULL);
+    if (thePipeline == NULL)
+    {
+        return;
+    }
+    UNIT_CHECK(thePipeline->getKind() == BLOCK_CONTROLLER_DSP_PIPELINE);
+    UNIT_CHECK(thePipeline->getStageCount() == 2);
+    UNIT_CHECK(thePipeline->getTelemetryNames().size() == 2);
+    UNIT_CHECK(thePipeline->getTelemetryNames()[0] == "1:sosFilter");
+    UNIT_CHECK(thePipeline->getTelemetryNames()[1] == "2:threshold");
+
+    // Crossings at rows 5 and 9, the second falls in the refractory period
+    SampleBlock theBlock(2, 32);
+    theBlock.appendSamples(20);
+    for (uint32_t row = 0; row < 20; row++)
+    {
+        theBlock.flags[row] = 0;
+        theBlock.measurement(0, row) = 100;
+        theBlock.measurement(1, row) = (row == 5 || row == 9) ? 10 : 0;
+    }
+    ControllerDecision theDecision;
+    UNIT_CHECK(thePipeline->processBlock(theBlock, &theDecision));
+    UNIT_CHECK(theDecision.triggerStimulation);
+    UNIT_CHECK(theDecision.triggerSampleIndex == 5);
+    UNIT_CHECK(thePipeline->getTelemetry()[0] == 0);
+
+    // No trigger while stimulation is active
+    theBlock.setFlag(3, SAMPLE_FLAG_STIM_ACTIVE, true);
+    theBlock.measurement(1, 5) = 0;
+    theBlock.measurement(1, 9) = 0;
+    theBlock.measurement(1, 3) = 10;
+    ControllerDecision stimActiveDecision;
+    UNIT_CHECK(thePipeline->processBlock(theBlock, &stimActiveDecision));
+    UNIT_CHECK(!stimActiveDecision.triggerStimulation);
+
+    // Past the refractory period the next crossing triggers again
+    theBlock.setFlag(3, SAMPLE_FLAG_STIM_ACTIVE, false);
+    ControllerDecision nextDecision;
+    UNIT_CHECK(thePipeline->processBlock(theBlock, &nextDecision));
+    UNIT_CHECK(nextDecision.triggerStimulation);
+    UNIT_CHECK(nextDecision.triggerSampleIndex == 3);
+
+    // Blocks without the sensing channel are refused
+    SampleBlock narrowBlock(1, 4);
+    narrowBlock.appendSample();
+    ControllerDecision narrowDecision;
+    UNIT_CHECK(!thePipeline->processBlock(narrowBlock, &narrowDecision));
+    delete thePipeline;
+}
+
+int main()
+{
+    UNIT_RUN(testLinearGapFill);
+    UNIT_RUN(testHoldLastGapFill);
+    UNIT_RUN(testCubicGapFollowsSlope);
+    UNIT_RUN(testGapStatistics);
+    UNIT_RUN(testPhaseEstimatorsTrackASine);
+    UNIT_RUN(testPipelineCompileErrors);
+    UNIT_RUN(testPipelineTriggersOnCrossing);
+    return UnitTest::report();
+}
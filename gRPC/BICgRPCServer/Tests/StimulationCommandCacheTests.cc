@@ -0,0 +1,118 @@
+// Unit tests of the stimulation command cache's LRU and collision handling. Commands are never dereferenced by the cache, so the
+// tests build them as empty pointers from a missing factory and need only the implant API headers, not its library.
+
+#include <stdexcept>
+#include <string>
+
+#include "UnitTest.h"
+#include "../ClassesSource/StimulationCommandCache.h"
+
+using namespace BICGRPCHelperNamespace;
+using namespace cortec::implantapi;
+
+static StimulationCommandCache* createTestCache(size_t capacity)
+{
+    return new StimulationCommandCache(capacity, []() -> IStimulationCommandFactory* { return NULL; });
+}
+
+// Builds or fetches an entry, counting builds
+static void request(StimulationCommandCache* theCache, uint64_t key, const std::string& definition, uint32_t* builds)
+{
+    theCache->findOrBuild(key, definition, [builds](IStimulationCommandFactory*) -> IStimulationCommand* { (*builds)++; return NULL; });
+}
+
+// Definition of the entry cached under a key, empty if none
+static std::string cachedDefinition(StimulationCommandCache* theCache, uint64_t key)
+{
+    std::string definition;
+    theCache->find(key, &definition);
+    return definition;
+}
+
+static void testRepeatedDefinitionIsBuiltOnce()
+{
+    StimulationCommandCache* theCache = createTestCache(4);
+    uint32_t builds = 0;
+    request(theCache, 11, "one", &builds);
+    request(theCache, 11, "one", &builds);
+    request(theCache, 11, "one", &builds);
+    UNIT_CHECK(builds == 1);
+
+    StimulationCommandCacheStats stats = theCache->getStats();
+    UNIT_CHECK(stats.misses == 1);
+    UNIT_CHECK(stats.hits == 2);
+    UNIT_CHECK(stats.entries == 1);
+    UNIT_CHECK(stats.lastKey == 11);
+    UNIT_CHECK(StimulationCommandCache::hashDefinition("one") == StimulationCommandCache::hashDefinition("one"));
+    UNIT_CHECK(StimulationCommandCache::hashDefinition("one") != StimulationCommandCache::hashDefinition("two"));
+    delete theCache;
+}
+
+static void testLeastRecentlyUsedIsEvicted()
+{
+    StimulationCommandCache* theCache = createTestCache(2);
+    uint32_t builds = 0;
+    request(theCache, 1, "one", &builds);
+    request(theCache, 2, "two", &builds);
+
+    // Touching 1 makes 2 the least recently used
+    request(theCache, 1, "one", &builds);
+    request(theCache, 3, "three", &builds);
+    UNIT_CHECK(builds == 3);
+    UNIT_CHECK(theCache->getStats().evictions == 1);
+    UNIT_CHECK(theCache->getStats().entries == 2);
+    UNIT_CHECK(cachedDefinition(theCache, 1) == "one");
+    UNIT_CHECK(cachedDefinition(theCache, 3) == "three");
+    UNIT_CHECK(cachedDefinition(theCache, 2).empty());
+
+    // The evicted definition is rebuilt
+    request(theCache, 2, "two", &builds);
+    UNIT_CHECK(builds == 4);
+    delete theCache;
+}
+
+static void testHashCollisionIsAMiss()
+{
+    StimulationCommandCache* theCache = createTestCache(4);
+    uint32_t builds = 0;
+    request(theCache, 7, "first", &builds);
+    request(theCache, 7, "second", &builds);
+    UNIT_CHECK(builds == 2);
+    UNIT_CHECK(theCache->getStats().hits == 0);
+    UNIT_CHECK(theCache->getStats().entries == 1);
+    UNIT_CHECK(cachedDefinition(theCache, 7) == "second");
+
+    request(theCache, 7, "second", &builds);
+    UNIT_CHECK(builds == 2);
+    delete theCache;
+}
+
+static void testFailedBuildIsNotCached()
+{
+    StimulationCommandCache* theCache = createTestCache(4);
+    bool isThrown = false;
+    try
+    {
+        theCache->findOrBuild(5, "bad", [](IStimulationCommandFactory*) -> IStimulationCommand* { throw std::runtime_error("invalid atom"); });
+    }
+    catch (const std::runtime_error&)
+    {
+        isThrown = true;
+    }
+    UNIT_CHECK(isThrown);
+    UNIT_CHECK(theCache->getStats().entries == 0);
+
+    std::string definition;
+    UNIT_CHECK(!theCache->find(5, &definition) && definition.empty());
+    UNIT_CHECK(theCache->getStats().misses == 1);
+    delete theCache;
+}
+
+int main()
+{
+    UNIT_RUN(testRepeatedDefinitionIsBuiltOnce);
+    UNIT_RUN(testLeastRecentlyUsedIsEvicted);
+    UNIT_RUN(testHashCollisionIsAMiss);
+    UNIT_RUN(testFailedBuildIsNotCached);
+    return UnitTest::report();
+}
@@ -0,0 +1,112 @@
+// Unit tests of stimulation sequence planning: trial order, timing and reproducibility from the seed
+
+#include <vector>
+
+#include "UnitTest.h"
+#include "../ClassesSource/StimulationSequence.h"
+
+using namespace BICGRPCHelperNamespace;
+
+static StimulationSequenceConfig createConfig(bool randomizeOrder, uint64_t interTrialJitterUs, uint64_t randomSeed)
+{
+    StimulationSequenceConfig config;
+    config.waveformSetCount = 3;
+    config.repetitions = 4;
+    config.randomizeOrder = randomizeOrder;
+    config.interTrialIntervalUs = 100000;
+    config.interTrialJitterUs = interTrialJitterUs;
+    config.randomSeed = randomSeed;
+    return config;
+}
+
+static bool isSamePlan(const StimulationSequence& first, const StimulationSequence& second)
+{
+    const std::vector<StimulationSequenceTrial>& firstTrials = first.getTrials();
+    const std::vector<StimulationSequenceTrial>& secondTrials = second.getTrials();
+    if (firstTrials.size() != secondTrials.size())
+    {
+        return false;
+    }
+    for (size_t i = 0; i < firstTrials.size(); i++)
+    {
+        if (firstTrials[i].waveformSetIndex != secondTrials[i].waveformSetIndex || firstTrials[i].startOffsetUs != secondTrials[i].startOffsetUs)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void testOrderedSequenceRunsSetsInTurn()
+{
+    StimulationSequence theSequence(createConfig(false, 0, 1));
+    const std::vector<StimulationSequenceTrial>& trials = theSequence.getTrials();
+    UNIT_CHECK(trials.size() == 12);
+    for (size_t i = 0; i < trials.size(); i++)
+    {
+        UNIT_CHECK(trials[i].waveformSetIndex == i % 3);
+        UNIT_CHECK(trials[i].startOffsetUs == i * 100000);
+    }
+}
+
+static void testShuffledSequenceKeepsEveryTrial()
+{
+    StimulationSequence theSequence(createConfig(true, 0, 12345));
+    std::vector<uint32_t> trialsPerSet(3, 0);
+    for (const StimulationSequenceTrial& aTrial : theSequence.getTrials())
+    {
+        UNIT_CHECK(aTrial.waveformSetIndex < 3);
+        if (aTrial.waveformSetIndex < 3)
+        {
+            trialsPerSet[aTrial.waveformSetIndex]++;
+        }
+    }
+    UNIT_CHECK(trialsPerSet[0] == 4 && trialsPerSet[1] == 4 && trialsPerSet[2] == 4);
+}
+
+static void testSeedReproducesThePlan()
+{
+    StimulationSequence first(createConfig(true, 20000, 987654321));
+    StimulationSequence second(createConfig(true, 20000, 987654321));
+    UNIT_CHECK(first.getRandomSeed() == 987654321);
+    UNIT_CHECK(isSamePlan(first, second));
+
+    // A server-picked seed is reported and replays the same plan
+    StimulationSequence picked(createConfig(true, 20000, 0));
+    UNIT_CHECK(picked.getRandomSeed() != 0);
+    StimulationSequence replayed(createConfig(true, 20000, picked.getRandomSeed()));
+    UNIT_CHECK(isSamePlan(picked, replayed));
+}
+
+static void testJitterStaysWithinBound()
+{
+    StimulationSequence theSequence(createConfig(false, 20000, 42));
+    const std::vector<StimulationSequenceTrial>& trials = theSequence.getTrials();
+    UNIT_CHECK(trials.size() == 12);
+    UNIT_CHECK(trials[0].startOffsetUs == 0);
+    bool hasJitter = false;
+    for (size_t i = 1; i < trials.size(); i++)
+    {
+        uint64_t intervalUs = trials[i].startOffsetUs - trials[i - 1].startOffsetUs;
+        UNIT_CHECK(intervalUs >= 100000 && intervalUs <= 120000);
+        hasJitter = hasJitter || intervalUs != 100000;
+    }
+    UNIT_CHECK(hasJitter);
+}
+
+static void testEmptySequencePlansNothing()
+{
+    StimulationSequenceConfig config = createConfig(true, 0, 7);
+    config.repetitions = 0;
+    UNIT_CHECK(StimulationSequence(config).getTrials().empty());
+}
+
+int main()
+{
+    UNIT_RUN(testOrderedSequenceRunsSetsInTurn);
+    UNIT_RUN(testShuffledSequenceKeepsEveryTrial);
+    UNIT_RUN(testSeedReproducesThePlan);
+    UNIT_RUN(testJitterStaysWithinBound);
+    UNIT_RUN(testEmptySequencePlansNothing);
+    return UnitTest::report();
+}
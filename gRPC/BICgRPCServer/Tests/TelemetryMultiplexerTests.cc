@@ -0,0 +1,121 @@
+// Unit tests of the telemetry multiplexer: subscriptions, per-source rate limits with conflation, the queue bound and stopping
+
+#include <chrono>
+#include <memory>
+#include <string>
+
+#include "UnitTest.h"
+#include "../ClassesSource/TelemetryMultiplexer.h"
+
+using namespace BICGRPCHelperNamespace;
+
+static BICgRPC::TelemetryUpdate* createTemperatureUpdate(double temperature)
+{
+    BICgRPC::TelemetryUpdate* anUpdate = new BICgRPC::TelemetryUpdate();
+    anUpdate->mutable_temperature()->set_temperature(temperature);
+    return anUpdate;
+}
+
+static BICgRPC::TelemetryUpdate* createErrorUpdate(const std::string& message)
+{
+    BICgRPC::TelemetryUpdate* anUpdate = new BICgRPC::TelemetryUpdate();
+    anUpdate->mutable_error()->set_message(message);
+    return anUpdate;
+}
+
+static void testUnlimitedUpdatesKeepArrivalOrder()
+{
+    google::protobuf::RepeatedPtrField<BICgRPC::TelemetrySubscription> everything;
+    TelemetryMultiplexer theStream(everything);
+    UNIT_CHECK(theStream.isSubscribed(TELEMETRY_SOURCE_TEMPERATURE));
+    UNIT_CHECK(theStream.isSubscribed(TELEMETRY_SOURCE_ERROR));
+
+    theStream.publish(TELEMETRY_SOURCE_TEMPERATURE, createTemperatureUpdate(36.5));
+    theStream.publish(TELEMETRY_SOURCE_ERROR, createErrorUpdate("first"));
+    theStream.publish(TELEMETRY_SOURCE_TEMPERATURE, createTemperatureUpdate(36.7));
+
+    std::unique_ptr<BICgRPC::TelemetryUpdate> first(theStream.next(std::chrono::milliseconds(100)));
+    std::unique_ptr<BICgRPC::TelemetryUpdate> second(theStream.next(std::chrono::milliseconds(100)));
+    std::unique_ptr<BICgRPC::TelemetryUpdate> third(theStream.next(std::chrono::milliseconds(100)));
+    UNIT_CHECK(first && first->temperature().temperature() == 36.5 && first->timestamp() != 0);
+    UNIT_CHECK(second && second->error().message() == "first");
+    UNIT_CHECK(third && third->temperature().temperature() == 36.7);
+    UNIT_CHECK(theStream.next(std::chrono::milliseconds(10)) == NULL);
+
+    TelemetryMultiplexerStats stats = theStream.getStats();
+    UNIT_CHECK(stats.published == 3);
+    UNIT_CHECK(stats.sent == 3);
+    UNIT_CHECK(stats.conflated == 0);
+}
+
+static void testRateLimitConflatesToLatest()
+{
+    google::protobuf::RepeatedPtrField<BICgRPC::TelemetrySubscription> subscriptions;
+    BICgRPC::TelemetrySubscription* temperature = subscriptions.Add();
+    temperature->set_type(BICgRPC::TELEMETRY_TYPE_TEMPERATURE);
+    temperature->set_minintervalms(100);
+    TelemetryMultiplexer theStream(subscriptions);
+    UNIT_CHECK(!theStream.isSubscribed(TELEMETRY_SOURCE_ERROR));
+
+    // Unsubscribed sources are discarded without being counted
+    theStream.publish(TELEMETRY_SOURCE_ERROR, createErrorUpdate("ignored"));
+
+    // The first update of a source is due at once
+    theStream.publish(TELEMETRY_SOURCE_TEMPERATURE, createTemperatureUpdate(36.0));
+    std::unique_ptr<BICgRPC::TelemetryUpdate> first(theStream.next(std::chrono::milliseconds(100)));
+    UNIT_CHECK(first && first->temperature().temperature() == 36.0 && first->conflatedupdates() == 0);
+    std::chrono::steady_clock::time_point firstSentAt = std::chrono::steady_clock::now();
+
+    // Later ones wait out the interval and only the newest is sent
+    theStream.publish(TELEMETRY_SOURCE_TEMPERATURE, createTemperatureUpdate(36.1));
+    theStream.publish(TELEMETRY_SOURCE_TEMPERATURE, createTemperatureUpdate(36.2));
+    theStream.publish(TELEMETRY_SOURCE_TEMPERATURE, createTemperatureUpdate(36.3));
+    UNIT_CHECK(theStream.next(std::chrono::milliseconds(10)) == NULL);
+    std::unique_ptr<BICgRPC::TelemetryUpdate> latest(theStream.next(std::chrono::milliseconds(1000)));
+    UNIT_CHECK(latest && latest->temperature().temperature() == 36.3 && latest->conflatedupdates() == 2);
+    UNIT_CHECK(std::chrono::steady_clock::now() - firstSentAt >= std::chrono::milliseconds(90));
+
+    TelemetryMultiplexerStats stats = theStream.getStats();
+    UNIT_CHECK(stats.published == 4);
+    UNIT_CHECK(stats.sent == 2);
+    UNIT_CHECK(stats.conflated == 2);
+}
+
+static void testFullQueueDropsUpdates()
+{
+    google::protobuf::RepeatedPtrField<BICgRPC::TelemetrySubscription> everything;
+    TelemetryMultiplexer theStream(everything);
+    const uint32_t publishCount = 510;
+    for (uint32_t i = 0; i < publishCount; i++)
+    {
+        theStream.publish(TELEMETRY_SOURCE_ERROR, createErrorUpdate("burst"));
+    }
+    TelemetryMultiplexerStats stats = theStream.getStats();
+    UNIT_CHECK(stats.published == publishCount);
+    UNIT_CHECK(stats.dropped == 10);
+}
+
+static void testStopEndsTheStream()
+{
+    google::protobuf::RepeatedPtrField<BICgRPC::TelemetrySubscription> everything;
+    TelemetryMultiplexer theStream(everything);
+    theStream.publish(TELEMETRY_SOURCE_HUMIDITY, new BICgRPC::TelemetryUpdate());
+    theStream.stop();
+    UNIT_CHECK(theStream.isStopped());
+
+    // Nothing more is written, unsent updates are freed with the multiplexer
+    std::chrono::steady_clock::time_point nextStart = std::chrono::steady_clock::now();
+    UNIT_CHECK(theStream.next(std::chrono::milliseconds(1000)) == NULL);
+    UNIT_CHECK(std::chrono::steady_clock::now() - nextStart < std::chrono::milliseconds(500));
+    theStream.publish(TELEMETRY_SOURCE_HUMIDITY, new BICgRPC::TelemetryUpdate());
+    UNIT_CHECK(theStream.getStats().published == 1);
+}
+
+int main()
+{
+    UNIT_RUN(testUnlimitedUpdatesKeepArrivalOrder);
+    UNIT_RUN(testRateLimitConflatesToLatest);
+    UNIT_RUN(testFullQueueDropsUpdates);
+    UNIT_RUN(testStopEndsTheStream);
+    return UnitTest::report();
+}
@@ -0,0 +1,61 @@
+// Minimal checks shared by the standalone unit tests. The tests build without the implant API or a test framework; a failed
+// check is reported and counted, and main() returns the count so ctest marks the executable as failed.
+#pragma once
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <thread>
+
+namespace UnitTest
+{
+    inline int& failureCount()
+    {
+        static int failures = 0;
+        return failures;
+    }
+
+    // Polls a condition that another thread makes true, returns false if it is still false after the timeout
+    inline bool waitFor(std::function<bool()> condition, std::chrono::milliseconds timeout)
+    {
+        std::chrono::steady_clock::time_point giveUpAt = std::chrono::steady_clock::now() + timeout;
+        while (!condition())
+        {
+            if (std::chrono::steady_clock::now() > giveUpAt)
+            {
+                return false;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return true;
+    }
+
+    inline int report()
+    {
+        if (failureCount() == 0)
+        {
+            std::cout << "TEST INFO: All checks passed" << std::endl;
+        }
+        else
+        {
+            std::cout << "ERROR: " << failureCount() << " checks failed" << std::endl;
+        }
+        return failureCount();
+    }
+}
+
+#define UNIT_CHECK(condition) \
+    do \
+    { \
+        if (!(condition)) \
+        { \
+            UnitTest::failureCount()++; \
+            std::cout << "ERROR: " << __FILE__ << ":" << __LINE__ << " check failed: " << #condition << std::endl; \
+        } \
+    } while (0)
+
+#define UNIT_RUN(testFunction) \
+    do \
+    { \
+        std::cout << "TEST INFO: " << #testFunction << std::endl; \
+        testFunction(); \
+    } while (0)
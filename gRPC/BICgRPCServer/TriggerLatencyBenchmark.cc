@@ -0,0 +1,107 @@
+// Microbenchmark of the closed-loop trigger path: time from a trigger being posted by the processing thread to the
+// stimulation thread reaching the point where it calls startStimulation(), for each TriggerMailbox wait mode.
+// No implant is needed, the stimulation command is replaced by an optional busy wait.
+//
+// Usage: TriggerLatencyBenchmark [triggers] [intervalMicroseconds] [stimMicroseconds]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "ClassesSource/TriggerMailbox.h"
+
+using namespace BICGRPCHelperNamespace;
+
+struct BenchmarkResult
+{
+    std::vector<double> latencies;      // Post to startStimulation, microseconds
+    uint64_t coalesced = 0;
+    TriggerMailboxStats stats;
+};
+
+static BenchmarkResult runMode(TriggerWaitMode waitMode, uint32_t spinMicroseconds, uint32_t triggers, uint32_t intervalMicroseconds, uint32_t stimMicroseconds)
+{
+    BenchmarkResult result;
+    result.latencies.reserve(triggers);
+    TriggerMailbox mailbox(waitMode, spinMicroseconds);
+
+    // Stimulation thread
+    std::thread consumer([&]()
+    {
+        TriggerDelivery trigger;
+        while (mailbox.wait(&trigger))
+        {
+            std::chrono::steady_clock::time_point stimTime = std::chrono::steady_clock::now();
+            result.latencies.push_back(std::chrono::duration<double, std::micro>(stimTime - trigger.postTime).count());
+            result.coalesced += trigger.coalesced;
+
+            // Stand-in for the duration of startStimulation()
+            while (std::chrono::steady_clock::now() - stimTime < std::chrono::microseconds(stimMicroseconds))
+            {
+            }
+        }
+    });
+
+    // Processing thread, posting at a fixed rate
+    std::chrono::steady_clock::time_point nextPost = std::chrono::steady_clock::now() + std::chrono::milliseconds(10);
+    for (uint32_t i = 0; i < triggers; i++)
+    {
+        std::this_thread::sleep_until(nextPost);
+        mailbox.post();
+        nextPost += std::chrono::microseconds(intervalMicroseconds);
+    }
+
+    // Let the last trigger be delivered before closing
+    std::this_thread::sleep_for(std::chrono::milliseconds(10) + std::chrono::microseconds(stimMicroseconds));
+    mailbox.close();
+    consumer.join();
+    result.stats = mailbox.getStats();
+    return result;
+}
+
+static void printResult(const char* modeName, BenchmarkResult& result)
+{
+    std::vector<double>& latencies = result.latencies;
+    if (latencies.empty())
+    {
+        std::cout << modeName << ": no triggers delivered" << std::endl;
+        return;
+    }
+    std::sort(latencies.begin(), latencies.end());
+    double total = 0;
+    for (double latency : latencies)
+    {
+        total += latency;
+    }
+
+    std::cout << modeName << ": " << result.stats.posted << " posted, " << result.stats.delivered << " delivered, "
+        << result.coalesced << " coalesced, " << result.stats.spinDeliveries << " while polling" << std::endl;
+    std::cout << "    latency us: mean " << total / latencies.size()
+        << ", median " << latencies[latencies.size() / 2]
+        << ", p99 " << latencies[(latencies.size() * 99) / 100]
+        << ", max " << latencies.back() << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t triggers = argc > 1 ? (uint32_t)std::strtoul(argv[1], NULL, 10) : 2000;
+    uint32_t intervalMicroseconds = argc > 2 ? (uint32_t)std::strtoul(argv[2], NULL, 10) : 1000;
+    uint32_t stimMicroseconds = argc > 3 ? (uint32_t)std::strtoul(argv[3], NULL, 10) : 0;
+
+    std::cout << "Trigger latency benchmark: " << triggers << " triggers every " << intervalMicroseconds << " us, "
+        << stimMicroseconds << " us stimulation" << std::endl;
+
+    BenchmarkResult blocking = runMode(TRIGGER_WAIT_BLOCKING, 0, triggers, intervalMicroseconds, stimMicroseconds);
+    printResult("Blocking", blocking);
+
+    BenchmarkResult hybrid = runMode(TRIGGER_WAIT_SPIN, intervalMicroseconds / 2, triggers, intervalMicroseconds, stimMicroseconds);
+    printResult("Spin then block", hybrid);
+
+    BenchmarkResult spin = runMode(TRIGGER_WAIT_SPIN, 0, triggers, intervalMicroseconds, stimMicroseconds);
+    printResult("Spin", spin);
+
+    return 0;
+}
@@ -121,31 +121,40 @@ namespace ImpedanceCheckApp
             // Get timestamp
             string timestamp = DateTime.Now.ToString("hh:mm:ss tt");
 
-            // Check impedances and log them
+            // Check impedances in one server-side sweep and log them as they arrive
             impBuffer = new List<string>();
             string impedEntry = "";
+            bicImpedanceSweepRequest sweepRequest = new bicImpedanceSweepRequest() { DeviceAddress = DeviceName };
             for (uint channelNum = 0; channelNum < numSensingChannelsDef; channelNum++)
             {
-                impedEntry = "CH" + (channelNum + 1).ToString();
-                bicGetImpedanceReply chanImpedValue = deviceClient.bicGetImpedance(new bicGetImpedanceRequest() { DeviceAddress = DeviceName, Channel = channelNum });
-                if (chanImpedValue.Success == "success")
-                {
-                    // Output to display to application
-                    impBuffer.Add(chanImpedValue.ChannelImpedance.ToString() + chanImpedValue.Units);
-
-                    // Output to save to file
-                    impedFileWriter.WriteLine((channelNum + 1).ToString() + ", " +
-                        chanImpedValue.ChannelImpedance.ToString() + ", " +
-                        chanImpedValue.Units);
-                }
-                else
+                sweepRequest.Channels.Add(channelNum);
+            }
+            using (var sweepCall = deviceClient.bicImpedanceSweep(sweepRequest))
+            {
+                while (sweepCall.ResponseStream.MoveNext(CancellationToken.None).Result)
                 {
-                    impBuffer.Add("Unsuccessful impedance reading");
-                    impedFileWriter.WriteLine((channelNum + 1).ToString() + ", " +
-                        "Unsuccessful impedance reading, " +
-                        "N/A");
+                    ImpedanceSweepUpdate chanImpedValue = sweepCall.ResponseStream.Current;
+                    uint channelNum = chanImpedValue.Channel;
+                    impedEntry = "CH" + (channelNum + 1).ToString();
+                    if (chanImpedValue.Success == "success")
+                    {
+                        // Output to display to application
+                        impBuffer.Add(chanImpedValue.ChannelImpedance.ToString() + chanImpedValue.Units);
+
+                        // Output to save to file
+                        impedFileWriter.WriteLine((channelNum + 1).ToString() + ", " +
+                            chanImpedValue.ChannelImpedance.ToString() + ", " +
+                            chanImpedValue.Units);
+                    }
+                    else
+                    {
+                        impBuffer.Add("Unsuccessful impedance reading");
+                        impedFileWriter.WriteLine((channelNum + 1).ToString() + ", " +
+                            "Unsuccessful impedance reading, " +
+                            "N/A");
+                    }
+                    impedEntry += "," + impBuffer.Last();
                 }
-                impedEntry += "," + impBuffer.Last();
             }
 
             // Close impedance logging items